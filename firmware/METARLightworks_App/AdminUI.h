@@ -4,6 +4,13 @@
 #include <WebServer.h>
 #include <ESP.h>
 #include "AppTypes.h"
+#include "Fetch.h"
+#include "Memory.h"
+#include "Power.h"
+#include "TimeSync.h"
+#include "FleetClock.h"
+#include "Hub.h"
+#include "Mqtt.h"
 
 // These are defined in your .ino (global objects/functions)
 extern WebServer server;
@@ -14,6 +21,9 @@ extern bool saveConfig();
 extern void setLEDColor(uint8_t r, uint8_t g, uint8_t b);
 extern void clearLED();
 
+// Bench suite in .ino
+extern String runBenchSuite(const String& only, bool live);
+
 // ---------- Basic Auth ----------
 static const char* ADMIN_USER = "admin";
 static const char* ADMIN_PASS = "north";  // change anytime
@@ -58,6 +68,7 @@ static bool isSafeGpioForNeoPixel(int pin) {
 
 static void handleAdminHome() {
   if (!adminAuth()) return;
+  power.noteUi();
 
   String html =
     "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
@@ -68,6 +79,14 @@ static void handleAdminHome() {
     "</head><body><div class='card'>"
     "<h2>🔒 Admin</h2>"
     "<a href='/admin/led'>LED Setup</a><br>"
+    "<a href='/admin/bench'>Run Benchmarks (JSON)</a><br>"
+    "<a href='/admin/replay'>Capture / Replay / Demo</a><br>"
+    "<a href='/admin/power'>Power Saving</a><br>"
+    "<a href='/admin/time'>Clock / NTP</a><br>"
+    "<a href='/admin/hub'>LAN METAR Hub</a><br>"
+    "<a href='/admin/mqtt'>MQTT</a><br>"
+    "<a href='/admin/diag'>Diagnostics (stalls)</a><br>"
+    "<a href='/admin/log'>Event Log / Core Dump</a><br>"
     "<a href='/admin/reboot' onclick=\"return confirm('Reboot now?')\">Reboot Device</a><br>"
     "<hr>"
     "<p><b>Current LED:</b><br>"
@@ -207,10 +226,508 @@ static void handleAdminReboot() {
   ESP.restart();
 }
 
+// -------------------- Capture / Replay (fetch layer) --------------------
+
+static void handleAdminReplay() {
+  if (!adminAuth()) return;
+
+  String rows = "";
+  for (int i = 0; i < PROV_COUNT; i++) {
+    FetchProvider p = (FetchProvider)i;
+    rows += "<tr><td>" + String(fetchProviderName(p)) + "</td><td>" + String((unsigned)fetchCaptureSize(p)) + " bytes";
+    rows += fetchState.captureFull[i] ? " (full)" : "";
+    rows += "</td><td><a href='/admin/replay/file?p=" + String(fetchProviderName(p)) + "'>download</a></td></tr>";
+  }
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Capture / Replay</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,select,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}"
+    "table td{padding:4px 8px}</style>"
+    "</head><body><div class='card'>"
+    "<h2>Capture / Replay</h2>"
+    "<p><b>Mode:</b> " + String(fetchModeName(fetchState.mode)) + " &nbsp; <b>Speed:</b> " + String(fetchState.speed) + "x</p>"
+    "<p class='small'><b>capture</b> saves raw AVWX / adsb.lol / GitHub responses to LittleFS. "
+    "<b>replay</b> serves them back with no network on a clock sped up by <i>speed</i> (demo mode).</p>"
+    "<table class='small'>" + rows + "</table>"
+    "<form method='GET' action='/admin/replay/set'>"
+    "<label>Mode</label>"
+    "<select name='mode'>"
+      "<option value='live'" + String(fetchState.mode == FETCH_LIVE ? " selected" : "") + ">Live</option>"
+      "<option value='capture'" + String(fetchState.mode == FETCH_CAPTURE ? " selected" : "") + ">Capture</option>"
+      "<option value='replay'" + String(fetchState.mode == FETCH_REPLAY ? " selected" : "") + ">Replay / Demo</option>"
+    "</select>"
+    "<label>Replay speed (1-600x)</label>"
+    "<input name='speed' type='number' min='1' max='600' value='" + String(cfg.replaySpeed) + "'>"
+    "<button type='submit'>Apply</button>"
+    "</form>"
+    "<button type='button' onclick=\"if(confirm('Delete all captures?'))fetch('/admin/replay/clear').then(()=>location.reload())\">Clear Captures</button>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminReplaySet() {
+  if (!adminAuth()) return;
+
+  FetchMode mode = fetchModeFromString(server.arg("mode"));
+  int speed = server.arg("speed").toInt();
+  if (speed < 1) speed = 1;
+  if (speed > 600) speed = 600;
+
+  cfg.fetchMode = fetchModeName(mode);
+  cfg.replaySpeed = speed;
+  if (!saveConfig()) {
+    server.send(500, "text/plain", "Save failed.");
+    return;
+  }
+
+  fetchSetMode(mode, speed);
+  server.sendHeader("Location", "/admin/replay");
+  server.send(302, "text/plain", "Saved");
+}
+
+// -------------------- Power saving --------------------
+
+static void handleAdminPower() {
+  if (!adminAuth()) return;
+
+  char duty[16];
+  snprintf(duty, sizeof(duty), "%.1f%%", power.dutyCycle() * 100.0);
+
+  String rows = "";
+  for (int i = 0; i < PWR_STATES; i++) {
+    rows += "<tr><td>" + String(POWER_STATE_NAMES[i]) + "</td><td>" + String((double)(power.usIn[i] / 1000000ULL), 0) + " s</td></tr>";
+  }
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Power Saving</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,select,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}"
+    "table td{padding:4px 8px}</style>"
+    "</head><body><div class='card'>"
+    "<h2>Power Saving</h2>"
+    "<p><b>Now:</b> " + String(power.state == PWR_ACTIVE ? "active" : "idle") +
+    " &nbsp; <b>Full-power duty cycle:</b> " + String(duty) +
+    " &nbsp; <b>Idle entries:</b> " + String(power.idleEntries) +
+    " &nbsp; <b>Light sleeps:</b> " + String(power.sleeps) + "</p>"
+    "<table class='small'>" + rows + "</table>"
+    "<p class='small'>While the schedule has the lamp off and no one is on the web UI, the lamp drops to 80 MHz "
+    "with Wi-Fi modem sleep and wakes on the next schedule change. With the SoftAP off too (and no home Wi-Fi link) "
+    "it light-sleeps between checks. The SoftAP comes back when the schedule turns the lamp on.</p>"
+    "<p class='small'><b>Light sleep on home Wi-Fi:</b> " +
+    String(power.autoSleepOk > 0 ? "available" :
+           power.autoSleepOk == 0 ? "not in this build (core without CONFIG_PM_ENABLE); modem sleep only" :
+           "checked the first time the lamp goes idle") + "</p>"
+    "<form method='POST' action='/admin/power/save'>"
+    "<label>Idle while off</label>"
+    "<select name='enabled'>"
+      "<option value='on'" + String(cfg.pwrSave ? " selected" : "") + ">ON</option>"
+      "<option value='off'" + String(cfg.pwrSave ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<label>SoftAP while idle</label>"
+    "<select name='ap'>"
+      "<option value='keep'" + String(cfg.pwrApOff ? "" : " selected") + ">Keep on</option>"
+      "<option value='off'" + String(cfg.pwrApOff ? " selected" : "") + ">Turn off (lamp reachable on home Wi-Fi only)</option>"
+    "</select>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminPowerSave() {
+  if (!adminAuth()) return;
+
+  cfg.pwrSave  = (server.arg("enabled") != "off");
+  cfg.pwrApOff = (server.arg("ap") == "off");
+  if (!saveConfig()) {
+    server.send(500, "text/plain", "Save failed.");
+    return;
+  }
+
+  server.sendHeader("Location", "/admin/power");
+  server.send(302, "text/plain", "Saved");
+}
+
+// -------------------- Clock / NTP --------------------
+
+static void handleAdminTime() {
+  if (!adminAuth()) return;
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Clock / NTP</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,select,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}</style>"
+    "</head><body><div class='card'>"
+    "<h2>Clock / NTP</h2>"
+    "<p class='small'>" + timeStatusLine() + "</p>"
+    "<p class='small'>" + fleetStatusLine() + "</p>"
+    "<form method='POST' action='/admin/time/save'>"
+    "<label>NTP servers (comma-separated, up to 3, first preferred)</label>"
+    "<input name='servers' value='" + cfg.ntpServers + "'>"
+    "<label>Fleet sync (LAN time beacon, udp/" + String(FLEET_PORT) + ")</label>"
+    "<select name='fleet'>"
+      "<option value='on'" + String(cfg.fleetSync ? " selected" : "") + ">ON: pulse/cycle in step with other lamps and maps</option>"
+      "<option value='off'" + String(cfg.fleetSync ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<p class='small'>Put a LAN server (router or NAS IP) first to keep the clock without internet; "
+    "the schedule and event log timestamps wait for a valid clock instead of guessing.</p>"
+    "<button type='submit'>Save &amp; Resync</button>"
+    "</form>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminTimeSave() {
+  if (!adminAuth()) return;
+
+  String servers = server.arg("servers");
+  servers.trim();
+  cfg.ntpServers = servers.length() ? servers : String("pool.ntp.org");
+  cfg.fleetSync = (server.arg("fleet") != "off");
+  if (!saveConfig()) {
+    server.send(500, "text/plain", "Save failed.");
+    return;
+  }
+
+  timeSyncBegin(cfg.ntpServers);
+  setenv("TZ", cfg.timezonePref.c_str(), 1);   // configTime() resets TZ
+  tzset();
+  fleetBegin(cfg.fleetSync);
+  server.sendHeader("Location", "/admin/time");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- LAN METAR hub (Hub.h) ----------
+static void handleAdminHub() {
+  if (!adminAuth()) return;
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>LAN METAR Hub</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}</style>"
+    "</head><body><div class='card'>"
+    "<h2>LAN METAR Hub</h2>"
+    "<p class='small'>" + hubStatusLine() + "</p>"
+    "<form method='POST' action='/admin/hub/save'>"
+    "<label>Hub: auto, off, or host[:port]</label>"
+    "<input name='use' value='" + cfg.hubUse + "'>"
+    "<p class='small'>Auto finds a map serving as hub (or tools/metar_hub.py) over mDNS; no AVWX token is needed "
+    "while it answers. If it stops answering, the lamp goes back to AVWX with its own token.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminHubSave() {
+  if (!adminAuth()) return;
+
+  String use = server.arg("use");
+  use.trim();
+  cfg.hubUse = use.length() ? use : String("auto");
+  if (!saveConfig()) {
+    server.send(500, "text/plain", "Save failed.");
+    return;
+  }
+
+  hubBegin(cfg.hubUse);
+  server.sendHeader("Location", "/admin/hub");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- MQTT (Mqtt.h) ----------
+static void handleAdminMqtt() {
+  if (!adminAuth()) return;
+
+  const MqttSettings& m = cfg.mqtt;
+  String base = m.base.length() ? m.base : mqttDefaultBase("lamp");
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>MQTT</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "input[type=checkbox]{width:auto}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}</style>"
+    "</head><body><div class='card'>"
+    "<h2>MQTT</h2>"
+    "<p class='small'>" + mqttStatusLine() + "</p>"
+    "<form method='POST' action='/admin/mqtt/save'>"
+    "<label><input type='checkbox' name='enabled' value='1'" + String(m.enabled ? " checked" : "") + "> Enabled</label>"
+    "<label>Broker host</label><input name='host' value='" + m.host + "'>"
+    "<label>Port</label><input name='port' type='number' min='1' max='65535' value='" + String(m.port) + "'>"
+    "<label>User (optional)</label><input name='user' value='" + m.user + "'>"
+    "<label>Password</label><input name='pass' type='password' value='" + m.pass + "'>"
+    "<label>Topic base (blank = default)</label><input name='base' value='" + m.base + "' placeholder='" + mqttDefaultBase("lamp") + "'>"
+    "<p class='small'>Retained: <b>" + base + "/status</b>, <b>/state</b>, <b>/health</b>, <b>/ota</b>, "
+    "<b>/station/&lt;ICAO&gt;/category</b> and <b>/obs</b>. "
+    "Commands: <b>" + base + "/cmd/mode</b> (auto, vfr, mvfr, ifr, lifr, cycle), "
+    "<b>/cmd/brightness</b> (3..100), <b>/cmd/refresh</b>.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminMqttSave() {
+  if (!adminAuth()) return;
+
+  MqttSettings& m = cfg.mqtt;
+  m.enabled = server.hasArg("enabled");
+  m.host = server.arg("host");
+  m.host.trim();
+  m.port = (uint16_t)constrain((int)server.arg("port").toInt(), 1, 65535);
+  m.user = server.arg("user");
+  m.pass = server.arg("pass");
+  m.base = server.arg("base");
+  m.base.trim();
+  while (m.base.endsWith("/")) m.base.remove(m.base.length() - 1);
+  if (!saveConfig()) {
+    server.send(500, "text/plain", "Save failed.");
+    return;
+  }
+
+  mqttConfigure(cfg.mqtt, "lamp");
+  server.sendHeader("Location", "/admin/mqtt");
+  server.send(302, "text/plain", "Saved");
+}
+
+static void handleAdminReplayFile() {
+  if (!adminAuth()) return;
+
+  String want = server.arg("p");
+  want.trim(); want.toLowerCase();
+
+  for (int i = 0; i < PROV_COUNT; i++) {
+    FetchProvider p = (FetchProvider)i;
+    if (want != fetchProviderName(p)) continue;
+
+    File f = LittleFS.open(fetchCapturePath(p), "r");
+    if (!f) {
+      server.send(404, "text/plain", "No capture.");
+      return;
+    }
+    server.sendHeader("Content-Disposition", "attachment; filename=" + want + ".cap");
+    server.streamFile(f, "application/octet-stream");
+    f.close();
+    return;
+  }
+
+  server.send(400, "text/plain", "Bad provider. Use p=awc|avwx|adsb|github|hub");
+}
+
+static void handleAdminReplayClear() {
+  if (!adminAuth()) return;
+  fetchClearCaptures();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+// ---------- Diagnostics (stall detector) ----------
+// /admin/diag?format=json for scripts; ?budget=<ms> changes the loop budget (not persisted)
+static void handleAdminDiag() {
+  if (!adminAuth()) return;
+
+  if (server.hasArg("budget")) stallSetBudget((uint32_t)server.arg("budget").toInt());
+  if (server.arg("format") == "json") {
+    server.send(200, "application/json", stallJson());
+    return;
+  }
+
+  static StallState snap;
+  stallSnapshot(snap);
+  HeapSample mem = heapSampleNow();
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Diagnostics</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "input,button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    "label{font-weight:bold;display:block;margin-top:10px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}"
+    "table td,table th{padding:4px 8px;text-align:left}</style>"
+    "</head><body><div class='card'>"
+    "<h2>Diagnostics</h2>"
+    "<p><b>Loop budget:</b> " + String(snap.loopBudgetMs) + " ms &nbsp; <b>Over budget:</b> " + String(snap.loopOverBudget)
+      + " &nbsp; <b>Worst loop:</b> " + String(snap.loopWorstMs) + " ms &nbsp; <b>Stalls:</b> " + String(snap.stallsTotal) + "</p>"
+    "<p class='small'>Blocking calls of " + String(STALL_MIN_MS) + " ms or more: web requests, AVWX / adsb.lol / GitHub fetches, time sync, Wi-Fi scan, OTA.</p>"
+    "<h3>Longest</h3>"
+    "<table class='small'><tr><th>Time</th><th>Site</th><th>When</th></tr>"
+      + stallTableRows(snap.top, snap.topCount, 0, false) + "</table>"
+    "<h3>Recent</h3>"
+    "<table class='small'><tr><th>Time</th><th>Site</th><th>When</th></tr>"
+      + stallTableRows(snap.ring, snap.ringCount, snap.ringHead, true) + "</table>"
+    "<h3>Memory</h3>"
+    "<p class='small'>Free " + String((unsigned)mem.freeBytes) + " | Largest block " + String((unsigned)mem.largestBlock)
+      + " (lowest " + String((unsigned)min(heapHistory.largestMin, mem.largestBlock)) + ") | Fragmentation " + String(mem.fragPct)
+      + "% (worst " + String(max(heapHistory.fragMax, mem.fragPct)) + "%)<br>"
+      "JSON arena " + String((unsigned)(jsonArena.cap / 1024)) + " KB, high water " + String((unsigned)(jsonArena.highWater / 1024))
+      + " KB, heap fallbacks " + String(jsonArena.fallbacks) + " | <a href='/admin/heap'>history (JSON)</a></p>"
+    "<form method='GET' action='/admin/diag'>"
+    "<label>Loop budget (ms)</label>"
+    "<input name='budget' type='number' min='20' max='60000' value='" + String(snap.loopBudgetMs) + "'>"
+    "<button type='submit'>Set</button>"
+    "</form>"
+    "<button type='button' onclick=\"fetch('/admin/diag/clear').then(()=>location.reload())\">Clear</button>"
+    "<p style='margin-top:12px;'><a href='/admin/diag?format=json'>JSON</a> &nbsp; <a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminHeap() {
+  if (!adminAuth()) return;
+  server.send(200, "application/json", memoryJson());
+}
+
+static void handleAdminDiagClear() {
+  if (!adminAuth()) return;
+  stallClear();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+// ---------- Event log + core dump ----------
+static void handleAdminLog() {
+  if (!adminAuth()) return;
+
+  size_t cd = elogCoreDumpSize();
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Event Log</title>"
+    "<style>body{font-family:Arial;background:#f2f2f2;margin:0;padding:16px}"
+    ".card{background:#fff;padding:14px;border-radius:10px;box-shadow:0 2px 6px rgba(0,0,0,.12);max-width:720px;margin:auto}"
+    "button{width:100%;padding:10px;margin-top:6px;border:1px solid #ccc;border-radius:8px}"
+    ".small{color:#555;font-size:13px;line-height:1.35}"
+    "pre{white-space:pre-wrap;background:#f7f7f7;padding:8px;border-radius:8px}</style>"
+    "</head><body><div class='card'>"
+    "<h2>Event Log</h2>"
+    "<p><b>Boot:</b> #" + String(elog.bootCount) + " &nbsp; <b>Last reset:</b> " + String(elogResetReasonName(elog.resetReason)) + "</p>"
+    "<p class='small'>Current " + String((unsigned)elogFileSize(ELOG_PATH)) + " bytes, previous " + String((unsigned)elogFileSize(ELOG_PATH_OLD))
+      + " bytes (rotates at " + String((unsigned)(ELOG_MAX_BYTES / 1024)) + " KB). Decode with tools/eventlog_decode.py.</p>"
+    "<p><a href='/admin/log/file?n=0'>Download events.bin</a> | <a href='/admin/log/file?n=1'>Download events.1.bin</a></p>"
+    "<h3>Recent</h3>"
+    "<pre class='small'>" + elogRecentText(30) + "</pre>"
+    "<h3>Core dump</h3>"
+    "<p class='small'>" + (cd ? ("Stored: " + String((unsigned)cd) + " bytes. <a href='/admin/coredump'>Download (ELF)</a>") : String("None stored.")) + "</p>"
+    "<button type='button' onclick=\"if(confirm('Clear the event log?'))fetch('/admin/log/clear').then(()=>location.reload())\">Clear Log</button>"
+    "<button type='button' onclick=\"if(confirm('Erase the core dump?'))fetch('/admin/coredump/erase').then(()=>location.reload())\">Erase Core Dump</button>"
+    "<p style='margin-top:12px;'><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminLogFile() {
+  if (!adminAuth()) return;
+  elogFlush();
+
+  const char* path = (server.arg("n") == "1") ? ELOG_PATH_OLD : ELOG_PATH;
+  File f = LittleFS.open(path, "r");
+  if (!f) {
+    server.send(404, "text/plain", "No log.");
+    return;
+  }
+  server.sendHeader("Content-Disposition", String("attachment; filename=") + (path + 5));
+  server.streamFile(f, "application/octet-stream");
+  f.close();
+}
+
+static void handleAdminLogClear() {
+  if (!adminAuth()) return;
+  elogClear();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+static void handleAdminCoreDump() {
+  if (!adminAuth()) return;
+
+  size_t size = elogCoreDumpSize();
+  if (!size) {
+    server.send(404, "text/plain", "No core dump.");
+    return;
+  }
+
+  server.sendHeader("Content-Disposition", "attachment; filename=coredump.elf");
+  server.setContentLength(size);
+  server.send(200, "application/octet-stream", "");
+
+  uint8_t buf[1024];
+  for (size_t off = 0; off < size; off += sizeof(buf)) {
+    size_t n = min(sizeof(buf), size - off);
+    if (!elogCoreDumpRead(off, buf, n)) break;
+    server.sendContent((const char*)buf, n);
+  }
+}
+
+static void handleAdminCoreDumpErase() {
+  if (!adminAuth()) return;
+  server.send(200, "text/plain", elogCoreDumpErase() ? "Erased." : "Nothing to erase.");
+}
+
+// /admin/bench?only=<op>&live=1
+// Runs the on-device micro-benchmarks and returns one JSON document.
+// live=1 also times a real fetchAndDisplayMETAR() (needs Wi-Fi + AVWX token).
+static void handleAdminBench() {
+  if (!adminAuth()) return;
+  String only = server.arg("only");
+  only.trim();
+  bool live = (server.arg("live") == "1");
+  server.send(200, "application/json", runBenchSuite(only, live));
+}
+
 static void registerAdminRoutes() {
   server.on("/admin", HTTP_GET, handleAdminHome);
   server.on("/admin/led", HTTP_GET, handleAdminLed);
   server.on("/admin/led/save", HTTP_POST, handleAdminLedSave);
   server.on("/admin/led/test", HTTP_GET, handleAdminLedTest);   // NEW
+  server.on("/admin/bench", HTTP_GET, handleAdminBench);
+  server.on("/admin/replay", HTTP_GET, handleAdminReplay);
+  server.on("/admin/power", HTTP_GET, handleAdminPower);
+  server.on("/admin/power/save", HTTP_POST, handleAdminPowerSave);
+  server.on("/admin/time", HTTP_GET, handleAdminTime);
+  server.on("/admin/time/save", HTTP_POST, handleAdminTimeSave);
+  server.on("/admin/hub", HTTP_GET, handleAdminHub);
+  server.on("/admin/hub/save", HTTP_POST, handleAdminHubSave);
+  server.on("/admin/mqtt", HTTP_GET, handleAdminMqtt);
+  server.on("/admin/mqtt/save", HTTP_POST, handleAdminMqttSave);
+  server.on("/admin/replay/set", HTTP_GET, handleAdminReplaySet);
+  server.on("/admin/replay/file", HTTP_GET, handleAdminReplayFile);
+  server.on("/admin/replay/clear", HTTP_GET, handleAdminReplayClear);
+  server.on("/admin/diag", HTTP_GET, handleAdminDiag);
+  server.on("/admin/diag/clear", HTTP_GET, handleAdminDiagClear);
+  server.on("/admin/heap", HTTP_GET, handleAdminHeap);
+  server.on("/admin/log", HTTP_GET, handleAdminLog);
+  server.on("/admin/log/file", HTTP_GET, handleAdminLogFile);
+  server.on("/admin/log/clear", HTTP_GET, handleAdminLogClear);
+  server.on("/admin/coredump", HTTP_GET, handleAdminCoreDump);
+  server.on("/admin/coredump/erase", HTTP_GET, handleAdminCoreDumpErase);
   server.on("/admin/reboot", HTTP_GET, handleAdminReboot);
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 #include <Arduino.h>
+#include "Solar.h"
+#include "Mqtt.h"
+#include "Staleness.h"
 
 struct AppConfig {
   // provisioned by Factory
@@ -12,15 +15,30 @@ struct AppConfig {
   String airport_code = "KTIX";
   int brightness = 100; // 3..100
 
-  // schedule
-  bool scheduleEnabled = false;
-  int startHour = 0, startMinute = 0;
-  int endHour   = 23, endMinute  = 59;
+  // schedule (weekday windows + solar dimming, see Solar.h)
+  ScheduleConfig sched;
   String timezonePref = "UTC0";
+  String geoIcao = "";  // station sched.lat/lon belong to
+
+  // clock (TimeSync.h): comma list, first wins, e.g. a LAN server first
+  String ntpServers = "pool.ntp.org";
+  bool fleetSync = true;   // LAN time beacon for shared animation phase (FleetClock.h)
+
+  // LAN METAR hub (Hub.h): auto (mDNS) / off / host[:port]
+  String hubUse = "auto";
+
+  // MQTT publish/subscribe for home automation (Mqtt.h)
+  MqttSettings mqtt;
 
   // mode
   int displayMode = 0; // 0..5
 
+  // TAF forecast view (Taf.h): fetch the station's TAF hourly
+  bool tafEnabled = false;
+
+  // METAR age (Staleness.h): fade, blink, then unknown (yellow)
+  StalePolicy stale;
+
   // flight pulse
   bool fpEnabled = false;
   String fpIcao = ""; // 6 hex
@@ -31,6 +49,14 @@ struct AppConfig {
   bool otaAutoUpdate   = false;
   int  otaIntervalDays = 7;
 
+  // power manager (Power.h): idle while the schedule has the display off
+  bool pwrSave  = true;
+  bool pwrApOff = false;   // also drop the SoftAP while idle
+
+  // fetch layer (capture/replay for field repro + offline demo)
+  String fetchMode   = "live"; // live/capture/replay
+  int    replaySpeed = 60;     // replay clock multiplier 1..600
+
   // advanced LED (admin)
   int led_pin = 5;
   int led_count = 1;
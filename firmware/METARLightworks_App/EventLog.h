@@ -0,0 +1,345 @@
+#pragma once
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_system.h>
+#include <esp_core_dump.h>
+#include <esp_partition.h>
+#include <time.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+
+// ---------- Persistent event log (/admin/log) ----------
+// Compact binary records on LittleFS so field failures can be read back
+// without a serial cable. Decode with tools/eventlog_decode.py.
+//
+// elogEvent() only queues (safe from the Wi-Fi event task); elogFlush()
+// from loop() does the flash writes. Two files rotate:
+//   /log/events.bin  (current)  ->  /log/events.1.bin  (previous)
+// each capped at ELOG_MAX_BYTES, so the log never holds more than 2x that.
+//
+// File header (8 bytes): "MLEV" u8 version u8 header_len u16 reserved
+// Record (little-endian, 20 + text_len bytes):
+//   u8 type, u8 text_len, u16 boot, u32 uptime_ms, u32 epoch, i32 a, i32 b, text
+// epoch is 0 when time was not synced yet.
+
+static const char* ELOG_DIR       = "/log";
+static const char* ELOG_PATH      = "/log/events.bin";
+static const char* ELOG_PATH_OLD  = "/log/events.1.bin";
+static const char* ELOG_BOOT_PATH = "/log/boot.bin";
+static const size_t ELOG_MAX_BYTES = 32 * 1024;
+static const uint8_t ELOG_VERSION = 1;
+static const int ELOG_TEXT_MAX = 48;
+static const int ELOG_PENDING = 16;
+
+enum EventType : uint8_t {
+  EV_BOOT = 1,          // a = reset reason, b = boot count, text = fw
+  EV_WDT_RESET,         // a = reset reason (panic / watchdog / brownout)
+  EV_COREDUMP,          // a = core dump size in flash
+  EV_WIFI_UP,           // a = rssi
+  EV_WIFI_DOWN,         // a = disconnect reason
+  EV_FETCH_FAIL,        // a = provider, b = http code (first failure of a streak)
+  EV_FETCH_RECOVER,     // a = provider, b = failures in the streak
+  EV_OTA_CHECK,         // a = ok, text = latest tag or status
+  EV_OTA_START,         // text = tag
+  EV_OTA_FAIL,          // text = status line
+  EV_OTA_OK,            // text = tag
+  EV_DROPPED,           // a = events lost to a full queue
+  EV_STALL,             // a = ms, text = site (only very long stalls)
+};
+
+#pragma pack(push, 1)
+struct EventRecordHdr {
+  uint8_t  type;
+  uint8_t  textLen;
+  uint16_t boot;
+  uint32_t uptimeMs;
+  uint32_t epoch;
+  int32_t  a;
+  int32_t  b;
+};
+#pragma pack(pop)
+
+struct EventPending {
+  EventRecordHdr hdr;
+  char text[ELOG_TEXT_MAX];
+};
+
+struct EventLogState {
+  bool ready = false;
+  uint32_t bootCount = 0;
+  int resetReason = 0;
+  EventPending pending[ELOG_PENDING];
+  int pendingCount = 0;
+  uint32_t dropped = 0;
+  uint16_t fetchFails[METRIC_PROVIDERS] = { 0 };
+  bool wifiUp = false;
+};
+
+static EventLogState elog;
+static portMUX_TYPE elogMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* elogResetReasonName(int r) {
+  switch (r) {
+    case ESP_RST_POWERON:   return "power-on";
+    case ESP_RST_EXT:       return "external";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:   return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:  return "task watchdog";
+    case ESP_RST_WDT:       return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    default:                return "unknown";
+  }
+}
+
+static const char* elogTypeName(uint8_t t) {
+  switch (t) {
+    case EV_BOOT:          return "boot";
+    case EV_WDT_RESET:     return "crash-reset";
+    case EV_COREDUMP:      return "coredump";
+    case EV_WIFI_UP:       return "wifi-up";
+    case EV_WIFI_DOWN:     return "wifi-down";
+    case EV_FETCH_FAIL:    return "fetch-fail";
+    case EV_FETCH_RECOVER: return "fetch-recover";
+    case EV_OTA_CHECK:     return "ota-check";
+    case EV_OTA_START:     return "ota-start";
+    case EV_OTA_FAIL:      return "ota-fail";
+    case EV_OTA_OK:        return "ota-ok";
+    case EV_DROPPED:       return "dropped";
+    case EV_STALL:         return "stall";
+    default:               return "?";
+  }
+}
+
+// Queue an event: a short critical section, safe from any task, never
+// touches flash.
+static void elogEvent(EventType type, int32_t a = 0, int32_t b = 0, const char* text = nullptr) {
+  EventPending e;
+  e.hdr.type = (uint8_t)type;
+  e.hdr.boot = (uint16_t)elog.bootCount;
+  e.hdr.uptimeMs = millis();
+  e.hdr.epoch = timeEpochOrZero();
+  e.hdr.a = a;
+  e.hdr.b = b;
+  size_t n = text ? strnlen(text, ELOG_TEXT_MAX) : 0;
+  if (n) memcpy(e.text, text, n);
+  e.hdr.textLen = (uint8_t)n;
+
+  portENTER_CRITICAL(&elogMux);
+  if (elog.pendingCount < ELOG_PENDING) elog.pending[elog.pendingCount++] = e;
+  else elog.dropped++;
+  portEXIT_CRITICAL(&elogMux);
+}
+
+static void elogRotateIfNeeded(size_t incoming) {
+  File f = LittleFS.open(ELOG_PATH, "r");
+  size_t cur = f ? f.size() : 0;
+  if (f) f.close();
+  if (cur > 0 && cur + incoming <= ELOG_MAX_BYTES) return;
+
+  if (cur > 0) {
+    if (LittleFS.exists(ELOG_PATH_OLD)) LittleFS.remove(ELOG_PATH_OLD);
+    LittleFS.rename(ELOG_PATH, ELOG_PATH_OLD);
+  }
+
+  File nf = LittleFS.open(ELOG_PATH, "w");
+  if (!nf) return;
+  uint8_t hdr[8] = { 'M', 'L', 'E', 'V', ELOG_VERSION, 8, 0, 0 };
+  nf.write(hdr, sizeof(hdr));
+  nf.close();
+}
+
+// Writes queued events; call from loop() (and before a deliberate restart).
+static void elogFlush() {
+  if (!elog.ready) return;
+
+  static EventPending batch[ELOG_PENDING + 1];   // +1 for the dropped marker
+  int n;
+  uint32_t dropped;
+  portENTER_CRITICAL(&elogMux);
+  n = elog.pendingCount;
+  for (int i = 0; i < n; i++) batch[i] = elog.pending[i];
+  elog.pendingCount = 0;
+  dropped = elog.dropped;
+  elog.dropped = 0;
+  portEXIT_CRITICAL(&elogMux);
+
+  if (dropped) {
+    EventPending& d = batch[n++];
+    memset(&d, 0, sizeof(d));
+    d.hdr.type = EV_DROPPED;
+    d.hdr.boot = (uint16_t)elog.bootCount;
+    d.hdr.uptimeMs = millis();
+    d.hdr.a = (int32_t)dropped;
+  }
+  if (!n) return;
+
+  size_t bytes = 0;
+  for (int i = 0; i < n; i++) bytes += sizeof(EventRecordHdr) + batch[i].hdr.textLen;
+  elogRotateIfNeeded(bytes);
+
+  File f = LittleFS.open(ELOG_PATH, "a");
+  if (!f) return;
+  for (int i = 0; i < n; i++) {
+    f.write((const uint8_t*)&batch[i].hdr, sizeof(EventRecordHdr));
+    if (batch[i].hdr.textLen) f.write((const uint8_t*)batch[i].text, batch[i].hdr.textLen);
+  }
+  f.close();
+  metrics.flashWrites.inc();
+}
+
+// ---------- core dump (coredump partition, ELF) ----------
+static size_t elogCoreDumpSize() {
+  size_t addr = 0, size = 0;
+  if (esp_core_dump_image_get(&addr, &size) != ESP_OK) return 0;
+  return size;
+}
+
+// Reads `n` bytes of the stored core dump image starting at `off`.
+static bool elogCoreDumpRead(size_t off, uint8_t* buf, size_t n) {
+  size_t addr = 0, size = 0;
+  if (esp_core_dump_image_get(&addr, &size) != ESP_OK) return false;
+  if (off + n > size) return false;
+  const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, nullptr);
+  if (!part) return false;
+  return esp_partition_read(part, (addr - part->address) + off, buf, n) == ESP_OK;
+}
+
+static bool elogCoreDumpErase() {
+  return esp_core_dump_image_erase() == ESP_OK;
+}
+
+// ---------- hooks ----------
+// Fetch outcome: logs the first failure of a streak and the recovery, so a
+// dead provider costs two records instead of one per request. Fetches can
+// run on several tasks at once (the Map's parallel METAR connections), so
+// the streak is updated under elogMux and the record written after.
+static void elogFetchOutcome(uint8_t provider, bool ok, int code) {
+  if (provider >= METRIC_PROVIDERS) return;
+  uint16_t streak = 0;
+  portENTER_CRITICAL(&elogMux);
+  uint16_t& fails = elog.fetchFails[provider];
+  if (ok) {
+    streak = fails;
+    fails = 0;
+  } else {
+    streak = fails;
+    if (fails < 0xFFFF) fails++;
+  }
+  portEXIT_CRITICAL(&elogMux);
+
+  if (ok && streak) elogEvent(EV_FETCH_RECOVER, provider, streak);
+  else if (!ok && streak == 0) elogEvent(EV_FETCH_FAIL, provider, code);
+}
+
+static void elogAttachWiFiEvents() {
+  WiFi.onEvent([](arduino_event_id_t event, arduino_event_info_t info) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+      elog.wifiUp = true;
+      elogEvent(EV_WIFI_UP, WiFi.RSSI());
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED && elog.wifiUp) {
+      // only the up->down edge; an unprovisioned STA retries constantly
+      elog.wifiUp = false;
+      elogEvent(EV_WIFI_DOWN, info.wifi_sta_disconnected.reason);
+    }
+  });
+}
+
+// Call once from setup() after LittleFS is mounted.
+static void elogBegin(const char* app, const char* fw) {
+  LittleFS.begin(true);
+  LittleFS.mkdir(ELOG_DIR);
+
+  uint32_t boots = 0;
+  File bf = LittleFS.open(ELOG_BOOT_PATH, "r");
+  if (bf) { bf.read((uint8_t*)&boots, sizeof(boots)); bf.close(); }
+  boots++;
+  bf = LittleFS.open(ELOG_BOOT_PATH, "w");
+  if (bf) { bf.write((const uint8_t*)&boots, sizeof(boots)); bf.close(); }
+
+  elog.bootCount = boots;
+  elog.resetReason = (int)esp_reset_reason();
+  elog.ready = true;
+
+  char text[ELOG_TEXT_MAX];
+  snprintf(text, sizeof(text), "%s %s", app, fw);
+  elogEvent(EV_BOOT, elog.resetReason, (int32_t)boots, text);
+
+  switch (elog.resetReason) {
+    case ESP_RST_PANIC: case ESP_RST_INT_WDT: case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:   case ESP_RST_BROWNOUT:
+      elogEvent(EV_WDT_RESET, elog.resetReason, 0, elogResetReasonName(elog.resetReason));
+      break;
+    default:
+      break;
+  }
+
+  size_t cd = elogCoreDumpSize();
+  if (cd) elogEvent(EV_COREDUMP, (int32_t)cd);
+
+  elogFlush();
+  Serial.printf("[ELOG] boot #%lu reset=%s coredump=%u\n",
+                (unsigned long)boots, elogResetReasonName(elog.resetReason), (unsigned)cd);
+}
+
+static size_t elogFileSize(const char* path) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  size_t n = f.size();
+  f.close();
+  return n;
+}
+
+static void elogClear() {
+  if (LittleFS.exists(ELOG_PATH)) LittleFS.remove(ELOG_PATH);
+  if (LittleFS.exists(ELOG_PATH_OLD)) LittleFS.remove(ELOG_PATH_OLD);
+}
+
+// Last `maxLines` records of the current file as text, newest first.
+static String elogRecentText(int maxLines) {
+  static const int MAXN = 40;
+  if (maxLines > MAXN) maxLines = MAXN;
+  String lines[MAXN];
+  int head = 0, count = 0;
+
+  File f = LittleFS.open(ELOG_PATH, "r");
+  if (!f) return "";
+  f.seek(8);
+
+  EventRecordHdr h;
+  char text[ELOG_TEXT_MAX + 1];
+  while (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h)) {
+    size_t n = min<size_t>(h.textLen, ELOG_TEXT_MAX);
+    if (n && f.read((uint8_t*)text, n) != n) break;
+    text[n] = 0;
+
+    char when[24];
+    if (h.epoch) {
+      time_t t = (time_t)h.epoch;
+      struct tm tmv;
+      localtime_r(&t, &tmv);
+      strftime(when, sizeof(when), "%m-%d %H:%M:%S", &tmv);
+    } else {
+      snprintf(when, sizeof(when), "+%lus", (unsigned long)(h.uptimeMs / 1000));
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "#%u %s %-13s a=%ld b=%ld %s",
+             (unsigned)h.boot, when, elogTypeName(h.type), (long)h.a, (long)h.b, text);
+    lines[head] = line;
+    head = (head + 1) % maxLines;
+    if (count < maxLines) count++;
+  }
+  f.close();
+
+  String out;
+  for (int i = 0; i < count; i++) {
+    out += lines[(head - 1 - i + maxLines) % maxLines];
+    out += "\n";
+  }
+  return out;
+}
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <mdns.h>
+#include <freertos/FreeRTOS.h>
+#include <math.h>
+#include <time.h>
+#include "Metrics.h"
+
+// ---------- LAN METAR hub ----------
+// One device on the LAN (a Map with hub serving on, or tools/metar_hub.py)
+// fetches the union of the stations everyone needs and serves them as
+// compact text records; the rest subscribe instead of calling AWC / AVWX
+// themselves.
+//
+//   GET http://<hub>:<port>/hub/obs?ids=KSEA,KPDX
+//
+//   #metarhub 1
+//   KSEA,1717000000,VFR,12,8,180,9,,100,3002,47.449,-122.309
+//
+// Fields: icao, obs epoch, category, temp C, dewpoint C, wind dir (VRB for
+// variable), wind kt, gust kt, visibility sm*10 (100 = 10+), altimeter
+// inHg*100, lat, lon. Empty = not reported. Stations the hub has nothing for
+// are left out; asking for them makes the hub fetch them from then on.
+//
+// Clients find the hub as _metarhub._tcp (TXT v=1) with a non-blocking mDNS
+// query from hubTick(), or use a fixed host[:port] from config. After
+// HUB_MAX_FAILS failed requests in a row the hub is dropped and the client
+// fetches directly again until a search finds one.
+//
+//   String url = hubUrl(ids);
+//   if (url.length()) { ok = fetchGET(...PROV_HUB...); hubReport(ok); }
+//   if (!ok) ...direct fetch...
+//
+// The Lamp only subscribes; what just the serving side uses is static
+// inline so including this there costs nothing and warns about nothing.
+
+static const int HUB_VERSION = 1;
+static const char* HUB_SERVICE = "metarhub";
+static const char* HUB_PROTO = "tcp";
+static const char* HUB_PATH = "/hub/obs";
+static const uint16_t HUB_DEFAULT_PORT = 80;
+static const int HUB_MAX_FAILS = 2;
+static const uint32_t HUB_QUERY_MS = 1500;                        // one mDNS query
+static const uint32_t HUB_SEARCH_MIN_MS = 30UL * 1000UL;          // retry while none found...
+static const uint32_t HUB_SEARCH_MAX_MS = 10UL * 60UL * 1000UL;   // ...backing off to this
+static const int16_t HUB_NA = INT16_MIN;
+static const int16_t HUB_VRB = -1;
+
+struct HubObs {
+  char icao[5] = { 0 };
+  char cat[5] = { 0 };          // VFR/MVFR/IFR/LIFR, "" = unknown
+  uint32_t obsTime = 0;         // epoch, 0 = unknown
+  int16_t temp = HUB_NA;        // C
+  int16_t dewp = HUB_NA;
+  int16_t wdir = HUB_NA;        // degrees, HUB_VRB = variable
+  int16_t wspd = HUB_NA;        // kt
+  int16_t wgst = HUB_NA;
+  int16_t visib = HUB_NA;       // sm * 10
+  int16_t altim = HUB_NA;       // inHg * 100
+  float lat = NAN;
+  float lon = NAN;
+};
+
+// ICAO as one word, for table lookups
+static inline uint32_t hubKey(const char* icao) {
+  uint32_t k = 0;
+  for (int i = 0; i < 4 && icao[i]; i++) k = (k << 8) | (uint8_t)toupper(icao[i]);
+  return k;
+}
+
+static void hubAppendInt(String& out, int16_t v) {
+  if (v != HUB_NA) out += v;
+}
+
+static inline void hubAppendRecord(String& out, const HubObs& o) {
+  out += o.icao; out += ',';
+  if (o.obsTime) out += o.obsTime;
+  out += ','; out += o.cat;
+  out += ','; hubAppendInt(out, o.temp);
+  out += ','; hubAppendInt(out, o.dewp);
+  out += ',';
+  if (o.wdir == HUB_VRB) out += "VRB";
+  else hubAppendInt(out, o.wdir);
+  out += ','; hubAppendInt(out, o.wspd);
+  out += ','; hubAppendInt(out, o.wgst);
+  out += ','; hubAppendInt(out, o.visib);
+  out += ','; hubAppendInt(out, o.altim);
+  out += ',';
+  if (!isnan(o.lat)) out += String(o.lat, 3);
+  out += ',';
+  if (!isnan(o.lon)) out += String(o.lon, 3);
+  out += '\n';
+}
+
+static inline void hubAppendHeader(String& out) {
+  out += "#metarhub ";
+  out += HUB_VERSION;
+  out += '\n';
+}
+
+static int16_t hubFieldInt(const char* s, size_t n) {
+  if (!n) return HUB_NA;
+  if (n == 3 && !strncmp(s, "VRB", 3)) return HUB_VRB;
+  return (int16_t)strtol(s, nullptr, 10);
+}
+
+// One record line (no newline needed). False on a malformed line.
+static bool hubParseRecord(const char* line, size_t len, HubObs& o) {
+  const char* f[12];
+  size_t n[12];
+  int count = 0;
+  size_t start = 0;
+  for (size_t i = 0; i <= len && count < 12; i++) {
+    if (i == len || line[i] == ',') {
+      f[count] = line + start;
+      n[count] = i - start;
+      count++;
+      start = i + 1;
+    }
+  }
+  if (count < 12 || n[0] != 4) return false;
+
+  o = HubObs();
+  memcpy(o.icao, f[0], 4);
+  if (n[1]) o.obsTime = (uint32_t)strtoul(f[1], nullptr, 10);
+  if (n[2] && n[2] < sizeof(o.cat)) memcpy(o.cat, f[2], n[2]);
+  o.temp = hubFieldInt(f[3], n[3]);
+  o.dewp = hubFieldInt(f[4], n[4]);
+  o.wdir = hubFieldInt(f[5], n[5]);
+  o.wspd = hubFieldInt(f[6], n[6]);
+  o.wgst = hubFieldInt(f[7], n[7]);
+  o.visib = hubFieldInt(f[8], n[8]);
+  o.altim = hubFieldInt(f[9], n[9]);
+  if (n[10]) o.lat = strtof(f[10], nullptr);
+  if (n[11]) o.lon = strtof(f[11], nullptr);
+  return true;
+}
+
+// Calls fn(const HubObs&) per record. False if the body isn't a v1 hub reply.
+template <typename Fn>
+static bool hubParseBody(const String& body, Fn fn) {
+  const char* s = body.c_str();
+  size_t len = body.length();
+  if (strncmp(s, "#metarhub ", 10) != 0 || atoi(s + 10) != HUB_VERSION) return false;
+
+  size_t pos = 0;
+  while (pos < len) {
+    const char* nl = (const char*)memchr(s + pos, '\n', len - pos);
+    size_t end = nl ? (size_t)(nl - s) : len;
+    size_t n = end - pos;
+    if (n && s[pos] == '\r') { pos++; n--; }
+    if (n && s[pos + n - 1] == '\r') n--;
+    HubObs o;
+    if (n && s[pos] != '#' && hubParseRecord(s + pos, n, o)) fn(o);
+    pos = end + 1;
+  }
+  return true;
+}
+
+// ---------- client ----------
+enum HubMode : uint8_t { HUB_OFF, HUB_AUTO, HUB_FIXED };
+
+struct HubClientState {
+  HubMode mode = HUB_AUTO;
+  String fixedHost;
+  uint16_t fixedPort = HUB_DEFAULT_PORT;
+
+  // current hub; read by fetchers on any task under hubMux
+  bool have = false;
+  uint32_t ip = 0;
+  uint16_t port = 0;
+  uint8_t fails = 0;
+
+  // discovery (hubTick, loop only)
+  mdns_search_once_t* search = nullptr;
+  uint32_t searchStartMs = 0;
+  uint32_t nextSearchMs = 0;
+  uint32_t backoffMs = HUB_SEARCH_MIN_MS;
+
+  uint32_t found = 0;
+  uint32_t lost = 0;
+  uint32_t served = 0;
+  uint32_t fallbacks = 0;
+};
+
+static HubClientState hubClient;
+static portMUX_TYPE hubMux = portMUX_INITIALIZER_UNLOCKED;
+
+static HubMode hubModeFromString(String s, String& host, uint16_t& port) {
+  s.trim();
+  String l = s;
+  l.toLowerCase();
+  if (l == "off" || l == "none") return HUB_OFF;
+  if (!l.length() || l == "auto") return HUB_AUTO;
+  int colon = s.lastIndexOf(':');
+  host = colon > 0 ? s.substring(0, colon) : s;
+  long p = colon > 0 ? s.substring(colon + 1).toInt() : HUB_DEFAULT_PORT;
+  port = (p > 0 && p < 65536) ? (uint16_t)p : HUB_DEFAULT_PORT;
+  return HUB_FIXED;
+}
+
+static void hubCancelSearch() {
+  if (hubClient.search) {
+    mdns_query_async_delete(hubClient.search);
+    hubClient.search = nullptr;
+  }
+}
+
+static void hubSet(uint32_t ip, uint16_t port) {
+  portENTER_CRITICAL(&hubMux);
+  hubClient.have = ip != 0;
+  hubClient.ip = ip;
+  hubClient.port = port;
+  hubClient.fails = 0;
+  portEXIT_CRITICAL(&hubMux);
+}
+
+// "auto" (mDNS), "off", or host[:port]. Safe to call again after a change.
+static void hubBegin(const String& setting) {
+  hubCancelSearch();
+  hubSet(0, 0);
+  hubClient.mode = hubModeFromString(setting, hubClient.fixedHost, hubClient.fixedPort);
+  hubClient.nextSearchMs = millis();
+  hubClient.backoffMs = HUB_SEARCH_MIN_MS;
+  Serial.printf("[HUB] %s\n", hubClient.mode == HUB_OFF ? "off"
+                             : hubClient.mode == HUB_AUTO ? "auto (mDNS)" : hubClient.fixedHost.c_str());
+}
+
+static bool hubHave() {
+  portENTER_CRITICAL(&hubMux);
+  bool h = hubClient.have;
+  portEXIT_CRITICAL(&hubMux);
+  return h;
+}
+
+// Request URL for ids (comma list), "" while there is no hub.
+static String hubUrl(const String& ids) {
+  portENTER_CRITICAL(&hubMux);
+  bool have = hubClient.have;
+  IPAddress ip(hubClient.ip);
+  uint16_t port = hubClient.port;
+  portEXIT_CRITICAL(&hubMux);
+  if (!have) return "";
+  return "http://" + ip.toString() + ":" + String(port) + HUB_PATH + "?ids=" + ids;
+}
+
+// After every hub request (from any task: the Map fetches METAR chunks on
+// several at once). Drops the hub after HUB_MAX_FAILS in a row.
+static void hubReport(bool ok) {
+  bool dropped = false;
+  portENTER_CRITICAL(&hubMux);
+  if (ok) {
+    hubClient.fails = 0;
+    hubClient.served++;
+  } else {
+    hubClient.fallbacks++;
+    if (hubClient.have && ++hubClient.fails >= HUB_MAX_FAILS) {
+      hubClient.have = false;
+      hubClient.lost++;
+      hubClient.backoffMs = HUB_SEARCH_MIN_MS;
+      hubClient.nextSearchMs = millis() + HUB_SEARCH_MIN_MS;
+      dropped = true;
+    }
+  }
+  portEXIT_CRITICAL(&hubMux);
+  if (dropped) Serial.println("[HUB] hub not answering, fetching directly");
+}
+
+static bool hubResultUsable(const mdns_result_t* r, uint32_t& ip) {
+  bool v1 = false;
+  for (size_t i = 0; i < r->txt_count; i++) {
+    if (!strcmp(r->txt[i].key, "v") && r->txt[i].value && atoi(r->txt[i].value) == HUB_VERSION) v1 = true;
+  }
+  if (!v1) return false;
+  uint32_t self = (uint32_t)WiFi.localIP();
+  for (const mdns_ip_addr_t* a = r->addr; a; a = a->next) {
+    if (a->addr.type != ESP_IPADDR_TYPE_V4) continue;
+    uint32_t cand = a->addr.u_addr.ip4.addr;
+    if (cand && cand != self) { ip = cand; return true; }
+  }
+  return false;
+}
+
+// From loop(): runs discovery (never blocks) and resolves a fixed host.
+// staUp: station link has an address.
+static void hubTick(bool staUp) {
+  HubClientState& h = hubClient;
+  if (h.mode == HUB_OFF || !staUp || hubHave()) return;
+
+  uint32_t now = millis();
+  if (h.search) {
+    mdns_result_t* results = nullptr;
+    uint8_t n = 0;
+    if (!mdns_query_async_get_results(h.search, 0, &results, &n)) {
+      if (now - h.searchStartMs < HUB_QUERY_MS * 2) return;   // lost query: give up on it
+    }
+    uint32_t ip = 0;
+    uint16_t port = 0;
+    for (const mdns_result_t* r = results; r; r = r->next) {
+      if (hubResultUsable(r, ip)) { port = r->port ? r->port : HUB_DEFAULT_PORT; break; }
+    }
+    if (results) mdns_query_results_free(results);
+    hubCancelSearch();
+
+    if (ip) {
+      hubSet(ip, port);
+      h.found++;
+      h.backoffMs = HUB_SEARCH_MIN_MS;
+      Serial.printf("[HUB] using %s:%u\n", IPAddress(ip).toString().c_str(), port);
+    } else {
+      h.nextSearchMs = now + h.backoffMs;
+      h.backoffMs = min(h.backoffMs * 2, HUB_SEARCH_MAX_MS);
+    }
+    return;
+  }
+
+  if ((int32_t)(now - h.nextSearchMs) < 0) return;
+
+  if (h.mode == HUB_FIXED) {
+    // numeric hosts resolve instantly; names go through DNS (short, rare)
+    IPAddress ip;
+    if (ip.fromString(h.fixedHost.c_str()) || WiFi.hostByName(h.fixedHost.c_str(), ip)) {
+      hubSet((uint32_t)ip, h.fixedPort);
+      h.found++;
+      h.backoffMs = HUB_SEARCH_MIN_MS;
+    } else {
+      h.nextSearchMs = now + h.backoffMs;
+      h.backoffMs = min(h.backoffMs * 2, HUB_SEARCH_MAX_MS);
+    }
+    return;
+  }
+
+  String svc = String("_") + HUB_SERVICE;
+  String proto = String("_") + HUB_PROTO;
+  h.search = mdns_query_async_new(nullptr, svc.c_str(), proto.c_str(), MDNS_TYPE_PTR, HUB_QUERY_MS, 4, nullptr);
+  h.searchStartMs = now;
+  if (!h.search) {
+    h.nextSearchMs = now + h.backoffMs;   // mDNS not up yet
+  }
+}
+
+// ---------- serving ----------
+// Call after MDNS.begin() on the device that serves HUB_PATH.
+static inline void hubAdvertise(uint16_t port) {
+  MDNS.addService(HUB_SERVICE, HUB_PROTO, port);
+  String v(HUB_VERSION);
+  MDNS.addServiceTxt(HUB_SERVICE, HUB_PROTO, "v", v.c_str());
+}
+
+// one line for the web UI
+static String hubStatusLine() {
+  if (hubClient.mode == HUB_OFF) return "Hub: <b>off</b> (direct fetch)";
+  portENTER_CRITICAL(&hubMux);
+  bool have = hubClient.have;
+  IPAddress ip(hubClient.ip);
+  uint16_t port = hubClient.port;
+  portEXIT_CRITICAL(&hubMux);
+  String line = "Hub: ";
+  if (have) line += "<b>" + ip.toString() + ":" + String(port) + "</b>";
+  else line += hubClient.mode == HUB_AUTO ? "<b>none found</b> (direct fetch)" : "<b>unreachable</b> (direct fetch)";
+  line += " &nbsp;|&nbsp; " + String(hubClient.served) + " served, " + String(hubClient.fallbacks) + " fallbacks";
+  return line;
+}
+
+// appended to /metrics by each app
+static void hubMetricsOut(String& out) {
+  metricGaugeOut(out, "metarlw_hub_connected", "1 while observations come from a LAN hub", hubHave() ? 1 : 0);
+  metricHeader(out, "metarlw_hub_found_total", "Hubs found by discovery", "counter");
+  metricLine(out, "metarlw_hub_found_total", "", hubClient.found);
+  metricHeader(out, "metarlw_hub_lost_total", "Hubs dropped after failed requests", "counter");
+  metricLine(out, "metarlw_hub_lost_total", "", hubClient.lost);
+  metricHeader(out, "metarlw_hub_fallbacks_total", "Hub requests that fell back to a direct fetch", "counter");
+  metricLine(out, "metarlw_hub_fallbacks_total", "", hubClient.fallbacks);
+}
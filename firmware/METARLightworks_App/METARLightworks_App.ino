@@ -2,12 +2,18 @@
 // North METAR Lamp + Flight Pulse (Tail OR Hex UI) — APP Firmware (ESP32 + ESP32-C3)
 // ============================================================
 // - Reads LittleFS /config.json (written by FACTORY firmware)
-// - SoftAP is ALWAYS ON so web UI is always reachable
+// - SoftAP is ALWAYS ON so web UI is always reachable (unless the admin
+//   lets the power manager drop it while the schedule has the lamp off)
 // - Also attempts STA Wi-Fi using config.wifi creds (AP+STA)
-// - mDNS: airportcode.local (ktix.local, etc) updates live on airport change
+// - mDNS: airportcode.local (ktix.local, etc) updates live on airport change;
+//   status (fw, station, category, fetch time) in the _http._tcp TXT record
 // - Brightness slider: Preview + Save
 // - OTA in app: Check Now + Install Update
 // - Auto-update default OFF, interval is DAYS
+// - Outside the schedule: 80 MHz + modem sleep, light sleep when possible
+// - METAR from a LAN hub when one answers (mDNS), else AVWX directly
+// - Forecast view: /taf?hours=N or ?animate=1 shows the AWC TAF category
+//   N hours ahead (decoded once per hourly fetch, see Taf.h)
 //
 // NOTE (ESP32-C3): Tools → USB CDC On Boot → Enabled
 // ============================================================
@@ -27,7 +33,20 @@
 
 #include "version.h"
 #include "AppTypes.h"
+#include "Metrics.h"
+#include "Memory.h"
+#include "EventLog.h"
+#include "Stall.h"
+#include "TimeSync.h"
+#include "FleetClock.h"
+#include "Fetch.h"
+#include "Hub.h"
+#include "MdnsStatus.h"
+#include "Mqtt.h"
+#include "Taf.h"
+#include "Staleness.h"
 #include "AdminUI.h"
+#include "Bench.h"
 
 // ================= WEB (GLOBAL so AdminUI.h can extern it) =================
 WebServer server(80);
@@ -37,6 +56,8 @@ AppConfig cfg;
 
 // ================= FS =================
 static const char* CONFIG_PATH = "/config.json";
+static const size_t JSON_ARENA_BYTES = 16 * 1024;         // largest document (GitHub releases)
+static const size_t JSON_ARENA_BYTES_PSRAM = 64 * 1024;
 
 // ================= LED runtime (dynamic so cfg pin/count/order can apply) =================
 Adafruit_NeoPixel* strip = nullptr;
@@ -48,8 +69,25 @@ String flight_category, metar_station, metar_time, metar_wind,
 // ================= Runtime =================
 bool connected = false;
 unsigned long lastMetarFetch = 0;
+unsigned long lastMetarOkMs = 0;    // last reading shown (0 = none yet)
+HubObs lastObs;                     // last reading as numbers, for MQTT
 const unsigned long fetchInterval = 20UL * 60UL * 1000UL;
 bool lastScheduleOn = false;
+static ScheduleRunner schedule;
+static unsigned long geoLastTryMs = 0;
+const unsigned long geoRetryInterval = 10UL * 60UL * 1000UL;
+
+// ================= TAF (forecast view, see Taf.h) =================
+TafTimeline tafLine;                // decoded once per fetch; the view only reads it
+String tafStation = "";             // station tafLine belongs to
+unsigned long lastTafFetch = 0;
+const unsigned long tafInterval = 60UL * 60UL * 1000UL;
+const unsigned long tafRetryInterval = 5UL * 60UL * 1000UL;
+static uint32_t tafHourSeen = 0;    // epoch hour last painted
+
+// ================= METAR age (see Staleness.h) =================
+static uint8_t staleSeen = STALE_FRESH;     // level last painted
+static bool staleBlinkSeen = true;          // blink phase last painted
 
 // ================= Display Mode =================
 enum DisplayMode {
@@ -62,8 +100,8 @@ enum DisplayMode {
 };
 
 DisplayMode displayMode = MODE_AUTO;
-unsigned long lastCycleSwitch = 0;
 int cycleIndex = 0;
+const uint32_t CYCLE_STEP_MS = 3000;   // on the fleet clock, so lamps switch together
 
 // ================= Flight Pulse =================
 bool fpIsFlying = false;
@@ -72,11 +110,10 @@ const unsigned long fpCheckIntervalMs = 45000; // 45s
 int fpFlyingStreak = 0;
 
 bool fpPulseActive = false;
-unsigned long fpPulseStartMs = 0;
 int fpBaseBrightness = 100;
 
-// pulse tuning
-const float FP_PERIOD_MS = 3500.0f;
+// pulse tuning (phase from the fleet clock, see FleetClock.h)
+const uint32_t FP_PERIOD_MS = 3500;
 const float FP_MIN_FRACTION = 0.15f;
 
 // ================= Chip helper (portable) =================
@@ -180,31 +217,32 @@ static void initStripFromConfig() {
   strip->show();
 }
 
-void waitForTimeSync() {
-  Serial.print("[NTP] waiting for sync");
-  time_t nowSecs = time(nullptr);
-  unsigned long start = millis();
-  while (nowSecs < 8 * 3600 * 2 && millis() - start < 5000) {
-    delay(500);
-    Serial.print(".");
-    nowSecs = time(nullptr);
-  }
-  Serial.println(nowSecs < 8 * 3600 * 2 ? " ❌ timed out" : " ✅ synced");
-}
-
 void clearLED() {
   if (!strip) return;
   strip->clear();
   strip->show();
 }
 
+// Configured brightness scaled by the solar curve; 0 only when the night
+// level is 0%.
+static int effectiveBrightness() {
+  int b = (int)lroundf(cfg.brightness * schedule.st.level);
+  if (b <= 0) return 0;
+  return clampInt(b, 3, 100);
+}
+
 // NEO_* expects Color(r,g,b)
 void setLEDColor(uint8_t r, uint8_t g, uint8_t b) {
   if (!strip) return;
-  strip->setBrightness((uint8_t)cfg.brightness);
+  if (!schedule.st.on) { clearLED(); return; }   // outside the weekday window
+  uint32_t t0 = micros();
+  strip->setBrightness((uint8_t)effectiveBrightness());
   for (int i = 0; i < cfg.led_count; i++) {
     strip->setPixelColor(i, strip->Color(r, g, b));
   }
+  metrics.renderTime.observeUs(micros() - t0);
+
+  MetricTimer showTimer(metrics.showTime);
   strip->show();
 }
 
@@ -236,11 +274,26 @@ void applyModeColor() {
     return;
   }
 
-  if      (flight_category == "VFR")  setLEDColor(0,   255, 0);
-  else if (flight_category == "MVFR") setLEDColor(0,   0,   255);
-  else if (flight_category == "IFR")  setLEDColor(255, 0,   0);
-  else if (flight_category == "LIFR") setLEDColor(255, 0,   255);
-  else                                setLEDColor(255, 255, 0);
+  // forecast view: the TAF category for that hour (unknown if the TAF doesn't reach it)
+  String cat = flight_category;
+  uint16_t scale = 256;
+  if (tafShownHours() > 0) {
+    cat = tafStation == cfg.airport_code ? tafCatName(tafCatAt(tafLine, tafShownHour())) : "";
+  } else {
+    // current view: an old METAR fades, then blinks, then reads as unknown
+    staleSeen = staleLevel(lastObs.obsTime, staleCutoffs(cfg.stale, staleClock()));
+    staleBlinkSeen = staleBlinkOn(fleetNowMs());
+    if (staleSeen == STALE_MISSING) cat = "";
+    else if (staleSeen == STALE_BLINK) scale = staleBlinkSeen ? 256 : 0;
+    else if (staleSeen == STALE_FADE) scale = STALE_FADE_SCALE;
+  }
+
+  uint8_t r = 255, g = 255, b = 0;
+  if      (cat == "VFR")  { r = 0;   g = 255; b = 0;   }
+  else if (cat == "MVFR") { r = 0;   g = 0;   b = 255; }
+  else if (cat == "IFR")  { r = 255; g = 0;   b = 0;   }
+  else if (cat == "LIFR") { r = 255; g = 0;   b = 255; }
+  setLEDColor((uint8_t)(r * scale >> 8), (uint8_t)(g * scale >> 8), (uint8_t)(b * scale >> 8));
 }
 
 // ================= LittleFS config =================
@@ -270,17 +323,21 @@ bool loadConfig() {
 
   JsonObject sched = doc["schedule"].as<JsonObject>();
   if (!sched.isNull()) {
-    cfg.scheduleEnabled = (bool)(sched["enabled"] | false);
-    cfg.timezonePref    = String(sched["tz"] | "UTC0");
-    cfg.startHour       = (int)(sched["starth"] | 0);
-    cfg.startMinute     = (int)(sched["startm"] | 0);
-    cfg.endHour         = (int)(sched["endh"] | 23);
-    cfg.endMinute       = (int)(sched["endm"] | 59);
+    scheduleFromJson(sched, cfg.sched);
+    cfg.timezonePref = String(sched["tz"] | "UTC0");
+    cfg.geoIcao      = String(sched["geo_for"] | "");
   }
 
   cfg.displayMode = (int)(doc["mode"] | 0);
   if (cfg.displayMode < 0 || cfg.displayMode > 5) cfg.displayMode = 0;
 
+  JsonObject taf = doc["taf"].as<JsonObject>();
+  if (!taf.isNull()) {
+    cfg.tafEnabled = (bool)(taf["enabled"] | false);
+  }
+
+  staleFromJson(doc["stale"], cfg.stale);
+
   JsonObject fp = doc["flightpulse"].as<JsonObject>();
   if (!fp.isNull()) {
     cfg.fpEnabled = (bool)(fp["enabled"] | false);
@@ -295,6 +352,31 @@ bool loadConfig() {
     cfg.otaIntervalDays = (int)(ota["interval_days"] | 7);
   }
 
+  JsonObject fetch = doc["fetch"].as<JsonObject>();
+  if (!fetch.isNull()) {
+    cfg.fetchMode   = String(fetch["mode"] | "live");
+    cfg.replaySpeed = (int)(fetch["speed"] | 60);
+  }
+
+  JsonObject clk = doc["time"].as<JsonObject>();
+  if (!clk.isNull()) {
+    cfg.ntpServers = String(clk["servers"] | "pool.ntp.org");
+    cfg.fleetSync  = (bool)(clk["fleet"] | true);
+  }
+
+  JsonObject hub = doc["hub"].as<JsonObject>();
+  if (!hub.isNull()) {
+    cfg.hubUse = String(hub["use"] | "auto");
+  }
+
+  mqttFromJson(doc["mqtt"], cfg.mqtt);
+
+  JsonObject pwr = doc["power"].as<JsonObject>();
+  if (!pwr.isNull()) {
+    cfg.pwrSave  = (bool)(pwr["enabled"] | true);
+    cfg.pwrApOff = (bool)(pwr["ap_off"] | false);
+  }
+
   // LED advanced
   JsonObject led = doc["led"].as<JsonObject>();
   if (!led.isNull()) {
@@ -313,6 +395,7 @@ bool loadConfig() {
 
   cfg.brightness = clampInt(cfg.brightness, 3, 100);
   cfg.otaIntervalDays = clampInt(cfg.otaIntervalDays, 1, 60);
+  cfg.replaySpeed = clampInt(cfg.replaySpeed, 1, 600);
 
   cfg.airport_code.trim(); cfg.airport_code.toUpperCase();
   cfg.fpIcao.trim(); cfg.fpIcao.toUpperCase();
@@ -339,12 +422,14 @@ bool saveConfig() {
   wifi["pass"] = cfg.wifi_pass;
 
   JsonObject sched = doc.createNestedObject("schedule");
-  sched["enabled"] = cfg.scheduleEnabled;
+  scheduleToJson(sched, cfg.sched);
   sched["tz"]      = cfg.timezonePref;
-  sched["starth"]  = cfg.startHour;
-  sched["startm"]  = cfg.startMinute;
-  sched["endh"]    = cfg.endHour;
-  sched["endm"]    = cfg.endMinute;
+  sched["geo_for"] = cfg.geoIcao;
+
+  JsonObject taf = doc.createNestedObject("taf");
+  taf["enabled"] = cfg.tafEnabled;
+
+  staleToJson(doc.createNestedObject("stale"), cfg.stale);
 
   JsonObject fp = doc.createNestedObject("flightpulse");
   fp["enabled"] = cfg.fpEnabled;
@@ -356,6 +441,24 @@ bool saveConfig() {
   ota["auto_update"]   = cfg.otaAutoUpdate;
   ota["interval_days"] = cfg.otaIntervalDays;
 
+  JsonObject fetch = doc.createNestedObject("fetch");
+  fetch["mode"]  = cfg.fetchMode;
+  fetch["speed"] = cfg.replaySpeed;
+
+  JsonObject clk = doc.createNestedObject("time");
+  clk["servers"] = cfg.ntpServers;
+  clk["fleet"]   = cfg.fleetSync;
+
+  JsonObject hub = doc.createNestedObject("hub");
+  hub["use"] = cfg.hubUse;
+
+  JsonObject mq = doc.createNestedObject("mqtt");
+  mqttToJson(mq, cfg.mqtt);
+
+  JsonObject pwr = doc.createNestedObject("power");
+  pwr["enabled"] = cfg.pwrSave;
+  pwr["ap_off"]  = cfg.pwrApOff;
+
   JsonObject led = doc.createNestedObject("led");
   led["pin"]   = cfg.led_pin;
   led["count"] = cfg.led_count;
@@ -365,6 +468,7 @@ bool saveConfig() {
   if (!f) return false;
   if (serializeJson(doc, f) == 0) { f.close(); return false; }
   f.close();
+  metrics.flashWrites.inc();
   return true;
 }
 
@@ -405,6 +509,8 @@ static void connectToWiFi() {
 
 // ================= mDNS =================
 void restartMDNSForAirport() {
+  hubCancelSearch();   // a pending query dies with the responder
+  mdnsStatusEnd();
   MDNS.end();
 
   String host = sanitizeAirportHost(cfg.airport_code);
@@ -412,6 +518,8 @@ void restartMDNSForAirport() {
     Serial.println("[mDNS] start/restart failed");
   } else {
     MDNS.addService("http", "tcp", 80);
+    mdnsStatusBegin("lamp", FW_VERSION);
+    mdnsStatusSet("stn", cfg.airport_code);
     Serial.print("[mDNS] http://");
     Serial.print(host);
     Serial.println(".local");
@@ -419,77 +527,185 @@ void restartMDNSForAirport() {
 }
 
 // ================= METAR =================
-static void parseAndDisplayMETAR(const String& json) {
-  DynamicJsonDocument doc(2048);
-  DeserializationError err = deserializeJson(doc, json);
-  if (err) {
-    Serial.printf("[METAR] JSON parse failed: %s\n", err.c_str());
-    return;
-  }
+// Readout strings shared by the AVWX and hub paths. windDir < 0: variable;
+// visSm < 0 / inHg <= 0: not reported.
+static void setMetarReadout(int windDir, int windKt, int gustKt, int visSm,
+                            int tempC, int dewC, float altimInHg) {
+  float wind_mph = windKt * 1.15078f;
+  metar_wind = (windDir < 0 ? String("VRB") : String(windDir) + "°") + " at " + windKt + " kt / " + String(wind_mph, 1) + " mph";
 
-  metar_station   = doc["station"].as<String>();
-  metar_time      = doc["time"]["dt"].as<String>();
-  flight_category = doc["flight_rules"].as<String>();
+  float gust_mph = gustKt * 1.15078f;
+  metar_gust = String(gustKt) + " kt / " + String(gust_mph, 1) + " mph";
+
+  metar_visibility = visSm < 0 ? String("N/A") : String(visSm) + " sm";
+
+  float f_temp = tempC * 9.0f/5.0f + 32.0f;
+  float f_dew  = dewC  * 9.0f/5.0f + 32.0f;
+  metar_temp     = String(tempC) + " °C / " + String(f_temp, 1) + " °F";
+  metar_dewpoint = String(dewC)  + " °C / " + String(f_dew,  1) + " °F";
 
-  int wind_dir = doc["wind_direction"]["value"] | 0;
-  int wind_kt  = doc["wind_speed"]["value"]      | 0;
-  float wind_mph = wind_kt * 1.15078f;
-  metar_wind = String(wind_dir) + "° at " + wind_kt + " kt / " + String(wind_mph, 1) + " mph";
+  metar_pressure = altimInHg <= 0 ? String("N/A") : String(altimInHg, 2) + " inHg";
+}
 
-  int gust_kt = doc["wind_gust"]["value"].isNull() ? 0 : doc["wind_gust"]["value"].as<int>();
-  float gust_mph = gust_kt * 1.15078f;
-  metar_gust = String(gust_kt) + " kt / " + String(gust_mph, 1) + " mph";
+// "2024-05-01T12:53:00Z" -> epoch, 0 if it doesn't parse
+static uint32_t isoUtcToEpoch(const char* s) {
+  int y, mo, d, h, mi, sec = 0;
+  if (!s || sscanf(s, "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &sec) < 5 || y < 2000) return 0;
+  y -= mo <= 2;
+  int era = y / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + doe - 719468;
+  return (uint32_t)days * 86400UL + h * 3600UL + mi * 60UL + sec;
+}
 
-  metar_visibility = doc["visibility"]["value"].isNull()
-                     ? "N/A"
-                     : String(doc["visibility"]["value"].as<int>()) + " sm";
+static const size_t METAR_DOC_BYTES = 2048;
 
-  int c_temp = doc["temperature"]["value"] | 0;
-  int c_dew  = doc["dewpoint"]["value"]    | 0;
-  float f_temp = c_temp * 9.0f/5.0f + 32.0f;
-  float f_dew  = c_dew  * 9.0f/5.0f + 32.0f;
-  metar_temp     = String(c_temp) + " °C / " + String(f_temp, 1) + " °F";
-  metar_dewpoint = String(c_dew)  + " °C / " + String(f_dew,  1) + " °F";
+static void displayMetarDoc(JsonDocument& doc) {
+  uint32_t t0 = micros();
 
-  metar_pressure = doc["altimeter"]["value"].isNull()
-                   ? "N/A"
-                   : String(doc["altimeter"]["value"].as<float>(), 2) + " inHg";
+  metar_station   = doc["station"].as<String>();
+  metar_time      = doc["time"]["dt"].as<String>();
+  flight_category = doc["flight_rules"].as<String>();
 
+  setMetarReadout(doc["wind_direction"]["value"] | 0,
+                  doc["wind_speed"]["value"] | 0,
+                  doc["wind_gust"]["value"].isNull() ? 0 : doc["wind_gust"]["value"].as<int>(),
+                  doc["visibility"]["value"].isNull() ? -1 : doc["visibility"]["value"].as<int>(),
+                  doc["temperature"]["value"] | 0,
+                  doc["dewpoint"]["value"] | 0,
+                  doc["altimeter"]["value"].isNull() ? 0.0f : doc["altimeter"]["value"].as<float>());
+
+  // same numbers as a hub record: visibility sm*10, altimeter inHg*100
+  HubObs o;
+  strncpy(o.icao, metar_station.c_str(), sizeof(o.icao) - 1);
+  if (flight_category == "VFR" || flight_category == "MVFR" || flight_category == "IFR" || flight_category == "LIFR") {
+    strcpy(o.cat, flight_category.c_str());
+  }
+  o.obsTime = isoUtcToEpoch(doc["time"]["dt"] | "");
+  auto num = [&](const char* key, float scale) -> int16_t {
+    JsonVariant v = doc[key]["value"];
+    return v.isNull() ? HUB_NA : (int16_t)lroundf(v.as<float>() * scale);
+  };
+  o.temp = num("temperature", 1);
+  o.dewp = num("dewpoint", 1);
+  o.wdir = doc["wind_direction"]["repr"] == "VRB" ? HUB_VRB : num("wind_direction", 1);
+  o.wspd = num("wind_speed", 1);
+  o.wgst = num("wind_gust", 1);
+  o.visib = num("visibility", 10);
+  bool hpa = doc["units"]["altimeter"] == "hPa";
+  o.altim = num("altimeter", hpa ? 2.953f : 100);
+  lastObs = o;
+
+  metrics.parseTime[PROV_AVWX].observeUs(micros() - t0);
+  lastMetarOkMs = millis();
   applyModeColor();
 }
 
-static int doOneGet(int attempt) {
-  WiFiClientSecure client;
-  client.setInsecure();
+// a body already in hand (bench, replay)
+static void parseAndDisplayMETAR(const String& json) {
+  ArenaJsonDocument doc(METAR_DOC_BYTES);
+  DeserializationError err = deserializeJson(doc, json);
+  if (err) {
+    Serial.printf("[METAR] JSON parse failed: %s\n", err.c_str());
+    return;
+  }
+  displayMetarDoc(doc);
+}
 
-  HTTPClient http;
-  http.setConnectTimeout(7000);
-  http.setTimeout(10000);
-  http.setReuse(false);
+static void showHubObs(const HubObs& o) {
+  metar_station = o.icao;
+  flight_category = o.cat[0] ? String(o.cat) : String("UNKNOWN");
+  if (o.obsTime) {
+    time_t t = (time_t)o.obsTime;
+    struct tm tmv;
+    gmtime_r(&t, &tmv);
+    char buf[24];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tmv);
+    metar_time = buf;
+  } else {
+    metar_time = "";
+  }
+
+  auto val = [](int16_t v) { return v == HUB_NA ? 0 : (int)v; };
+  setMetarReadout(o.wdir == HUB_NA ? 0 : o.wdir,
+                  val(o.wspd), val(o.wgst),
+                  o.visib == HUB_NA ? -1 : o.visib / 10,
+                  val(o.temp), val(o.dewp),
+                  o.altim == HUB_NA ? 0.0f : o.altim / 100.0f);
+  lastObs = o;
+  lastMetarOkMs = millis();
+  applyModeColor();
+}
 
-  String url = "https://avwx.rest/api/metar/" + cfg.airport_code + "?format=json&onfail=cache";
-  if (!http.begin(client, url)) {
+// The station from the LAN hub, if one is up. False: fetch from AVWX.
+// A hub that answers without this station yet is still healthy; it
+// fetches the station from then on.
+static bool fetchMetarFromHub() {
+  String url = hubUrl(cfg.airport_code);
+  if (!url.length()) return false;
+
+  FetchRequest req;
+  req.provider = PROV_HUB;
+  req.url = url;
+  req.userAgent = "METARLightworks-Lamp/1.0 ESP32";
+  req.connectTimeoutMs = 3000;
+  req.timeoutMs = 5000;
+
+  String body;
+  int code = 0;
+  bool ok = fetchGET(req, body, code);
+
+  uint32_t t0 = micros();
+  HubObs obs;
+  bool got = false;
+  bool valid = ok && hubParseBody(body, [&](const HubObs& o) {
+    if (cfg.airport_code == o.icao) { obs = o; got = true; }
+  });
+  hubReport(valid);
+  if (!got) return false;
+
+  metrics.parseTime[PROV_HUB].observeUs(micros() - t0);
+  showHubObs(obs);
+  Serial.println("[METAR] OK (hub)");
+  return true;
+}
+
+static int doOneGet(int attempt) {
+  FetchRequest req;
+  req.provider = PROV_AVWX;
+  req.url = "https://avwx.rest/api/metar/" + cfg.airport_code + "?format=json&onfail=cache";
+  req.authorization = "Bearer " + cfg.avwx_token;
+  req.connectTimeoutMs = 7000;
+  req.timeoutMs = 10000;
+
+  // the body streams into the doc (fetchGETJson), it isn't held as text
+  ArenaJsonDocument doc(METAR_DOC_BYTES);
+  int code = 0;
+  bool parsed = fetchGETJson(req, doc, code);
+
+  if (code == -1) {
     Serial.printf("[METAR] begin failed (try %d)\n", attempt);
     return -1;
   }
 
-  http.addHeader("Authorization", "Bearer " + cfg.avwx_token);
-  int code = http.GET();
-
   if (code == 200) {
-    parseAndDisplayMETAR(http.getString());
+    if (parsed) displayMetarDoc(doc);
+    else Serial.println("[METAR] JSON parse failed");
     Serial.printf("[METAR] OK (try %d)\n", attempt);
   } else {
     Serial.printf("[METAR] HTTP %d (try %d)\n", code, attempt);
   }
 
-  http.end();
   return code;
 }
 
 void fetchAndDisplayMETAR() {
-  if (!connected) return;
-  if (!cfg.avwx_token.length()) {
+  if (!connected && !fetchReplaying()) return;
+  StallScope stall("fetchAndDisplayMETAR");
+  if (fetchMetarFromHub()) return;
+  if (!cfg.avwx_token.length() && !fetchReplaying()) {
     Serial.println("[METAR] Missing AVWX token in /config.json");
     return;
   }
@@ -501,6 +717,90 @@ void fetchAndDisplayMETAR() {
   }
 }
 
+// ================= TAF =================
+// AWC, no key needed; one station, so one small request an hour. The
+// timeline is decoded here once and the view (/taf) only reads it.
+static bool fetchTaf() {
+  if (!connected && !fetchReplaying()) return false;
+  StallScope stall("fetchTaf");
+
+  FetchRequest req;
+  req.provider = PROV_AWC;
+  req.url = String(TAF_ENDPOINT) + "?format=json&ids=" + cfg.airport_code;
+  req.userAgent = "METARLightworks-Lamp/1.0 ESP32";
+  req.connectTimeoutMs = 7000;
+  req.timeoutMs = 10000;
+
+  String body;
+  int code = 0;
+  if (!fetchGET(req, body, code) || code != 200) {
+    tafStats.fetchFailures++;
+    Serial.printf("[TAF] HTTP %d\n", code);
+    return false;
+  }
+
+  tafStats.decodeUs = 0;
+  bool got = false;
+  bool ok = tafParseAwc(body, [&](const char* icao, const TafTimeline& tl) {
+    if (got || cfg.airport_code != icao) return;    // latest TAF first
+    tafLine = tl;
+    got = true;
+  });
+  if (!ok) { tafStats.fetchFailures++; return false; }
+  if (!got) {
+    Serial.printf("[TAF] no TAF for %s\n", cfg.airport_code.c_str());
+    tafLine = TafTimeline();
+  }
+  tafStation = cfg.airport_code;
+  tafStats.stations = got ? 1 : 0;
+  tafStats.fetchedMs = millis();
+  if (tafShownHours() > 0 && !fpPulseActive) applyModeColor();
+  return got;
+}
+
+// ================= Station location (solar schedule) =================
+// AVWX's METAR payload has no coordinates; AWC stationinfo is looked up once
+// per airport change and kept in /config.json (schedule.lat/lon/geo_for).
+static bool fetchStationGeo() {
+  if (!connected && !fetchReplaying()) return false;
+  if (cfg.geoIcao == cfg.airport_code && cfg.sched.hasGeo) return true;
+  StallScope stall("fetchStationGeo");
+  geoLastTryMs = millis();
+
+  FetchRequest req;
+  req.provider = PROV_AWC;
+  req.url = "https://aviationweather.gov/api/data/stationinfo?format=json&ids=" + cfg.airport_code;
+  req.userAgent = "METARLightworks-Lamp/1.0 ESP32";
+  req.connectTimeoutMs = 7000;
+  req.timeoutMs = 10000;
+
+  String body;
+  int code = 0;
+  if (!fetchGET(req, body, code) || code != 200) {
+    Serial.printf("[GEO] stationinfo HTTP %d\n", code);
+    return false;
+  }
+
+  ArenaJsonDocument doc(2048);
+  if (deserializeJson(doc, body) || !doc.is<JsonArray>() || doc.size() == 0) {
+    Serial.println("[GEO] stationinfo: no match");
+    return false;
+  }
+  JsonObject st = doc[0];
+  JsonVariant lat = st.containsKey("lat") ? st["lat"] : st["latitude"];
+  JsonVariant lon = st.containsKey("lon") ? st["lon"] : st["longitude"];
+  if (lat.isNull() || lon.isNull()) return false;
+
+  cfg.sched.lat = lat.as<float>();
+  cfg.sched.lon = lon.as<float>();
+  cfg.sched.hasGeo = true;
+  cfg.geoIcao = cfg.airport_code;
+  saveConfig();
+  schedule.invalidate();
+  Serial.printf("[GEO] %s at %.3f, %.3f\n", cfg.geoIcao.c_str(), cfg.sched.lat, cfg.sched.lon);
+  return true;
+}
+
 // ================= Tail/Hex utilities =================
 static bool isHex6(String s) {
   s.trim();
@@ -607,33 +907,24 @@ static String resolveTailOrHex(String tailIn, String hexIn) {
 
 // ================= Flight Pulse ADSB =================
 static bool fpFetchIsFlying_ADSBlol(const String& icaoHex6) {
-  if (WiFi.status() != WL_CONNECTED) return false;
+  if (WiFi.status() != WL_CONNECTED && !fetchReplaying()) return false;
   if (!isHex6(icaoHex6)) return false;
 
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient http;
-  http.setConnectTimeout(7000);
-  http.setTimeout(10000);
-  http.setReuse(false);
-
   String icao = icaoHex6;
   icao.toLowerCase();
-  String url = "https://api.adsb.lol/v2/icao/" + icao;
 
-  if (!http.begin(client, url)) return false;
+  FetchRequest req;
+  req.provider = PROV_ADSB;
+  req.url = "https://api.adsb.lol/v2/icao/" + icao;
+  req.connectTimeoutMs = 7000;
+  req.timeoutMs = 10000;
 
-  int code = http.GET();
-  if (code != 200) {
-    http.end();
-    return false;
-  }
+  String body;
+  int code = 0;
+  if (!fetchGET(req, body, code)) return false;
 
-  String body = http.getString();
-  http.end();
-
-  DynamicJsonDocument doc(8192);
+  MetricTimer parseTimer(metrics.parseTime[PROV_ADSB]);
+  ArenaJsonDocument doc(8192);
   if (deserializeJson(doc, body)) return false;
 
   JsonArray ac = doc["ac"].as<JsonArray>();
@@ -655,14 +946,13 @@ static bool fpFetchIsFlying_ADSBlol(const String& icaoHex6) {
 
 static void fpStartPulse() {
   fpPulseActive = true;
-  fpPulseStartMs = millis();
-  fpBaseBrightness = cfg.brightness;
+  fpBaseBrightness = effectiveBrightness();
 }
 
 static void fpStopPulseRestore() {
   fpPulseActive = false;
   if (!strip) return;
-  strip->setBrightness((uint8_t)cfg.brightness);
+  strip->setBrightness((uint8_t)effectiveBrightness());
   strip->show();
 }
 
@@ -670,8 +960,7 @@ void fpUpdatePulseOverlay() {
   if (!fpPulseActive) return;
   if (!strip) return;
 
-  unsigned long now = millis();
-  float t = fmod((float)(now - fpPulseStartMs), FP_PERIOD_MS) / FP_PERIOD_MS;
+  float t = (float)(fleetNowMs() % FP_PERIOD_MS) / (float)FP_PERIOD_MS;
   float wave = 0.5f - 0.5f * cosf(2.0f * PI * t);
 
   int minB = (int)(fpBaseBrightness * FP_MIN_FRACTION);
@@ -681,6 +970,8 @@ void fpUpdatePulseOverlay() {
 
   int b = (int)(minB + (maxB - minB) * wave);
   strip->setBrightness((uint8_t)b);
+
+  MetricTimer showTimer(metrics.showTime);
   strip->show();
 }
 
@@ -715,38 +1006,29 @@ static int semverCompare3(const String& aIn, const String& bIn) {
 }
 
 static bool otaGetLatest(String &outTag, String &outUrl, int &outSize) {
-  if (WiFi.status() != WL_CONNECTED) return false;
+  if (WiFi.status() != WL_CONNECTED && !fetchReplaying()) return false;
 
   const char* desired = otaAssetNameForThisChip();
   Serial.printf("[OTA] Desired asset: %s\n", desired);
 
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient http;
-  http.setConnectTimeout(8000);
-  http.setTimeout(12000);
-
-  String api = String("https://api.github.com/repos/")
-             + OTA_OWNER + "/" + OTA_REPO + "/releases/latest";
-
-  if (!http.begin(client, api)) return false;
-
-  http.addHeader("User-Agent", "METARLightworks");
-  http.addHeader("Accept", "application/vnd.github+json");
-
-  int code = http.GET();
+  FetchRequest req;
+  req.provider = PROV_GITHUB;
+  req.url = String("https://api.github.com/repos/")
+          + OTA_OWNER + "/" + OTA_REPO + "/releases/latest";
+  req.userAgent = "METARLightworks";
+  req.accept = "application/vnd.github+json";
+  req.connectTimeoutMs = 8000;
+  req.timeoutMs = 12000;
+
+  String body;
+  int code = 0;
+  fetchGET(req, body, code);
   Serial.printf("[OTA] latest HTTP %d\n", code);
 
-  if (code != 200) {
-    http.end();
-    return false;
-  }
-
-  String body = http.getString();
-  http.end();
+  if (code != 200) return false;
 
-  StaticJsonDocument<16384> doc;
+  MetricTimer parseTimer(metrics.parseTime[PROV_GITHUB]);
+  ArenaJsonDocument doc(16384);
   if (deserializeJson(doc, body)) return false;
 
   outTag = String(doc["tag_name"] | "");
@@ -766,12 +1048,14 @@ static bool otaGetLatest(String &outTag, String &outUrl, int &outSize) {
 }
 
 static bool otaCheckNow() {
+  StallScope stall("otaCheckNow");
+  metrics.otaChecks.inc();
   otaLatestTag = "";
   otaLatestUrl = "";
   otaLatestSize = 0;
   otaUpdateAvailable = false;
 
-  if (WiFi.status() != WL_CONNECTED) {
+  if (WiFi.status() != WL_CONNECTED && !fetchReplaying()) {
     otaStatusLine = "No Wi-Fi";
     return false;
   }
@@ -780,6 +1064,7 @@ static bool otaCheckNow() {
   int size = 0;
   if (!otaGetLatest(tag, url, size)) {
     otaStatusLine = "Check failed";
+    elogEvent(EV_OTA_CHECK, 0, 0, otaStatusLine.c_str());
     return false;
   }
 
@@ -797,6 +1082,7 @@ static bool otaCheckNow() {
   }
 
   otaLastCheckMs = millis();
+  elogEvent(EV_OTA_CHECK, 1, otaUpdateAvailable ? 1 : 0, otaLatestTag.c_str());
   return true;
 }
 
@@ -805,11 +1091,24 @@ static bool otaInstallNow() {
     otaStatusLine = "No update available";
     return false;
   }
+  if (fetchReplaying()) {
+    otaStatusLine = "Replay mode: install disabled";
+    return false;
+  }
   if (WiFi.status() != WL_CONNECTED) {
     otaStatusLine = "No Wi-Fi";
     return false;
   }
 
+  StallScope stall("otaInstallNow");
+
+  // every return below is a failed install (success reboots)
+  metrics.otaAttempts.inc();
+  struct OtaFailCount {
+    ~OtaFailCount() { metrics.otaFailures.inc(); elogEvent(EV_OTA_FAIL, 0, 0, otaStatusLine.c_str()); }
+  } otaFail;
+  elogEvent(EV_OTA_START, 0, 0, otaLatestTag.c_str());
+
   WiFiClientSecure client;
   client.setInsecure();
 
@@ -864,6 +1163,8 @@ static bool otaInstallNow() {
 
   http.end();
   otaStatusLine = "Update success, rebooting...";
+  elogEvent(EV_OTA_OK, (int32_t)written, 0, otaLatestTag.c_str());
+  elogFlush();
   delay(600);
   ESP.restart();
   return true;
@@ -886,6 +1187,37 @@ static void handleSaveWiFi() {
   }
 }
 
+// Shared by the web UI and MQTT commands.
+static void setBrightness(int value, bool save) {
+  cfg.brightness = clampInt(value, 3, 100);
+  if (strip && schedule.st.on) {
+    strip->setBrightness((uint8_t)effectiveBrightness());
+    strip->show();
+  }
+  if (save) saveConfig();
+}
+
+// auto/vfr/mvfr/ifr/lifr/cycle; false for anything else
+static bool setDisplayModeByName(const String& v) {
+  if      (v == "auto")  displayMode = MODE_AUTO;
+  else if (v == "vfr")   displayMode = MODE_VFR;
+  else if (v == "mvfr")  displayMode = MODE_MVFR;
+  else if (v == "ifr")   displayMode = MODE_IFR;
+  else if (v == "lifr")  displayMode = MODE_LIFR;
+  else if (v == "cycle") displayMode = MODE_CYCLE;
+  else return false;
+
+  cfg.displayMode = (int)displayMode;
+  saveConfig();
+  applyModeColor();
+  return true;
+}
+
+static const char* displayModeName(DisplayMode m) {
+  static const char* names[] = { "auto", "vfr", "mvfr", "ifr", "lifr", "cycle" };
+  return names[(int)m];
+}
+
 // Brightness with preview flag:
 // - preview=1 : apply only (no flash write)
 // - otherwise : apply + save to /config.json
@@ -895,17 +1227,7 @@ static void handleBrightness() {
     return;
   }
 
-  int b = clampInt(server.arg("value").toInt(), 3, 100);
-
-  cfg.brightness = b;
-  if (strip) {
-    strip->setBrightness((uint8_t)cfg.brightness);
-    strip->show();
-  }
-
-  bool preview = server.hasArg("preview");
-  if (!preview) saveConfig();
-
+  setBrightness(server.arg("value").toInt(), !server.hasArg("preview"));
   server.send(200, "text/plain", "OK");
 }
 
@@ -922,10 +1244,12 @@ static void handleAirport() {
   saveConfig();
 
   restartMDNSForAirport();
+  lastTafFetch = 0;   // new station: its TAF on the next loop pass
 
   // --- FORCE METAR refresh if Wi-Fi is available ---
   if (WiFi.status() == WL_CONNECTED) {
     connected = true;                // ensure flag is correct
+    fetchStationGeo();
     fetchAndDisplayMETAR();
     lastMetarFetch = millis();
   }
@@ -934,31 +1258,32 @@ static void handleAirport() {
 }
 
 
+// Full form post from the schedule card (see scheduleFieldsHtml()); the
+// loop applies the result on its next pass.
 static void handleSched() {
-  if (!(server.hasArg("enabled") && server.hasArg("tz") && server.hasArg("start") && server.hasArg("end"))) {
+  if (!server.hasArg("tz")) {
     server.send(400, "text/plain", "Bad schedule request");
     return;
   }
 
-  cfg.scheduleEnabled = (server.arg("enabled") == "on");
-  cfg.timezonePref    = server.arg("tz");
-
-  String s = server.arg("start"), e = server.arg("end");
-  cfg.startHour   = s.substring(0, 2).toInt();
-  cfg.startMinute = s.substring(3).toInt();
-  cfg.endHour     = e.substring(0, 2).toInt();
-  cfg.endMinute   = e.substring(3).toInt();
+  scheduleFromArgs(server, cfg.sched);
+  cfg.timezonePref = server.arg("tz");
 
   saveConfig();
 
   setenv("TZ", cfg.timezonePref.c_str(), 1);
   tzset();
+  schedule.invalidate();
 
-  if (cfg.scheduleEnabled && connected) {
-    fetchAndDisplayMETAR();
-    lastMetarFetch = millis();
-  }
+  server.send(200, "text/plain", "OK");
+}
 
+// /stale?stale_fade=..&stale_blink=..&stale_missing=.. (minutes, 0 = never)
+static void handleStale() {
+  power.noteUi();
+  staleFromArgs(server, cfg.stale);
+  saveConfig();
+  if (!fpPulseActive) applyModeColor();
   server.send(200, "text/plain", "OK");
 }
 
@@ -968,26 +1293,42 @@ static void handleMode() {
     return;
   }
 
-  String v = server.arg("value");
-  if      (v == "auto")  displayMode = MODE_AUTO;
-  else if (v == "vfr")   displayMode = MODE_VFR;
-  else if (v == "mvfr")  displayMode = MODE_MVFR;
-  else if (v == "ifr")   displayMode = MODE_IFR;
-  else if (v == "lifr")  displayMode = MODE_LIFR;
-  else if (v == "cycle") displayMode = MODE_CYCLE;
-  else {
+  if (!setDisplayModeByName(server.arg("value"))) {
     server.send(400, "text/plain", "Invalid mode");
     return;
   }
-
-  cfg.displayMode = (int)displayMode;
-  saveConfig();
-
-  applyModeColor();
   server.send(200, "text/plain", "OK");
 }
 
 // /flightpulse?enabled=on|off&tail=N247AP&hex=A24A0E
+// /taf                       -> JSON: view + this station's forecast timeline
+// /taf?hours=N               -> show the forecast N hours ahead (0 = current METAR)
+// /taf?animate=1             -> step through the next TAF_ANIM_HOURS hours
+// /taf?enabled=on|off        -> hourly TAF fetch (a forecast view turns it on)
+static void handleTaf() {
+  power.noteUi();
+  bool wantsView = server.hasArg("hours") || server.hasArg("animate");
+  if (wantsView) {
+    bool animate = server.arg("animate") == "1" || server.arg("animate") == "on";
+    tafSetView(server.arg("hours").toInt(), animate);
+  }
+  bool enable = server.hasArg("enabled") ? server.arg("enabled") == "on" : cfg.tafEnabled;
+  if (wantsView && (tafViewHours > 0 || tafAnimate)) enable = true;
+  if (enable != cfg.tafEnabled) {
+    cfg.tafEnabled = enable;
+    saveConfig();
+    lastTafFetch = 0;                 // the loop fetches on its next pass
+  }
+  if (wantsView && !fpPulseActive) applyModeColor();
+
+  String out = String("{\"enabled\":") + (cfg.tafEnabled ? "true" : "false") +
+               ",\"hours\":" + tafViewHours + ",\"animate\":" + (tafAnimate ? "true" : "false") +
+               ",\"shown_hours\":" + tafShownHours() + ",\"station\":\"" + cfg.airport_code + "\"";
+  if (tafStats.fetchedMs) out += ",\"fetched_age_s\":" + String((millis() - tafStats.fetchedMs) / 1000);
+  out += ",\"timeline\":" + (tafStation == cfg.airport_code ? tafTimelineJson(tafLine) : String("[]")) + "}";
+  server.send(200, "application/json", out);
+}
+
 static void handleFlightPulse() {
   if (server.hasArg("enabled")) cfg.fpEnabled = (server.arg("enabled") == "on");
 
@@ -1038,19 +1379,105 @@ static void handleOtaSettings() {
   server.send(200, "text/plain", "OK");
 }
 
+// Prometheus scrape target (no auth, read-only)
+static void handleMetrics() {
+  String& out = responseBuffer(8192);
+  metricsRender(out, "lamp", FW_VERSION);
+
+  static const char* cats[] = { "VFR", "MVFR", "IFR", "LIFR" };
+  metricHeader(out, "metarlw_lamp_flight_category", "Current METAR category (1 = active)", "gauge");
+  for (const char* c : cats) {
+    String lbl = "station=\"" + cfg.airport_code + "\",category=\"" + c + "\"";
+    metricLine(out, "metarlw_lamp_flight_category", lbl.c_str(), flight_category == c ? 1 : 0);
+  }
+  metricGaugeOut(out, "metarlw_lamp_display_mode", "0=auto 1=vfr 2=mvfr 3=ifr 4=lifr 5=cycle", (int)displayMode);
+  metricGaugeOut(out, "metarlw_lamp_brightness", "Configured brightness 3..100", cfg.brightness);
+  metricGaugeOut(out, "metarlw_lamp_schedule_on", "Inside schedule window (1/0)", lastScheduleOn ? 1 : 0);
+  scheduleMetricsOut(out, schedule);
+  powerMetricsOut(out);
+  timeMetricsOut(out);
+  fleetMetricsOut(out);
+  hubMetricsOut(out);
+  mdnsStatusMetricsOut(out);
+  mqttMetricsOut(out);
+  tafMetricsOut(out);
+  staleMetricsOut(out);
+  metricGaugeOut(out, "metarlw_lamp_flight_pulse_flying", "Tracked aircraft airborne (1/0)", fpIsFlying ? 1 : 0);
+  metricGaugeOut(out, "metarlw_lamp_last_fetch_age_seconds", "Seconds since the last METAR fetch", (millis() - lastMetarFetch) / 1000.0);
+  stallMetricsOut(out);
+  memoryMetricsOut(out);
+
+  server.send(200, "text/plain; version=0.0.4", out);
+}
+
+// ================= MQTT =================
+// Commands in, retained state out (Mqtt.h). Each topic keeps the payload
+// last handed to the queue and is re-sent when it changes, when the queue
+// had no room, or after a reconnect. Returns true when a refresh was asked for.
+static bool mqttTick() {
+  bool refresh = false;
+  MqttCommand c;
+  while (mqttPollCommand(c)) {
+    String name = c.name, value = c.value;
+    value.trim();
+    value.toLowerCase();
+    Serial.printf("[MQTT] cmd %s=%s\n", c.name, c.value);
+    if (name == "mode") {
+      if (!setDisplayModeByName(value)) Serial.println("[MQTT] bad mode");
+    } else if (name == "brightness") {
+      setBrightness(value.toInt(), true);
+    } else if (name == "refresh") {
+      refresh = true;
+    }
+  }
+  if (!mqttConnected()) return refresh;
+
+  static uint32_t gen = 0;
+  static String sentState, sentOta, sentCat, sentObs, sentStation;
+  static uint32_t healthMs = 0;
+  if (mqttConnectGen() != gen) {
+    gen = mqttConnectGen();
+    sentState = sentOta = sentCat = sentObs = "";
+    healthMs = 0;
+  }
+
+  String state = String("{\"mode\":\"") + displayModeName(displayMode) + "\",\"brightness\":" + cfg.brightness +
+                 ",\"on\":" + (schedule.st.on ? "true" : "false") + ",\"station\":\"" + cfg.airport_code + "\"}";
+  if (state != sentState && mqttPublish("state", state, true)) sentState = state;
+
+  String ota = mqttOtaJson(FW_VERSION, otaLatestTag, otaUpdateAvailable, otaStatusLine);
+  if (ota != sentOta && mqttPublish("ota", ota, true)) sentOta = ota;
+
+  if (!healthMs || millis() - healthMs >= MQTT_HEALTH_MS) {
+    if (mqttPublish("health", mqttHealthJson("lamp", FW_VERSION), true)) healthMs = millis();
+  }
+
+  if (!lastObs.icao[0]) return refresh;
+  String station = lastObs.icao;
+  String topic = "station/" + station + "/";
+  if (sentStation.length() && sentStation != station) {
+    // airport changed: clear the old retained topics
+    String old = "station/" + sentStation + "/";
+    if (!mqttPublish((old + "category").c_str(), "", true) || !mqttPublish((old + "obs").c_str(), "", true)) return refresh;
+    sentCat = sentObs = "";
+  }
+  sentStation = station;
+
+  String cat = lastObs.cat[0] ? lastObs.cat : "UNKNOWN";
+  if (cat != sentCat && mqttPublish((topic + "category").c_str(), cat, true)) sentCat = cat;
+  String obs = mqttObsJson(lastObs);
+  if (obs != sentObs && mqttPublish((topic + "obs").c_str(), obs, true)) sentObs = obs;
+  return refresh;
+}
+
 // ================= Web UI =================
-static void handleRoot() {
+static const String& buildRootPage() {
   struct tm tmnow;
   char timeBuf[9];
-  if (getLocalTime(&tmnow)) sprintf(timeBuf, "%02d:%02d:%02d", tmnow.tm_hour, tmnow.tm_min, tmnow.tm_sec);
+  time_t nowSecs = time(nullptr);
+  if (timeValid(nowSecs) && localtime_r(&nowSecs, &tmnow)) sprintf(timeBuf, "%02d:%02d:%02d", tmnow.tm_hour, tmnow.tm_min, tmnow.tm_sec);
   else strcpy(timeBuf, "--:--:--");
 
-  String startStr = (cfg.startHour < 10 ? "0" + String(cfg.startHour) : String(cfg.startHour));
-  startStr += ":"; startStr += (cfg.startMinute < 10 ? "0" + String(cfg.startMinute) : String(cfg.startMinute));
-
-  String endStr = (cfg.endHour < 10 ? "0" + String(cfg.endHour) : String(cfg.endHour));
-  endStr += ":"; endStr += (cfg.endMinute < 10 ? "0" + String(cfg.endMinute) : String(cfg.endMinute));
-
   String fpStatus = "Disabled";
   if (cfg.fpEnabled) {
     fpStatus = fpIsFlying ? "Flying: YES" : "Flying: NO";
@@ -1059,8 +1486,7 @@ static void handleRoot() {
 
   String mdnsHost = sanitizeAirportHost(cfg.airport_code);
 
-  String page;
-  page.reserve(24000);
+  String& page = responseBuffer(24000);
 
   page += R"rawliteral(
 <!DOCTYPE html><html><head><meta charset="UTF-8"><title>North METAR Lamp</title>
@@ -1078,6 +1504,8 @@ input,select,button{width:100%;padding:8px;margin-top:5px;border:1px solid #ccc;
 input:checked + .slider{background:#2196F3;}
 input:checked + .slider:before{transform:translateX(22px);}
 table td{padding:4px 8px;vertical-align:top;}
+.sched td,.sched th{padding:2px 4px;}
+.sched input[type=checkbox],label input[type=checkbox]{width:auto;}
 .mode-buttons{display:grid;grid-template-columns:1fr 1fr;gap:6px;margin-top:10px;}
 .mode-buttons button{font-size:0.95rem;}
 .badge{display:inline-block;padding:3px 8px;border-radius:999px;background:#eee;font-size:12px;}
@@ -1100,7 +1528,7 @@ table td{padding:4px 8px;vertical-align:top;}
   page += R"rawliteral(<div class="card"><h3>📡 Current METAR & Time</h3><table>)rawliteral";
   page += "<tr><td>📶 AP SSID:</td><td>" + cfg.device_ssid + "</td></tr>";
   page += "<tr><td>🌐 mDNS:</td><td>http://" + mdnsHost + ".local</td></tr>";
-  page += "<tr><td>⌚ Local Time:</td><td>" + String(timeBuf) + "</td></tr>";
+  page += "<tr><td>⌚ Local Time:</td><td>" + String(timeBuf) + " <span class='badge'>" + timeQualityName(timeQuality()) + "</span></td></tr>";
   page += "<tr><td>📍 Station:</td><td>" + metar_station + "</td></tr>";
   page += "<tr><td>🕒 METAR Time:</td><td>" + metar_time + "</td></tr>";
   page += "<tr><td>🧭 Category:</td><td>" + flight_category + "</td></tr>";
@@ -1159,28 +1587,18 @@ table td{padding:4px 8px;vertical-align:top;}
 </div>)rawliteral";
 
   // Schedule
-  page += R"rawliteral(<div class="card"><h3>⏰ Schedule On/Off</h3>)rawliteral";
-  page += R"rawliteral(<label>Enable Schedule:</label>)rawliteral";
-  page += R"rawliteral(<label class="switch"><input type="checkbox" id="schedToggle" )rawliteral";
-  page += (cfg.scheduleEnabled ? "checked" : "");
-  page += R"rawliteral(><span class="slider"></span></label>)rawliteral";
+  page += R"rawliteral(<div class="card"><h3>⏰ Schedule</h3><form id="schedForm">)rawliteral";
+  page += scheduleFieldsHtml(cfg.sched);
 
   page += R"rawliteral(<label>Time Zone:</label>
-<select id="tzSelect">
+<select id="tzSelect" name="tz">
   <option value="UTC0">UTC</option>
   <option value="EST5EDT">America/New_York</option>
   <option value="CST6CDT">America/Chicago</option>
   <option value="MST7MDT">America/Denver</option>
   <option value="PST8PDT">America/Los_Angeles</option>
-</select>)rawliteral";
-
-  page += R"rawliteral(<label>Start Time:</label><input type="time" id="startTime" value=")rawliteral";
-  page += startStr;
-  page += R"rawliteral(">)rawliteral";
-
-  page += R"rawliteral(<label>End Time:</label><input type="time" id="endTime" value=")rawliteral";
-  page += endStr;
-  page += R"rawliteral(">)rawliteral";
+</select></form>)rawliteral";
+  page += scheduleStatusHtml(cfg.sched, schedule.st);
 
   page += R"rawliteral(<button id="scheduleBtn" type="button">💾 Save Schedule</button></div>)rawliteral";
 
@@ -1200,11 +1618,36 @@ table td{padding:4px 8px;vertical-align:top;}
 </div>
 )rawliteral";
 
+  // Forecast (TAF)
+  page += R"rawliteral(<div class="card"><h3>🔮 Forecast (TAF)</h3>)rawliteral";
+  page += "<p class='small'>" + tafStatusLine() + "</p>";
+  page += R"rawliteral(<label>Show:</label><select id="tafSel">)rawliteral";
+  page += String("<option value='0'") + (!tafAnimate && !tafViewHours ? " selected" : "") + ">Now (METAR)</option>";
+  for (int h = 1; h <= TAF_ANIM_HOURS; h++) {
+    page += "<option value='" + String(h) + "'" + (!tafAnimate && tafViewHours == h ? " selected" : "") + ">+" + String(h) + " h</option>";
+  }
+  page += String("<option value='anim'") + (tafAnimate ? " selected" : "") + ">Animate next " + String(TAF_ANIM_HOURS) + " h</option>";
+  page += R"rawliteral(</select>
+<div class="small">Auto mode only. Choosing a forecast turns the hourly TAF fetch on; hours past the end of the TAF show yellow.</div>
+</div>)rawliteral";
+
+  // METAR age
+  page += R"rawliteral(<div class="card"><h3>⌛ Data Age</h3>)rawliteral";
+  page += "<p class='small'>" + staleStatusLine() + "</p><form id=\"staleForm\">" + staleFieldsHtml(cfg.stale);
+  page += R"rawliteral(</form>
+<div class="small">Counted from the METAR's observation time. Auto mode only; a missing METAR shows yellow.</div>
+<button id="staleBtn" type="button">💾 Save Data Age</button>
+</div>)rawliteral";
+
   // Wi-Fi setup
   page += R"rawliteral(<div class="card"><h3>Wi-Fi Setup</h3><form action="/save" method="POST">
 <label>Select Wi-Fi Network:</label><select name="ssid">)rawliteral";
 
-  int n = WiFi.scanNetworks();
+  int n;
+  {
+    StallScope stall("WiFi.scanNetworks");
+    n = WiFi.scanNetworks();
+  }
   for (int i = 0; i < n; i++) {
     page += "<option value='";
     page += WiFi.SSID(i);
@@ -1302,17 +1745,9 @@ table td{padding:4px 8px;vertical-align:top;}
   page += R"rawliteral(';
 
   document.getElementById('scheduleBtn').onclick = function() {
-    var enabled = document.getElementById('schedToggle').checked ? 'on':'off';
-    var tz      = document.getElementById('tzSelect').value;
-    var start   = document.getElementById('startTime').value;
-    var end     = document.getElementById('endTime').value;
-
-    var url = '/schedule?enabled=' + encodeURIComponent(enabled)
-            + '&tz=' + encodeURIComponent(tz)
-            + '&start=' + encodeURIComponent(start)
-            + '&end=' + encodeURIComponent(end);
-
-    fetch(url).then(function(){ alert('Schedule saved'); });
+    var form = document.getElementById('schedForm');
+    var url = '/schedule?' + new URLSearchParams(new FormData(form)).toString();
+    fetch(url).then(function(){ alert('Schedule saved'); location.reload(); });
   };
 
   // -------- mode buttons --------
@@ -1324,6 +1759,19 @@ table td{padding:4px 8px;vertical-align:top;}
     };
   }
 
+  // -------- forecast --------
+  document.getElementById('tafSel').onchange = function(){
+    var v = this.value;
+    fetch(v === 'anim' ? '/taf?animate=1' : '/taf?hours=' + encodeURIComponent(v))
+      .then(function(){ location.reload(); });
+  };
+
+  // -------- data age --------
+  document.getElementById('staleBtn').onclick = function() {
+    var form = document.getElementById('staleForm');
+    fetch('/stale?' + new URLSearchParams(new FormData(form)).toString()).then(function(){ location.reload(); });
+  };
+
   // -------- flight pulse --------
   var fpTailEl = document.getElementById('fpTail');
   var fpHexEl  = document.getElementById('fpHex');
@@ -1375,7 +1823,94 @@ table td{padding:4px 8px;vertical-align:top;}
 </script>
 </body></html>)rawliteral";
 
-  server.send(200, "text/html", page);
+  return page;
+}
+
+static void handleRoot() {
+  power.noteUi();
+  server.send(200, "text/html", buildRootPage());
+}
+
+// ================= Bench (/admin/bench) =================
+// The Lamp is single-station, so ops run against one AVWX payload: the
+// embedded sample below and, if present, a recorded response uploaded to
+// /bench/avwx.json on LittleFS.
+static const char* BENCH_RECORDED_PATH = "/bench/avwx.json";
+
+static const char BENCH_AVWX_SAMPLE[] PROGMEM =
+  "{\"meta\":{\"timestamp\":\"2026-01-12T19:05:21Z\"},"
+  "\"altimeter\":{\"repr\":\"A3001\",\"value\":30.01,\"spoken\":\"three zero point zero one\"},"
+  "\"clouds\":[{\"repr\":\"FEW050\",\"type\":\"FEW\",\"altitude\":50,\"modifier\":null}],"
+  "\"flight_rules\":\"VFR\",\"other\":[],\"visibility\":{\"repr\":\"10\",\"value\":10,\"spoken\":\"ten\"},"
+  "\"wind_direction\":{\"repr\":\"270\",\"value\":270,\"spoken\":\"two seven zero\"},"
+  "\"wind_gust\":null,\"wind_speed\":{\"repr\":\"09\",\"value\":9,\"spoken\":\"nine\"},"
+  "\"wx_codes\":[],\"raw\":\"KTIX 121853Z 27009KT 10SM FEW050 12/04 A3001\",\"sanitized\":\"KTIX 121853Z 27009KT 10SM FEW050 12/04 A3001\","
+  "\"station\":\"KTIX\",\"time\":{\"repr\":\"121853Z\",\"dt\":\"2026-01-12T18:53:00Z\"},"
+  "\"remarks\":\"\",\"dewpoint\":{\"repr\":\"04\",\"value\":4,\"spoken\":\"four\"},"
+  "\"relative_humidity\":0.58,\"remarks_info\":null,\"runway_visibility\":[],"
+  "\"temperature\":{\"repr\":\"12\",\"value\":12,\"spoken\":\"one two\"},\"wind_variable_direction\":[],\"units\":"
+  "{\"accumulation\":\"in\",\"altimeter\":\"inHg\",\"altitude\":\"ft\",\"temperature\":\"C\",\"visibility\":\"sm\",\"wind_speed\":\"kt\"}}";
+
+static String benchReadFile(const char* path) {
+  String body;
+  if (!LittleFS.begin(true) || !LittleFS.exists(path)) return body;
+  File f = LittleFS.open(path, "r");
+  if (!f) return body;
+  body.reserve(f.size() + 1);
+  while (f.available()) body += (char)f.read();
+  f.close();
+  return body;
+}
+
+static bool benchWants(const String& only, const char* op) {
+  return (only.length() == 0) || only.equalsIgnoreCase(op);
+}
+
+String runBenchSuite(const String& only, bool live) {
+  // parseAndDisplayMETAR() writes the UI globals; keep the live values
+  String sCat = flight_category, sSta = metar_station, sTime = metar_time, sWind = metar_wind,
+         sVis = metar_visibility, sTemp = metar_temp, sDew = metar_dewpoint, sPres = metar_pressure, sGust = metar_gust;
+
+  String res = "[";
+
+  if (benchWants(only, "parseAndDisplayMETAR")) {
+    String sample = String(BENCH_AVWX_SAMPLE);
+    benchRun(res, "parseAndDisplayMETAR", "sample", 5, [&]() { parseAndDisplayMETAR(sample); });
+
+    String recorded = benchReadFile(BENCH_RECORDED_PATH);
+    if (recorded.length()) {
+      benchRun(res, "parseAndDisplayMETAR", "recorded", 5, [&]() { parseAndDisplayMETAR(recorded); });
+    }
+  }
+
+  flight_category = sCat; metar_station = sSta; metar_time = sTime; metar_wind = sWind;
+  metar_visibility = sVis; metar_temp = sTemp; metar_dewpoint = sDew; metar_pressure = sPres; metar_gust = sGust;
+
+  if (benchWants(only, "fpUpdatePulseOverlay")) {
+    bool wasActive = fpPulseActive;
+    if (!wasActive) fpStartPulse();
+    benchRun(res, "fpUpdatePulseOverlay", "pulse", 20, [&]() { fpUpdatePulseOverlay(); });
+    if (!wasActive) fpStopPulseRestore();
+  }
+
+  if (benchWants(only, "handleRoot")) {
+    // includes the blocking WiFi.scanNetworks() the real page does
+    benchRun(res, "handleRoot", "live-config", 2, [&]() { (void)buildRootPage(); });
+  }
+
+  if (live && benchWants(only, "fetchAndDisplayMETAR")) {
+    if (connected && cfg.avwx_token.length()) {
+      benchRun(res, "fetchAndDisplayMETAR", "live", 1, [&]() { fetchAndDisplayMETAR(); });
+      lastMetarFetch = millis();
+    } else {
+      benchAppendSkip(res, "fetchAndDisplayMETAR", "live", "offline");
+    }
+  }
+
+  applyModeColor();
+  res += "]";
+
+  return "{" + benchHeaderJson("lamp", FW_VERSION) + ",\"results\":" + res + "}";
 }
 
 // ================= Web server routes =================
@@ -1388,6 +1923,9 @@ void setupWebServer() {
   server.on("/schedule", HTTP_GET, handleSched);
   server.on("/mode", HTTP_GET, handleMode);
   server.on("/flightpulse", HTTP_GET, handleFlightPulse);
+  server.on("/taf", HTTP_GET, handleTaf);
+  server.on("/stale", HTTP_GET, handleStale);
+  server.on("/metrics", HTTP_GET, handleMetrics);
 
   server.on("/ota/check", HTTP_GET, handleOtaCheck);
   server.on("/ota/install", HTTP_GET, handleOtaInstall);
@@ -1402,6 +1940,10 @@ void setupWebServer() {
 // ================= Arduino setup/loop =================
 void setup() {
   serialAttachSafe();
+
+  // reserve the JSON arena while the heap is still one piece
+  arenaBegin(JSON_ARENA_BYTES, JSON_ARENA_BYTES_PSRAM);
+  heapHistoryBegin();
   Serial.println("[APP] Boot");
   Serial.printf("[APP] FW_VERSION: %s\n", FW_VERSION);
   Serial.printf("[APP] CHIP: %s\n", ESP.getChipModel());          // <-- FIXED (no .c_str())
@@ -1409,6 +1951,9 @@ void setup() {
 
   bool cfgOk = loadConfig();
   Serial.println(cfgOk ? "[APP] Config loaded" : "[APP] Config missing (defaults)");
+  elogBegin("lamp", FW_VERSION);
+
+  fetchSetMode(fetchModeFromString(cfg.fetchMode), cfg.replaySpeed);
 
   // clamp + normalize
   cfg.brightness = clampInt(cfg.brightness, 3, 100);
@@ -1431,19 +1976,24 @@ void setup() {
   displayMode = (DisplayMode)m;
 
   // Wi-Fi AP+STA
+  metricsAttachWiFiEvents();
+  elogAttachWiFiEvents();
   WiFi.mode(WIFI_MODE_APSTA);
 
-  // Always-on SoftAP
+  // Always-on SoftAP (the power manager may drop it while idle)
   startSoftAPAlways();
+  power.restoreAp = startSoftAPAlways;
 
   // STA connect (optional)
   connectToWiFi();
 
-  // NTP/TZ
-  configTime(0, 0, "pool.ntp.org");
+  // NTP/TZ: syncs in the background; the schedule reads "no clock" until then
+  timeSyncBegin(cfg.ntpServers);
   setenv("TZ", cfg.timezonePref.c_str(), 1);
   tzset();
-  waitForTimeSync();
+  fleetBegin(cfg.fleetSync);
+  hubBegin(cfg.hubUse);
+  mqttConfigure(cfg.mqtt, "lamp");
 
   // mDNS
   restartMDNSForAirport();
@@ -1451,11 +2001,18 @@ void setup() {
   // initial METAR
   if (WiFi.status() == WL_CONNECTED) {
     connected = true;
+    fetchStationGeo();
+    schedule.tick(cfg.sched, timeSyncCount());
     fetchAndDisplayMETAR();
     lastMetarFetch = millis();
   } else {
     connected = false;
-    applyModeColor();
+    if (fetchReplaying()) {
+      fetchAndDisplayMETAR();
+      lastMetarFetch = millis();
+    } else {
+      applyModeColor();
+    }
   }
 
   setupWebServer();
@@ -1478,52 +2035,112 @@ void setup() {
 }
 
 void loop() {
-  server.handleClient();
+  uint32_t loopStart = micros();
+  stallLoopBegin();
+  stallHandleClient(server);
+
+  fleetTick();
+
+  // replay (demo) mode needs no network and runs the fetch clock faster
+  bool online = connected || fetchReplaying();
+  unsigned long metarInterval = fetchInterval / fetchClockScale();
+
+  // a hub just showed up: take the next reading from it now
+  static uint32_t hubFoundSeen = 0;
+  hubTick(connected);
+  if (hubClient.found != hubFoundSeen) {
+    hubFoundSeen = hubClient.found;
+    lastMetarFetch = millis() - metarInterval - 1;
+  }
 
-  bool inSchedule = true;
+  // MQTT: commands from the queue, state out (the client runs on its own task)
+  if (mqttTick()) lastMetarFetch = millis() - metarInterval - 1;
 
-  if (cfg.scheduleEnabled) {
-    struct tm tmnow;
-    if (getLocalTime(&tmnow)) {
-      int cur  = tmnow.tm_hour * 60 + tmnow.tm_min;
-      int smin = cfg.startHour * 60 + cfg.startMinute;
-      int emin = cfg.endHour * 60 + cfg.endMinute;
-      inSchedule = (smin <= emin) ? (cur >= smin && cur < emin) : (cur >= smin || cur < emin);
-    }
+  // status TXT for fleet browsing (sent only when a value changes)
+  mdnsStatusSet("cat", flight_category);
+  mdnsStatusTick(lastMetarOkMs);
+
+  // schedule: re-evaluated only at its next transition, after a change, or
+  // when the clock (re)syncs
+  time_t schedDue = schedule.st.nextChange;
+  bool schedChanged = schedule.tick(cfg.sched, timeSyncCount());
+  bool inSchedule = schedule.st.on;
+  if (schedChanged) power.observeEdge(schedDue);
+
+  // nothing to show and no one on the UI: clock, radio (and maybe AP) down
+  bool idle = power.update(cfg.sched.enabled && !inSchedule, cfg.pwrSave, cfg.pwrApOff);
+
+  // station lat/lon for the solar curve (once per airport, retried)
+  if (cfg.sched.solar && connected && cfg.geoIcao != cfg.airport_code &&
+      millis() - geoLastTryMs > geoRetryInterval) {
+    fetchStationGeo();
   }
 
   // schedule / metar refresh
-  if (cfg.scheduleEnabled) {
+  if (cfg.sched.enabled) {
     if (!inSchedule) {
-      clearLED();
+      if (lastScheduleOn || schedChanged) clearLED();
       lastScheduleOn = false;
     } else {
-      if (!lastScheduleOn || (connected && millis() - lastMetarFetch > fetchInterval)) {
+      if (!lastScheduleOn || (online && millis() - lastMetarFetch > metarInterval)) {
         fetchAndDisplayMETAR();
         lastMetarFetch = millis();
       }
       lastScheduleOn = true;
     }
-  } else if (connected && millis() - lastMetarFetch > fetchInterval) {
+  } else if (online && millis() - lastMetarFetch > metarInterval) {
     fetchAndDisplayMETAR();
     lastMetarFetch = millis();
   }
 
+  // TAF for the forecast view: hourly (retried sooner until one arrives)
+  if (cfg.tafEnabled && online && (!cfg.sched.enabled || inSchedule)) {
+    bool current = tafStation == cfg.airport_code;
+    unsigned long due = (current ? tafInterval : tafRetryInterval) / fetchClockScale();
+    if (!lastTafFetch || millis() - lastTafFetch > due) {
+      fetchTaf();
+      lastTafFetch = millis();
+    }
+  }
+
+  // forecast view: repaint when the shown hour moves (animation step, top of the hour)
+  if (inSchedule && displayMode == MODE_AUTO && !fpPulseActive) {
+    uint32_t h = tafShownHours() > 0 ? tafShownHour() : 0;
+    if (h != tafHourSeen) {
+      tafHourSeen = h;
+      applyModeColor();
+    }
+  }
+
+  // METAR age: repaint when the reading passes a step, and on each blink phase
+  {
+    uint8_t lvl = staleLevel(lastObs.obsTime, staleCutoffs(cfg.stale, staleClock()));
+    if (inSchedule && displayMode == MODE_AUTO && !fpPulseActive && tafShownHours() == 0 &&
+        (lvl != staleSeen || (lvl == STALE_BLINK && staleBlinkOn(fleetNowMs()) != staleBlinkSeen))) {
+      applyModeColor();
+    }
+    staleCounts.fading = lvl == STALE_FADE;
+    staleCounts.blinking = lvl == STALE_BLINK;
+    staleCounts.missing = lvl == STALE_MISSING;
+  }
+
+  // solar level moved (dusk/dawn step): repaint at the new brightness
+  if (schedChanged && inSchedule && !fpPulseActive) applyModeColor();
+
   // cycle demo
-  if ((!cfg.scheduleEnabled || inSchedule) && displayMode == MODE_CYCLE) {
-    unsigned long now = millis();
-    if (now - lastCycleSwitch > 3000) {
-      lastCycleSwitch = now;
-      cycleIndex = (cycleIndex + 1) % 4;
+  if (inSchedule && displayMode == MODE_CYCLE) {
+    int idx = (int)((fleetNowMs() / CYCLE_STEP_MS) % 4);
+    if (idx != cycleIndex) {
+      cycleIndex = idx;
       applyModeColor();
     }
   }
 
   // flight pulse runtime
-  if (cfg.fpEnabled && connected && cfg.fpIcao.length() == 6 && (!cfg.scheduleEnabled || inSchedule)) {
+  if (cfg.fpEnabled && online && cfg.fpIcao.length() == 6 && inSchedule) {
     unsigned long now = millis();
 
-    if (now - fpLastCheckMs >= fpCheckIntervalMs) {
+    if (now - fpLastCheckMs >= fpCheckIntervalMs / fetchClockScale()) {
       fpLastCheckMs = now;
 
       bool flyingNow = fpFetchIsFlying_ADSBlol(cfg.fpIcao);
@@ -1546,7 +2163,7 @@ void loop() {
   }
 
   // OTA periodic check in DAYS (only if auto-update enabled)
-  if (connected && cfg.otaAutoUpdate) {
+  if (connected && cfg.otaAutoUpdate && !fetchReplaying()) {
     unsigned long intervalMs = (unsigned long)cfg.otaIntervalDays * 24UL * 60UL * 60UL * 1000UL;
     if (intervalMs < 60000UL) intervalMs = 60000UL;
 
@@ -1563,5 +2180,19 @@ void loop() {
     }
   }
 
-  delay(100);
+  elogFlush();
+  heapHistoryTick();
+  arenaReset();
+  metrics.loopTime.observeUs(micros() - loopStart);
+  stallLoopEnd();
+
+  // idle: wake for the next schedule change (light sleep when nothing to keep up)
+  // animating: land passes on the fleet clock's 100 ms grid so devices
+  // sample the same phase
+  uint32_t nextMs = schedule.msUntilNext();
+  bool animating = fpPulseActive || displayMode == MODE_CYCLE || tafAnimate
+                || (displayMode == MODE_AUTO && staleSeen == STALE_BLINK);
+  uint32_t passMs = animating ? POWER_ACTIVE_PASS_MS - (uint32_t)(fleetNowMs() % POWER_ACTIVE_PASS_MS)
+                              : POWER_ACTIVE_PASS_MS;
+  power.rest(idle ? (nextMs ? nextMs : 1) : 0, WiFi.status() == WL_CONNECTED, cfg.wifi_ssid.length() > 0, passMs);
 }
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP.h>
+#include <ESPmDNS.h>
+#include <mdns.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+
+// ---------- mDNS status TXT ----------
+// The _http._tcp record carries a few status fields so a fleet browser
+// (tools/fleet.py) can list every unit from one mDNS query, before it
+// fetches any /metrics:
+//
+//   fw=1.11.5 chip=ESP32-C3 app=lamp stn=KSEA cat=VFR boot=<epoch> fetch=<epoch>
+//
+// Each key goes out through MDNS.addServiceTxt(), which updates the live
+// service and re-announces it; the responder is never restarted. Keys are
+// only sent when their value changes, and ages are published as epochs
+// (boot, last fetch) so they don't change at all between events. Before
+// the clock is valid, up=/age= seconds are sent instead, at most every
+// MDNS_TXT_AGE_MS; switching between the two sets removes the other one,
+// so a browser never sees a stale age next to the epochs.
+//
+//   mdnsStatusBegin("lamp", FW_VERSION);        // after MDNS.addService("http", ...)
+//   mdnsStatusSet("cat", flight_category);      // whenever
+//   mdnsStatusTick(lastFetchMs);                // from loop()
+
+static const int MDNS_TXT_MAX = 12;
+static const uint32_t MDNS_TXT_AGE_MS = 5UL * 60UL * 1000UL;
+static const uint32_t MDNS_TXT_BOOT_SLACK_S = 60;   // boot epoch re-sent only past this
+
+struct MdnsTxtSlot {
+  const char* key = nullptr;
+  String value;
+};
+
+struct MdnsStatusState {
+  bool up = false;
+  MdnsTxtSlot slots[MDNS_TXT_MAX];
+  int count = 0;
+  uint32_t bootEpoch = 0;
+  uint32_t lastFetchMs = 0;
+  uint32_t lastAgeMs = 0;
+  uint32_t updates = 0;
+};
+
+static MdnsStatusState mdnsStatus;
+
+// Sends key=value unless it is already out there. key must be a literal.
+static void mdnsStatusSet(const char* key, const String& value) {
+  if (!mdnsStatus.up) return;
+  MdnsTxtSlot* slot = nullptr;
+  for (int i = 0; i < mdnsStatus.count; i++) {
+    if (!strcmp(mdnsStatus.slots[i].key, key)) { slot = &mdnsStatus.slots[i]; break; }
+  }
+  if (slot && slot->value == value) return;
+  if (!slot) {
+    if (mdnsStatus.count >= MDNS_TXT_MAX) return;
+    slot = &mdnsStatus.slots[mdnsStatus.count++];
+    slot->key = key;
+  }
+  slot->value = value;
+  MDNS.addServiceTxt("http", "tcp", key, value.c_str());
+  mdnsStatus.updates++;
+}
+
+// Drops key from the record if it was sent. ESPmDNS has no remove call,
+// so this goes to the IDF responder under the same "_http"/"_tcp" names.
+static void mdnsStatusRemove(const char* key) {
+  if (!mdnsStatus.up) return;
+  for (int i = 0; i < mdnsStatus.count; i++) {
+    if (strcmp(mdnsStatus.slots[i].key, key)) continue;
+    mdns_service_txt_item_remove("_http", "_tcp", key);
+    mdnsStatus.slots[i] = mdnsStatus.slots[--mdnsStatus.count];
+    mdnsStatus.slots[mdnsStatus.count] = MdnsTxtSlot();
+    mdnsStatus.updates++;
+    return;
+  }
+}
+
+// After every MDNS.begin() + addService("http"): a new responder starts
+// with no TXT, so everything is sent again.
+static void mdnsStatusBegin(const char* app, const char* fw) {
+  mdnsStatus.up = true;
+  mdnsStatus.count = 0;
+  mdnsStatus.bootEpoch = 0;
+  mdnsStatus.lastFetchMs = 0;
+  mdnsStatus.lastAgeMs = 0;
+  mdnsStatusSet("fw", fw);
+  mdnsStatusSet("chip", ESP.getChipModel());
+  mdnsStatusSet("app", app);
+}
+
+static void mdnsStatusEnd() { mdnsStatus.up = false; }
+
+// lastFetchMs: millis() of the last observation fetch, 0 = none yet.
+static void mdnsStatusTick(uint32_t lastFetchMs) {
+  if (!mdnsStatus.up) return;
+  uint32_t now = millis();
+  uint32_t epoch = timeEpochOrZero();
+
+  if (epoch) {
+    mdnsStatusRemove("up");
+    mdnsStatusRemove("age");
+    uint32_t boot = epoch - now / 1000;
+    uint32_t drift = boot > mdnsStatus.bootEpoch ? boot - mdnsStatus.bootEpoch : mdnsStatus.bootEpoch - boot;
+    if (drift > MDNS_TXT_BOOT_SLACK_S) {
+      mdnsStatus.bootEpoch = boot;
+      mdnsStatusSet("boot", String(boot));
+    }
+    if (lastFetchMs && lastFetchMs != mdnsStatus.lastFetchMs) {
+      mdnsStatus.lastFetchMs = lastFetchMs;
+      mdnsStatusSet("fetch", String(epoch - (now - lastFetchMs) / 1000));
+    }
+    return;
+  }
+
+  if (mdnsStatus.bootEpoch) {                 // clock lost again
+    mdnsStatusRemove("boot");
+    mdnsStatusRemove("fetch");
+    mdnsStatus.bootEpoch = 0;
+    mdnsStatus.lastFetchMs = 0;
+    mdnsStatus.lastAgeMs = 0;
+  }
+  if (mdnsStatus.lastAgeMs && now - mdnsStatus.lastAgeMs < MDNS_TXT_AGE_MS) return;
+  mdnsStatus.lastAgeMs = now;
+  mdnsStatusSet("up", String(now / 1000));
+  if (lastFetchMs) mdnsStatusSet("age", String((now - lastFetchMs) / 1000));
+}
+
+// appended to /metrics by each app
+static void mdnsStatusMetricsOut(String& out) {
+  metricHeader(out, "metarlw_mdns_txt_updates_total", "Status TXT keys sent or removed (changes only)", "counter");
+  metricLine(out, "metarlw_mdns_txt_updates_total", "", mdnsStatus.updates);
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP.h>
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Metrics.h"
+
+// ---------- PSRAM ----------
+// Detected at runtime, so one build serves boards with and without it.
+// Cold, large data (JSON arena, history rings, the station table) goes to
+// PSRAM when present; hot render buffers and the LED driver stay internal.
+// Without PSRAM the cold allocations are ordinary internal-heap ones.
+
+static bool memHasPsram() {
+  return psramFound() && ESP.getPsramSize() > 0;
+}
+
+static void* memAllocCold(size_t n) {
+  if (memHasPsram()) {
+    void* p = heap_caps_malloc(n, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p) return p;
+  }
+  return heap_caps_malloc(n, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+static bool memIsPsram(const void* p) {
+  return p && esp_ptr_external_ram(p);
+}
+
+// ---------- JSON arena ----------
+// One block reserved at boot (before Wi-Fi/TLS carve up the heap) and reused
+// for every large JSON document, so the big parse buffers stop punching
+// holes in the heap every refresh.
+//
+//   ArenaJsonDocument doc(96 * 1024);    // instead of DynamicJsonDocument
+//
+// Allocation is a bump pointer. Documents are scoped, so frees arrive in
+// LIFO order and give their space straight back; anything freed out of
+// order is reclaimed once everything above it is gone. arenaReset() at the
+// end of each loop pass is the safety net. If the arena is missing or full
+// the request falls back to the heap and is counted.
+//
+// Single user: by default whichever task calls first (the loop task). Once
+// arenaSetOwner() names a task, allocations from any other task go to the
+// heap and arenaReset() from them is a no-op. With PSRAM the arena lives
+// there and can be larger.
+
+static const int ARENA_MAX_LIVE = 16;
+
+struct JsonArena {
+  uint8_t* base = nullptr;
+  size_t cap = 0;
+  size_t used = 0;
+  size_t highWater = 0;
+
+  // live allocations, bottom to top
+  size_t liveOff[ARENA_MAX_LIVE];
+  bool   liveFreed[ARENA_MAX_LIVE];
+  int    liveCount = 0;
+
+  uint32_t allocs = 0;
+  uint32_t fallbacks = 0;
+  uint32_t strays = 0;     // still live at arenaReset()
+  uint32_t foreign = 0;    // requests from a task that doesn't own it
+
+  TaskHandle_t owner = nullptr;   // nullptr: any (single-task sketches)
+};
+
+static JsonArena jsonArena;
+
+static bool arenaBegin(size_t internalCap, size_t psramCap) {
+  if (jsonArena.base) return true;
+  size_t cap = memHasPsram() ? psramCap : internalCap;
+  jsonArena.base = (uint8_t*)memAllocCold(cap);
+  if (!jsonArena.base) {
+    Serial.printf("[MEM] arena %u bytes: allocation failed, using heap\n", (unsigned)cap);
+    return false;
+  }
+  jsonArena.cap = cap;
+  Serial.printf("[MEM] arena %u bytes reserved (%s)\n", (unsigned)cap, memIsPsram(jsonArena.base) ? "psram" : "internal");
+  return true;
+}
+
+static inline void arenaSetOwner(TaskHandle_t t) { jsonArena.owner = t; }
+
+static bool arenaUsableHere() {
+  return !jsonArena.owner || jsonArena.owner == xTaskGetCurrentTaskHandle();
+}
+
+static bool arenaOwns(const void* p) {
+  const uint8_t* b = (const uint8_t*)p;
+  return jsonArena.base && b >= jsonArena.base && b < jsonArena.base + jsonArena.cap;
+}
+
+static void* arenaAlloc(size_t n) {
+  JsonArena& a = jsonArena;
+  n = (n + 7) & ~(size_t)7;
+  if (!arenaUsableHere()) {
+    a.foreign++;
+    return malloc(n);
+  }
+  if (a.base && a.liveCount < ARENA_MAX_LIVE && a.used + n <= a.cap) {
+    void* p = a.base + a.used;
+    a.liveOff[a.liveCount] = a.used;
+    a.liveFreed[a.liveCount] = false;
+    a.liveCount++;
+    a.used += n;
+    if (a.used > a.highWater) a.highWater = a.used;
+    a.allocs++;
+    return p;
+  }
+  a.fallbacks++;
+  return malloc(n);
+}
+
+static void arenaFree(void* p) {
+  if (!p) return;
+  if (!arenaOwns(p)) { free(p); return; }
+
+  JsonArena& a = jsonArena;
+  size_t off = (uint8_t*)p - a.base;
+  for (int i = a.liveCount - 1; i >= 0; i--) {
+    if (a.liveOff[i] == off) { a.liveFreed[i] = true; break; }
+  }
+  while (a.liveCount > 0 && a.liveFreed[a.liveCount - 1]) {
+    a.liveCount--;
+    a.used = a.liveOff[a.liveCount];
+  }
+}
+
+static void* arenaRealloc(void* p, size_t n) {
+  if (!p) return arenaAlloc(n);
+  if (!arenaOwns(p)) return realloc(p, n);
+
+  JsonArena& a = jsonArena;
+  n = (n + 7) & ~(size_t)7;
+  size_t off = (uint8_t*)p - a.base;
+
+  // top of the stack resizes in place (shrinkToFit lands here)
+  if (a.liveCount && a.liveOff[a.liveCount - 1] == off && off + n <= a.cap) {
+    a.used = off + n;
+    if (a.used > a.highWater) a.highWater = a.used;
+    return p;
+  }
+
+  // below the top a block ends where the next one starts
+  int i = a.liveCount - 1;
+  while (i >= 0 && a.liveOff[i] != off) i--;
+  if (i < 0) return nullptr;                 // not a live block
+  size_t oldSize = (i + 1 < a.liveCount ? a.liveOff[i + 1] : a.used) - off;
+  if (n <= oldSize) return p;                // shrink: the slack goes with it
+  void* q = arenaAlloc(n);
+  if (!q) return nullptr;                    // p stays valid, as with realloc()
+  memcpy(q, p, oldSize);
+  arenaFree(p);
+  return q;
+}
+
+// End of a loop pass / refresh / request: nothing should still be live.
+static void arenaReset() {
+  if (!arenaUsableHere()) return;
+  if (jsonArena.liveCount) jsonArena.strays += jsonArena.liveCount;
+  jsonArena.liveCount = 0;
+  jsonArena.used = 0;
+}
+
+struct ArenaAllocator {
+  void* allocate(size_t n) { return arenaAlloc(n); }
+  void deallocate(void* p) { arenaFree(p); }
+  void* reallocate(void* p, size_t n) { return arenaRealloc(p, n); }
+};
+
+typedef BasicJsonDocument<ArenaAllocator> ArenaJsonDocument;
+
+// ---------- Response buffer ----------
+// Large text responses (root page, /metrics) are built into one String whose
+// capacity is kept between requests. Valid until the next call.
+static String& responseBuffer(size_t reserve) {
+  static String buf;
+  buf = "";
+  buf.reserve(reserve);
+  return buf;
+}
+
+// ---------- Heap fragmentation history ----------
+// Internal heap, sampled once a minute: a 1-hour ring of minute samples and a
+// ring of 30-minute samples (24 h, or 7 days with PSRAM).
+// fragmentation = 1 - largest_free_block / free.
+
+struct HeapSample {
+  uint32_t uptimeS;
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+  uint32_t minFree;
+  uint8_t  fragPct;
+};
+
+static const int HEAP_SHORT_N = 60;
+static const int HEAP_LONG_N = 48;          // 24 h
+static const int HEAP_LONG_N_PSRAM = 336;   // 7 days
+static const uint32_t HEAP_SAMPLE_MS = 60UL * 1000UL;
+static const int HEAP_LONG_EVERY = 30;   // short samples per long sample
+
+struct HeapHistory {
+  HeapSample shortRing[HEAP_SHORT_N];
+  int shortHead = 0, shortCount = 0;
+  HeapSample* longRing = nullptr;
+  int longN = 0;
+  int longHead = 0, longCount = 0;
+  uint32_t samples = 0;
+  uint32_t lastSampleMs = 0;
+  uint32_t largestMin = 0xFFFFFFFFu;    // worst largest-free-block since boot
+  uint8_t  fragMax = 0;
+};
+
+static HeapHistory heapHistory;
+static HeapSample heapLongInternal[HEAP_LONG_N];
+
+static void heapHistoryBegin() {
+  HeapHistory& h = heapHistory;
+  if (h.longRing) return;
+  if (memHasPsram()) {
+    h.longRing = (HeapSample*)memAllocCold(sizeof(HeapSample) * HEAP_LONG_N_PSRAM);
+    if (h.longRing) { h.longN = HEAP_LONG_N_PSRAM; return; }
+  }
+  h.longRing = heapLongInternal;
+  h.longN = HEAP_LONG_N;
+}
+
+static HeapSample heapSampleNow() {
+  HeapSample s;
+  s.uptimeS = millis() / 1000;
+  s.freeBytes = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  s.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  s.minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  s.fragPct = s.freeBytes ? (uint8_t)(100 - (uint64_t)s.largestBlock * 100 / s.freeBytes) : 0;
+  return s;
+}
+
+// Call from loop(); takes a sample when one is due.
+static void heapHistoryTick() {
+  HeapHistory& h = heapHistory;
+  if (!h.longRing) heapHistoryBegin();
+  if (h.samples && millis() - h.lastSampleMs < HEAP_SAMPLE_MS) return;
+  h.lastSampleMs = millis();
+
+  HeapSample s = heapSampleNow();
+  if (s.largestBlock < h.largestMin) h.largestMin = s.largestBlock;
+  if (s.fragPct > h.fragMax) h.fragMax = s.fragPct;
+
+  h.shortRing[h.shortHead] = s;
+  h.shortHead = (h.shortHead + 1) % HEAP_SHORT_N;
+  if (h.shortCount < HEAP_SHORT_N) h.shortCount++;
+
+  if (h.samples % HEAP_LONG_EVERY == 0) {
+    h.longRing[h.longHead] = s;
+    h.longHead = (h.longHead + 1) % h.longN;
+    if (h.longCount < h.longN) h.longCount++;
+  }
+  h.samples++;
+}
+
+static void heapRingJson(String& out, const HeapSample* ring, int head, int count, int n) {
+  out += "[";
+  for (int i = 0; i < count; i++) {
+    const HeapSample& s = ring[(head - count + i + n) % n];   // oldest first
+    if (i) out += ",";
+    out += "[" + String(s.uptimeS) + "," + String(s.freeBytes) + "," + String(s.largestBlock)
+         + "," + String(s.minFree) + "," + String(s.fragPct) + "]";
+  }
+  out += "]";
+}
+
+// /admin/heap: rows are [uptime_s, free, largest_block, min_free, frag_pct]
+static String memoryJson() {
+  HeapSample now = heapSampleNow();
+  const HeapHistory& h = heapHistory;
+  String out;
+  out.reserve(512 + 40 * (h.shortCount + h.longCount));
+  out += "{\"now\":[" + String(now.uptimeS) + "," + String(now.freeBytes) + "," + String(now.largestBlock)
+       + "," + String(now.minFree) + "," + String(now.fragPct) + "]";
+  out += ",\"largest_min\":" + String(h.largestMin == 0xFFFFFFFFu ? now.largestBlock : h.largestMin);
+  out += ",\"frag_max\":" + String(h.fragMax);
+  out += ",\"psram\":{\"size\":" + String((unsigned)ESP.getPsramSize()) + ",\"free\":" + String((unsigned)ESP.getFreePsram()) + "}";
+  out += ",\"arena\":{\"psram\":" + String(memIsPsram(jsonArena.base) ? "true" : "false") + ",\"cap\":" + String((unsigned)jsonArena.cap) + ",\"high_water\":" + String((unsigned)jsonArena.highWater)
+       + ",\"allocs\":" + String(jsonArena.allocs) + ",\"fallbacks\":" + String(jsonArena.fallbacks)
+       + ",\"strays\":" + String(jsonArena.strays) + ",\"foreign\":" + String(jsonArena.foreign) + "}";
+  out += ",\"minute\":";
+  heapRingJson(out, h.shortRing, h.shortHead, h.shortCount, HEAP_SHORT_N);
+  out += ",\"half_hour\":";
+  heapRingJson(out, h.longRing, h.longHead, h.longCount, h.longN);
+  out += "}";
+  return out;
+}
+
+// appended to /metrics by each app
+static void memoryMetricsOut(String& out) {
+  HeapSample now = heapSampleNow();
+  const HeapHistory& h = heapHistory;
+  metricGaugeOut(out, "metarlw_heap_fragmentation_ratio", "1 - largest_free_block / free", now.fragPct / 100.0);
+  metricGaugeOut(out, "metarlw_heap_largest_free_block_min_bytes", "Smallest largest-free-block seen by the minute sampler",
+                 (double)(h.largestMin == 0xFFFFFFFFu ? now.largestBlock : h.largestMin));
+  if (memHasPsram()) {
+    metricGaugeOut(out, "metarlw_psram_size_bytes", "PSRAM size", (double)ESP.getPsramSize());
+    metricGaugeOut(out, "metarlw_psram_free_bytes", "Free PSRAM", (double)ESP.getFreePsram());
+  }
+  metricGaugeOut(out, "metarlw_json_arena_capacity_bytes", "Reserved JSON arena", (double)jsonArena.cap);
+  metricGaugeOut(out, "metarlw_json_arena_high_water_bytes", "Most of the arena ever in use", (double)jsonArena.highWater);
+  metricHeader(out, "metarlw_json_arena_fallbacks_total", "JSON documents that had to use the heap", "counter");
+  metricLine(out, "metarlw_json_arena_fallbacks_total", "", jsonArena.fallbacks);
+}
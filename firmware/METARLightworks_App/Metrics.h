@@ -0,0 +1,210 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+#include <atomic>
+
+// ---------- Metrics registry (/metrics, Prometheus text format) ----------
+// Lock-free: every value is a 32-bit std::atomic, so the loop, the Wi-Fi
+// event task and (on dual-core boards) worker tasks can record without a
+// mutex. Histograms use fixed buckets; their _sum is kept in microseconds
+// with a wrap counter so it never goes backwards.
+//
+// Provider index matches FetchProvider in Fetch.h (awc, avwx, adsb, github).
+
+static const int METRIC_PROVIDERS = 5;
+static const char* const METRIC_PROVIDER_NAMES[METRIC_PROVIDERS] = { "awc", "avwx", "adsb", "github", "hub" };
+
+struct MetricCounter {
+  std::atomic<uint32_t> v{0};
+  void inc(uint32_t n = 1) { v.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t get() const { return v.load(std::memory_order_relaxed); }
+};
+
+struct MetricGauge {
+  std::atomic<int32_t> v{0};
+  void set(int32_t x) { v.store(x, std::memory_order_relaxed); }
+  int32_t get() const { return v.load(std::memory_order_relaxed); }
+};
+
+// upper bounds in microseconds (1ms .. 10s) + implicit +Inf
+static const int METRIC_BUCKETS = 12;
+static const uint32_t METRIC_BUCKET_US[METRIC_BUCKETS] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+struct MetricHistogram {
+  std::atomic<uint32_t> buckets[METRIC_BUCKETS + 1];
+  std::atomic<uint32_t> count{0};
+  std::atomic<uint32_t> sumUs{0};
+  std::atomic<uint32_t> sumWraps{0};
+
+  MetricHistogram() { for (auto& b : buckets) b.store(0); }
+
+  void observeUs(uint32_t us) {
+    int i = 0;
+    while (i < METRIC_BUCKETS && us > METRIC_BUCKET_US[i]) i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    uint32_t prev = sumUs.fetch_add(us, std::memory_order_relaxed);
+    if ((uint32_t)(prev + us) < prev) sumWraps.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+// Times a scope into a histogram: { MetricTimer t(metrics.renderTime); ... }
+struct MetricTimer {
+  MetricHistogram& h;
+  uint32_t start;
+  explicit MetricTimer(MetricHistogram& hist) : h(hist), start(micros()) {}
+  ~MetricTimer() { h.observeUs(micros() - start); }
+};
+
+struct Metrics {
+  MetricCounter   fetchOk[METRIC_PROVIDERS];
+  MetricCounter   fetchErr[METRIC_PROVIDERS];
+  MetricCounter   fetchBytes[METRIC_PROVIDERS];       // inflated body
+  MetricCounter   fetchWireBytes[METRIC_PROVIDERS];   // as received (gzip or not)
+  MetricCounter   fetchGzip[METRIC_PROVIDERS];        // responses that came gzipped
+  MetricHistogram fetchLatency[METRIC_PROVIDERS];
+  MetricHistogram parseTime[METRIC_PROVIDERS];
+
+  MetricHistogram renderTime;     // building the frame
+  MetricHistogram showTime;       // pushing it to the LEDs
+  MetricHistogram loopTime;       // one loop() pass, excluding its trailing delay
+
+  MetricCounter   wifiConnects;
+  MetricCounter   wifiDisconnects;
+  MetricCounter   flashWrites;
+  MetricCounter   otaChecks;
+  MetricCounter   otaAttempts;
+  MetricCounter   otaFailures;
+};
+
+static Metrics metrics;
+
+// ---------- Prometheus text rendering ----------
+static void metricHeader(String& out, const char* name, const char* help, const char* type) {
+  out += "# HELP "; out += name; out += " "; out += help; out += "\n";
+  out += "# TYPE "; out += name; out += " "; out += type; out += "\n";
+}
+
+static void metricLine(String& out, const char* name, const char* labels, double v) {
+  char buf[160];
+  if (labels && labels[0]) snprintf(buf, sizeof(buf), "%s{%s} %.6g\n", name, labels, v);
+  else                     snprintf(buf, sizeof(buf), "%s %.6g\n", name, v);
+  out += buf;
+}
+
+static void metricGaugeOut(String& out, const char* name, const char* help, double v) {
+  metricHeader(out, name, help, "gauge");
+  metricLine(out, name, "", v);
+}
+
+static void metricCounterOut(String& out, const char* name, const char* help, const MetricCounter& c) {
+  metricHeader(out, name, help, "counter");
+  metricLine(out, name, "", c.get());
+}
+
+static void metricHistogramLines(String& out, const char* name, const char* labels, const MetricHistogram& h) {
+  char lbl[96];
+  char series[96];
+  uint32_t cum = 0;
+
+  snprintf(series, sizeof(series), "%s_bucket", name);
+  for (int i = 0; i <= METRIC_BUCKETS; i++) {
+    cum += h.buckets[i].load(std::memory_order_relaxed);
+    if (i < METRIC_BUCKETS) {
+      snprintf(lbl, sizeof(lbl), "%s%sle=\"%g\"", labels, labels[0] ? "," : "", METRIC_BUCKET_US[i] / 1e6);
+    } else {
+      snprintf(lbl, sizeof(lbl), "%s%sle=\"+Inf\"", labels, labels[0] ? "," : "");
+    }
+    metricLine(out, series, lbl, cum);
+  }
+
+  double sumS = (h.sumWraps.load() * 4294967296.0 + h.sumUs.load()) / 1e6;
+  snprintf(series, sizeof(series), "%s_sum", name);
+  metricLine(out, series, labels, sumS);
+  snprintf(series, sizeof(series), "%s_count", name);
+  metricLine(out, series, labels, h.count.load());
+}
+
+static void metricHistogramOut(String& out, const char* name, const char* help, const MetricHistogram& h) {
+  metricHeader(out, name, help, "histogram");
+  metricHistogramLines(out, name, "", h);
+}
+
+static void metricProviderHistogramOut(String& out, const char* name, const char* help, const MetricHistogram* hs) {
+  metricHeader(out, name, help, "histogram");
+  char lbl[32];
+  for (int p = 0; p < METRIC_PROVIDERS; p++) {
+    if (hs[p].count.load() == 0) continue;
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\"", METRIC_PROVIDER_NAMES[p]);
+    metricHistogramLines(out, name, lbl, hs[p]);
+  }
+}
+
+// Common metrics for both apps; the app appends its own gauges afterwards.
+static void metricsRender(String& out, const char* app, const char* fw) {
+  char lbl[128];
+
+  metricHeader(out, "metarlw_build_info", "Firmware build and chip", "gauge");
+  snprintf(lbl, sizeof(lbl), "app=\"%s\",fw=\"%s\",chip=\"%s\"", app, fw, ESP.getChipModel());
+  metricLine(out, "metarlw_build_info", lbl, 1);
+
+  metricGaugeOut(out, "metarlw_uptime_seconds", "Seconds since boot", millis() / 1000.0);
+  metricGaugeOut(out, "metarlw_heap_free_bytes", "Free internal heap", (double)heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  metricGaugeOut(out, "metarlw_heap_largest_free_block_bytes", "Largest allocatable internal block", (double)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  metricGaugeOut(out, "metarlw_heap_min_free_bytes", "Lowest free internal heap since boot", (double)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+
+  bool sta = (WiFi.status() == WL_CONNECTED);
+  metricGaugeOut(out, "metarlw_wifi_connected", "STA link up (1/0)", sta ? 1 : 0);
+  if (sta) metricGaugeOut(out, "metarlw_wifi_rssi_dbm", "STA signal strength", WiFi.RSSI());
+  metricCounterOut(out, "metarlw_wifi_connects_total", "STA got-IP events", metrics.wifiConnects);
+  metricCounterOut(out, "metarlw_wifi_disconnects_total", "STA disconnect events", metrics.wifiDisconnects);
+
+  metricHeader(out, "metarlw_fetch_requests_total", "Provider GETs by result", "counter");
+  for (int p = 0; p < METRIC_PROVIDERS; p++) {
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\",result=\"ok\"", METRIC_PROVIDER_NAMES[p]);
+    metricLine(out, "metarlw_fetch_requests_total", lbl, metrics.fetchOk[p].get());
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\",result=\"error\"", METRIC_PROVIDER_NAMES[p]);
+    metricLine(out, "metarlw_fetch_requests_total", lbl, metrics.fetchErr[p].get());
+  }
+
+  metricHeader(out, "metarlw_fetch_bytes_total", "Response body bytes received (after gzip inflate)", "counter");
+  for (int p = 0; p < METRIC_PROVIDERS; p++) {
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\"", METRIC_PROVIDER_NAMES[p]);
+    metricLine(out, "metarlw_fetch_bytes_total", lbl, metrics.fetchBytes[p].get());
+  }
+  metricHeader(out, "metarlw_fetch_wire_bytes_total", "Response body bytes on the wire (compressed when gzip)", "counter");
+  for (int p = 0; p < METRIC_PROVIDERS; p++) {
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\"", METRIC_PROVIDER_NAMES[p]);
+    metricLine(out, "metarlw_fetch_wire_bytes_total", lbl, metrics.fetchWireBytes[p].get());
+  }
+  metricHeader(out, "metarlw_fetch_gzip_responses_total", "Responses received gzipped and inflated", "counter");
+  for (int p = 0; p < METRIC_PROVIDERS; p++) {
+    snprintf(lbl, sizeof(lbl), "provider=\"%s\"", METRIC_PROVIDER_NAMES[p]);
+    metricLine(out, "metarlw_fetch_gzip_responses_total", lbl, metrics.fetchGzip[p].get());
+  }
+
+  metricProviderHistogramOut(out, "metarlw_fetch_duration_seconds", "Provider GET latency", metrics.fetchLatency);
+  metricProviderHistogramOut(out, "metarlw_parse_duration_seconds", "Response parse time", metrics.parseTime);
+
+  metricHistogramOut(out, "metarlw_render_duration_seconds", "Frame build time", metrics.renderTime);
+  metricHistogramOut(out, "metarlw_show_duration_seconds", "LED strip show() time", metrics.showTime);
+  metricHistogramOut(out, "metarlw_loop_duration_seconds", "loop() pass time excluding idle delay", metrics.loopTime);
+
+  metricCounterOut(out, "metarlw_flash_writes_total", "LittleFS file writes", metrics.flashWrites);
+  metricCounterOut(out, "metarlw_ota_checks_total", "OTA release checks", metrics.otaChecks);
+  metricCounterOut(out, "metarlw_ota_attempts_total", "OTA install attempts", metrics.otaAttempts);
+  metricCounterOut(out, "metarlw_ota_failures_total", "OTA install failures", metrics.otaFailures);
+}
+
+// Wi-Fi event hook; call once from setup().
+static void metricsAttachWiFiEvents() {
+  WiFi.onEvent([](arduino_event_id_t event, arduino_event_info_t info) {
+    (void)info;
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) metrics.wifiConnects.inc();
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) metrics.wifiDisconnects.inc();
+  });
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+#include "Hub.h"
+
+// ---------- MQTT (optional) ----------
+// For building automation: state goes out as retained topics, commands
+// come in, nobody scrapes HTML. The client lives on its own task; connect
+// attempts (which block in lwIP for seconds when the broker is down),
+// reconnect backoff and PubSubClient::loop() all run there, so a dead
+// broker stalls nothing but that task. The app side only touches two
+// bounded queues and never waits on either:
+//
+//   mqttPublish("station/KSEA/category", "VFR", true);  // false: full or offline, retry later
+//   MqttCommand c;
+//   while (mqttPollCommand(c)) apply(c);               // from loop()
+//
+// Topics, under <base> (default metarlw/<app>-<last 3 MAC bytes>, which
+// survives airport and hostname changes):
+//   status                   online / offline (retained; offline is the last will)
+//   health                   JSON, retained, every MQTT_HEALTH_MS
+//   ota                      JSON, retained, on change
+//   state                    JSON, retained, on change (app specific)
+//   station/<ICAO>/category  VFR / MVFR / IFR / LIFR / UNKNOWN, retained
+//   station/<ICAO>/obs       JSON observation, retained
+//   cmd/<name>               in: mode, brightness, refresh
+//
+// Nothing is queued while disconnected. Apps keep "last sent" markers and
+// reset them when mqttConnectGen() moves, so all retained state goes out
+// again after every (re)connect.
+
+static const int MQTT_OUT_LEN = 16;
+static const int MQTT_IN_LEN = 4;
+static const size_t MQTT_TOPIC_MAX = 48;      // relative to base
+static const size_t MQTT_BASE_MAX = 48;
+static const size_t MQTT_PAYLOAD_MAX = 256;
+static const uint32_t MQTT_BACKOFF_MIN_MS = 2000;
+static const uint32_t MQTT_BACKOFF_MAX_MS = 5UL * 60UL * 1000UL;
+static const uint32_t MQTT_HEALTH_MS = 60UL * 1000UL;
+static const uint32_t MQTT_TASK_STACK = 4 * 1024;
+static const int MQTT_DRAIN_PER_PASS = 8;
+
+struct MqttSettings {
+  bool enabled = false;
+  String host = "";
+  uint16_t port = 1883;
+  String user = "";
+  String pass = "";
+  String base = "";        // "" = metarlw/<app>-<mac>
+};
+
+struct MqttOut {
+  char topic[MQTT_TOPIC_MAX];
+  char payload[MQTT_PAYLOAD_MAX];
+  bool retain;
+};
+
+struct MqttCommand {
+  char name[24];
+  char value[40];
+};
+
+struct MqttState {
+  // handed to the task under cfgLock; the task copies it when cfgGen moves
+  SemaphoreHandle_t cfgLock = nullptr;
+  MqttSettings pending;
+  String defaultBase;
+  volatile uint32_t cfgGen = 0;
+
+  QueueHandle_t out = nullptr;
+  QueueHandle_t in = nullptr;
+  TaskHandle_t task = nullptr;
+  char cmdPrefix[MQTT_BASE_MAX + 8] = { 0 };   // "<base>/cmd/", for the callback
+
+  volatile bool connected = false;
+  volatile uint32_t connectGen = 0;
+  volatile int lastError = 0;                   // PubSubClient state() after a failed connect
+
+  uint32_t published = 0;
+  uint32_t dropped = 0;
+  uint32_t connects = 0;
+  uint32_t connectFails = 0;
+  uint32_t commands = 0;
+};
+
+static MqttState mqttState;
+
+static bool mqttConnected() { return mqttState.connected; }
+static uint32_t mqttConnectGen() { return mqttState.connectGen; }
+static int mqttSpace() { return mqttState.out ? (int)uxQueueSpacesAvailable(mqttState.out) : 0; }
+
+// Never blocks. False when offline, full, or too long (counted as dropped).
+static bool mqttPublish(const char* topic, const String& payload, bool retain) {
+  if (!mqttState.out || !mqttState.connected) return false;
+  if (strlen(topic) >= MQTT_TOPIC_MAX || payload.length() >= MQTT_PAYLOAD_MAX) {
+    mqttState.dropped++;
+    return false;
+  }
+  MqttOut m;
+  strcpy(m.topic, topic);
+  strcpy(m.payload, payload.c_str());
+  m.retain = retain;
+  if (xQueueSend(mqttState.out, &m, 0) != pdTRUE) {
+    mqttState.dropped++;
+    return false;
+  }
+  return true;
+}
+
+static bool mqttPollCommand(MqttCommand& c) {
+  return mqttState.in && xQueueReceive(mqttState.in, &c, 0) == pdTRUE;
+}
+
+// PubSubClient callback (MQTT task)
+static void mqttOnMessage(char* topic, uint8_t* payload, unsigned int len) {
+  size_t plen = strlen(mqttState.cmdPrefix);
+  if (strncmp(topic, mqttState.cmdPrefix, plen) != 0) return;
+  MqttCommand c;
+  strncpy(c.name, topic + plen, sizeof(c.name) - 1);
+  c.name[sizeof(c.name) - 1] = 0;
+  size_t n = min((size_t)len, sizeof(c.value) - 1);
+  memcpy(c.value, payload, n);
+  c.value[n] = 0;
+  if (xQueueSend(mqttState.in, &c, 0) == pdTRUE) mqttState.commands++;
+}
+
+static void mqttTaskMain(void*) {
+  MqttState& s = mqttState;
+  WiFiClient net;
+  PubSubClient client(net);
+  client.setBufferSize(MQTT_BASE_MAX + MQTT_TOPIC_MAX + MQTT_PAYLOAD_MAX + 16);
+  client.setSocketTimeout(5);
+  client.setCallback(mqttOnMessage);
+
+  MqttSettings cfg;           // task-local copy; setServer() keeps the host pointer
+  String base;
+  uint32_t seenGen = 0;
+  uint32_t backoff = MQTT_BACKOFF_MIN_MS;
+  uint32_t nextTryMs = 0;
+
+  // a clean DISCONNECT suppresses the will, so say offline first
+  auto hangUp = [&]() {
+    if (client.connected()) {
+      client.publish((base + "/status").c_str(), "offline", true);
+      client.disconnect();
+    }
+    s.connected = false;
+  };
+
+  for (;;) {
+    if (s.cfgGen != seenGen) {
+      hangUp();
+      xSemaphoreTake(s.cfgLock, portMAX_DELAY);
+      seenGen = s.cfgGen;
+      cfg = s.pending;
+      base = cfg.base.length() ? cfg.base : s.defaultBase;
+      xSemaphoreGive(s.cfgLock);
+      if (base.length() >= MQTT_BASE_MAX) base = base.substring(0, MQTT_BASE_MAX - 1);
+      snprintf(s.cmdPrefix, sizeof(s.cmdPrefix), "%s/cmd/", base.c_str());
+      backoff = MQTT_BACKOFF_MIN_MS;
+      nextTryMs = millis();
+    }
+
+    if (!cfg.enabled || !cfg.host.length() || WiFi.status() != WL_CONNECTED) {
+      hangUp();
+      vTaskDelay(pdMS_TO_TICKS(500));
+      continue;
+    }
+
+    if (!client.connected()) {
+      if (s.connected) {
+        s.connected = false;
+        Serial.println("[MQTT] connection lost");
+      }
+      if ((int32_t)(millis() - nextTryMs) < 0) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        continue;
+      }
+
+      String will = base + "/status";
+      String id = base;
+      id.replace('/', '-');
+      client.setServer(cfg.host.c_str(), cfg.port);
+      bool ok = client.connect(id.c_str(),
+                               cfg.user.length() ? cfg.user.c_str() : nullptr,
+                               cfg.user.length() ? cfg.pass.c_str() : nullptr,
+                               will.c_str(), 1, true, "offline");
+      if (!ok) {
+        s.connectFails++;
+        s.lastError = client.state();
+        nextTryMs = millis() + backoff + (uint32_t)random(0, backoff / 4 + 1);
+        Serial.printf("[MQTT] connect to %s:%u failed (%d), retry in %lu s\n",
+                      cfg.host.c_str(), cfg.port, s.lastError, (unsigned long)(backoff / 1000));
+        backoff = min(backoff * 2, MQTT_BACKOFF_MAX_MS);
+        continue;
+      }
+
+      backoff = MQTT_BACKOFF_MIN_MS;
+      s.lastError = 0;
+      client.publish(will.c_str(), "online", true);
+      client.subscribe((base + "/cmd/#").c_str());
+      s.connects++;
+      s.connectGen++;
+      s.connected = true;
+      Serial.printf("[MQTT] connected to %s:%u as %s\n", cfg.host.c_str(), cfg.port, base.c_str());
+    }
+
+    client.loop();
+
+    MqttOut m;
+    int n = 0;
+    while (n < MQTT_DRAIN_PER_PASS && xQueueReceive(s.out, &m, 0) == pdTRUE) {
+      String t = base + "/" + m.topic;
+      if (client.publish(t.c_str(), m.payload, m.retain)) s.published++;
+      else s.dropped++;
+      n++;
+    }
+    vTaskDelay(pdMS_TO_TICKS(n ? 1 : 20));
+  }
+}
+
+static String mqttDefaultBase(const char* app) {
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "metarlw/%s-%02x%02x%02x", app, mac[3], mac[4], mac[5]);
+  return buf;
+}
+
+// Boot and after a settings change. The task and queues are created the
+// first time MQTT is enabled and kept after that (disabled = idle task).
+static void mqttConfigure(const MqttSettings& settings, const char* app) {
+  MqttState& s = mqttState;
+  if (!settings.enabled && !s.task) return;
+
+  if (!s.task) {
+    s.cfgLock = xSemaphoreCreateMutex();
+    s.out = xQueueCreate(MQTT_OUT_LEN, sizeof(MqttOut));
+    s.in = xQueueCreate(MQTT_IN_LEN, sizeof(MqttCommand));
+    if (!s.cfgLock || !s.out || !s.in) {
+      Serial.println("[MQTT] queue allocation failed");
+      return;
+    }
+  }
+
+  xSemaphoreTake(s.cfgLock, portMAX_DELAY);
+  s.pending = settings;
+  s.defaultBase = mqttDefaultBase(app);
+  s.cfgGen++;
+  xSemaphoreGive(s.cfgLock);
+
+  if (!s.task) xTaskCreate(mqttTaskMain, "mqtt", MQTT_TASK_STACK, nullptr, 1, &s.task);
+}
+
+// ---------- payloads ----------
+static void mqttJsonNum(String& out, const char* key, int16_t v, float scale = 1.0f, int decimals = 0) {
+  out += ",\"";
+  out += key;
+  out += "\":";
+  if (v == HUB_NA) out += "null";
+  else if (decimals) out += String(v / scale, decimals);
+  else out += v;
+}
+
+static String mqttObsJson(const HubObs& o) {
+  String out = "{\"icao\":\"";
+  out += o.icao;
+  out += "\",\"cat\":\"";
+  out += o.cat[0] ? o.cat : "UNKNOWN";
+  out += "\",\"obs_time\":";
+  if (o.obsTime) out += o.obsTime;
+  else out += "null";
+  mqttJsonNum(out, "temp_c", o.temp);
+  mqttJsonNum(out, "dewp_c", o.dewp);
+  if (o.wdir == HUB_VRB) out += ",\"wdir\":\"VRB\"";
+  else mqttJsonNum(out, "wdir", o.wdir);
+  mqttJsonNum(out, "wspd_kt", o.wspd);
+  mqttJsonNum(out, "wgst_kt", o.wgst);
+  mqttJsonNum(out, "visib_sm", o.visib, 10.0f, 1);
+  mqttJsonNum(out, "altim_inhg", o.altim, 100.0f, 2);
+  if (!isnan(o.lat) && !isnan(o.lon)) {
+    out += ",\"lat\":" + String(o.lat, 3) + ",\"lon\":" + String(o.lon, 3);
+  }
+  out += "}";
+  return out;
+}
+
+static String mqttHealthJson(const char* app, const char* fw) {
+  String out = "{\"app\":\"";
+  out += app;
+  out += "\",\"fw\":\"";
+  out += fw;
+  out += "\",\"chip\":\"";
+  out += ESP.getChipModel();
+  out += "\",\"uptime_s\":";
+  out += millis() / 1000;
+  out += ",\"heap_free\":";
+  out += heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  out += ",\"heap_min\":";
+  out += heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  out += ",\"rssi\":";
+  out += WiFi.RSSI();
+  out += ",\"ip\":\"";
+  out += WiFi.localIP().toString();
+  out += "\",\"clock\":\"";
+  out += timeQualityName(timeQuality());
+  out += "\",\"hub\":";
+  out += hubHave() ? "true" : "false";
+  out += "}";
+  return out;
+}
+
+static String mqttOtaJson(const char* fw, const String& latest, bool available, const String& status) {
+  String out = "{\"current\":\"";
+  out += fw;
+  out += "\",\"latest\":\"";
+  out += latest;
+  out += "\",\"update_available\":";
+  out += available ? "true" : "false";
+  out += ",\"status\":\"";
+  String st = status;
+  st.replace("\"", "'");
+  out += st;
+  out += "\"}";
+  return out;
+}
+
+// ---------- config (JSON) ----------
+static void mqttToJson(JsonObject o, const MqttSettings& m) {
+  o["enabled"] = m.enabled;
+  o["host"] = m.host;
+  o["port"] = m.port;
+  o["user"] = m.user;
+  o["pass"] = m.pass;
+  o["base"] = m.base;
+}
+
+static void mqttFromJson(JsonVariantConst o, MqttSettings& m) {
+  if (o.isNull()) return;
+  m.enabled = o["enabled"] | false;
+  m.host = String((const char*)(o["host"] | ""));
+  m.port = (uint16_t)constrain((int)(o["port"] | 1883), 1, 65535);
+  m.user = String((const char*)(o["user"] | ""));
+  m.pass = String((const char*)(o["pass"] | ""));
+  m.base = String((const char*)(o["base"] | ""));
+}
+
+// one line for the web UI
+static String mqttStatusLine() {
+  const MqttState& s = mqttState;
+  if (!s.task) return "MQTT: <b>off</b>";
+  String line = "MQTT: <b>";
+  line += s.connected ? "connected" : "not connected";
+  line += "</b>";
+  if (!s.connected && s.lastError) line += " (error " + String(s.lastError) + ")";
+  line += " &nbsp;|&nbsp; " + String(s.published) + " published, " + String(s.dropped) + " dropped, " +
+          String(s.commands) + " commands";
+  return line;
+}
+
+// appended to /metrics by each app
+static void mqttMetricsOut(String& out) {
+  const MqttState& s = mqttState;
+  metricGaugeOut(out, "metarlw_mqtt_connected", "1 while connected to the broker", s.connected ? 1 : 0);
+  metricGaugeOut(out, "metarlw_mqtt_queue_free", "Free outbound queue slots", mqttSpace());
+  metricHeader(out, "metarlw_mqtt_published_total", "Messages handed to the broker", "counter");
+  metricLine(out, "metarlw_mqtt_published_total", "", s.published);
+  metricHeader(out, "metarlw_mqtt_dropped_total", "Messages dropped (queue full, too long, publish failed)", "counter");
+  metricLine(out, "metarlw_mqtt_dropped_total", "", s.dropped);
+  metricHeader(out, "metarlw_mqtt_connects_total", "Broker connections made", "counter");
+  metricLine(out, "metarlw_mqtt_connects_total", "", s.connects);
+  metricHeader(out, "metarlw_mqtt_connect_failures_total", "Failed connection attempts", "counter");
+  metricLine(out, "metarlw_mqtt_connect_failures_total", "", s.connectFails);
+  metricHeader(out, "metarlw_mqtt_commands_total", "Commands received", "counter");
+  metricLine(out, "metarlw_mqtt_commands_total", "", s.commands);
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include "Metrics.h"
+#include "FleetClock.h"
+
+// ---------- Power manager (Lamp) ----------
+// While the display is scheduled off and nobody is using the web UI, the
+// lamp has nothing to do until the next schedule edge. Instead of spinning
+// loop() every 100 ms at full clock with the radio awake, it goes idle:
+//   - CPU down to 80 MHz (the lowest Wi-Fi allows), max modem sleep on STA,
+//   - optionally the SoftAP off (an AP keeps the radio awake regardless),
+//   - automatic light sleep while the STA stays associated: the idle task
+//     sleeps between DTIM wake-ups. This needs a core built with
+//     CONFIG_PM_ENABLE and tickless idle. The released builds use the stock
+//     Arduino core, which has neither (see build/*/sdkconfig), so there
+//     esp_pm_configure() refuses and the lamp stays in modem sleep only;
+//     /admin/power and /metrics say which one applies,
+//   - explicit light sleep between passes when there is no link left to
+//     keep (AP off and STA not associated). With a network configured, each
+//     wake first stays up for POWER_RECONNECT_MS so the STA can reassociate.
+// Deep sleep is not used: the lamp has to keep answering its web UI.
+//
+//   power.update(displayOff, cfg.pwrSave, cfg.pwrApOff);   // top of loop()
+//   power.rest(msUntilNextWork, staUp, staConfigured);     // instead of delay()
+//
+// Time per state and wake latency are kept for /metrics.
+
+static const uint32_t POWER_ACTIVE_PASS_MS = 100;    // loop cadence when on
+static const uint32_t POWER_IDLE_PASS_MS = 250;      // idle, link kept: web UI still answers
+static const uint32_t POWER_SLEEP_MAX_MS = 30000;    // light sleep cap (Wi-Fi reconnect)
+static const uint32_t POWER_SLEEP_MIN_MS = 50;       // not worth sleeping below this
+static const uint32_t POWER_RECONNECT_MS = 10000;    // awake after a wake, STA configured but down
+static const uint32_t POWER_UI_HOLD_MS = 5UL * 60UL * 1000UL;   // stay awake after a page load
+static const uint32_t POWER_IDLE_CPU_MHZ = 80;
+
+enum PowerState : uint8_t { PWR_ACTIVE, PWR_IDLE, PWR_SLEEP, PWR_STATES };
+static const char* const POWER_STATE_NAMES[PWR_STATES] = { "active", "idle", "light_sleep" };
+
+struct PowerManager {
+  uint8_t state = PWR_ACTIVE;
+  bool apDropped = false;
+  uint32_t cpuMhz = 0;               // clock to restore when leaving idle
+  bool autoSleep = false;            // esp_pm automatic light sleep armed
+  int8_t autoSleepOk = -1;           // esp_pm took light sleep: -1 = not tried yet
+  unsigned long lastUiMs = 0;        // last page load (0 = none yet)
+  unsigned long wakeMs = 0;          // went idle / left light sleep
+  void (*restoreAp)() = nullptr;     // brings the SoftAP back (set in setup)
+
+  // stats
+  uint64_t usIn[PWR_STATES] = { 0, 0, 0 };
+  int64_t sinceUs = 0;
+  uint32_t idleEntries = 0;
+  uint32_t sleeps = 0;
+  MetricHistogram wakeLatency;       // schedule edge due -> loop acting on it
+  MetricHistogram resumeLatency;     // leaving idle: clock, radio and AP restored
+
+  void noteUi() { lastUiMs = millis(); }
+
+  bool uiActive() const {
+    if (WiFi.softAPgetStationNum() > 0) return true;
+    return lastUiMs && millis() - lastUiMs < POWER_UI_HOLD_MS;
+  }
+
+  void account() {
+    int64_t now = esp_timer_get_time();
+    if (sinceUs) usIn[state == PWR_SLEEP ? PWR_IDLE : state] += (uint64_t)(now - sinceUs);
+    sinceUs = now;
+  }
+
+  // Returns true while idle.
+  bool update(bool displayOff, bool enabled, bool apOff) {
+    bool want = enabled && displayOff && !uiActive();
+    if (want && state == PWR_ACTIVE) enter(apOff);
+    else if (!want && state != PWR_ACTIVE) leave();
+    else if (want && apOff != apDropped) setAp(!apOff);
+    return state != PWR_ACTIVE;
+  }
+
+  // Paces loop(): sleeps at most maxMs (0 = no deadline). staLinkUp is the
+  // live STA state, staWanted whether a network is configured at all.
+  // activeMs is the pass length while active (shortened to land passes on
+  // a shared grid).
+  void rest(uint32_t maxMs, bool staLinkUp, bool staWanted, uint32_t activeMs = POWER_ACTIVE_PASS_MS) {
+    if (state == PWR_ACTIVE) { delay(activeMs); return; }
+    if (!maxMs) maxMs = POWER_SLEEP_MAX_MS;
+
+    bool linkToKeep = staLinkUp || !apDropped;
+    bool reconnecting = staWanted && !staLinkUp && millis() - wakeMs < POWER_RECONNECT_MS;
+    if (linkToKeep || reconnecting || maxMs < POWER_SLEEP_MIN_MS) {
+      delay(min(maxMs, POWER_IDLE_PASS_MS));
+      return;
+    }
+
+    uint32_t ms = min(maxMs, POWER_SLEEP_MAX_MS);
+    account();
+    state = PWR_SLEEP;
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+    int64_t t0 = esp_timer_get_time();
+    esp_light_sleep_start();
+    int64_t t1 = esp_timer_get_time();     // esp_timer keeps counting in light sleep
+    usIn[PWR_SLEEP] += (uint64_t)(t1 - t0);
+    sinceUs = t1;
+    sleeps++;
+    state = PWR_IDLE;
+    wakeMs = millis();
+  }
+
+  // Call when a schedule transition was due at `due` and has just been applied.
+  void observeEdge(time_t due) {
+    if (!due) return;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t lateUs = ((int64_t)tv.tv_sec - (int64_t)due) * 1000000LL + tv.tv_usec;
+    if (lateUs >= 0 && lateUs < 60000000LL) wakeLatency.observeUs((uint32_t)lateUs);
+  }
+
+  double dutyCycle() {
+    account();
+    uint64_t total = usIn[PWR_ACTIVE] + usIn[PWR_IDLE] + usIn[PWR_SLEEP];
+    return total ? (double)usIn[PWR_ACTIVE] / (double)total : 1.0;
+  }
+
+private:
+  void enter(bool apOff) {
+    account();
+    state = PWR_IDLE;
+    idleEntries++;
+    wakeMs = millis();
+    cpuMhz = getCpuFrequencyMhz();
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+    fleetSetRadioDozing(true);
+    if (apOff) setAp(false);
+    if (cpuMhz > POWER_IDLE_CPU_MHZ) setCpuFrequencyMhz(POWER_IDLE_CPU_MHZ);
+    autoSleep = setAutoLightSleep(true, min(cpuMhz, POWER_IDLE_CPU_MHZ));
+    Serial.printf("[PWR] idle (ap %s, auto light sleep %s)\n",
+                  apDropped ? "off" : "on", autoSleep ? "on" : "off");
+  }
+
+  void leave() {
+    uint32_t t0 = micros();
+    account();
+    state = PWR_ACTIVE;
+    if (autoSleep) autoSleep = !setAutoLightSleep(false, cpuMhz ? cpuMhz : getCpuFrequencyMhz());
+    if (cpuMhz && getCpuFrequencyMhz() != cpuMhz) setCpuFrequencyMhz(cpuMhz);
+    WiFi.setSleep(WIFI_PS_MIN_MODEM);      // the core's default: wake every DTIM
+    fleetSetRadioDozing(false);
+    if (apDropped) setAp(true);
+    resumeLatency.observeUs(micros() - t0);
+    Serial.println("[PWR] active");
+  }
+
+  // Fixed clock (no DFS), light sleep on or off. Returns true when applied.
+  bool setAutoLightSleep(bool on, uint32_t mhz) {
+    esp_pm_config_t pm = {};
+    pm.max_freq_mhz = (int)mhz;
+    pm.min_freq_mhz = (int)mhz;
+    pm.light_sleep_enable = on;
+    esp_err_t err = esp_pm_configure(&pm);
+    if (on && autoSleepOk < 0 && err != ESP_OK)
+      Serial.printf("[PWR] auto light sleep unavailable (%s), modem sleep only\n", esp_err_to_name(err));
+    if (on) autoSleepOk = err == ESP_OK;
+    return err == ESP_OK;
+  }
+
+  void setAp(bool on) {
+    if (on) {
+      WiFi.mode(WIFI_MODE_APSTA);
+      if (restoreAp) restoreAp();
+      apDropped = false;
+    } else {
+      WiFi.softAPdisconnect(true);
+      WiFi.mode(WIFI_MODE_STA);
+      apDropped = true;
+    }
+  }
+};
+
+static PowerManager power;
+
+// appended to /metrics
+static void powerMetricsOut(String& out) {
+  double duty = power.dutyCycle();
+  metricHeader(out, "metarlw_power_state_seconds_total", "Time spent per power state", "counter");
+  for (int i = 0; i < PWR_STATES; i++) {
+    String lbl = String("state=\"") + POWER_STATE_NAMES[i] + "\"";
+    metricLine(out, "metarlw_power_state_seconds_total", lbl.c_str(), power.usIn[i] / 1e6);
+  }
+  metricGaugeOut(out, "metarlw_power_duty_cycle", "Fraction of uptime at full power", duty);
+  metricGaugeOut(out, "metarlw_power_idle", "1 while the power manager has the lamp idle", power.state != PWR_ACTIVE ? 1 : 0);
+  metricGaugeOut(out, "metarlw_power_ap_off", "1 while the SoftAP is dropped", power.apDropped ? 1 : 0);
+  metricGaugeOut(out, "metarlw_power_auto_light_sleep_supported", "1 = esp_pm accepted light sleep, 0 = core lacks it, -1 = not idle yet", power.autoSleepOk);
+  metricGaugeOut(out, "metarlw_power_auto_light_sleep", "1 while automatic light sleep is armed (never on builds without CONFIG_PM_ENABLE)", power.autoSleep ? 1 : 0);
+  metricHeader(out, "metarlw_power_idle_entries_total", "Times the lamp went idle", "counter");
+  metricLine(out, "metarlw_power_idle_entries_total", "", power.idleEntries);
+  metricHeader(out, "metarlw_power_light_sleeps_total", "Light-sleep periods", "counter");
+  metricLine(out, "metarlw_power_light_sleeps_total", "", power.sleeps);
+  metricHistogramOut(out, "metarlw_power_wake_latency_seconds", "Schedule edge due until applied", power.wakeLatency);
+  metricHistogramOut(out, "metarlw_power_resume_latency_seconds", "Leaving idle until clock, radio and AP are back", power.resumeLatency);
+}
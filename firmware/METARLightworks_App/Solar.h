@@ -0,0 +1,438 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+
+// ---------- Schedule: weekday windows + sun-driven brightness ----------
+// Two independent parts, both optional:
+//   - windows: per-weekday on/off window (local time). A window whose end is
+//     at or before its start runs past midnight; start == end is all day.
+//   - solar:   brightness curve from the station's sunrise/sunset. Full
+//     level by day, nightPct overnight, cosine ramps of rampMin centred on
+//     sunset (dusk) and sunrise (dawn).
+//
+// scheduleEvaluate() returns the state now plus the time it next changes
+// (a window edge, a ramp start/end, or the next ramp step), so callers
+// re-evaluate only then:
+//
+//   static ScheduleRunner schedule;
+//   if (schedule.tick(cfg.sched)) applyBrightness();   // cheap when not due
+//
+// Without a wall clock the schedule reads "on, full level" and retries.
+
+static const uint32_t SCHED_RAMP_STEP_S = 30;       // level step during a ramp
+static const uint32_t SCHED_UNSYNCED_RETRY_S = 30;
+static const float SOLAR_ZENITH = 90.833f;           // sunrise/sunset incl. refraction
+
+struct DayWindow {
+  bool on = true;
+  uint16_t startMin = 0;    // minutes after local midnight
+  uint16_t endMin = 0;
+};
+
+struct ScheduleConfig {
+  bool enabled = false;     // weekday windows
+  DayWindow days[7];        // tm_wday order (Sunday first)
+
+  bool solar = false;       // dusk/night/dawn curve
+  uint8_t nightPct = 25;    // night level, % of the configured brightness
+  uint16_t rampMin = 45;
+
+  bool hasGeo = false;      // lat/lon for the solar part
+  float lat = 0;
+  float lon = 0;
+};
+
+enum SchedPhase : uint8_t { SCHED_NOCLOCK, SCHED_OFF, SCHED_DAY, SCHED_DUSK, SCHED_NIGHT, SCHED_DAWN };
+
+struct ScheduleState {
+  bool on = true;
+  float level = 1.0f;          // multiplier for the configured brightness
+  uint8_t phase = SCHED_NOCLOCK;
+  time_t nextChange = 0;       // epoch of the next on/level change
+  time_t sunrise = 0;          // today (local date); 0 when unknown / polar
+  time_t sunset = 0;
+};
+
+static const char* schedPhaseName(uint8_t p) {
+  switch (p) {
+    case SCHED_OFF:   return "off";
+    case SCHED_DAY:   return "day";
+    case SCHED_DUSK:  return "dusk";
+    case SCHED_NIGHT: return "night";
+    case SCHED_DAWN:  return "dawn";
+    default:          return "no clock";
+  }
+}
+
+// ---------- solar calculator ----------
+// Almanac for Computers sunrise/sunset (accurate to a minute or two, which
+// is plenty for a lamp). Returns hours UT; false if the sun never crosses
+// the zenith that day (polar day/night, see *alwaysUp).
+static bool solarEventUt(int dayOfYear, float lat, float lon, bool rising, float& utHours, bool& alwaysUp) {
+  const float D2R = (float)M_PI / 180.0f;
+  float lngHour = lon / 15.0f;
+  float t = dayOfYear + ((rising ? 6.0f : 18.0f) - lngHour) / 24.0f;
+
+  float M = 0.9856f * t - 3.289f;
+  float L = M + 1.916f * sinf(M * D2R) + 0.020f * sinf(2 * M * D2R) + 282.634f;
+  L = fmodf(L + 360.0f, 360.0f);
+
+  float RA = atanf(0.91764f * tanf(L * D2R)) / D2R;
+  RA = fmodf(RA + 360.0f, 360.0f);
+  RA += floorf(L / 90.0f) * 90.0f - floorf(RA / 90.0f) * 90.0f;
+  RA /= 15.0f;
+
+  float sinDec = 0.39782f * sinf(L * D2R);
+  float cosDec = cosf(asinf(sinDec));
+  float cosH = (cosf(SOLAR_ZENITH * D2R) - sinDec * sinf(lat * D2R)) / (cosDec * cosf(lat * D2R));
+  if (cosH > 1.0f)  { alwaysUp = false; return false; }
+  if (cosH < -1.0f) { alwaysUp = true;  return false; }
+
+  float H = rising ? 360.0f - acosf(cosH) / D2R : acosf(cosH) / D2R;
+  H /= 15.0f;
+
+  float T = H + RA - 0.06571f * t - 6.622f;
+  utHours = fmodf(T - lngHour + 48.0f, 24.0f);
+  return true;
+}
+
+static int32_t schedDaysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+enum SunKind : uint8_t { SUN_NORMAL, SUN_UP, SUN_DOWN };
+
+struct SunDay {
+  uint8_t kind = SUN_NORMAL;
+  time_t rise = 0;
+  time_t set = 0;
+};
+
+// Sunrise/sunset for a calendar date at lat/lon, as epochs either side of
+// that date's solar noon.
+static SunDay solarDay(int year, int month, int day, float lat, float lon) {
+  SunDay out;
+  int doy = (int)(schedDaysFromCivil(year, month, day) - schedDaysFromCivil(year, 1, 1)) + 1;
+  time_t noon = (time_t)schedDaysFromCivil(year, month, day) * 86400 + (time_t)((12.0f - lon / 15.0f) * 3600.0f);
+  time_t midnightUtc = (time_t)schedDaysFromCivil(year, month, day) * 86400;
+
+  float riseUt = 0, setUt = 0;
+  bool up = false;
+  if (!solarEventUt(doy, lat, lon, true, riseUt, up) || !solarEventUt(doy, lat, lon, false, setUt, up)) {
+    out.kind = up ? SUN_UP : SUN_DOWN;
+    return out;
+  }
+
+  out.rise = midnightUtc + (time_t)(riseUt * 3600.0f);
+  out.set = midnightUtc + (time_t)(setUt * 3600.0f);
+  while (out.rise > noon) out.rise -= 86400;
+  while (out.rise <= noon - 86400) out.rise += 86400;
+  while (out.set < noon) out.set += 86400;
+  while (out.set >= noon + 86400) out.set -= 86400;
+  return out;
+}
+
+// ---------- evaluation ----------
+// Local wall-clock time dayOffset days from `day` at minuteOfDay (DST-safe).
+static time_t schedLocalTime(const struct tm& day, int dayOffset, int minuteOfDay) {
+  struct tm t = day;
+  t.tm_mday += dayOffset;
+  t.tm_hour = minuteOfDay / 60;
+  t.tm_min = minuteOfDay % 60;
+  t.tm_sec = 0;
+  t.tm_isdst = -1;
+  return mktime(&t);
+}
+
+static bool schedWindowOn(const ScheduleConfig& c, time_t now, const struct tm& today, time_t& next) {
+  bool on = false;
+  // yesterday's window can run past midnight; a week ahead covers all days off
+  for (int d = -1; d <= 7; d++) {
+    const DayWindow& w = c.days[((today.tm_wday + d) % 7 + 7) % 7];
+    if (!w.on) continue;
+    time_t start = schedLocalTime(today, d, w.startMin);
+    time_t end = (w.endMin > w.startMin) ? schedLocalTime(today, d, w.endMin)
+                                         : schedLocalTime(today, d + 1, w.endMin);
+    if (now >= start && now < end) on = true;
+    if (start > now && start < next) next = start;
+    if (end > now && end < next) next = end;
+  }
+  return on;
+}
+
+static float schedEase(float x) {
+  if (x <= 0) return 0;
+  if (x >= 1) return 1;
+  return 0.5f - 0.5f * cosf((float)M_PI * x);
+}
+
+static float schedSolarLevel(const ScheduleConfig& c, time_t now, const struct tm& today, ScheduleState& st, time_t& next) {
+  float night = c.nightPct / 100.0f;
+  time_t half = (time_t)c.rampMin * 30;
+
+  SunDay days[3];
+  for (int k = -1; k <= 1; k++) {
+    struct tm d = today;
+    d.tm_mday += k;
+    d.tm_hour = 12; d.tm_min = 0; d.tm_sec = 0; d.tm_isdst = -1;
+    mktime(&d);
+    days[k + 1] = solarDay(d.tm_year + 1900, d.tm_mon + 1, d.tm_mday, c.lat, c.lon);
+  }
+  st.sunrise = days[1].rise;
+  st.sunset = days[1].set;
+
+  if (days[1].kind != SUN_NORMAL) {
+    time_t midnight = schedLocalTime(today, 1, 0);
+    if (midnight < next) next = midnight;
+    st.phase = (days[1].kind == SUN_UP) ? SCHED_DAY : SCHED_NIGHT;
+    return (days[1].kind == SUN_UP) ? 1.0f : night;
+  }
+
+  // in a ramp?
+  for (int k = 0; k < 3; k++) {
+    if (days[k].kind != SUN_NORMAL) continue;
+    time_t dawn0 = days[k].rise - half, dawn1 = days[k].rise + half;
+    time_t dusk0 = days[k].set - half, dusk1 = days[k].set + half;
+    if (now >= dawn0 && now < dawn1) {
+      st.phase = SCHED_DAWN;
+      time_t n = min((time_t)(now + SCHED_RAMP_STEP_S), dawn1);
+      if (n < next) next = n;
+      return night + (1.0f - night) * schedEase((float)(now - dawn0) / (float)(2 * half));
+    }
+    if (now >= dusk0 && now < dusk1) {
+      st.phase = SCHED_DUSK;
+      time_t n = min((time_t)(now + SCHED_RAMP_STEP_S), dusk1);
+      if (n < next) next = n;
+      return 1.0f - (1.0f - night) * schedEase((float)(now - dusk0) / (float)(2 * half));
+    }
+  }
+
+  // between ramps: the last one to finish decides, the next one to start is the edge
+  time_t lastEnd = 0;
+  bool day = true;
+  for (int k = 0; k < 3; k++) {
+    if (days[k].kind != SUN_NORMAL) continue;
+    time_t dawn0 = days[k].rise - half, dawn1 = days[k].rise + half;
+    time_t dusk0 = days[k].set - half, dusk1 = days[k].set + half;
+    if (dawn1 <= now && dawn1 >= lastEnd) { lastEnd = dawn1; day = true; }
+    if (dusk1 <= now && dusk1 >= lastEnd) { lastEnd = dusk1; day = false; }
+    if (dawn0 > now && dawn0 < next) next = dawn0;
+    if (dusk0 > now && dusk0 < next) next = dusk0;
+  }
+  st.phase = day ? SCHED_DAY : SCHED_NIGHT;
+  return day ? 1.0f : night;
+}
+
+static ScheduleState scheduleEvaluate(const ScheduleConfig& c, time_t now) {
+  ScheduleState st;
+  if (!timeValid(now)) {             // no wall clock yet
+    st.nextChange = now + SCHED_UNSYNCED_RETRY_S;
+    return st;
+  }
+
+  struct tm today;
+  localtime_r(&now, &today);
+  time_t next = now + 86400;         // re-check daily even if nothing is configured
+
+  st.on = c.enabled ? schedWindowOn(c, now, today, next) : true;
+  st.phase = SCHED_DAY;
+  time_t solarNext = now + 86400;
+  if (c.solar && c.hasGeo) st.level = schedSolarLevel(c, now, today, st, solarNext);
+  if (st.on && solarNext < next) next = solarNext;   // ramp steps don't matter while off
+  if (!st.on) st.phase = SCHED_OFF;
+
+  st.nextChange = next;
+  return st;
+}
+
+// Caches the last evaluation until its nextChange, or until the inputs
+// change (pass a config version, or call invalidate()).
+struct ScheduleRunner {
+  ScheduleState st;
+  uint32_t inputVersion = 0xFFFFFFFFu;
+  uint32_t evals = 0;
+
+  // true when on/level/phase changed
+  bool tick(const ScheduleConfig& c, uint32_t version = 0) {
+    time_t now = time(nullptr);
+    if (version == inputVersion && st.nextChange && now < st.nextChange) return false;
+    inputVersion = version;
+    ScheduleState n = scheduleEvaluate(c, now);
+    evals++;
+    bool changed = n.on != st.on || fabsf(n.level - st.level) > 0.001f || n.phase != st.phase;
+    st = n;
+    return changed;
+  }
+
+  void invalidate() { st.nextChange = 0; }
+
+  // 0 when due (or never evaluated); ms resolution so sleepers wake on the edge
+  uint32_t msUntilNext() const {
+    if (!st.nextChange) return 0;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t ms = (int64_t)st.nextChange * 1000LL - ((int64_t)tv.tv_sec * 1000LL + tv.tv_usec / 1000);
+    return ms > 0 ? (uint32_t)ms : 0;
+  }
+};
+
+// ---------- config (JSON) ----------
+static void scheduleToJson(JsonObject o, const ScheduleConfig& c) {
+  o["enabled"] = c.enabled;
+  JsonArray days = o.createNestedArray("days");
+  for (int i = 0; i < 7; i++) {
+    JsonArray d = days.createNestedArray();
+    d.add(c.days[i].on ? 1 : 0);
+    d.add(c.days[i].startMin);
+    d.add(c.days[i].endMin);
+  }
+  JsonObject solar = o.createNestedObject("solar");
+  solar["enabled"] = c.solar;
+  solar["night"]   = c.nightPct;
+  solar["ramp"]    = c.rampMin;
+  if (c.hasGeo) {
+    o["lat"] = c.lat;
+    o["lon"] = c.lon;
+  }
+}
+
+// Older configs have a single starth/startm/endh/endm window; it becomes
+// the window for every day. There, equal start and end meant the display
+// never came on, so that case migrates to every day off.
+static void scheduleFromJson(JsonVariantConst o, ScheduleConfig& c) {
+  if (o.isNull()) return;
+  c.enabled = o["enabled"] | false;
+
+  JsonArrayConst days = o["days"].as<JsonArrayConst>();
+  if (!days.isNull() && days.size() == 7) {
+    for (int i = 0; i < 7; i++) {
+      c.days[i].on       = (int)(days[i][0] | 1) != 0;
+      c.days[i].startMin = (uint16_t)constrain((int)(days[i][1] | 0), 0, 1439);
+      c.days[i].endMin   = (uint16_t)constrain((int)(days[i][2] | 0), 0, 1439);
+    }
+  } else if (o.containsKey("starth")) {
+    int s = (int)(o["starth"] | 0) * 60 + (int)(o["startm"] | 0);
+    int e = (int)(o["endh"] | 23) * 60 + (int)(o["endm"] | 59);
+    for (int i = 0; i < 7; i++) {
+      c.days[i].on = (s != e);
+      c.days[i].startMin = (uint16_t)constrain(s, 0, 1439);
+      c.days[i].endMin = (uint16_t)constrain(e, 0, 1439);
+    }
+  }
+
+  JsonVariantConst solar = o["solar"];
+  if (!solar.isNull()) {
+    c.solar    = solar["enabled"] | false;
+    c.nightPct = (uint8_t)constrain((int)(solar["night"] | 25), 0, 100);
+    c.rampMin  = (uint16_t)constrain((int)(solar["ramp"] | 45), 0, 240);
+  }
+  if (o.containsKey("lat") && o.containsKey("lon")) {
+    c.lat = o["lat"] | 0.0f;
+    c.lon = o["lon"] | 0.0f;
+    c.hasGeo = true;
+  }
+}
+
+// ---------- web form ----------
+static const char* const SCHED_DAY_NAMES[7] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+
+static String schedHHMM(int minuteOfDay) {
+  char buf[6];
+  snprintf(buf, sizeof(buf), "%02d:%02d", (minuteOfDay / 60) % 24, minuteOfDay % 60);
+  return String(buf);
+}
+
+static int schedParseHHMM(const String& s, int fallback) {
+  int colon = s.indexOf(':');
+  if (colon < 1) return fallback;
+  int h = s.substring(0, colon).toInt(), m = s.substring(colon + 1).toInt();
+  if (h < 0 || h > 23 || m < 0 || m > 59) return fallback;
+  return h * 60 + m;
+}
+
+static String schedClock(time_t t) {
+  if (!t) return "--:--";
+  struct tm tmv;
+  localtime_r(&t, &tmv);
+  char buf[8];
+  strftime(buf, sizeof(buf), "%H:%M", &tmv);
+  return String(buf);
+}
+
+// Inputs only; each app wraps them in its own form/card. Field names match
+// scheduleFromArgs().
+static String scheduleFieldsHtml(const ScheduleConfig& c) {
+  String h;
+  h.reserve(2200);
+  h += "<label><input type='checkbox' name='enabled'";
+  h += c.enabled ? " checked" : "";
+  h += "> On/off by weekday</label>";
+  h += "<table class='sched'><tr><th>Day</th><th>On</th><th>Off</th></tr>";
+  for (int i = 0; i < 7; i++) {
+    String n = String(i);
+    h += "<tr><td><label><input type='checkbox' name='d" + n + "on'";
+    h += c.days[i].on ? " checked" : "";
+    h += "> " + String(SCHED_DAY_NAMES[i]) + "</label></td>";
+    h += "<td><input type='time' name='d" + n + "s' value='" + schedHHMM(c.days[i].startMin) + "'></td>";
+    h += "<td><input type='time' name='d" + n + "e' value='" + schedHHMM(c.days[i].endMin) + "'></td></tr>";
+  }
+  h += "</table><p class='small'>Off at or before On runs past midnight; equal times mean all day.</p>";
+
+  h += "<label><input type='checkbox' name='solar'";
+  h += c.solar ? " checked" : "";
+  h += "> Dim at night (sunset/sunrise)</label>";
+  h += "<label>Night level (% of brightness)</label><input type='number' name='night' min='0' max='100' value='" + String(c.nightPct) + "'>";
+  h += "<label>Dusk/dawn ramp (minutes)</label><input type='number' name='ramp' min='0' max='240' value='" + String(c.rampMin) + "'>";
+  return h;
+}
+
+// Reads a full form submission (unchecked boxes are simply absent).
+template <typename Server>
+static void scheduleFromArgs(Server& srv, ScheduleConfig& c) {
+  c.enabled = srv.hasArg("enabled");
+  for (int i = 0; i < 7; i++) {
+    String n = String(i);
+    c.days[i].on = srv.hasArg("d" + n + "on");
+    c.days[i].startMin = (uint16_t)schedParseHHMM(srv.arg("d" + n + "s"), c.days[i].startMin);
+    c.days[i].endMin = (uint16_t)schedParseHHMM(srv.arg("d" + n + "e"), c.days[i].endMin);
+  }
+  c.solar = srv.hasArg("solar");
+  if (srv.hasArg("night")) c.nightPct = (uint8_t)constrain((int)srv.arg("night").toInt(), 0, 100);
+  if (srv.hasArg("ramp")) c.rampMin = (uint16_t)constrain((int)srv.arg("ramp").toInt(), 0, 240);
+}
+
+static String scheduleStatusHtml(const ScheduleConfig& c, const ScheduleState& s) {
+  String h = "<p class='small'>Now: <b>" + String(schedPhaseName(s.phase)) + "</b>";
+  if (s.on && s.phase != SCHED_NOCLOCK) h += " (" + String((int)(s.level * 100.0f + 0.5f)) + "%)";
+  if (s.nextChange && s.phase != SCHED_NOCLOCK) h += " &nbsp;|&nbsp; next change " + schedClock(s.nextChange);
+  if (c.hasGeo) {
+    h += "<br>Sunrise " + schedClock(s.sunrise) + " &nbsp;|&nbsp; Sunset " + schedClock(s.sunset)
+       + " &nbsp;(" + String(c.lat, 3) + ", " + String(c.lon, 3) + ")";
+  } else if (c.solar) {
+    h += "<br>No location yet: night dimming waits for station lat/lon.";
+  }
+  h += "</p>";
+  return h;
+}
+
+// appended to /metrics by each app
+static void scheduleMetricsOut(String& out, const ScheduleRunner& r) {
+  time_t now = time(nullptr);
+  metricGaugeOut(out, "metarlw_schedule_on", "Display on per the weekday windows (1/0)", r.st.on ? 1 : 0);
+  metricGaugeOut(out, "metarlw_schedule_level", "Solar brightness multiplier 0..1", r.st.level);
+  metricGaugeOut(out, "metarlw_schedule_next_change_seconds", "Seconds until the schedule next changes",
+                 (r.st.nextChange > now) ? (double)(r.st.nextChange - now) : 0.0);
+  metricHeader(out, "metarlw_schedule_evaluations_total", "Schedule evaluations (one per transition/ramp step)", "counter");
+  metricLine(out, "metarlw_schedule_evaluations_total", "", r.evals);
+}
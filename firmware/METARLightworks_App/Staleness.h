@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+#include "Fetch.h"
+
+// ---------- METAR staleness ----------
+// The observation time is stored once, when a METAR arrives. Rendering
+// turns the policy into three epoch cutoffs per frame (or loop pass), so
+// each LED costs integer compares, not date math:
+//
+//   StaleCutoffs c = staleCutoffs(policy, staleClock());
+//   uint8_t lvl = staleLevel(obsTime, c);           // STALE_*
+//
+//   fade    after fadeMin:    the color at STALE_FADE_SCALE
+//   blink   after blinkMin:   on/off on the fleet clock
+//   missing after missingMin: no data, so the map's fallback applies
+//
+// 0 turns a step off. An unknown observation time (0) or no wall clock
+// reads as fresh: there is nothing to judge it by.
+
+enum StaleLevel : uint8_t { STALE_FRESH, STALE_FADE, STALE_BLINK, STALE_MISSING };
+
+static const uint16_t STALE_FADE_SCALE = 90;        // of 256, ~35 %
+static const uint32_t STALE_BLINK_MS = 1000;        // full on/off period
+
+struct StalePolicy {
+  uint16_t fadeMin = 100;     // METARs are hourly; a missed one shows
+  uint16_t blinkMin = 0;
+  uint16_t missingMin = 180;
+};
+
+struct StaleCutoffs {
+  uint32_t fade = 0, blink = 0, missing = 0;        // obs before these (epoch), 0 = off
+};
+
+// The clock ages are taken against. Replayed captures carry the times they
+// were recorded at, so while replaying nothing ages (0 = no clock).
+static uint32_t staleClock() { return fetchReplaying() ? 0 : timeEpochOrZero(); }
+
+static StaleCutoffs staleCutoffs(const StalePolicy& p, uint32_t now) {
+  StaleCutoffs c;
+  if (!now) return c;
+  auto cut = [&](uint16_t min) { return (min && now > min * 60UL) ? now - min * 60UL : 0UL; };
+  c.fade = cut(p.fadeMin);
+  c.blink = cut(p.blinkMin);
+  c.missing = cut(p.missingMin);
+  return c;
+}
+
+static uint8_t staleLevel(uint32_t obs, const StaleCutoffs& c) {
+  if (!obs) return STALE_FRESH;
+  if (obs < c.missing) return STALE_MISSING;
+  if (obs < c.blink) return STALE_BLINK;
+  if (obs < c.fade) return STALE_FADE;
+  return STALE_FRESH;
+}
+
+// Epoch at which obs next moves up a level (0 = never), so callers can
+// sleep until then instead of re-checking.
+static inline uint32_t staleNextChange(uint32_t obs, const StalePolicy& p, uint32_t now) {
+  if (!obs || !now) return 0;
+  uint32_t next = 0;
+  for (uint16_t min : { p.fadeMin, p.blinkMin, p.missingMin }) {
+    if (!min) continue;
+    uint32_t at = obs + min * 60UL;
+    if (at > now && (!next || at < next)) next = at;
+  }
+  return next;
+}
+
+// Epoch at which obs passes the missing step (0 = never).
+static inline uint32_t staleMissingAt(uint32_t obs, const StalePolicy& p) {
+  return (obs && p.missingMin) ? obs + p.missingMin * 60UL : 0;
+}
+
+// blink phase, shared across devices via the fleet clock
+static bool staleBlinkOn(uint64_t fleetMs) { return (fleetMs % STALE_BLINK_MS) < STALE_BLINK_MS / 2; }
+
+// ---------- config ----------
+static void staleToJson(JsonObject o, const StalePolicy& p) {
+  o["fade_min"] = p.fadeMin;
+  o["blink_min"] = p.blinkMin;
+  o["missing_min"] = p.missingMin;
+}
+
+static void staleFromJson(JsonVariantConst o, StalePolicy& p) {
+  if (o.isNull()) return;
+  p.fadeMin = (uint16_t)constrain((int)(o["fade_min"] | 100), 0, 1440);
+  p.blinkMin = (uint16_t)constrain((int)(o["blink_min"] | 0), 0, 1440);
+  p.missingMin = (uint16_t)constrain((int)(o["missing_min"] | 180), 0, 1440);
+}
+
+// Inputs only, like scheduleFieldsHtml(); names match staleFromArgs().
+static String staleFieldsHtml(const StalePolicy& p) {
+  auto field = [](const char* name, const char* label, uint16_t v) {
+    return String("<label>") + label + "</label><input type='number' name='" + name +
+           "' min='0' max='1440' value='" + String(v) + "'>";
+  };
+  return field("stale_fade", "Fade after (minutes, 0 = never)", p.fadeMin) +
+         field("stale_blink", "Blink after (minutes, 0 = never)", p.blinkMin) +
+         field("stale_missing", "Treat as missing after (minutes, 0 = never)", p.missingMin);
+}
+
+template <typename Server>
+static void staleFromArgs(Server& srv, StalePolicy& p) {
+  if (srv.hasArg("stale_fade")) p.fadeMin = (uint16_t)constrain((int)srv.arg("stale_fade").toInt(), 0, 1440);
+  if (srv.hasArg("stale_blink")) p.blinkMin = (uint16_t)constrain((int)srv.arg("stale_blink").toInt(), 0, 1440);
+  if (srv.hasArg("stale_missing")) p.missingMin = (uint16_t)constrain((int)srv.arg("stale_missing").toInt(), 0, 1440);
+}
+
+// ---------- status ----------
+// stations past each step, as last rendered
+struct StaleCounts {
+  int fading = 0, blinking = 0, missing = 0;
+  int total() const { return fading + blinking + missing; }
+};
+
+static StaleCounts staleCounts;
+
+static String staleStatusLine() {
+  const StaleCounts n = staleCounts;
+  if (!timeValid()) return "Staleness: <b>no clock</b>";
+  if (!n.total()) return "Staleness: <b>all fresh</b>";
+  return "Staleness: <b>" + String(n.total()) + " stale</b> (" + String(n.fading) + " fading, " +
+         String(n.blinking) + " blinking, " + String(n.missing) + " missing)";
+}
+
+static void staleMetricsOut(String& out) {
+  const StaleCounts n = staleCounts;
+  metricHeader(out, "metarlw_stale_stations", "Stations whose METAR is past a staleness step", "gauge");
+  metricLine(out, "metarlw_stale_stations", "level=\"fade\"", n.fading);
+  metricLine(out, "metarlw_stale_stations", "level=\"blink\"", n.blinking);
+  metricLine(out, "metarlw_stale_stations", "level=\"missing\"", n.missing);
+}
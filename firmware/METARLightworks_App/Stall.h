@@ -0,0 +1,220 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <time.h>
+#include "Metrics.h"
+#include "EventLog.h"
+#include "TimeSync.h"
+
+// ---------- Stall detector (/admin/diag) ----------
+// Anything that blocks the loop long enough to make the web UI hang is
+// recorded here: HTTP handlers (timed at dispatch, keyed by URI), provider
+// fetches, refresh passes, OTA, time sync, Wi-Fi scans.
+//
+//   { StallScope s("refreshNow"); ... }    // records if >= STALL_MIN_MS
+//
+// Two views are kept: the top-N longest since boot/clear, and a ring of the
+// most recent ones. loop() brackets itself with stallLoopBegin/End; a pass
+// over the budget bumps a counter and logs (rate-limited) with the worst
+// site seen during that pass.
+
+static const uint32_t STALL_MIN_MS = 50;
+static const int STALL_TOP_N = 8;
+static const int STALL_RING_N = 16;
+static const int STALL_SITE_LEN = 40;
+static const uint32_t STALL_LOG_MS = 2000;     // also written to the event log
+
+struct StallEntry {
+  char site[STALL_SITE_LEN];
+  uint32_t durMs;
+  uint32_t atMs;       // millis() when the stall ended
+  uint32_t epoch;      // wall clock, 0 if time was unsynced
+};
+
+struct StallState {
+  StallEntry top[STALL_TOP_N];
+  int topCount = 0;
+  StallEntry ring[STALL_RING_N];
+  int ringHead = 0;
+  int ringCount = 0;
+
+  uint32_t stallsTotal = 0;
+  uint32_t loopBudgetMs = 250;
+  uint32_t loopOverBudget = 0;
+  uint32_t loopWorstMs = 0;
+  uint32_t lastWarnMs = 0;
+
+  // current loop pass
+  uint32_t passStartMs = 0;
+  uint32_t passWorstMs = 0;
+  char passWorstSite[STALL_SITE_LEN] = { 0 };
+};
+
+static StallState stallState;
+static portMUX_TYPE stallMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void stallRecord(const char* site, uint32_t durMs) {
+  if (durMs < STALL_MIN_MS) return;
+
+  StallEntry e;
+  strncpy(e.site, site ? site : "?", STALL_SITE_LEN - 1);
+  e.site[STALL_SITE_LEN - 1] = 0;
+  e.durMs = durMs;
+  e.atMs = millis();
+  e.epoch = timeEpochOrZero();
+
+  portENTER_CRITICAL(&stallMux);
+  StallState& s = stallState;
+  s.stallsTotal++;
+
+  s.ring[s.ringHead] = e;
+  s.ringHead = (s.ringHead + 1) % STALL_RING_N;
+  if (s.ringCount < STALL_RING_N) s.ringCount++;
+
+  // top-N kept sorted longest first
+  int pos = s.topCount;
+  while (pos > 0 && s.top[pos - 1].durMs < durMs) pos--;
+  if (pos < STALL_TOP_N) {
+    int last = (s.topCount < STALL_TOP_N) ? s.topCount : STALL_TOP_N - 1;
+    for (int i = last; i > pos; i--) s.top[i] = s.top[i - 1];
+    s.top[pos] = e;
+    if (s.topCount < STALL_TOP_N) s.topCount++;
+  }
+
+  if (durMs > s.passWorstMs) {
+    s.passWorstMs = durMs;
+    memcpy(s.passWorstSite, e.site, STALL_SITE_LEN);
+  }
+  portEXIT_CRITICAL(&stallMux);
+
+  if (durMs >= STALL_LOG_MS) elogEvent(EV_STALL, (int32_t)durMs, 0, e.site);
+}
+
+struct StallScope {
+  const char* site;
+  uint32_t start;
+  explicit StallScope(const char* s) : site(s), start(millis()) {}
+  ~StallScope() { stallRecord(site, millis() - start); }
+};
+
+static void stallClear() {
+  portENTER_CRITICAL(&stallMux);
+  stallState.topCount = 0;
+  stallState.ringHead = 0;
+  stallState.ringCount = 0;
+  stallState.stallsTotal = 0;
+  stallState.loopOverBudget = 0;
+  stallState.loopWorstMs = 0;
+  portEXIT_CRITICAL(&stallMux);
+}
+
+static void stallSetBudget(uint32_t ms) {
+  if (ms < 20) ms = 20;
+  if (ms > 60000) ms = 60000;
+  stallState.loopBudgetMs = ms;
+}
+
+static void stallLoopBegin() {
+  stallState.passStartMs = millis();
+  stallState.passWorstMs = 0;
+  stallState.passWorstSite[0] = 0;
+}
+
+static void stallLoopEnd() {
+  uint32_t dur = millis() - stallState.passStartMs;
+  if (dur > stallState.loopWorstMs) stallState.loopWorstMs = dur;
+  if (dur <= stallState.loopBudgetMs) return;
+
+  stallState.loopOverBudget++;
+  if (millis() - stallState.lastWarnMs > 10000 || stallState.lastWarnMs == 0) {
+    stallState.lastWarnMs = millis();
+    Serial.printf("[STALL] loop took %lums (budget %lums), worst: %s %lums\n",
+                  (unsigned long)dur, (unsigned long)stallState.loopBudgetMs,
+                  stallState.passWorstSite[0] ? stallState.passWorstSite : "(untracked)",
+                  (unsigned long)stallState.passWorstMs);
+  }
+  if (!stallState.passWorstSite[0]) stallRecord("loop (untracked)", dur);
+}
+
+// Times server.handleClient(); the request (if any) is attributed to its URI.
+template <typename Server>
+static void stallHandleClient(Server& srv) {
+  uint32_t t0 = millis();
+  srv.handleClient();
+  uint32_t dur = millis() - t0;
+  if (dur < STALL_MIN_MS) return;
+  String site = "http " + srv.uri();
+  stallRecord(site.c_str(), dur);
+}
+
+// ---------- output ----------
+static String stallAgo(const StallEntry& e) {
+  uint32_t s = (millis() - e.atMs) / 1000;
+  if (s < 120) return String(s) + "s ago";
+  if (s < 7200) return String(s / 60) + "m ago";
+  return String(s / 3600) + "h ago";
+}
+
+static String stallWhen(const StallEntry& e) {
+  if (!e.epoch) return stallAgo(e);
+  time_t t = (time_t)e.epoch;
+  struct tm tmv;
+  localtime_r(&t, &tmv);
+  char buf[24];
+  strftime(buf, sizeof(buf), "%m-%d %H:%M:%S", &tmv);
+  return String(buf) + " (" + stallAgo(e) + ")";
+}
+
+// snapshot under the lock so the page never sees a half-written entry
+static void stallSnapshot(StallState& out) {
+  portENTER_CRITICAL(&stallMux);
+  out = stallState;
+  portEXIT_CRITICAL(&stallMux);
+}
+
+static String stallTableRows(const StallEntry* list, int n, int head, bool ring) {
+  String rows = "";
+  for (int i = 0; i < n; i++) {
+    // ring: newest first
+    const StallEntry& e = ring ? list[(head - 1 - i + STALL_RING_N) % STALL_RING_N] : list[i];
+    rows += "<tr><td>" + String(e.durMs) + " ms</td><td>" + String(e.site) + "</td><td>" + stallWhen(e) + "</td></tr>";
+  }
+  if (!n) rows = "<tr><td colspan='3'>none</td></tr>";
+  return rows;
+}
+
+static String stallJson() {
+  static StallState s;
+  stallSnapshot(s);
+
+  String out = "{\"budget_ms\":" + String(s.loopBudgetMs)
+             + ",\"loop_over_budget\":" + String(s.loopOverBudget)
+             + ",\"loop_worst_ms\":" + String(s.loopWorstMs)
+             + ",\"stalls_total\":" + String(s.stallsTotal)
+             + ",\"top\":[";
+  for (int i = 0; i < s.topCount; i++) {
+    const StallEntry& e = s.top[i];
+    if (i) out += ",";
+    out += "{\"site\":\"" + String(e.site) + "\",\"ms\":" + String(e.durMs)
+         + ",\"at_ms\":" + String(e.atMs) + ",\"epoch\":" + String(e.epoch) + "}";
+  }
+  out += "],\"recent\":[";
+  for (int i = 0; i < s.ringCount; i++) {
+    const StallEntry& e = s.ring[(s.ringHead - 1 - i + STALL_RING_N) % STALL_RING_N];
+    if (i) out += ",";
+    out += "{\"site\":\"" + String(e.site) + "\",\"ms\":" + String(e.durMs)
+         + ",\"at_ms\":" + String(e.atMs) + ",\"epoch\":" + String(e.epoch) + "}";
+  }
+  out += "]}";
+  return out;
+}
+
+// appended to /metrics by each app
+static void stallMetricsOut(String& out) {
+  metricHeader(out, "metarlw_stalls_total", "Blocking calls >= 50 ms", "counter");
+  metricLine(out, "metarlw_stalls_total", "", stallState.stallsTotal);
+  metricHeader(out, "metarlw_loop_over_budget_total", "loop() passes over the stall budget", "counter");
+  metricLine(out, "metarlw_loop_over_budget_total", "", stallState.loopOverBudget);
+  metricGaugeOut(out, "metarlw_loop_worst_seconds", "Longest loop() pass since boot/clear", stallState.loopWorstMs / 1000.0);
+}
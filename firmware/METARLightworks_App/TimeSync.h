@@ -0,0 +1,201 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <sys/time.h>
+#include <time.h>
+#include "Metrics.h"
+
+// ---------- Time sync (SNTP, non-blocking) ----------
+// timeSyncBegin() hands up to three servers to SNTP and returns at once;
+// syncs arrive on lwIP's task through timeSyncNotify(). Nothing waits for
+// them: callers ask timeValid() / timeQuality() and degrade instead.
+//
+// Each sync is a point (esp_timer us, server wall us). Between syncs the
+// wall clock is extrapolated from the last point with the measured crystal
+// drift, so timeNowUs() is smooth and its error can be bounded:
+//
+//   if (timeQuality() == TIME_SYNCED) startAnimationAt(timeNowUs());
+//
+//   TIME_UNSYNCED  no sync this boot (the RTC may still carry a clock over
+//                  a soft reset; timeValid() says whether it is plausible)
+//   TIME_SYNCED    synced within TIME_STALE_AFTER_S
+//   TIME_STALE     synced once, but the server has gone quiet since
+
+static const int TIME_MAX_SERVERS = 3;
+static const uint32_t TIME_SYNC_INTERVAL_MS = 60UL * 60UL * 1000UL;
+static const uint32_t TIME_STALE_AFTER_S = 4UL * 3600UL;        // 3 missed syncs
+static const uint32_t TIME_DRIFT_MIN_SPAN_S = 600;              // shorter spans: too noisy
+static const float TIME_CRYSTAL_PPM = 50.0f;                    // bound until drift is measured
+static const uint32_t TIME_BASE_ERROR_MS = 20;                  // SNTP over Wi-Fi
+static const time_t TIME_VALID_EPOCH = 1600000000;              // anything earlier: no clock
+
+enum TimeQuality : uint8_t { TIME_UNSYNCED, TIME_SYNCED, TIME_STALE };
+
+struct TimeSyncState {
+  char servers[TIME_MAX_SERVERS][64];   // SNTP keeps the pointers, so they live here
+  int serverCount = 0;
+
+  // written by timeSyncNotify() under timeMux
+  uint32_t syncs = 0;
+  int64_t baseMonoUs = 0;      // esp_timer at the last sync
+  int64_t baseWallUs = 0;      // server time at the last sync
+  float driftPpm = 0;          // local clock slow (+) / fast (-) vs the server
+  bool driftKnown = false;
+  int32_t lastCorrectionUs = 0;   // model minus server at the last sync
+  float residualPpm = 0;          // that correction over the span it built up in
+};
+
+static TimeSyncState timeState;
+static portMUX_TYPE timeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool timeValid(time_t t) { return t >= TIME_VALID_EPOCH; }
+static bool timeValid() { return timeValid(time(nullptr)); }
+
+// epoch for logs and captures; 0 while there is no plausible clock
+static uint32_t timeEpochOrZero() {
+  time_t now = time(nullptr);
+  return timeValid(now) ? (uint32_t)now : 0;
+}
+
+static int64_t timeModelUs(const TimeSyncState& s, int64_t monoUs) {
+  int64_t d = monoUs - s.baseMonoUs;
+  return s.baseWallUs + d + (int64_t)((double)d * s.driftPpm / 1e6);
+}
+
+static void timeSyncNotify(struct timeval* tv) {
+  int64_t mono = esp_timer_get_time();
+  int64_t wall = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec;
+
+  portENTER_CRITICAL(&timeMux);
+  TimeSyncState& s = timeState;
+  if (s.syncs) {
+    int64_t span = mono - s.baseMonoUs;
+    int64_t corr = timeModelUs(s, mono) - wall;
+    s.lastCorrectionUs = (int32_t)constrain(corr, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+    if (span >= (int64_t)TIME_DRIFT_MIN_SPAN_S * 1000000LL) {
+      s.residualPpm = (float)((double)corr / (double)span * 1e6);
+      float measured = (float)((double)(wall - s.baseWallUs - span) / (double)span * 1e6);
+      s.driftPpm = s.driftKnown ? 0.7f * s.driftPpm + 0.3f * measured : measured;
+      s.driftKnown = true;
+    }
+  }
+  s.baseMonoUs = mono;
+  s.baseWallUs = wall;
+  s.syncs++;
+  portEXIT_CRITICAL(&timeMux);
+}
+
+static TimeSyncState timeSnapshot() {
+  portENTER_CRITICAL(&timeMux);
+  TimeSyncState s = timeState;
+  portEXIT_CRITICAL(&timeMux);
+  return s;
+}
+
+static uint32_t timeSyncCount() { return timeSnapshot().syncs; }
+
+static uint32_t timeSinceSyncS() {
+  TimeSyncState s = timeSnapshot();
+  if (!s.syncs) return 0;
+  return (uint32_t)((esp_timer_get_time() - s.baseMonoUs) / 1000000LL);
+}
+
+static TimeQuality timeQuality() {
+  TimeSyncState s = timeSnapshot();
+  if (!s.syncs) return TIME_UNSYNCED;
+  uint32_t age = (uint32_t)((esp_timer_get_time() - s.baseMonoUs) / 1000000LL);
+  return age > TIME_STALE_AFTER_S ? TIME_STALE : TIME_SYNCED;
+}
+
+static const char* timeQualityName(TimeQuality q) {
+  switch (q) {
+    case TIME_SYNCED: return "synced";
+    case TIME_STALE:  return "stale";
+    default:          return "unsynced";
+  }
+}
+
+// Drift-corrected wall clock (us). Falls back to the system clock before
+// the first sync.
+static int64_t timeNowUs() {
+  TimeSyncState s = timeSnapshot();
+  if (!s.syncs) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  }
+  return timeModelUs(s, esp_timer_get_time());
+}
+
+// Rough bound on |timeNowUs() - true time|; 0 when unsynced (unknown).
+static uint32_t timeErrorBoundMs() {
+  TimeSyncState s = timeSnapshot();
+  if (!s.syncs) return 0;
+  double ageS = (double)(esp_timer_get_time() - s.baseMonoUs) / 1e6;
+  double ppm = s.driftKnown ? fabs(s.residualPpm) + 2.0 : TIME_CRYSTAL_PPM;
+  return TIME_BASE_ERROR_MS + (uint32_t)(ageS * ppm / 1000.0);
+}
+
+// Comma-separated list, first wins (e.g. "192.168.1.1,pool.ntp.org" for a
+// LAN server with a public fallback). Safe to call again after a change.
+static void timeSyncBegin(const String& serverList) {
+  TimeSyncState& s = timeState;
+  s.serverCount = 0;
+  int from = 0;
+  while (from <= (int)serverList.length() && s.serverCount < TIME_MAX_SERVERS) {
+    int comma = serverList.indexOf(',', from);
+    if (comma < 0) comma = serverList.length();
+    String one = serverList.substring(from, comma);
+    one.trim();
+    if (one.length()) {
+      strncpy(s.servers[s.serverCount], one.c_str(), sizeof(s.servers[0]) - 1);
+      s.servers[s.serverCount][sizeof(s.servers[0]) - 1] = 0;
+      s.serverCount++;
+    }
+    from = comma + 1;
+  }
+  if (!s.serverCount) {
+    strcpy(s.servers[0], "pool.ntp.org");
+    s.serverCount = 1;
+  }
+
+  sntp_set_time_sync_notification_cb(timeSyncNotify);
+  sntp_set_sync_interval(TIME_SYNC_INTERVAL_MS);
+  configTime(0, 0, s.servers[0],
+             s.serverCount > 1 ? s.servers[1] : nullptr,
+             s.serverCount > 2 ? s.servers[2] : nullptr);
+  Serial.printf("[NTP] %d server(s), first %s\n", s.serverCount, s.servers[0]);
+}
+
+// one line for the web UI
+static String timeStatusLine() {
+  TimeSyncState s = timeSnapshot();
+  TimeQuality q = timeQuality();
+  String line = String("Clock: <b>") + timeQualityName(q) + "</b>";
+  if (s.syncs) {
+    line += " &nbsp;|&nbsp; last sync " + String(timeSinceSyncS()) + " s ago";
+    line += " &nbsp;|&nbsp; &plusmn;" + String(timeErrorBoundMs()) + " ms";
+    if (s.driftKnown) line += " &nbsp;|&nbsp; drift " + String(s.driftPpm, 1) + " ppm";
+  }
+  line += " &nbsp;|&nbsp; NTP ";
+  for (int i = 0; i < s.serverCount; i++) {
+    if (i) line += ", ";
+    line += s.servers[i];
+  }
+  return line;
+}
+
+// appended to /metrics by each app
+static void timeMetricsOut(String& out) {
+  TimeSyncState s = timeSnapshot();
+  metricGaugeOut(out, "metarlw_time_quality", "0=unsynced 1=synced 2=stale", (int)timeQuality());
+  metricGaugeOut(out, "metarlw_time_since_sync_seconds", "Seconds since the last SNTP sync", timeSinceSyncS());
+  metricGaugeOut(out, "metarlw_time_error_bound_ms", "Estimated bound on the wall clock error", timeErrorBoundMs());
+  metricGaugeOut(out, "metarlw_time_drift_ppm", "Measured local clock drift vs NTP", s.driftPpm);
+  metricGaugeOut(out, "metarlw_time_last_correction_ms", "Model minus server time at the last sync", s.lastCorrectionUs / 1000.0);
+  metricHeader(out, "metarlw_time_syncs_total", "SNTP syncs since boot", "counter");
+  metricLine(out, "metarlw_time_syncs_total", "", s.syncs);
+}
@@ -4,22 +4,41 @@
 #include <WebServer.h>
 #include <ESP.h>
 #include "AppTypes.h"
+#include "State.h"
+#include "Fetch.h"
+#include "Memory.h"
+#include "TimeSync.h"
+#include "FleetClock.h"
+#include "Hub.h"
+#include "Mqtt.h"
+#include "Live.h"
+#include "Advisory.h"
+#include "Taf.h"
+#include "Terminator.h"
 
 // defined in .ino
 extern WebServer server;
-extern AppConfig cfg;
+
+// shared state: read()/copy() here, change only through update()
+extern SharedState<AppConfig> config;
+extern SharedState<MapStatus> mapStatus;
+extern SharedState<OtaStatus> otaState;
+extern SharedState<ScheduleState> schedState;
 
 extern bool saveConfig();
 extern void restartMDNSFixed();
 extern void rebuildStripFromConfig();
-extern void refreshNow();
+extern void requestRefresh();
+extern void requestFullRefresh();
+extern void handleHubObs();
+extern void handleTaf();
+extern void hubApplyConfig();
+extern void mqttApplyConfig();
+extern void liveApplyConfig();
+extern void staleApplyConfig();
 extern void clearLED();
 extern void setLEDColor(uint8_t r, uint8_t g, uint8_t b);
 
-// OTA status from .ino
-extern String otaStatusLine;
-extern bool   otaUpdateAvailable;
-extern unsigned long otaLastCheckMs;
 extern const char* otaAssetNameForThisChip();
 
 // OTA actions in .ino
@@ -27,6 +46,12 @@ extern bool otaCheckNow();
 extern void otaInstallNow();
 extern void otaMaybeAutoCheck();
 
+// Bench suite + metrics in .ino
+extern String runBenchSuite(const String& only, bool live);
+extern const String& metricsText();
+extern int tokenCapacity();
+extern ScheduleConfig mapScheduleConfig();
+
 // ---------- Basic Auth ----------
 static const char* ADMIN_USER = "admin";
 static const char* ADMIN_PASS = "north";  // keep same as your Lamp, or change
@@ -77,19 +102,58 @@ static String pageStyle() {
     ".btnrow{display:flex;gap:8px;flex-wrap:wrap;margin-top:10px}"
     ".btnrow button{flex:1;min-width:160px}"
     "a{color:#1a73e8;text-decoration:none}"
+    ".sched td,.sched th{padding:2px 6px}"
+    "label input[type=checkbox]{width:auto;margin-right:6px}"
     "</style>";
 }
 
-static void handleRoot() {
+static const char* const TZ_CHOICES[][2] = {
+  { "UTC0", "UTC" },
+  { "EST5EDT", "America/New_York" },
+  { "CST6CDT", "America/Chicago" },
+  { "MST7MDT", "America/Denver" },
+  { "PST8PDT", "America/Los_Angeles" },
+};
+
+static String tzSelectHtml(const String& cur) {
+  String h = "<select name='tz'>";
+  for (auto& tz : TZ_CHOICES) {
+    h += "<option value='" + String(tz[0]) + "'" + String(cur == tz[0] ? " selected" : "") + ">" + tz[1] + "</option>";
+  }
+  h += "</select>";
+  return h;
+}
+
+static String tafSelectHtml() {
+  String h = "<select id='tafSel'>";
+  h += String("<option value='0'") + (!tafAnimate && !tafViewHours ? " selected" : "") + ">Now (METAR)</option>";
+  for (int i = 1; i <= TAF_ANIM_HOURS; i++) {
+    h += "<option value='" + String(i) + "'" + (!tafAnimate && tafViewHours == i ? " selected" : "") + ">+" + String(i) + " h</option>";
+  }
+  h += String("<option value='anim'") + (tafAnimate ? " selected" : "") + ">Animate next " + String(TAF_ANIM_HOURS) + " h</option>";
+  h += "</select>";
+  return h;
+}
+
+static bool provisionedForMap(const AppConfig& cfg) {
+  return cfg.provisioned && cfg.app_role.length() && cfg.app_role.equalsIgnoreCase("map");
+}
+
+static String buildRootPage() {
+  auto snap = config.read();
+  const AppConfig& cfg = *snap;
+  MapStatus st = mapStatus.copy();
+  OtaStatus ota = otaState.copy();
+
   // Map provisioning gate
-  bool ok = (cfg.provisioned && cfg.app_role.length() && cfg.app_role.equalsIgnoreCase("map"));
+  bool ok = provisionedForMap(cfg);
 
   String html =
     "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
     "<title>METAR Map</title>" + pageStyle() +
     "</head><body><div class='card'>"
     "<h2>🗺️ METAR Map</h2>"
-    "<p class='small'>mDNS: <b>metarmap.local</b> &nbsp; | &nbsp; LEDs: <b>" + String(cfg.led_count) + "</b> / 250</p>";
+    "<p class='small'>mDNS: <b>metarmap.local</b> &nbsp; | &nbsp; LEDs: <b>" + String(st.ledCount) + "</b> / " + String(tokenCapacity()) + "</p>";
 
   if (!ok) {
     html +=
@@ -101,8 +165,7 @@ static void handleRoot() {
       "</pre>"
       "<p class='small'>SoftAP is running so you can reach this page.</p>"
       "</div></body></html>";
-    server.send(200, "text/html", html);
-    return;
+    return html;
   }
 
   html +=
@@ -111,10 +174,12 @@ static void handleRoot() {
     "<textarea name='map_list'>" + cfg.map_list + "</textarea>"
     "<p class='small'>Tokens supported: <b>ICAO</b> (KJFK), <b>SKIP</b>, and legend tokens <b>VFR</b>, <b>MVFR</b>, <b>IFR</b>, <b>LIFR</b>.</p>"
     "<p class='small'>Refresh is every <b>20 minutes</b>. Fallback radius <b>75nm</b>. If no data + no fallback: dim white.</p>"
+    "<p class='small'>Each refresh fetches only stations whose METAR is 50 minutes old or missing "
+    "(last: <b>" + String(st.stationsDue) + "</b> of " + String(st.stations) + "); Refresh Now fetches all.</p>"
 
     "<div class='row'>"
       "<div><label>Brightness (1-255)</label><input name='brightness' type='number' min='1' max='255' value='" + String(cfg.brightness) + "'></div>"
-      "<div><label>Derived LED Count</label><input value='" + String(cfg.led_count) + "' disabled></div>"
+      "<div><label>Derived LED Count</label><input value='" + String(st.ledCount) + "' disabled></div>"
     "</div>"
 
     "<div class='btnrow'>"
@@ -124,9 +189,37 @@ static void handleRoot() {
     "</div>"
     "</form>"
 
+    "<hr>"
+    "<h3>Forecast (TAF)</h3>"
+    "<p class='small'>" + tafStatusLine() + "</p>"
+    "<label>Show</label>" + tafSelectHtml() +
+    "<p class='small'>Choosing a forecast turns the TAF fetch on (with each refresh). Airports without a TAF "
+    "take the nearest one within 75nm; hours past the end of the TAF show as no data.</p>"
+    "<script>document.getElementById('tafSel').onchange=function(){"
+      "var v=this.value;fetch(v==='anim'?'/taf?animate=1':'/taf?hours='+encodeURIComponent(v)).then(()=>location.reload());"
+    "};</script>"
+
+    "<hr>"
+    "<h3>Data Age</h3>"
+    "<p class='small'>" + staleStatusLine() + "</p>"
+    "<form method='POST' action='/stale'>" + staleFieldsHtml(cfg.stale) +
+    "<div class='btnrow'><button type='submit'>💾 Save</button></div>"
+    "</form>"
+    "<p class='small'>Counted from each METAR's observation time. A missing station takes the nearest "
+    "current one within 75nm, like a station with no METAR at all.</p>"
+
+    "<hr>"
+    "<h3>Schedule</h3>"
+    "<form method='POST' action='/schedule'>" + scheduleFieldsHtml(cfg.sched) +
+    "<label>Time Zone</label>" + tzSelectHtml(cfg.timezonePref) +
+    "<div class='btnrow'><button type='submit'>💾 Save Schedule</button></div>"
+    "</form>" + scheduleStatusHtml(mapScheduleConfig(), schedState.copy()) +
+    "<p class='small'>" + timeStatusLine() + "</p>"
+    "<p class='small'>Without a set location the sun is taken at the mean station position.</p>"
+
     "<hr>"
     "<h3>OTA Updates</h3>"
-    "<p><span class='badge'>" + otaStatusLine + "</span></p>"
+    "<p><span class='badge'>" + ota.statusLine + "</span></p>"
     "<p class='small'>Asset: " + String(otaAssetNameForThisChip()) + "</p>"
     "<p class='small'>Auto-update: <b>" + String(cfg.otaAutoUpdate ? "ON" : "OFF") + "</b> &nbsp; | &nbsp; Interval: <b>" + String(cfg.otaIntervalDays) + " days</b></p>"
 
@@ -167,29 +260,64 @@ static void handleRoot() {
     "<p><a href='/admin'>🔒 Admin</a></p>"
     "</div></body></html>";
 
-  server.send(200, "text/html", html);
+  return html;
+}
+
+static void handleRoot() {
+  server.send(200, "text/html", buildRootPage());
 }
 
 static void handleSave() {
-  bool ok = (cfg.provisioned && cfg.app_role.length() && cfg.app_role.equalsIgnoreCase("map"));
-  if (!ok) { server.send(403, "text/plain", "Not provisioned"); return; }
+  if (!provisionedForMap(*config.read())) { server.send(403, "text/plain", "Not provisioned"); return; }
+
+  String list = server.arg("map_list");
+  int brightness = server.arg("brightness").toInt();
+  if (brightness < 1) brightness = 1;
+  if (brightness > 255) brightness = 255;
+
+  config.update([&](AppConfig& c) {
+    c.map_list = list;
+    c.brightness = brightness;
+  });
+
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed"); return; }
+
+  requestRefresh();   // the refresh job re-parses the list, rebuilds the strip and fetches
+  server.sendHeader("Location", "/");
+  server.send(302, "text/plain", "Saved");
+}
+
+static void handleSchedule() {
+  if (!provisionedForMap(*config.read())) { server.send(403, "text/plain", "Not provisioned"); return; }
+
+  String tz = server.hasArg("tz") ? server.arg("tz") : String("UTC0");
+  config.update([&](AppConfig& c) {
+    scheduleFromArgs(server, c.sched);
+    c.timezonePref = tz;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed"); return; }
+
+  // the render side re-evaluates on the config version bump
+  setenv("TZ", tz.c_str(), 1);
+  tzset();
+  server.sendHeader("Location", "/");
+  server.send(302, "text/plain", "Saved");
+}
 
-  cfg.map_list = server.arg("map_list");
-  cfg.brightness = server.arg("brightness").toInt();
-  if (cfg.brightness < 1) cfg.brightness = 1;
-  if (cfg.brightness > 255) cfg.brightness = 255;
+static void handleStale() {
+  if (!provisionedForMap(*config.read())) { server.send(403, "text/plain", "Not provisioned"); return; }
 
+  config.update([&](AppConfig& c) { staleFromArgs(server, c.stale); });
   if (!saveConfig()) { server.send(500, "text/plain", "Save failed"); return; }
 
-  refreshNow();   // refreshNow() already parses token list + rebuilds strip + fetches
+  staleApplyConfig();   // fallbacks follow the new missing step
   server.sendHeader("Location", "/");
   server.send(302, "text/plain", "Saved");
 }
 
 static void handleRefresh() {
-  bool ok = (cfg.provisioned && cfg.app_role.length() && cfg.app_role.equalsIgnoreCase("map"));
-  if (!ok) { server.send(403, "text/plain", "Not provisioned"); return; }
-  refreshNow();
+  if (!provisionedForMap(*config.read())) { server.send(403, "text/plain", "Not provisioned"); return; }
+  requestFullRefresh();
   server.send(200, "text/plain", "OK");
 }
 
@@ -202,13 +330,13 @@ static void handleReboot() {
 // ---------- OTA endpoints (same pattern as Lamp) ----------
 static void handleOtaCheck() {
   bool ok = otaCheckNow();
-  server.send(ok ? 200 : 500, "text/plain", otaStatusLine);
+  server.send(ok ? 200 : 500, "text/plain", otaState.read()->statusLine);
 }
 
 static void handleOtaInstall() {
   bool ok = otaCheckNow();
-  if (!ok) { server.send(500, "text/plain", otaStatusLine); return; }
-  if (!otaUpdateAvailable) { server.send(200, "text/plain", "No update available"); return; }
+  if (!ok) { server.send(500, "text/plain", otaState.read()->statusLine); return; }
+  if (!otaState.read()->updateAvailable) { server.send(200, "text/plain", "No update available"); return; }
   server.send(200, "text/plain", "Installing update... device will reboot.");
   delay(100);
   otaInstallNow(); // will reboot on success
@@ -220,8 +348,10 @@ static void handleOtaSettings() {
   if (days < 1) days = 1;
   if (days > 60) days = 60;
 
-  cfg.otaAutoUpdate = (a == "on");
-  cfg.otaIntervalDays = days;
+  config.update([&](AppConfig& c) {
+    c.otaAutoUpdate = (a == "on");
+    c.otaIntervalDays = days;
+  });
 
   if (!saveConfig()) { server.send(500, "text/plain", "Save failed"); return; }
   server.send(200, "text/plain", "Saved");
@@ -230,6 +360,7 @@ static void handleOtaSettings() {
 // ---------- Admin pages (LED setup + reboot + LED test) ----------
 static void handleAdminHome() {
   if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
 
   String html =
     "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
@@ -237,9 +368,18 @@ static void handleAdminHome() {
     "</head><body><div class='card'>"
     "<h2>🔒 Admin</h2>"
     "<a href='/admin/led'>LED Setup</a><br>"
+    "<a href='/admin/bench'>Run Benchmarks (JSON)</a><br>"
+    "<a href='/admin/replay'>Capture / Replay / Demo</a><br>"
+    "<a href='/admin/time'>Clock / NTP</a><br>"
+    "<a href='/admin/hub'>LAN METAR Hub</a><br>"
+    "<a href='/admin/mqtt'>MQTT</a><br>"
+    "<a href='/admin/live'>Live LED Input (DDP / E1.31)</a><br>"
+    "<a href='/admin/overlay'>Overlays (SIGMET / AIRMET, day/night)</a><br>"
+    "<a href='/admin/diag'>Diagnostics (stalls)</a><br>"
+    "<a href='/admin/log'>Event Log / Core Dump</a><br>"
     "<a href='/admin/reboot' onclick=\"return confirm('Reboot now?')\">Reboot Device</a><br>"
     "<hr>"
-    "<p class='small'><b>LED:</b> Pin " + String(cfg.led_pin) + " | Count " + String(cfg.led_count) + " | Order " + cfg.led_order + "</p>"
+    "<p class='small'><b>LED:</b> Pin " + String(cfg.led_pin) + " | Count " + String(mapStatus.read()->ledCount) + " | Order " + cfg.led_order + "</p>"
     "<p><a href='/'>Back</a></p>"
     "</div></body></html>";
 
@@ -248,6 +388,7 @@ static void handleAdminHome() {
 
 static void handleAdminLed() {
   if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
   int maxPin = isChipC3() ? 21 : 33;
 
   String html =
@@ -269,7 +410,7 @@ static void handleAdminLed() {
       "<option value='BGR'" + String(cfg.led_order=="BGR"?" selected":"") + ">BGR</option>"
     "</select>"
 
-    "<p class='small'>LED count is derived from the token list (max 250).</p>"
+    "<p class='small'>LED count is derived from the token list (max " + String(tokenCapacity()) + ").</p>"
     "<button type='submit'>Save</button>"
     "</form>"
 
@@ -298,8 +439,10 @@ static void handleAdminLedSave() {
     return;
   }
 
-  cfg.led_pin = pin;
-  cfg.led_order = order;
+  config.update([&](AppConfig& c) {
+    c.led_pin = pin;
+    c.led_order = order;
+  });
 
   if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
 
@@ -327,11 +470,524 @@ static void handleAdminReboot() {
   ESP.restart();
 }
 
+// ---------- Capture / replay (fetch layer) ----------
+static void handleAdminReplay() {
+  if (!adminAuth()) return;
+  int replaySpeed = config.read()->replaySpeed;
+  int fetchParallel = config.read()->fetchParallel;
+  MapStatus st = mapStatus.copy();
+
+  String rows = "";
+  for (int i = 0; i < PROV_COUNT; i++) {
+    FetchProvider p = (FetchProvider)i;
+    rows += "<tr><td>" + String(fetchProviderName(p)) + "</td><td>" + String((unsigned)fetchCaptureSize(p)) + " bytes"
+          + String(fetchState.captureFull[i] ? " (full)" : "") + "</td>"
+          + "<td><a href='/admin/replay/file?p=" + String(fetchProviderName(p)) + "'>download</a></td></tr>";
+  }
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Capture / Replay</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Capture / Replay</h2>"
+    "<p><span class='badge'>Mode: " + String(fetchModeName(fetchState.mode)) + " | Speed: " + String(fetchState.speed) + "x</span></p>"
+    "<p class='small'><b>capture</b> saves raw provider responses to LittleFS. "
+    "<b>replay</b> serves them back with no network on a clock sped up by <i>speed</i> (demo mode).</p>"
+    "<table class='small'>" + rows + "</table>"
+    "<form method='GET' action='/admin/replay/set'>"
+    "<div class='row'>"
+      "<div><label>Mode</label><select name='mode'>"
+        "<option value='live'" + String(fetchState.mode==FETCH_LIVE?" selected":"") + ">Live</option>"
+        "<option value='capture'" + String(fetchState.mode==FETCH_CAPTURE?" selected":"") + ">Capture</option>"
+        "<option value='replay'" + String(fetchState.mode==FETCH_REPLAY?" selected":"") + ">Replay / Demo</option>"
+      "</select></div>"
+      "<div><label>Replay speed (1-600x)</label><input name='speed' type='number' min='1' max='600' value='" + String(replaySpeed) + "'></div>"
+      "<div><label>METAR connections (1-3)</label><input name='parallel' type='number' min='1' max='3' value='" + String(fetchParallel) + "'></div>"
+    "</div>"
+    "<p class='small'>Live mode on dual-core boards splits the METAR fetch over this many HTTPS connections "
+    "(last refresh: <b>" + String(st.metarConnections) + "</b>, " + String(st.metarPhaseMs) + " ms). "
+    "Capture and replay always use one.</p>"
+    "<button type='submit'>Apply</button>"
+    "</form>"
+    "<div class='btnrow'>"
+      "<button type='button' onclick=\"if(confirm('Delete all captures?'))fetch('/admin/replay/clear').then(()=>location.reload())\">Clear Captures</button>"
+    "</div>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminReplaySet() {
+  if (!adminAuth()) return;
+
+  FetchMode mode = fetchModeFromString(server.arg("mode"));
+  int speed = server.arg("speed").toInt();
+  if (speed < 1) speed = 1;
+  if (speed > 600) speed = 600;
+  int parallel = server.hasArg("parallel") ? server.arg("parallel").toInt() : config.read()->fetchParallel;
+  if (parallel < 1) parallel = 1;
+  if (parallel > 3) parallel = 3;
+
+  config.update([&](AppConfig& c) {
+    c.fetchMode = fetchModeName(mode);
+    c.replaySpeed = speed;
+    c.fetchParallel = parallel;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  fetchSetMode(mode, speed);
+  server.sendHeader("Location", "/admin/replay");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- Clock / NTP ----------
+static void handleAdminTime() {
+  if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Clock / NTP</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Clock / NTP</h2>"
+    "<p class='small'>" + timeStatusLine() + "</p>"
+    "<p class='small'>" + fleetStatusLine() + "</p>"
+    "<form method='POST' action='/admin/time/save'>"
+    "<label>NTP servers (comma-separated, up to 3, first preferred)</label>"
+    "<input name='servers' value='" + cfg.ntpServers + "'>"
+    "<label>Fleet sync (LAN time beacon, udp/" + String(FLEET_PORT) + ")</label>"
+    "<select name='fleet'>"
+      "<option value='on'" + String(cfg.fleetSync ? " selected" : "") + ">ON: share the clock with nearby lamps</option>"
+      "<option value='off'" + String(cfg.fleetSync ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<p class='small'>Put a LAN server (router or NAS IP) first to keep the clock without internet.</p>"
+    "<button type='submit'>Save &amp; Resync</button>"
+    "</form>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminTimeSave() {
+  if (!adminAuth()) return;
+
+  String servers = server.arg("servers");
+  servers.trim();
+  if (!servers.length()) servers = "pool.ntp.org";
+  bool fleetOn = (server.arg("fleet") != "off");
+  config.update([&](AppConfig& c) {
+    c.ntpServers = servers;
+    c.fleetSync = fleetOn;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  timeSyncBegin(servers);
+  setenv("TZ", config.read()->timezonePref.c_str(), 1);   // configTime() resets TZ
+  tzset();
+  fleetBegin(fleetOn);
+  server.sendHeader("Location", "/admin/time");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- LAN METAR hub (Hub.h) ----------
+static void handleAdminHub() {
+  if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>LAN METAR Hub</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>LAN METAR Hub</h2>"
+    "<p class='small'>" + (cfg.hubServe ? String("Serving <b>/hub/obs</b> to the LAN (_metarhub._tcp)") : hubStatusLine()) + "</p>"
+    "<form method='POST' action='/admin/hub/save'>"
+    "<label>Serve observations to lamps and maps on this network</label>"
+    "<select name='serve'>"
+      "<option value='on'" + String(cfg.hubServe ? " selected" : "") + ">ON: this map is the hub</option>"
+      "<option value='off'" + String(cfg.hubServe ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<label>Use a hub (when not serving): auto, off, or host[:port]</label>"
+    "<input name='use' value='" + cfg.hubUse + "'>"
+    "<p class='small'>Auto finds a hub over mDNS. If it stops answering, this map fetches from aviationweather.gov directly.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminHubSave() {
+  if (!adminAuth()) return;
+
+  bool serve = (server.arg("serve") == "on");
+  String use = server.arg("use");
+  use.trim();
+  if (!use.length()) use = "auto";
+  config.update([&](AppConfig& c) {
+    c.hubServe = serve;
+    c.hubUse = use;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  hubApplyConfig();
+  restartMDNSFixed();   // (un)advertise _metarhub
+  server.sendHeader("Location", "/admin/hub");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- MQTT (Mqtt.h) ----------
+static void handleAdminMqtt() {
+  if (!adminAuth()) return;
+  MqttSettings m = config.read()->mqtt;
+  String base = m.base.length() ? m.base : mqttDefaultBase("map");
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>MQTT</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>MQTT</h2>"
+    "<p class='small'>" + mqttStatusLine() + "</p>"
+    "<form method='POST' action='/admin/mqtt/save'>"
+    "<label>MQTT</label>"
+    "<select name='enabled'>"
+      "<option value='on'" + String(m.enabled ? " selected" : "") + ">ON</option>"
+      "<option value='off'" + String(m.enabled ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<label>Broker host</label><input name='host' value='" + m.host + "'>"
+    "<label>Port</label><input name='port' type='number' min='1' max='65535' value='" + String(m.port) + "'>"
+    "<label>User (optional)</label><input name='user' value='" + m.user + "'>"
+    "<label>Password</label><input name='pass' type='password' value='" + m.pass + "'>"
+    "<label>Topic base (blank = default)</label><input name='base' value='" + m.base + "' placeholder='" + mqttDefaultBase("map") + "'>"
+    "<p class='small'>Retained: <b>" + base + "/status</b>, <b>/state</b>, <b>/health</b>, <b>/ota</b>, and per airport "
+    "<b>/station/&lt;ICAO&gt;/category</b> and <b>/obs</b>. "
+    "Commands: <b>" + base + "/cmd/brightness</b> (1..255), <b>/cmd/refresh</b>.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminMqttSave() {
+  if (!adminAuth()) return;
+
+  MqttSettings m;
+  m.enabled = (server.arg("enabled") == "on");
+  m.host = server.arg("host");
+  m.host.trim();
+  m.port = (uint16_t)constrain((int)server.arg("port").toInt(), 1, 65535);
+  m.user = server.arg("user");
+  m.pass = server.arg("pass");
+  m.base = server.arg("base");
+  m.base.trim();
+  while (m.base.endsWith("/")) m.base.remove(m.base.length() - 1);
+  config.update([&](AppConfig& c) { c.mqtt = m; });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  mqttApplyConfig();
+  server.sendHeader("Location", "/admin/mqtt");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- Live LED input (Live.h) ----------
+static void handleAdminLive() {
+  if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
+  int leds = mapStatus.read()->ledCount;
+  int universes = (leds + LIVE_E131_PIXELS - 1) / LIVE_E131_PIXELS;
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<meta http-equiv='refresh' content='5'>"
+    "<title>Live LED Input</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Live LED Input</h2>"
+    "<p class='small'>" + liveStatusLine() + "</p>"
+    "<form method='POST' action='/admin/live/save'>"
+    "<label>Accept DDP (udp/" + String(LIVE_DDP_PORT) + ") and E1.31 (udp/" + String(LIVE_E131_PORT) + ")</label>"
+    "<select name='enabled'>"
+      "<option value='on'" + String(cfg.liveEnabled ? " selected" : "") + ">ON</option>"
+      "<option value='off'" + String(cfg.liveEnabled ? "" : " selected") + ">OFF</option>"
+    "</select>"
+    "<label>E1.31 start universe</label>"
+    "<input name='universe' type='number' min='1' max='63999' value='" + String(cfg.liveUniverse) + "'>"
+    "<label>Back to weather after (ms without packets)</label>"
+    "<input name='timeout' type='number' min='500' max='60000' value='" + String(cfg.liveTimeoutMs) + "'>"
+    "<p class='small'>" + String(leds) + " LEDs: " + String(universes) + " universe(s) of " + String(LIVE_E131_PIXELS) +
+    " pixels from the start universe, sent unicast to this map's IP. DDP: RGB, offset in bytes. "
+    "The map brightness applies to live frames; the schedule does not.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminLiveSave() {
+  if (!adminAuth()) return;
+
+  bool enabled = (server.arg("enabled") == "on");
+  int universe = constrain((int)server.arg("universe").toInt(), 1, 63999);
+  int timeout = constrain((int)server.arg("timeout").toInt(), 500, 60000);
+  config.update([&](AppConfig& c) {
+    c.liveEnabled = enabled;
+    c.liveUniverse = universe;
+    c.liveTimeoutMs = timeout;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  liveApplyConfig();
+  server.sendHeader("Location", "/admin/live");
+  server.send(302, "text/plain", "Saved");
+}
+
+// ---------- Overlays: SIGMET / AIRMET (Advisory.h), day/night (Terminator.h) ----------
+static void handleAdminOverlay() {
+  if (!adminAuth()) return;
+  AppConfig cfg = config.copy();
+  auto opt = [&](const String& cur, const char* v, const char* label) {
+    return String("<option value='") + v + "'" + (cur == v ? " selected" : "") + ">" + label + "</option>";
+  };
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Overlays</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Overlays</h2>"
+    "<form method='POST' action='/admin/overlay/save'>"
+    "<h3>SIGMET / AIRMET</h3>"
+    "<p class='small'>" + advStatusLine() + "</p>"
+    "<label>Animate stations inside active advisories</label>"
+    "<select name='mode'>" +
+      opt(cfg.advOverlay, "off", "Off") + opt(cfg.advOverlay, "sigmet", "SIGMETs and convective SIGMETs") +
+      opt(cfg.advOverlay, "all", "SIGMETs and AIRMETs") +
+    "</select>"
+    "<p class='small'>Convective SIGMET: double white flash. SIGMET: white swell. "
+    "AIRMET (G-AIRMET, current snapshot): slow breathe. Polygons are fetched with each map refresh; "
+    "the animation is phased on the fleet clock so maps on the LAN pulse together.</p>"
+    "<h3>Day / night</h3>"
+    "<p class='small'>" + termStatusLine(termModeFromString(cfg.termMode)) + "</p>"
+    "<label>Stations where the sun is down</label>"
+    "<select name='term'>" +
+      opt(cfg.termMode, "off", "Off") + opt(cfg.termMode, "dim", "Dim") +
+      opt(cfg.termMode, "tint", "Dusk tint") + opt(cfg.termMode, "both", "Dim + dusk tint") +
+    "</select>"
+    "<label>Night level (% of the station color)</label>"
+    "<input name='night' type='number' min='0' max='100' value='" + String(cfg.termNightPct) + "'>"
+    "<p class='small'>Per station, from its own sun elevation: full at sunset, night level from nautical "
+    "dusk (-12&deg;). The tint is strongest at the horizon. Stacks with the schedule's solar dimming.</p>"
+    "<button type='submit'>Save</button>"
+    "</form>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminOverlaySave() {
+  if (!adminAuth()) return;
+
+  String mode = server.arg("mode"); mode.trim(); mode.toLowerCase();
+  if (!advKindsForMode(mode)) mode = "off";
+  String termMode = server.arg("term"); termMode.trim(); termMode.toLowerCase();
+  if (!termModeFromString(termMode)) termMode = "off";
+  int night = constrain((int)server.arg("night").toInt(), 0, 100);
+
+  bool advChanged = mode != config.read()->advOverlay;
+  config.update([&](AppConfig& c) {
+    c.advOverlay = mode;
+    c.termMode = termMode;
+    c.termNightPct = night;
+  });
+  if (!saveConfig()) { server.send(500, "text/plain", "Save failed."); return; }
+
+  // polygons are fetched (or dropped) by a refresh; the terminator is render-side
+  if (advChanged) requestRefresh();
+  server.sendHeader("Location", "/admin/overlay");
+  server.send(302, "text/plain", "Saved");
+}
+
+static void handleAdminReplayFile() {
+  if (!adminAuth()) return;
+
+  String want = server.arg("p"); want.trim(); want.toLowerCase();
+  for (int i = 0; i < PROV_COUNT; i++) {
+    FetchProvider p = (FetchProvider)i;
+    if (want != fetchProviderName(p)) continue;
+    File f = LittleFS.open(fetchCapturePath(p), "r");
+    if (!f) { server.send(404, "text/plain", "No capture."); return; }
+    server.sendHeader("Content-Disposition", "attachment; filename=" + want + ".cap");
+    server.streamFile(f, "application/octet-stream");
+    f.close();
+    return;
+  }
+  server.send(400, "text/plain", "Bad provider. Use p=awc|avwx|adsb|github|hub");
+}
+
+static void handleAdminReplayClear() {
+  if (!adminAuth()) return;
+  fetchClearCaptures();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+// ---------- Diagnostics (stall detector) ----------
+// /admin/diag?format=json for scripts; ?budget=<ms> changes the loop budget (not persisted)
+static void handleAdminDiag() {
+  if (!adminAuth()) return;
+
+  if (server.hasArg("budget")) stallSetBudget((uint32_t)server.arg("budget").toInt());
+  if (server.arg("format") == "json") {
+    server.send(200, "application/json", stallJson());
+    return;
+  }
+
+  static StallState snap;
+  stallSnapshot(snap);
+  HeapSample mem = heapSampleNow();
+
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Diagnostics</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Diagnostics</h2>"
+    "<p><span class='badge'>Loop budget " + String(snap.loopBudgetMs) + " ms | Over budget: " + String(snap.loopOverBudget)
+      + " | Worst loop: " + String(snap.loopWorstMs) + " ms | Stalls: " + String(snap.stallsTotal) + "</span></p>"
+    "<p class='small'>Blocking calls of " + String(STALL_MIN_MS) + " ms or more: web requests, provider fetches, refresh, OTA.</p>"
+    "<h3>Longest</h3>"
+    "<table class='small'><tr><th>Time</th><th>Site</th><th>When</th></tr>"
+      + stallTableRows(snap.top, snap.topCount, 0, false) + "</table>"
+    "<h3>Recent</h3>"
+    "<table class='small'><tr><th>Time</th><th>Site</th><th>When</th></tr>"
+      + stallTableRows(snap.ring, snap.ringCount, snap.ringHead, true) + "</table>"
+    "<h3>Memory</h3>"
+    "<p class='small'>Free " + String((unsigned)mem.freeBytes) + " | Largest block " + String((unsigned)mem.largestBlock)
+      + " (lowest " + String((unsigned)min(heapHistory.largestMin, mem.largestBlock)) + ") | Fragmentation " + String(mem.fragPct)
+      + "% (worst " + String(max(heapHistory.fragMax, mem.fragPct)) + "%)<br>"
+      "JSON arena " + String((unsigned)(jsonArena.cap / 1024)) + " KB, high water " + String((unsigned)(jsonArena.highWater / 1024))
+      + " KB, heap fallbacks " + String(jsonArena.fallbacks) + " | <a href='/admin/heap'>history (JSON)</a></p>"
+    "<form method='GET' action='/admin/diag'>"
+      "<label>Loop budget (ms)</label><input name='budget' type='number' min='20' max='60000' value='" + String(snap.loopBudgetMs) + "'>"
+      "<button type='submit'>Set</button>"
+    "</form>"
+    "<div class='btnrow'>"
+      "<button type='button' onclick=\"fetch('/admin/diag/clear').then(()=>location.reload())\">Clear</button>"
+      "<button type='button' onclick=\"location.href='/admin/diag?format=json'\">JSON</button>"
+    "</div>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminHeap() {
+  if (!adminAuth()) return;
+  server.send(200, "application/json", memoryJson());
+}
+
+static void handleAdminDiagClear() {
+  if (!adminAuth()) return;
+  stallClear();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+// ---------- Event log + core dump ----------
+static void handleAdminLog() {
+  if (!adminAuth()) return;
+
+  size_t cd = elogCoreDumpSize();
+  String html =
+    "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+    "<title>Event Log</title>" + pageStyle() +
+    "</head><body><div class='card'>"
+    "<h2>Event Log</h2>"
+    "<p><span class='badge'>Boot #" + String(elog.bootCount) + " | Last reset: " + String(elogResetReasonName(elog.resetReason)) + "</span></p>"
+    "<p class='small'>Current " + String((unsigned)elogFileSize(ELOG_PATH)) + " bytes, previous " + String((unsigned)elogFileSize(ELOG_PATH_OLD))
+      + " bytes (rotates at " + String((unsigned)(ELOG_MAX_BYTES / 1024)) + " KB). Decode with tools/eventlog_decode.py.</p>"
+    "<p><a href='/admin/log/file?n=0'>Download events.bin</a> | <a href='/admin/log/file?n=1'>Download events.1.bin</a></p>"
+    "<h3>Recent</h3>"
+    "<pre class='small' style='white-space:pre-wrap'>" + elogRecentText(30) + "</pre>"
+    "<h3>Core dump</h3>"
+    "<p class='small'>" + (cd ? ("Stored: " + String((unsigned)cd) + " bytes. <a href='/admin/coredump'>Download (ELF)</a>") : String("None stored.")) + "</p>"
+    "<div class='btnrow'>"
+      "<button type='button' onclick=\"if(confirm('Clear the event log?'))fetch('/admin/log/clear').then(()=>location.reload())\">Clear Log</button>"
+      "<button type='button' onclick=\"if(confirm('Erase the core dump?'))fetch('/admin/coredump/erase').then(()=>location.reload())\">Erase Core Dump</button>"
+    "</div>"
+    "<p><a href='/admin'>Back</a></p>"
+    "</div></body></html>";
+
+  server.send(200, "text/html", html);
+}
+
+static void handleAdminLogFile() {
+  if (!adminAuth()) return;
+  elogFlush();
+  const char* path = (server.arg("n") == "1") ? ELOG_PATH_OLD : ELOG_PATH;
+  File f = LittleFS.open(path, "r");
+  if (!f) { server.send(404, "text/plain", "No log."); return; }
+  server.sendHeader("Content-Disposition", String("attachment; filename=") + (path + 5));
+  server.streamFile(f, "application/octet-stream");
+  f.close();
+}
+
+static void handleAdminLogClear() {
+  if (!adminAuth()) return;
+  elogClear();
+  server.send(200, "text/plain", "Cleared.");
+}
+
+static void handleAdminCoreDump() {
+  if (!adminAuth()) return;
+  size_t size = elogCoreDumpSize();
+  if (!size) { server.send(404, "text/plain", "No core dump."); return; }
+
+  server.sendHeader("Content-Disposition", "attachment; filename=coredump.elf");
+  server.setContentLength(size);
+  server.send(200, "application/octet-stream", "");
+
+  uint8_t buf[1024];
+  for (size_t off = 0; off < size; off += sizeof(buf)) {
+    size_t n = min(sizeof(buf), size - off);
+    if (!elogCoreDumpRead(off, buf, n)) break;
+    server.sendContent((const char*)buf, n);
+  }
+}
+
+static void handleAdminCoreDumpErase() {
+  if (!adminAuth()) return;
+  server.send(200, "text/plain", elogCoreDumpErase() ? "Erased." : "Nothing to erase.");
+}
+
+// /admin/bench?only=<op>&live=1
+// Runs the on-device micro-benchmarks and returns one JSON document.
+// live=1 also times a real refreshNow() (needs Wi-Fi, hits AWC), and a
+// full refresh on one connection vs fetchParallel (metarParallel).
+static void handleAdminBench() {
+  if (!adminAuth()) return;
+  String only = server.arg("only"); only.trim();
+  bool live = (server.arg("live") == "1");
+  server.send(200, "application/json", runBenchSuite(only, live));
+}
+
+// Prometheus scrape target (no auth, read-only)
+static void handleMetrics() {
+  server.send(200, "text/plain; version=0.0.4", metricsText());
+}
+
 static void registerRoutes() {
   server.on("/", HTTP_GET, handleRoot);
   server.on("/save", HTTP_POST, handleSave);
+  server.on("/schedule", HTTP_POST, handleSchedule);
+  server.on("/stale", HTTP_POST, handleStale);
   server.on("/refresh", HTTP_GET, handleRefresh);
   server.on("/reboot", HTTP_GET, handleReboot);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/hub/obs", HTTP_GET, handleHubObs);
+  server.on("/taf", HTTP_GET, handleTaf);
 
   server.on("/ota/check", HTTP_GET, handleOtaCheck);
   server.on("/ota/install", HTTP_GET, handleOtaInstall);
@@ -341,6 +997,29 @@ static void registerRoutes() {
   server.on("/admin/led", HTTP_GET, handleAdminLed);
   server.on("/admin/led/save", HTTP_POST, handleAdminLedSave);
   server.on("/admin/led/test", HTTP_GET, handleAdminLedTest);
+  server.on("/admin/bench", HTTP_GET, handleAdminBench);
+  server.on("/admin/replay", HTTP_GET, handleAdminReplay);
+  server.on("/admin/time", HTTP_GET, handleAdminTime);
+  server.on("/admin/time/save", HTTP_POST, handleAdminTimeSave);
+  server.on("/admin/hub", HTTP_GET, handleAdminHub);
+  server.on("/admin/hub/save", HTTP_POST, handleAdminHubSave);
+  server.on("/admin/mqtt", HTTP_GET, handleAdminMqtt);
+  server.on("/admin/mqtt/save", HTTP_POST, handleAdminMqttSave);
+  server.on("/admin/live", HTTP_GET, handleAdminLive);
+  server.on("/admin/live/save", HTTP_POST, handleAdminLiveSave);
+  server.on("/admin/overlay", HTTP_GET, handleAdminOverlay);
+  server.on("/admin/overlay/save", HTTP_POST, handleAdminOverlaySave);
+  server.on("/admin/replay/set", HTTP_GET, handleAdminReplaySet);
+  server.on("/admin/replay/file", HTTP_GET, handleAdminReplayFile);
+  server.on("/admin/replay/clear", HTTP_GET, handleAdminReplayClear);
+  server.on("/admin/diag", HTTP_GET, handleAdminDiag);
+  server.on("/admin/diag/clear", HTTP_GET, handleAdminDiagClear);
+  server.on("/admin/heap", HTTP_GET, handleAdminHeap);
+  server.on("/admin/log", HTTP_GET, handleAdminLog);
+  server.on("/admin/log/file", HTTP_GET, handleAdminLogFile);
+  server.on("/admin/log/clear", HTTP_GET, handleAdminLogClear);
+  server.on("/admin/coredump", HTTP_GET, handleAdminCoreDump);
+  server.on("/admin/coredump/erase", HTTP_GET, handleAdminCoreDumpErase);
   server.on("/admin/reboot", HTTP_GET, handleAdminReboot);
 
   server.onNotFound([]() {
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Memory.h"
+#include "Metrics.h"
+#include "TimeSync.h"
+
+// ---------- Advisory overlay (SIGMET / AIRMET / G-AIRMET) ----------
+// Active advisories from the AWC Data API are kept as polygons, and every
+// station with a position is tested against them when the snapshot is
+// published. The render side gives affected LEDs an effect on top of their
+// category color (see advEffect()).
+//
+//   advBegin();                                   // first time the overlay is on
+//   advClear();
+//   advParse(body, ADV_SRC_AIRSIGMET, kinds);     // one per AWC response
+//   advIndexBuild();                              // after the last one
+//   uint8_t in = advAt(lat, lon, epoch);          // ADV_* bits
+//
+// Points are stored as int16 hundredths of a degree (4 bytes a point).
+// The index is a uniform grid over the union of the polygon bounding
+// boxes, kept as a CSR list: cellStart[c]..cellStart[c+1] are the polygons
+// whose box overlaps cell c. A lookup is one cell, then a box test, then the
+// crossing-number test only for polygons whose box holds the point, so a
+// few hundred stations against dozens of polygons costs a few hundred
+// polygon tests, not stations x polygons.
+//
+// Only the net task writes (fetch, parse, index, snapshot); the counters
+// are read by /metrics and the admin page.
+
+enum AdvKind : uint8_t {
+  ADV_NONE = 0,
+  ADV_AIRMET = 1,        // AIRMET and G-AIRMET
+  ADV_SIGMET = 2,        // non-convective SIGMET (turbulence, icing, ash, ...)
+  ADV_CONVECTIVE = 4,    // convective SIGMET
+};
+
+enum AdvSource : uint8_t { ADV_SRC_AIRSIGMET, ADV_SRC_GAIRMET };
+
+static const char* ADV_AIRSIGMET_URL = "https://aviationweather.gov/api/data/airsigmet?format=json";
+static const char* ADV_GAIRMET_URL = "https://aviationweather.gov/api/data/gairmet?format=json";
+
+static const int ADV_MAX_POLYS = 128;
+static const int ADV_MAX_POINTS = 4096;
+static const float ADV_CELL_DEG = 2.0f;
+static const int ADV_GRID_MAX_CELLS = 1024;
+static const int ADV_GRID_MAX_ITEMS = 2048;
+static const uint32_t ADV_FRAME_MS = 40;       // animation frame pace
+
+struct AdvPoly {
+  int16_t minLat, maxLat, minLon, maxLon;   // hundredths of a degree
+  uint16_t first;                           // into advPts
+  uint16_t count;
+  uint32_t validTo;                         // epoch, 0 = unknown (kept until the next fetch)
+  uint8_t kind;
+};
+
+struct AdvPt {
+  int16_t lat, lon;
+};
+
+struct AdvStore {
+  AdvPoly* polys = nullptr;
+  AdvPt* pts = nullptr;
+  uint16_t* cellStart = nullptr;            // ADV_GRID_MAX_CELLS + 1
+  uint8_t* cellItems = nullptr;             // ADV_GRID_MAX_ITEMS poly indices
+  int polyCount = 0;
+  int ptCount = 0;
+
+  // grid
+  int16_t gMinLat = 0, gMinLon = 0;
+  int16_t cellSize = 0;                     // hundredths of a degree
+  int cols = 0, rows = 0;
+  int items = 0;
+
+  // last refresh
+  uint32_t fetchedMs = 0;
+  int skipped = 0;                          // polygons or points that did not fit
+  int affected = 0;                         // stations inside at least one polygon
+  uint32_t evalUs = 0;
+  uint32_t lookups = 0;                     // totals
+  uint32_t pipTests = 0;
+  uint32_t fetchFailures = 0;
+};
+
+static AdvStore adv;
+
+static bool advReady() { return adv.polys != nullptr; }
+
+// Allocated the first time the overlay is turned on; kept after that.
+static bool advBegin() {
+  if (adv.polys) return true;
+  adv.polys = (AdvPoly*)memAllocCold(sizeof(AdvPoly) * ADV_MAX_POLYS);
+  adv.pts = (AdvPt*)memAllocCold(sizeof(AdvPt) * ADV_MAX_POINTS);
+  adv.cellStart = (uint16_t*)memAllocCold(sizeof(uint16_t) * (ADV_GRID_MAX_CELLS + 1));
+  adv.cellItems = (uint8_t*)memAllocCold(ADV_GRID_MAX_ITEMS);
+  if (!adv.polys || !adv.pts || !adv.cellStart || !adv.cellItems) {
+    Serial.println("[ADV] allocation failed");
+    free(adv.polys); free(adv.pts); free(adv.cellStart); free(adv.cellItems);
+    adv.polys = nullptr; adv.pts = nullptr; adv.cellStart = nullptr; adv.cellItems = nullptr;
+    return false;
+  }
+  return true;
+}
+
+static void advClear() {
+  adv.polyCount = 0;
+  adv.ptCount = 0;
+  adv.cols = adv.rows = 0;
+  adv.items = 0;
+  adv.skipped = 0;
+}
+
+static int16_t advCenti(float deg) { return (int16_t)lroundf(deg * 100.0f); }
+
+static uint8_t advKindOf(AdvSource src, const char* type, const char* hazard) {
+  if (src == ADV_SRC_GAIRMET) return ADV_AIRMET;
+  if (!strcmp(type, "AIRMET")) return ADV_AIRMET;
+  if (strcmp(type, "SIGMET")) return ADV_NONE;                // OUTLOOK and anything new
+  return !strcmp(hazard, "CONVECTIVE") ? ADV_CONVECTIVE : ADV_SIGMET;
+}
+
+// One AWC response into the store. kinds: ADV_* bits to keep. False if the
+// body didn't parse (the store keeps whatever was added before).
+static bool advParse(const String& body, AdvSource src, uint8_t kinds) {
+  StaticJsonDocument<256> filter;
+  JsonObject f = filter.createNestedObject();
+  f["airSigmetType"] = true;
+  f["hazard"] = true;
+  f["validTimeTo"] = true;
+  f["forecastHour"] = true;
+  f["geometryType"] = true;
+  f["coords"] = true;
+
+  ArenaJsonDocument doc(48 * 1024);
+  DeserializationError err = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+  if (err || !doc.is<JsonArray>()) {
+    Serial.printf("[ADV] parse failed: %s\n", err.c_str());
+    return false;
+  }
+
+  uint32_t now = timeEpochOrZero();
+  for (JsonObject o : doc.as<JsonArray>()) {
+    uint8_t kind = advKindOf(src, o["airSigmetType"] | "", o["hazard"] | "");
+    if (!(kind & kinds)) continue;
+    if ((o["forecastHour"] | 0) != 0) continue;                 // G-AIRMET: current snapshot only
+    const char* geom = o["geometryType"] | "AREA";
+    if (strcmp(geom, "AREA")) continue;                          // freezing-level lines
+    uint32_t validTo = o["validTimeTo"] | 0u;
+    if (validTo && now && validTo < now) continue;
+
+    JsonArray coords = o["coords"].as<JsonArray>();
+    int n = coords.size();
+    if (n < 3) continue;
+    if (adv.polyCount >= ADV_MAX_POLYS || adv.ptCount + n > ADV_MAX_POINTS) { adv.skipped++; continue; }
+
+    AdvPoly& p = adv.polys[adv.polyCount];
+    p.first = (uint16_t)adv.ptCount;
+    p.count = 0;
+    p.kind = kind;
+    p.validTo = validTo;
+    p.minLat = p.minLon = INT16_MAX;
+    p.maxLat = p.maxLon = INT16_MIN;
+    for (JsonObject c : coords) {
+      if (!c.containsKey("lat") || !c.containsKey("lon")) continue;
+      AdvPt& pt = adv.pts[adv.ptCount + p.count];
+      pt.lat = advCenti(c["lat"].as<float>());
+      pt.lon = advCenti(c["lon"].as<float>());
+      p.minLat = min(p.minLat, pt.lat); p.maxLat = max(p.maxLat, pt.lat);
+      p.minLon = min(p.minLon, pt.lon); p.maxLon = max(p.maxLon, pt.lon);
+      p.count++;
+    }
+    if (p.count < 3) continue;
+    adv.ptCount += p.count;
+    adv.polyCount++;
+  }
+  return true;
+}
+
+// Grid over the union of the boxes; the cell grows until it fits.
+static void advIndexBuild() {
+  adv.cols = adv.rows = adv.items = 0;
+  if (!adv.polyCount) return;
+
+  int16_t minLat = INT16_MAX, maxLat = INT16_MIN, minLon = INT16_MAX, maxLon = INT16_MIN;
+  for (int i = 0; i < adv.polyCount; i++) {
+    const AdvPoly& p = adv.polys[i];
+    minLat = min(minLat, p.minLat); maxLat = max(maxLat, p.maxLat);
+    minLon = min(minLon, p.minLon); maxLon = max(maxLon, p.maxLon);
+  }
+
+  int cell = (int)(ADV_CELL_DEG * 100);
+  int cols, rows;
+  for (;;) {
+    cols = (maxLon - minLon) / cell + 1;
+    rows = (maxLat - minLat) / cell + 1;
+    if (cols * rows <= ADV_GRID_MAX_CELLS) break;
+    cell *= 2;
+  }
+
+  auto cellRange = [&](const AdvPoly& p, int& c0, int& c1, int& r0, int& r1) {
+    c0 = (p.minLon - minLon) / cell; c1 = (p.maxLon - minLon) / cell;
+    r0 = (p.minLat - minLat) / cell; r1 = (p.maxLat - minLat) / cell;
+  };
+
+  // count per cell, prefix sum, then fill (cellStart ends as the exclusive end)
+  int cells = cols * rows;
+  memset(adv.cellStart, 0, sizeof(uint16_t) * (cells + 1));
+  for (int i = 0; i < adv.polyCount; i++) {
+    int c0, c1, r0, r1;
+    cellRange(adv.polys[i], c0, c1, r0, r1);
+    for (int r = r0; r <= r1; r++)
+      for (int c = c0; c <= c1; c++) adv.cellStart[r * cols + c + 1]++;
+  }
+  for (int c = 0; c < cells; c++) adv.cellStart[c + 1] += adv.cellStart[c];
+  if (adv.cellStart[cells] > ADV_GRID_MAX_ITEMS) {
+    // dozens of huge polygons: one cell, every polygon in it
+    cols = rows = 1;
+    cell = max(maxLon - minLon, maxLat - minLat) + 1;
+    cells = 1;
+    adv.cellStart[0] = 0;
+    adv.cellStart[1] = (uint16_t)adv.polyCount;
+    for (int i = 0; i < adv.polyCount; i++) adv.cellItems[i] = (uint8_t)i;
+  } else {
+    for (int i = 0; i < adv.polyCount; i++) {
+      int c0, c1, r0, r1;
+      cellRange(adv.polys[i], c0, c1, r0, r1);
+      for (int r = r0; r <= r1; r++)
+        for (int c = c0; c <= c1; c++) adv.cellItems[adv.cellStart[r * cols + c]++] = (uint8_t)i;
+    }
+    for (int c = cells; c > 0; c--) adv.cellStart[c] = adv.cellStart[c - 1];   // back to starts
+    adv.cellStart[0] = 0;
+  }
+
+  adv.gMinLat = minLat;
+  adv.gMinLon = minLon;
+  adv.cellSize = (int16_t)cell;
+  adv.cols = cols;
+  adv.rows = rows;
+  adv.items = adv.cellStart[cells];
+}
+
+// crossing number, half-open edges so shared vertices count once
+static bool advInside(const AdvPoly& p, int16_t lat, int16_t lon) {
+  bool in = false;
+  const AdvPt* v = adv.pts + p.first;
+  for (int i = 0, j = p.count - 1; i < p.count; j = i++) {
+    if ((v[i].lat > lat) != (v[j].lat > lat)) {
+      int32_t dy = v[j].lat - v[i].lat;
+      // lon < v[i].lon + (lat - v[i].lat) * dx / dy, without the division
+      int64_t lhs = (int64_t)(lon - v[i].lon) * dy;
+      int64_t rhs = (int64_t)(lat - v[i].lat) * (v[j].lon - v[i].lon);
+      if (dy > 0 ? lhs < rhs : lhs > rhs) in = !in;
+    }
+  }
+  return in;
+}
+
+// ADV_* bits of the advisories covering the point (expired ones skipped).
+static uint8_t advAt(float latDeg, float lonDeg, uint32_t nowEpoch) {
+  if (!adv.cols) return ADV_NONE;
+  adv.lookups++;
+  int16_t lat = advCenti(latDeg), lon = advCenti(lonDeg);
+  int c = (lon - adv.gMinLon) / adv.cellSize;
+  int r = (lat - adv.gMinLat) / adv.cellSize;
+  if (lon < adv.gMinLon || lat < adv.gMinLat || c >= adv.cols || r >= adv.rows) return ADV_NONE;
+
+  uint8_t kinds = ADV_NONE;
+  int cell = r * adv.cols + c;
+  for (int k = adv.cellStart[cell]; k < adv.cellStart[cell + 1]; k++) {
+    const AdvPoly& p = adv.polys[adv.cellItems[k]];
+    if ((kinds & p.kind) == p.kind) continue;                    // already known
+    if (lat < p.minLat || lat > p.maxLat || lon < p.minLon || lon > p.maxLon) continue;
+    if (p.validTo && nowEpoch && p.validTo < nowEpoch) continue;
+    adv.pipTests++;
+    if (advInside(p, lat, lon)) kinds |= p.kind;
+  }
+  return kinds;
+}
+
+// Render side: scale (0..256) and white mix (0..256) for an LED whose
+// station sits inside kinds, at fleet time nowMs (shared phase across maps).
+//   convective: two short white flashes every 2.4 s
+//   SIGMET:     swells toward white every 2 s
+//   AIRMET:     breathes 35..100 % every 3 s
+static void advEffect(uint8_t kinds, uint64_t nowMs, uint16_t& scale, uint16_t& white) {
+  scale = 256;
+  white = 0;
+  if (kinds & ADV_CONVECTIVE) {
+    uint32_t t = nowMs % 2400;
+    if (t < 80 || (t >= 160 && t < 240)) white = 256;
+    return;
+  }
+  if (kinds & ADV_SIGMET) {
+    uint32_t t = nowMs % 2000;
+    uint32_t tri = t < 1000 ? t : 2000 - t;                      // 0..1000
+    white = (uint16_t)(tri * 154 / 1000);                        // up to 60 %
+    return;
+  }
+  if (kinds & ADV_AIRMET) {
+    uint32_t t = nowMs % 3000;
+    uint32_t tri = t < 1500 ? t : 3000 - t;                      // 0..1500
+    scale = (uint16_t)(90 + tri * 166 / 1500);                   // 35..100 %
+  }
+}
+
+// "off" / "sigmet" / "all" -> ADV_* bits to fetch and show
+static uint8_t advKindsForMode(const String& mode) {
+  if (mode == "sigmet") return ADV_SIGMET | ADV_CONVECTIVE;
+  if (mode == "all") return ADV_SIGMET | ADV_CONVECTIVE | ADV_AIRMET;
+  return ADV_NONE;
+}
+
+static String advStatusLine() {
+  if (!advReady()) return "Advisories: <b>off</b>";
+  String line = "Advisories: <b>" + String(adv.polyCount) + " polygons</b>";
+  if (adv.fetchedMs) line += ", fetched " + String((millis() - adv.fetchedMs) / 60000) + " min ago";
+  line += " &nbsp;|&nbsp; " + String(adv.affected) + " stations inside";
+  line += " &nbsp;|&nbsp; grid " + String(adv.cols) + "x" + String(adv.rows) + " of " +
+          String(adv.cellSize / 100.0f, 1) + "&deg;, test " + String(adv.evalUs) + " us";
+  if (adv.skipped) line += " &nbsp;|&nbsp; " + String(adv.skipped) + " skipped (full)";
+  return line;
+}
+
+// appended to /metrics by the map
+static void advMetricsOut(String& out) {
+  if (!advReady()) return;
+  metricGaugeOut(out, "metarlw_adv_polygons", "Advisory polygons loaded", adv.polyCount);
+  metricGaugeOut(out, "metarlw_adv_points", "Advisory polygon points loaded", adv.ptCount);
+  metricGaugeOut(out, "metarlw_adv_stations_affected", "Stations inside an advisory", adv.affected);
+  metricGaugeOut(out, "metarlw_adv_grid_cells", "Spatial index cells", adv.cols * adv.rows);
+  metricGaugeOut(out, "metarlw_adv_grid_items", "Spatial index entries (polygon-cell pairs)", adv.items);
+  metricGaugeOut(out, "metarlw_adv_eval_seconds", "Wall time of the last station pass", adv.evalUs / 1e6);
+  metricHeader(out, "metarlw_adv_lookups_total", "Station lookups against the index", "counter");
+  metricLine(out, "metarlw_adv_lookups_total", "", adv.lookups);
+  metricHeader(out, "metarlw_adv_polygon_tests_total", "Point-in-polygon tests after the box test", "counter");
+  metricLine(out, "metarlw_adv_polygon_tests_total", "", adv.pipTests);
+  metricHeader(out, "metarlw_adv_fetch_failures_total", "Advisory fetches that failed or didn't parse", "counter");
+  metricLine(out, "metarlw_adv_fetch_failures_total", "", adv.fetchFailures);
+}
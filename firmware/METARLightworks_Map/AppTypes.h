@@ -1,5 +1,8 @@
 #pragma once
 #include <Arduino.h>
+#include "Solar.h"
+#include "Mqtt.h"
+#include "Staleness.h"
 
 struct AppConfig {
   // provisioned by Factory
@@ -15,13 +18,80 @@ struct AppConfig {
   String map_list    = "VFR,MVFR,IFR,LIFR,SKIP";
   int    brightness  = 120; // 1..255
 
+  // schedule (weekday windows + solar dimming, see Solar.h)
+  ScheduleConfig sched;
+  String timezonePref = "UTC0";
+
+  // clock (TimeSync.h): comma list, first wins, e.g. a LAN server first
+  String ntpServers = "pool.ntp.org";
+  bool fleetSync = true;   // LAN time beacon shared with lamps (FleetClock.h)
+
+  // LAN METAR hub (Hub.h): serve /hub/obs to nearby devices, and/or take
+  // observations from another hub instead of AWC
+  bool   hubServe = false;
+  String hubUse   = "auto";    // auto (mDNS) / off / host[:port]
+
+  // MQTT publish/subscribe for home automation (Mqtt.h)
+  MqttSettings mqtt;
+
+  // TAF forecast view (Taf.h): fetch TAFs with each refresh
+  bool tafEnabled = false;
+
+  // SIGMET / AIRMET overlay (Advisory.h): off / sigmet / all
+  String advOverlay = "off";
+
+  // day/night terminator (Terminator.h): off / dim / tint / both
+  String termMode = "off";
+  int termNightPct = 20;       // level past nautical dusk, % of the station color
+
+  // METAR age (Staleness.h): fade, blink, then fallback as if missing
+  StalePolicy stale;
+
+  // live LED input from a show controller (Live.h): DDP + E1.31
+  bool liveEnabled   = false;
+  int  liveUniverse  = 1;        // E1.31 start universe
+  int  liveTimeoutMs = 2500;     // back to the weather after this much silence
+
   // LED (admin)
   int    led_pin     = 5;
-  int    led_count   = 1;        // derived from token count, saved for visibility
   String led_order   = "GRB";    // RGB/GRB/...
 
   // OTA prefs (same workflow as Lamp)
   bool otaCheckOnBoot  = true;
   bool otaAutoUpdate   = false;
   int  otaIntervalDays = 7;      // 1..60
-};
\ No newline at end of file
+
+  // Fetch layer (capture/replay for field repro + offline demo)
+  String fetchMode   = "live";   // live/capture/replay
+  int    replaySpeed = 60;       // replay clock multiplier 1..600
+  int    fetchParallel = 2;      // METAR requests at once, 1..3 (dual-core; 1 = one after another)
+};
+
+// Runtime status for the web UI and /metrics (published by the refresh job)
+struct MapStatus {
+  int  ledCount = 1;             // derived from the token count
+  int  stations = 0;
+  int  stationsWithMetar = 0;
+  int  stationsWithGeo = 0;
+  int  stationsDue = 0;           // fetched by the last refresh (planMetarRefresh)
+  int  metarConnections = 1;      // METAR requests in flight at once, last refresh
+  uint32_t metarPhaseMs = 0;      // wall time of the last METAR phase
+  int  catCount[5] = { 0 };      // stations with a METAR, indexed by FltCat
+  bool  hasCenter = false;       // mean station position (solar schedule)
+  float centerLat = 0;
+  float centerLon = 0;
+  unsigned long lastRefreshMs = 0;          // millis() when the last refresh started
+  unsigned long lastRefreshDurationMs = 0;
+  unsigned long lastRefreshDoneMs = 0;      // millis() when the last refresh finished (0 = none)
+  bool refreshing = false;
+};
+
+// OTA check/install results (written by the OTA workflow)
+struct OtaStatus {
+  String latestTag = "";
+  String latestUrl = "";
+  int    latestSize = 0;
+  String statusLine = "Not checked yet";
+  bool   updateAvailable = false;
+  unsigned long lastCheckMs = 0;
+};
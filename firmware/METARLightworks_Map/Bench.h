@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+// ---------- Micro-benchmark harness (/admin/bench) ----------
+// Each op is timed with the CPU cycle counter (plus esp_timer for ops that
+// outlive a 32-bit cycle wrap) and bracketed by heap snapshots.
+//
+// Per op we report:
+//   cycles_min/avg/max, us_avg   - time per iteration
+//   allocs                       - net heap blocks still held after one iteration
+//   alloc_bytes                  - net heap bytes still held after one iteration
+//   heap_peak                    - bytes the op pushed the heap low-water mark down
+//                                  (0 = op stayed above the previous lifetime low)
+//
+// Output is one JSON object per op so runs can be diffed between releases
+// (see tools/bench_compare.py).
+
+struct BenchHeapSnap {
+  size_t freeBytes  = 0;
+  size_t allocBytes = 0;
+  size_t blocks     = 0;
+  size_t minFree    = 0;
+};
+
+static BenchHeapSnap benchHeapSnap() {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  BenchHeapSnap s;
+  s.freeBytes  = info.total_free_bytes;
+  s.allocBytes = info.total_allocated_bytes;
+  s.blocks     = info.allocated_blocks;
+  s.minFree    = info.minimum_free_bytes;
+  return s;
+}
+
+static void benchAppendSkip(String& out, const char* op, const char* input, const char* why) {
+  if (out.length() > 1) out += ",";
+  out += "{\"op\":\""; out += op;
+  out += "\",\"input\":\""; out += input;
+  out += "\",\"skipped\":\""; out += why;
+  out += "\"}";
+}
+
+// Runs fn() `iters` times and appends one JSON result object to `out`.
+template <typename F>
+static void benchRun(String& out, const char* op, const char* input, uint16_t iters, F fn) {
+  if (iters < 1) iters = 1;
+
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  const uint64_t wrapUs = (uint64_t)0xFFFFFFFFu / (mhz ? mhz : 1);
+
+  uint64_t cyclesSum = 0;
+  uint32_t cyclesMin = 0xFFFFFFFFu, cyclesMax = 0;
+  int64_t  usSum = 0;
+  long     heldBlocks = 0, heldBytes = 0;
+  size_t   peak = 0;
+
+  for (uint16_t i = 0; i < iters; i++) {
+    BenchHeapSnap before = benchHeapSnap();
+    int64_t  t0 = esp_timer_get_time();
+    uint32_t c0 = ESP.getCycleCount();
+
+    fn();
+
+    uint32_t c1 = ESP.getCycleCount();
+    int64_t  t1 = esp_timer_get_time();
+    BenchHeapSnap after = benchHeapSnap();
+
+    int64_t us = t1 - t0;
+    uint32_t cycles = ((uint64_t)us >= wrapUs) ? (uint32_t)min<uint64_t>((uint64_t)us * mhz, 0xFFFFFFFFu) : (c1 - c0);
+
+    cyclesSum += cycles;
+    if (cycles < cyclesMin) cyclesMin = cycles;
+    if (cycles > cyclesMax) cyclesMax = cycles;
+    usSum += us;
+
+    // first iteration is the interesting one for retention (later ones reuse it)
+    if (i == 0) {
+      heldBlocks = (long)after.blocks - (long)before.blocks;
+      heldBytes  = (long)after.allocBytes - (long)before.allocBytes;
+    }
+    if (after.minFree < before.minFree) {
+      size_t drop = before.freeBytes - after.minFree;
+      if (drop > peak) peak = drop;
+    }
+    yield();
+  }
+
+  char row[320];
+  snprintf(row, sizeof(row),
+           "%s{\"op\":\"%s\",\"input\":\"%s\",\"iters\":%u,"
+           "\"cycles_min\":%lu,\"cycles_avg\":%lu,\"cycles_max\":%lu,\"us_avg\":%lu,"
+           "\"allocs\":%ld,\"alloc_bytes\":%ld,\"heap_peak\":%lu}",
+           (out.length() > 1) ? "," : "",
+           op, input, (unsigned)iters,
+           (unsigned long)cyclesMin, (unsigned long)(cyclesSum / iters), (unsigned long)cyclesMax,
+           (unsigned long)(usSum / iters),
+           heldBlocks, heldBytes, (unsigned long)peak);
+  out += row;
+}
+
+// Header object for a run: firmware, chip, clock and heap at start.
+static String benchHeaderJson(const char* app, const char* fw) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "\"app\":\"%s\",\"fw\":\"%s\",\"chip\":\"%s\",\"cpu_mhz\":%lu,"
+           "\"heap_free\":%lu,\"heap_largest\":%lu",
+           app, fw, ESP.getChipModel(), (unsigned long)ESP.getCpuFreqMHz(),
+           (unsigned long)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+           (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  return String(buf);
+}
@@ -0,0 +1,629 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <new>
+#include "Metrics.h"
+#include "Memory.h"
+#include "Stall.h"
+#include "TimeSync.h"
+#include <ArduinoJson.h>
+
+#if __has_include(<miniz.h>)
+#include <miniz.h>
+#elif __has_include(<rom/miniz.h>)
+#include <rom/miniz.h>
+#endif
+#if __has_include(<esp_rom_crc.h>)
+#include <esp_rom_crc.h>
+#endif
+#if defined(TINFL_LZ_DICT_SIZE) && __has_include(<esp_rom_crc.h>)
+#define FETCH_GZIP 1
+#else
+#define FETCH_GZIP 0
+#endif
+
+// ---------- Shared fetch layer ----------
+// Every outbound GET (AWC, AVWX, adsb.lol, GitHub API, a LAN hub) goes through
+// fetchGET(). http:// URLs (the hub) use a plain client, everything else TLS.
+//
+// Modes:
+//   LIVE    - plain HTTPS request
+//   CAPTURE - LIVE, plus the raw response is appended to /cap/<provider>.cap
+//   REPLAY  - no network; responses come from the capture files on an
+//             accelerated clock (demo mode). Replay loops when it runs off
+//             the end of a capture, so a unit can run a trade show all day.
+//
+// Capture record (text header, raw body, so tools/replay_server.py can read it):
+//   #CAP <t_ms> <epoch> <code> <len> <url>\n
+//   <len bytes of body>\n
+// t_ms is milliseconds since capture started; epoch is 0 if time was unsynced.
+//
+// Live HTTPS requests ask for gzip (see FetchInflateReader); captures hold
+// the inflated body, so replay and tools never see compression.
+
+enum FetchProvider : uint8_t { PROV_AWC = 0, PROV_AVWX, PROV_ADSB, PROV_GITHUB, PROV_HUB, PROV_COUNT };
+enum FetchMode : uint8_t { FETCH_LIVE = 0, FETCH_CAPTURE, FETCH_REPLAY };
+
+struct FetchRequest {
+  FetchProvider provider = PROV_AWC;
+  String url;
+  const char* userAgent = nullptr;
+  const char* accept = nullptr;
+  String authorization;               // full header value, e.g. "Bearer abc"
+  uint32_t connectTimeoutMs = 0;      // 0 = HTTPClient default
+  uint32_t timeoutMs = 0;
+  bool acceptGzip = true;             // HTTPS only; the LAN hub answers plain
+};
+
+static const char* FETCH_CAPTURE_DIR = "/cap";
+static const size_t FETCH_CAPTURE_MAX_BYTES = 256 * 1024;   // per provider file
+
+struct FetchState {
+  FetchMode mode = FETCH_LIVE;
+  uint16_t speed = 1;                 // replay clock multiplier (1..600)
+  unsigned long clockStartMs = 0;     // capture/replay clock origin
+  bool captureFull[PROV_COUNT] = { false, false, false, false, false };
+};
+
+static FetchState fetchState;
+
+static const char* fetchProviderName(FetchProvider p) {
+  switch (p) {
+    case PROV_AWC:    return "awc";
+    case PROV_AVWX:   return "avwx";
+    case PROV_ADSB:   return "adsb";
+    case PROV_GITHUB: return "github";
+    case PROV_HUB:    return "hub";
+    default:          return "unknown";
+  }
+}
+
+static const char* fetchModeName(FetchMode m) {
+  switch (m) {
+    case FETCH_CAPTURE: return "capture";
+    case FETCH_REPLAY:  return "replay";
+    default:            return "live";
+  }
+}
+
+static FetchMode fetchModeFromString(String s) {
+  s.trim(); s.toLowerCase();
+  if (s == "capture") return FETCH_CAPTURE;
+  if (s == "replay" || s == "demo") return FETCH_REPLAY;
+  return FETCH_LIVE;
+}
+
+static String fetchCapturePath(FetchProvider p) {
+  return String(FETCH_CAPTURE_DIR) + "/" + fetchProviderName(p) + ".cap";
+}
+
+static bool fetchReplaying() { return fetchState.mode == FETCH_REPLAY; }
+
+// Refresh intervals divide by this so replay runs through captures faster.
+static uint16_t fetchClockScale() { return fetchReplaying() ? fetchState.speed : 1; }
+
+static void fetchSetMode(FetchMode mode, int speed) {
+  if (speed < 1) speed = 1;
+  if (speed > 600) speed = 600;
+  fetchState.mode = mode;
+  fetchState.speed = (uint16_t)speed;
+  fetchState.clockStartMs = millis();
+  for (int i = 0; i < PROV_COUNT; i++) fetchState.captureFull[i] = false;
+  if (mode != FETCH_LIVE) {
+    LittleFS.begin(true);
+    LittleFS.mkdir(FETCH_CAPTURE_DIR);
+  }
+  Serial.printf("[FETCH] mode=%s speed=%d\n", fetchModeName(mode), speed);
+}
+
+static size_t fetchCaptureSize(FetchProvider p) {
+  String path = fetchCapturePath(p);
+  if (!LittleFS.exists(path)) return 0;
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  size_t n = f.size();
+  f.close();
+  return n;
+}
+
+static void fetchClearCaptures() {
+  for (int i = 0; i < PROV_COUNT; i++) {
+    String path = fetchCapturePath((FetchProvider)i);
+    if (LittleFS.exists(path)) LittleFS.remove(path);
+    fetchState.captureFull[i] = false;
+  }
+  fetchState.clockStartMs = millis();
+}
+
+// ---------- capture ----------
+static void fetchCaptureAppend(FetchProvider p, const String& url, int code, const String& body) {
+  if (fetchState.captureFull[p]) return;
+
+  String path = fetchCapturePath(p);
+  size_t cur = fetchCaptureSize(p);
+  if (cur + body.length() + url.length() + 64 > FETCH_CAPTURE_MAX_BYTES) {
+    fetchState.captureFull[p] = true;
+    Serial.printf("[FETCH] capture %s full (%u bytes)\n", fetchProviderName(p), (unsigned)cur);
+    return;
+  }
+
+  File f = LittleFS.open(path, "a");
+  if (!f) return;
+
+  char hdr[48];
+  snprintf(hdr, sizeof(hdr), "#CAP %lu %ld %d %u ",
+           (unsigned long)(millis() - fetchState.clockStartMs),
+           (long)timeEpochOrZero(), code, (unsigned)body.length());
+  f.print(hdr);
+  f.print(url);
+  f.print("\n");
+  f.write((const uint8_t*)body.c_str(), body.length());
+  f.print("\n");
+  f.close();
+  metrics.flashWrites.inc();
+}
+
+// ---------- replay ----------
+struct FetchCapHeader {
+  unsigned long tMs = 0;
+  int code = 0;
+  size_t len = 0;
+  size_t bodyPos = 0;
+  String url;
+};
+
+static bool fetchReadCapHeader(File& f, FetchCapHeader& h) {
+  if (!f.available()) return false;
+  String line = f.readStringUntil('\n');
+  if (!line.startsWith("#CAP ")) return false;
+
+  // #CAP <t_ms> <epoch> <code> <len> <url>
+  int p1 = line.indexOf(' ', 5);
+  int p2 = (p1 > 0) ? line.indexOf(' ', p1 + 1) : -1;
+  int p3 = (p2 > 0) ? line.indexOf(' ', p2 + 1) : -1;
+  int p4 = (p3 > 0) ? line.indexOf(' ', p3 + 1) : -1;
+  if (p4 < 0) return false;
+
+  h.tMs  = (unsigned long)line.substring(5, p1).toInt();
+  h.code = (int)line.substring(p2 + 1, p3).toInt();
+  h.len  = (size_t)line.substring(p3 + 1, p4).toInt();
+  h.url  = line.substring(p4 + 1);
+  h.bodyPos = f.position();
+  return f.seek(h.bodyPos + h.len + 1);
+}
+
+// Picks the newest record at or before the replay clock, preferring an exact
+// URL match (Map chunks differ by ids=...). Loops past the last record.
+static bool fetchReplay(const FetchRequest& req, String& outBody, int& outCode) {
+  String path = fetchCapturePath(req.provider);
+  if (!LittleFS.exists(path)) { outCode = -1; outBody = ""; return false; }
+
+  File f = LittleFS.open(path, "r");
+  if (!f) { outCode = -1; outBody = ""; return false; }
+
+  unsigned long lastT = 0;
+  FetchCapHeader h;
+  while (fetchReadCapHeader(f, h)) lastT = h.tMs;
+
+  unsigned long now = (millis() - fetchState.clockStartMs) * (unsigned long)fetchState.speed;
+  now %= (lastT + 1);
+
+  bool haveExact = false, haveAny = false;
+  FetchCapHeader exact, any, first;
+  bool haveFirst = false;
+
+  f.seek(0);
+  while (fetchReadCapHeader(f, h)) {
+    if (!haveFirst) { first = h; haveFirst = true; }
+    if (h.tMs > now) continue;
+    if (h.url == req.url) { exact = h; haveExact = true; }
+    any = h; haveAny = true;
+  }
+
+  const FetchCapHeader* pick = haveExact ? &exact : (haveAny ? &any : (haveFirst ? &first : nullptr));
+  if (!pick) { f.close(); outCode = -1; outBody = ""; return false; }
+
+  outBody = "";
+  outBody.reserve(pick->len + 1);
+  f.seek(pick->bodyPos);
+  char buf[256];
+  size_t left = pick->len;
+  while (left > 0) {
+    size_t n = f.read((uint8_t*)buf, min(left, sizeof(buf)));
+    if (n == 0) break;
+    outBody.concat(buf, n);
+    left -= n;
+  }
+  f.close();
+
+  outCode = pick->code;
+  return (outCode == 200);
+}
+
+// ---------- response body ----------
+// A live 200 body is read through FetchBodyReader (bounded by Content-Length
+// when there is one) and, when the server gzipped it, FetchInflateReader on
+// top. Both are Streams: fetchGETJson() hands them straight to
+// deserializeJson(), so the body is never held whole; fetchGET() collects
+// the same Stream into a String for callers that want text.
+//
+// Requests go out as HTTP/1.0: HTTPClient sends "Accept-Encoding: identity"
+// on HTTP/1.1 and leaves it out only for 1.0, which also rules out chunked
+// replies, so the body comes straight off the socket.
+static const int FETCH_ERR_GZIP = -100;                  // bad gzip framing/data/CRC
+static const int FETCH_ERR_BODY = -101;                  // body cut short (timeout, early close)
+static const int FETCH_ERR_NOMEM = -102;                 // no room to collect the body
+static const uint32_t FETCH_BODY_TIMEOUT_MS = 5000;      // per read, HTTPClient's default
+static const size_t FETCH_GZIP_HEADROOM = 48 * 1024;     // internal heap left for TLS
+
+struct FetchBodyReader : public Stream {
+  WiFiClient& c;
+  int32_t left;                  // Content-Length still to come, -1 = until close
+  uint32_t timeoutMs;
+  uint32_t bytes = 0;            // off the wire
+  bool cut = false;              // timed out, or closed before Content-Length
+  uint16_t pos = 0, end = 0;
+  uint8_t buf[512];
+
+  FetchBodyReader(WiFiClient& client, int32_t len, uint32_t timeout) : c(client), left(len), timeoutMs(timeout) { setTimeout(0); }
+
+  bool fill() {
+    pos = end = 0;
+    if (left == 0) return false;
+    uint32_t t0 = millis();
+    for (;;) {
+      int a = c.available();
+      if (a > 0) {
+        size_t want = min((size_t)a, sizeof(buf));
+        if (left > 0 && (size_t)left < want) want = left;
+        int n = c.read(buf, want);
+        if (n > 0) {
+          end = n;
+          bytes += n;
+          if (left > 0) left -= n;
+          return true;
+        }
+      } else if (!c.connected()) {
+        cut = left > 0;
+        return false;
+      }
+      if (millis() - t0 > timeoutMs) { cut = true; return false; }
+      delay(1);
+    }
+  }
+
+  // next buffered run; 0 at the end
+  size_t take(const uint8_t*& p) {
+    if (pos == end && !fill()) return 0;
+    p = buf + pos;
+    size_t n = end - pos;
+    pos = end;
+    return n;
+  }
+
+  int32_t sizeHint() const { return left; }   // before the first read: Content-Length
+  int read() override { return (pos == end && !fill()) ? -1 : buf[pos++]; }
+  int peek() override { return (pos == end && !fill()) ? -1 : buf[pos]; }
+  int available() override { return end - pos; }
+  size_t write(uint8_t) override { return 0; }
+  void drain() { while (fill()) {} }
+};
+
+// Collects a body reader into s, growing it geometrically rather than per
+// piece. hint: the final size when known (-1 = not). False when s can't grow.
+template <typename R>
+static bool fetchCollect(R& src, String& s, int32_t hint) {
+  size_t cap = 0;
+  if (hint > 0) {
+    cap = hint;
+    if (!s.reserve(cap)) return false;
+  }
+  const uint8_t* p;
+  while (size_t n = src.take(p)) {
+    size_t want = s.length() + n;
+    if (want > cap) {
+      cap = max(want, cap + cap / 2);
+      if (!s.reserve(cap)) return false;
+    }
+    if (!s.concat((const char*)p, n)) return false;
+  }
+  return true;
+}
+
+#if FETCH_GZIP
+// ---------- gzip ----------
+// A gzipped body is inflated as it is read. What it costs is tinfl's state
+// plus its 32 KB window (deflate back-references reach that far), allocated
+// per request (PSRAM when present) and freed after it. Without miniz in
+// ROM, or without the memory, the request doesn't ask for gzip.
+//
+// The ROM CRC is zlib's CRC-32 when seeded with 0; checked once against
+// the standard check value rather than trusted. If it differs, the trailer
+// length alone guards the body (tinfl already rejects corrupt deflate).
+static bool fetchCrcUsable() {
+  static int8_t usable = -1;
+  if (usable < 0) usable = esp_rom_crc32_le(0, (const uint8_t*)"123456789", 9) == 0xCBF43926u;
+  return usable;
+}
+
+struct FetchInflateReader : public Stream {
+  enum Stage : uint8_t { GZ_HEAD, GZ_XLEN, GZ_EXTRA, GZ_NAME, GZ_COMMENT, GZ_HCRC, GZ_BODY, GZ_TRAILER, GZ_DONE, GZ_ERROR };
+
+  FetchBodyReader* in = nullptr;
+  Stage stage = GZ_HEAD;
+  uint8_t flags = 0;
+  uint32_t need = 10;            // header bytes left in this stage
+  uint32_t outBytes = 0;         // inflated bytes
+  uint32_t crc = 0;
+  uint8_t trailer[8];
+  size_t winOfs = 0;             // where tinfl writes next
+  size_t outPos = 0, outEnd = 0; // inflated, not read yet
+  tinfl_decompressor inf;
+  uint8_t window[TINFL_LZ_DICT_SIZE];
+
+  FetchInflateReader() { tinfl_init(&inf); setTimeout(0); }
+
+  // The header's optional fields, in order (RFC 1952 2.3).
+  void nextHeaderStage() {
+    if (stage < GZ_XLEN && (flags & 0x04)) { stage = GZ_XLEN; need = 2; return; }
+    if (stage < GZ_NAME && (flags & 0x08)) { stage = GZ_NAME; return; }
+    if (stage < GZ_COMMENT && (flags & 0x10)) { stage = GZ_COMMENT; return; }
+    if (stage < GZ_HCRC && (flags & 0x02)) { stage = GZ_HCRC; need = 2; return; }
+    stage = GZ_BODY;
+  }
+
+  void header(uint8_t c) {
+    switch (stage) {
+      case GZ_HEAD: {
+        uint32_t i = 10 - need;
+        if ((i == 0 && c != 0x1f) || (i == 1 && c != 0x8b) || (i == 2 && c != 8)) { stage = GZ_ERROR; return; }
+        if (i == 3) flags = c;
+        if (--need == 0) nextHeaderStage();
+        return;
+      }
+      case GZ_XLEN:
+        if (need == 2) trailer[0] = c;
+        else { need = trailer[0] | (c << 8); stage = GZ_EXTRA; if (!need) nextHeaderStage(); return; }
+        need--;
+        return;
+      case GZ_EXTRA:  if (--need == 0) nextHeaderStage(); return;
+      case GZ_NAME:
+      case GZ_COMMENT: if (c == 0) nextHeaderStage(); return;
+      case GZ_HCRC:   if (--need == 0) nextHeaderStage(); return;
+      default: return;
+    }
+  }
+
+  bool inByte(uint8_t& c) {
+    if (in->pos == in->end && !in->fill()) return false;
+    c = in->buf[in->pos++];
+    return true;
+  }
+
+  // Inflates the next run into window[outPos, outEnd); false at the end of
+  // the stream or on an error (stage tells which).
+  bool produce() {
+    while (stage < GZ_BODY) {
+      uint8_t c;
+      if (!inByte(c)) { stage = GZ_ERROR; return false; }
+      header(c);
+    }
+    while (stage == GZ_BODY) {
+      bool eof = in->pos == in->end && !in->fill();
+      size_t inN = in->end - in->pos, outN = TINFL_LZ_DICT_SIZE - winOfs;
+      tinfl_status st = tinfl_decompress(&inf, in->buf + in->pos, &inN, window, window + winOfs, &outN, TINFL_FLAG_HAS_MORE_INPUT);
+      in->pos += inN;
+      if (st == TINFL_STATUS_DONE) stage = GZ_TRAILER;
+      else if (st < TINFL_STATUS_DONE || (st == TINFL_STATUS_NEEDS_MORE_INPUT && eof)) stage = GZ_ERROR;
+      if (outN) {
+        crc = esp_rom_crc32_le(crc, window + winOfs, outN);
+        outBytes += outN;
+        outPos = winOfs;
+        outEnd = winOfs + outN;
+        winOfs = (winOfs + outN) & (TINFL_LZ_DICT_SIZE - 1);
+        return true;
+      }
+    }
+    if (stage == GZ_TRAILER) {
+      // The ROM tinfl (miniz 1.x) refills its bit buffer up to 4 bytes ahead
+      // and, unlike 2.x, doesn't put them back at the end of the stream, so
+      // the trailer starts with whatever whole bytes are still held there.
+      uint32_t bits = inf.m_num_bits;
+      uint64_t held = (uint64_t)inf.m_bit_buf >> (bits & 7);
+      int k = 0;
+      for (bits >>= 3; k < 8 && bits; k++, bits--, held >>= 8) trailer[k] = (uint8_t)held;
+      for (; k < 8; k++) {
+        if (!inByte(trailer[k])) { stage = GZ_ERROR; return false; }
+      }
+      stage = GZ_DONE;                        // anything after the trailer is ignored
+    }
+    return false;
+  }
+
+  size_t take(const uint8_t*& p) {
+    if (outPos == outEnd && !produce()) return 0;
+    p = window + outPos;
+    size_t n = outEnd - outPos;
+    outPos = outEnd;
+    return n;
+  }
+
+  int32_t sizeHint() const { return -1; }
+  int read() override { return (outPos == outEnd && !produce()) ? -1 : window[outPos++]; }
+  int peek() override { return (outPos == outEnd && !produce()) ? -1 : window[outPos]; }
+  int available() override { return outEnd - outPos; }
+  size_t write(uint8_t) override { return 0; }
+  void drain() { const uint8_t* p; while (take(p)) {} }
+
+  // CRC-32 and length (mod 2^32) from the trailer
+  bool complete() const {
+    if (stage != GZ_DONE) return false;
+    uint32_t tCrc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+    uint32_t tLen = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    return (tCrc == crc || !fetchCrcUsable()) && tLen == outBytes;
+  }
+};
+
+static FetchInflateReader* fetchInflateBegin() {
+  size_t n = sizeof(FetchInflateReader);
+  if (!memHasPsram() && heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < n + FETCH_GZIP_HEADROOM) return nullptr;
+  void* mem = memAllocCold(n);
+  return mem ? new (mem) FetchInflateReader() : nullptr;
+}
+
+static void fetchInflateEnd(FetchInflateReader* z) {
+  if (!z) return;
+  z->~FetchInflateReader();
+  heap_caps_free(z);
+}
+#endif
+
+// ---------- live ----------
+// Runs the request and, on a 200, hands the body to consume() as a reader
+// (FetchBodyReader or FetchInflateReader: a Stream with take()). consume
+// returns false when it couldn't keep the body. Whatever it leaves unread
+// is drained so the length and gzip trailer are still checked.
+// bodyBytes: what consume() was offered; wireBytes: what the network carried.
+template <typename F>
+static bool fetchLiveWith(WiFiClient& client, const FetchRequest& req, bool gzip, int& outCode, size_t& bodyBytes, size_t& wireBytes, F consume) {
+  HTTPClient http;
+  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  if (req.connectTimeoutMs) http.setConnectTimeout(req.connectTimeoutMs);
+  if (req.timeoutMs) http.setTimeout(req.timeoutMs);
+  http.setReuse(false);
+  http.useHTTP10(true);
+  if (req.userAgent) http.setUserAgent(req.userAgent);
+
+  bodyBytes = wireBytes = 0;
+#if FETCH_GZIP
+  FetchInflateReader* z = gzip ? fetchInflateBegin() : nullptr;
+#else
+  (void)gzip;
+#endif
+
+  if (!http.begin(client, req.url)) {
+#if FETCH_GZIP
+    fetchInflateEnd(z);
+#endif
+    outCode = -1;
+    return false;
+  }
+
+  if (req.accept) http.addHeader("Accept", req.accept);
+  if (req.authorization.length()) http.addHeader("Authorization", req.authorization);
+#if FETCH_GZIP
+  static const char* headerKeys[] = { "Content-Encoding" };
+  if (z) {
+    http.addHeader("Accept-Encoding", "gzip");
+    http.collectHeaders(headerKeys, 1);
+  }
+#endif
+
+  outCode = http.GET();
+  if (outCode == 200) {
+    FetchBodyReader body(client, http.getSize(), req.timeoutMs ? req.timeoutMs : FETCH_BODY_TIMEOUT_MS);
+#if FETCH_GZIP
+    if (z && http.header("Content-Encoding") == "gzip") {
+      z->in = &body;
+      bool kept = consume(*z);
+      z->drain();
+      bodyBytes = z->outBytes;
+      if (!kept) outCode = FETCH_ERR_NOMEM;
+      else if (!z->complete()) outCode = FETCH_ERR_GZIP;
+      else metrics.fetchGzip[req.provider < METRIC_PROVIDERS ? req.provider : 0].inc();
+    } else
+#endif
+    {
+      bool kept = consume(body);
+      body.drain();
+      bodyBytes = body.bytes;
+      if (!kept) outCode = FETCH_ERR_NOMEM;
+      else if (body.cut) outCode = FETCH_ERR_BODY;
+    }
+    wireBytes = body.bytes;
+  }
+  http.end();
+#if FETCH_GZIP
+  fetchInflateEnd(z);
+#endif
+  return (outCode == 200);
+}
+
+template <typename F>
+static bool fetchLive(const FetchRequest& req, int& outCode, size_t& bodyBytes, size_t& wireBytes, F consume) {
+  if (req.url.startsWith("http://")) {
+    WiFiClient client;
+    return fetchLiveWith(client, req, false, outCode, bodyBytes, wireBytes, consume);
+  }
+  WiFiClientSecure client;
+  client.setInsecure();
+  return fetchLiveWith(client, req, req.acceptGzip, outCode, bodyBytes, wireBytes, consume);
+}
+
+static const char* const FETCH_STALL_SITES[PROV_COUNT] = { "fetch awc", "fetch avwx", "fetch adsb", "fetch github", "fetch hub" };
+
+static void fetchRecord(const FetchRequest& req, bool ok, int code, size_t bodyBytes, size_t wireBytes, uint32_t t0) {
+  uint8_t p = (uint8_t)req.provider;
+  if (p >= METRIC_PROVIDERS) return;
+  metrics.fetchLatency[p].observeUs(micros() - t0);
+  metrics.fetchBytes[p].inc(bodyBytes);
+  metrics.fetchWireBytes[p].inc(wireBytes);
+  if (ok) metrics.fetchOk[p].inc();
+  else    metrics.fetchErr[p].inc();
+  elogFetchOutcome(p, ok, code);
+}
+
+static bool fetchGET(const FetchRequest& req, String& outBody, int& outCode) {
+  StallScope stall(req.provider < PROV_COUNT ? FETCH_STALL_SITES[req.provider] : "fetch");
+  uint32_t t0 = micros();
+  bool ok;
+  size_t bodyBytes = 0, wireBytes = 0;
+
+  outBody = "";
+  if (fetchState.mode == FETCH_REPLAY) {
+    ok = fetchReplay(req, outBody, outCode);
+    bodyBytes = wireBytes = outBody.length();
+  } else {
+    ok = fetchLive(req, outCode, bodyBytes, wireBytes, [&](auto& body) {
+      return fetchCollect(body, outBody, body.sizeHint());
+    });
+  }
+  fetchRecord(req, ok, outCode, bodyBytes, wireBytes, t0);
+
+  if (fetchState.mode == FETCH_CAPTURE && outCode > 0) {
+    fetchCaptureAppend(req.provider, req.url, outCode, outBody);
+  }
+  return ok;
+}
+
+static bool fetchParseJson(JsonDocument& doc, const String& body, const JsonDocument* filter) {
+  DeserializationError err = filter ? deserializeJson(doc, body, DeserializationOption::Filter(*filter)) : deserializeJson(doc, body);
+  return !err;
+}
+
+// Like fetchGET(), for JSON: a live body streams straight into
+// deserializeJson() (through the inflater when gzipped) and is never held
+// whole. Capture and replay need the text, so they parse fetchGET()'s
+// String. filter: an ArduinoJson filter, or null. True for a 200 that parsed.
+static bool fetchGETJson(const FetchRequest& req, JsonDocument& doc, int& outCode, const JsonDocument* filter = nullptr) {
+  if (fetchState.mode != FETCH_LIVE) {
+    String body;
+    return fetchGET(req, body, outCode) && fetchParseJson(doc, body, filter);
+  }
+
+  StallScope stall(req.provider < PROV_COUNT ? FETCH_STALL_SITES[req.provider] : "fetch");
+  uint32_t t0 = micros();
+  size_t bodyBytes = 0, wireBytes = 0;
+  DeserializationError err;
+  bool ok = fetchLive(req, outCode, bodyBytes, wireBytes, [&](Stream& body) {
+    err = filter ? deserializeJson(doc, body, DeserializationOption::Filter(*filter)) : deserializeJson(doc, body);
+    return true;
+  });
+  fetchRecord(req, ok, outCode, bodyBytes, wireBytes, t0);
+  return ok && !err;
+}
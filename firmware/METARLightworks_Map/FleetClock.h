@@ -0,0 +1,297 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <AsyncUDP.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include "Metrics.h"
+#include "TimeSync.h"
+
+// ---------- Fleet clock (LAN time beacon) ----------
+// Animations (flight pulse, cycle demo) take their phase from fleetNowMs()
+// modulo their period, so every device on the LAN shows the same phase:
+//
+//   float t = (fleetNowMs() % PERIOD_MS) / (float)PERIOD_MS;
+//
+// NTP alone puts devices within tens of ms of each other. To tighten that,
+// the best-clocked device on the LAN (synced first, then smallest error
+// bound, then lowest MAC) broadcasts a beacon every second, and everyone
+// else follows it. Receive times are taken in the AsyncUDP callback, not
+// on the next loop() pass.
+//
+// Each sample (beacon time - own time) is the true offset minus that
+// beacon's one-way delay, and the delay is never negative but often large:
+// the AP holds broadcasts until the next DTIM beacon whenever any station
+// dozes. So, as NTP does with round trips, the follower keeps the sample
+// with the least delay in its window, which is the largest one.
+// Samples that arrive while our own radio is in power save (see
+// fleetSetRadioDozing()) carry our wake-up latency as well and are dropped.
+//
+// With no beacon heard the device leads itself (offset 0); with no clock
+// at all fleetNowMs() is still monotonic, just not shared.
+
+static const uint16_t FLEET_PORT = 47631;
+static const uint32_t FLEET_BEACON_MS = 1000;
+static const uint32_t FLEET_LEADER_TIMEOUT_MS = 3500;    // ~3 missed beacons
+static const uint32_t FLEET_ERROR_HYST_MS = 25;          // error bound must beat the leader by this
+static const int FLEET_SAMPLES = 16;                    // ~16 s window, spans many DTIM phases
+static const int FLEET_MAX_PEERS = 8;
+
+enum FleetRole : uint8_t { FLEET_OFF, FLEET_LEADER, FLEET_FOLLOWER };
+
+struct __attribute__((packed)) FleetBeacon {
+  char magic[4];        // "MLFC"
+  uint8_t version;      // 1
+  uint8_t quality;      // TimeQuality
+  uint16_t errorMs;     // sender's timeErrorBoundMs(), 0xFFFF = unknown
+  uint8_t id[6];        // STA MAC
+  uint16_t seq;
+  int64_t wallUs;       // sender's timeNowUs() just before sending
+};
+
+struct FleetPeer {
+  uint8_t id[6];
+  uint32_t lastMs = 0;
+};
+
+struct FleetState {
+  bool enabled = false;
+  uint8_t self[6] = { 0 };
+  uint16_t seq = 0;
+  uint32_t lastTxMs = 0;
+
+  // written by the receive callback under fleetMux
+  uint8_t leader[6] = { 0 };
+  uint8_t leaderQuality = TIME_UNSYNCED;
+  uint16_t leaderErrorMs = 0xFFFF;
+  uint32_t leaderLastMs = 0;
+  int64_t samples[FLEET_SAMPLES];
+  int sampleCount = 0;
+  int sampleNext = 0;
+  int64_t offsetUs = 0;          // applied: max of samples (least delay)
+  int64_t spreadUs = 0;          // max - min of samples (delay jitter)
+  FleetPeer peers[FLEET_MAX_PEERS];
+
+  uint32_t rx = 0;
+  uint32_t tx = 0;
+  uint32_t leaderChanges = 0;
+  uint32_t dozeDrops = 0;        // leader samples skipped, radio in power save
+};
+
+static FleetState fleet;
+static AsyncUDP fleetUdp;
+static portMUX_TYPE fleetMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool fleetRadioDozing = false;
+
+// Set by a power manager around periods where it puts the STA radio into
+// modem sleep; beacons are still followed but not sampled meanwhile.
+static inline void fleetSetRadioDozing(bool dozing) {
+  fleetRadioDozing = dozing;
+}
+
+// lower is better: quality class, then error bound, then MAC
+static int fleetRankCompare(uint8_t qa, uint16_t ea, const uint8_t* ida,
+                            uint8_t qb, uint16_t eb, const uint8_t* idb) {
+  static const uint8_t qRank[] = { 2, 0, 1 };    // unsynced, synced, stale
+  if (qRank[qa % 3] != qRank[qb % 3]) return qRank[qa % 3] < qRank[qb % 3] ? -1 : 1;
+  if (ea + FLEET_ERROR_HYST_MS < eb) return -1;
+  if (eb + FLEET_ERROR_HYST_MS < ea) return 1;
+  return memcmp(ida, idb, 6);
+}
+
+static uint16_t fleetOwnErrorMs() {
+  if (timeQuality() == TIME_UNSYNCED) return 0xFFFF;
+  return (uint16_t)min(timeErrorBoundMs(), (uint32_t)0xFFFE);
+}
+
+static bool fleetHasLeader(const FleetState& f) {
+  return f.leaderLastMs && millis() - f.leaderLastMs < FLEET_LEADER_TIMEOUT_MS;
+}
+
+static void fleetNotePeer(const uint8_t* id) {
+  FleetPeer* slot = nullptr;
+  for (auto& p : fleet.peers) {
+    if (p.lastMs && memcmp(p.id, id, 6) == 0) { slot = &p; break; }
+    if (!slot && (!p.lastMs || millis() - p.lastMs > 60000)) slot = &p;
+  }
+  if (!slot) return;
+  memcpy(slot->id, id, 6);
+  slot->lastMs = millis();
+}
+
+static void fleetOnPacket(AsyncUDPPacket& packet) {
+  int64_t rxUs = timeNowUs();               // as close to arrival as we get
+  bool dozing = fleetRadioDozing;
+  if (packet.length() != sizeof(FleetBeacon)) return;
+  FleetBeacon b;
+  memcpy(&b, packet.data(), sizeof(b));
+  if (memcmp(b.magic, "MLFC", 4) != 0 || b.version != 1) return;
+  if (memcmp(b.id, fleet.self, 6) == 0) return;   // our own broadcast
+  uint8_t ownQ = (uint8_t)timeQuality();
+  uint16_t ownE = fleetOwnErrorMs();
+
+  portENTER_CRITICAL(&fleetMux);
+  FleetState& f = fleet;
+  f.rx++;
+  fleetNotePeer(b.id);
+
+  bool fromLeader = fleetHasLeader(f) && memcmp(b.id, f.leader, 6) == 0;
+  if (!fromLeader) {
+    // take over only from a better sender than both the current leader and us
+    bool beatsSelf = fleetRankCompare(b.quality, b.errorMs, b.id, ownQ, ownE, f.self) < 0;
+    bool beatsLeader = !fleetHasLeader(f) ||
+                       fleetRankCompare(b.quality, b.errorMs, b.id,
+                                        f.leaderQuality, f.leaderErrorMs, f.leader) < 0;
+    if (beatsSelf && beatsLeader) {
+      memcpy(f.leader, b.id, 6);
+      f.sampleCount = 0;
+      f.sampleNext = 0;
+      f.leaderChanges++;
+      fromLeader = true;
+    }
+  }
+
+  if (fromLeader) {
+    f.leaderQuality = b.quality;
+    f.leaderErrorMs = b.errorMs;
+    f.leaderLastMs = millis();
+    if (dozing) {
+      f.dozeDrops++;
+    } else {
+      f.samples[f.sampleNext] = b.wallUs - rxUs;
+      f.sampleNext = (f.sampleNext + 1) % FLEET_SAMPLES;
+      if (f.sampleCount < FLEET_SAMPLES) f.sampleCount++;
+
+      int64_t lo = f.samples[0], hi = f.samples[0];
+      for (int i = 1; i < f.sampleCount; i++) {
+        lo = min(lo, f.samples[i]);
+        hi = max(hi, f.samples[i]);
+      }
+      f.offsetUs = hi;                     // least one-way delay
+      f.spreadUs = hi - lo;
+    }
+  }
+  portEXIT_CRITICAL(&fleetMux);
+}
+
+static FleetRole fleetRole() {
+  if (!fleet.enabled) return FLEET_OFF;
+  portENTER_CRITICAL(&fleetMux);
+  bool following = fleetHasLeader(fleet);
+  portEXIT_CRITICAL(&fleetMux);
+  return following ? FLEET_FOLLOWER : FLEET_LEADER;
+}
+
+static const char* fleetRoleName(FleetRole r) {
+  switch (r) {
+    case FLEET_LEADER:   return "leader";
+    case FLEET_FOLLOWER: return "follower";
+    default:             return "off";
+  }
+}
+
+// Offset applied to timeNowUs() (0 while leading).
+static int64_t fleetOffsetUs() {
+  if (fleetRole() != FLEET_FOLLOWER) return 0;
+  portENTER_CRITICAL(&fleetMux);
+  int64_t o = fleet.offsetUs;
+  portEXIT_CRITICAL(&fleetMux);
+  return o;
+}
+
+// Shared animation clock (ms). Unsynced devices with no leader still get
+// a monotonic value.
+static uint64_t fleetNowMs() {
+  int64_t us = timeNowUs() + fleetOffsetUs();
+  if (us < 0) us = esp_timer_get_time();
+  return (uint64_t)us / 1000ULL;
+}
+
+static void fleetBegin(bool enabled) {
+  fleet.enabled = enabled;
+  if (!enabled) {
+    fleetUdp.close();
+    return;
+  }
+  WiFi.macAddress(fleet.self);
+  fleetUdp.close();                          // re-begin after a settings change
+  if (fleetUdp.listen(FLEET_PORT)) {
+    fleetUdp.onPacket(fleetOnPacket);
+    Serial.printf("[FLEET] listening on udp/%u\n", FLEET_PORT);
+  } else {
+    Serial.println("[FLEET] udp listen failed");
+  }
+}
+
+// From loop(): beacons while leading.
+static void fleetTick() {
+  if (!fleet.enabled || WiFi.status() != WL_CONNECTED) return;
+  uint8_t ownQ = (uint8_t)timeQuality();
+  uint16_t ownE = fleetOwnErrorMs();
+
+  // our own clock got better than the leader's (e.g. we synced): take over
+  portENTER_CRITICAL(&fleetMux);
+  if (fleetHasLeader(fleet) &&
+      fleetRankCompare(ownQ, ownE, fleet.self, fleet.leaderQuality, fleet.leaderErrorMs, fleet.leader) < 0) {
+    fleet.leaderLastMs = 0;
+  }
+  portEXIT_CRITICAL(&fleetMux);
+
+  if (fleetRole() != FLEET_LEADER) return;
+  if (millis() - fleet.lastTxMs < FLEET_BEACON_MS) return;
+  fleet.lastTxMs = millis();
+
+  FleetBeacon b;
+  memcpy(b.magic, "MLFC", 4);
+  b.version = 1;
+  b.quality = ownQ;
+  b.errorMs = ownE;
+  memcpy(b.id, fleet.self, 6);
+  b.seq = fleet.seq++;
+  b.wallUs = timeNowUs();
+  if (fleetUdp.broadcastTo((uint8_t*)&b, sizeof(b), FLEET_PORT)) fleet.tx++;
+}
+
+static int fleetPeerCount() {
+  int n = 0;
+  portENTER_CRITICAL(&fleetMux);
+  for (auto& p : fleet.peers) if (p.lastMs && millis() - p.lastMs < 10000) n++;
+  portEXIT_CRITICAL(&fleetMux);
+  return n;
+}
+
+static String fleetStatusLine() {
+  FleetRole r = fleetRole();
+  String line = String("Fleet sync: <b>") + fleetRoleName(r) + "</b>";
+  if (r == FLEET_FOLLOWER) {
+    char buf[64];
+    portENTER_CRITICAL(&fleetMux);
+    FleetState f = fleet;
+    portEXIT_CRITICAL(&fleetMux);
+    snprintf(buf, sizeof(buf), " of %02X:%02X:%02X, offset %.2f ms (spread %.2f ms)",
+             f.leader[3], f.leader[4], f.leader[5], f.offsetUs / 1000.0, f.spreadUs / 1000.0);
+    line += buf;
+  }
+  if (r != FLEET_OFF) line += " &nbsp;|&nbsp; peers " + String(fleetPeerCount());
+  return line;
+}
+
+// appended to /metrics by each app
+static void fleetMetricsOut(String& out) {
+  portENTER_CRITICAL(&fleetMux);
+  uint32_t rx = fleet.rx, tx = fleet.tx, changes = fleet.leaderChanges, drops = fleet.dozeDrops;
+  int64_t spread = fleet.spreadUs;
+  portEXIT_CRITICAL(&fleetMux);
+  metricGaugeOut(out, "metarlw_fleet_role", "0=off 1=leader 2=follower", (int)fleetRole());
+  metricGaugeOut(out, "metarlw_fleet_offset_ms", "Offset applied to the local clock (follower)", fleetOffsetUs() / 1000.0);
+  metricGaugeOut(out, "metarlw_fleet_offset_spread_ms", "Max - min of the recent offset samples (delay jitter)", spread / 1000.0);
+  metricGaugeOut(out, "metarlw_fleet_peers", "Devices heard in the last 10 s", fleetPeerCount());
+  metricHeader(out, "metarlw_fleet_beacons_total", "Time beacons", "counter");
+  metricLine(out, "metarlw_fleet_beacons_total", "dir=\"rx\"", rx);
+  metricLine(out, "metarlw_fleet_beacons_total", "dir=\"tx\"", tx);
+  metricHeader(out, "metarlw_fleet_leader_changes_total", "Times a new leader was adopted", "counter");
+  metricLine(out, "metarlw_fleet_leader_changes_total", "", changes);
+  metricHeader(out, "metarlw_fleet_doze_drops_total", "Leader beacons not sampled, radio in power save", "counter");
+  metricLine(out, "metarlw_fleet_doze_drops_total", "", drops);
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include <freertos/FreeRTOS.h>
+#include "Metrics.h"
+
+// ---------- Live LED input (DDP / E1.31) ----------
+// A show controller (xLights, WLED, Resolume, ...) drives the map's LEDs
+// over the LAN at 30-40 fps. Pixel data goes from the UDP packet straight
+// into the strip's own pixel buffer through a sink the app provides, with
+// no intermediate frame; the render side then only calls show():
+//
+//   liveBegin(enabled, universe, timeoutMs, writePixels, renderWake);
+//   if (liveActive()) { if (liveShowDue()) { show(); liveFrameShown(); } }   // render tick
+//
+// While packets keep coming the weather render is held off; it takes over
+// again one timeout after the last packet, or on an E1.31 stream-terminated
+// packet. Live frames override the display schedule: a show runs when it
+// runs.
+//
+//   DDP    udp/4048: RGB 8-bit, byte offset into the strip, PUSH shows
+//   E1.31  udp/5568, unicast: 170 pixels per universe from the start
+//          universe; the last universe the strip needs shows the frame
+//
+// A frame with no push marker is shown LIVE_PUSH_WAIT_MS after its first
+// packet. Loss is counted from the sequence numbers (DDP 1..15 wrap, E1.31
+// 8-bit per universe).
+
+static const uint16_t LIVE_DDP_PORT = 4048;
+static const uint16_t LIVE_E131_PORT = 5568;
+static const int LIVE_E131_PIXELS = 170;            // 510 channels per universe
+static const int LIVE_MAX_UNIVERSES = 8;
+static const uint32_t LIVE_PUSH_WAIT_MS = 25;
+static const uint32_t LIVE_TIMEOUT_DEFAULT_MS = 2500;
+
+static const size_t LIVE_E131_HDR = 126;             // through the DMX start code
+static const uint8_t LIVE_DDP_VER1 = 0x40;
+static const uint8_t LIVE_DDP_TIMECODE = 0x10;
+static const uint8_t LIVE_DDP_REPLY = 0x04;
+static const uint8_t LIVE_DDP_QUERY = 0x02;
+static const uint8_t LIVE_DDP_PUSH = 0x01;
+
+// firstPixel/count in strip pixels, rgb = count * 3 bytes (R, G, B)
+typedef void (*LivePixelSink)(int firstPixel, const uint8_t* rgb, int count);
+
+struct LiveState {
+  bool enabled = false;
+  uint16_t universe = 1;
+  uint32_t timeoutMs = LIVE_TIMEOUT_DEFAULT_MS;
+  LivePixelSink sink = nullptr;
+  void (*wake)() = nullptr;
+  volatile int pixels = 0;                 // strip length, set by the app
+
+  // receive side (AsyncUDP task)
+  volatile uint32_t lastPacketMs = 0;      // 0 = not streaming
+  volatile uint32_t pendingSinceMs = 0;    // first packet of an unshown frame, 0 = none
+  volatile bool pushed = false;
+  uint8_t ddpSeq = 0;
+  uint8_t e131Seq[LIVE_MAX_UNIVERSES];
+  bool e131SeqValid[LIVE_MAX_UNIVERSES];
+
+  // counters (packets/bytes/lost/bad: receive side; frames: render side)
+  uint32_t packets = 0;
+  uint32_t bytes = 0;
+  uint32_t lost = 0;
+  uint32_t bad = 0;
+  uint32_t frames = 0;
+  uint32_t sessions = 0;
+
+  // last second (liveRateTick)
+  bool wasActive = false;
+  uint32_t rateMs = 0;
+  uint32_t ratePackets0 = 0, rateFrames0 = 0, rateLost0 = 0;
+  float pps = 0, fps = 0, lossPct = 0;
+};
+
+static LiveState live;
+static AsyncUDP liveDdpUdp;
+static AsyncUDP liveE131Udp;
+
+static bool liveActive() {
+  uint32_t last = live.lastPacketMs;
+  return live.enabled && last && millis() - last < live.timeoutMs;
+}
+
+static void liveNotePacket(size_t len) {
+  uint32_t now = millis();
+  if (!liveActive()) {
+    live.sessions++;
+    live.ddpSeq = 0;
+    for (int i = 0; i < LIVE_MAX_UNIVERSES; i++) live.e131SeqValid[i] = false;
+  }
+  live.lastPacketMs = now ? now : 1;
+  if (!live.pendingSinceMs) live.pendingSinceMs = live.lastPacketMs;
+  live.packets++;
+  live.bytes += len;
+}
+
+static void liveDeliver(int firstPixel, const uint8_t* rgb, int count, bool push) {
+  int n = live.pixels;
+  if (firstPixel >= n) return;
+  if (firstPixel + count > n) count = n - firstPixel;
+  if (count > 0 && live.sink) live.sink(firstPixel, rgb, count);
+  if (push) {
+    live.pushed = true;
+    if (live.wake) live.wake();
+  }
+}
+
+static uint32_t liveBe32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint16_t liveBe16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+static void liveOnDdp(AsyncUDPPacket& packet) {
+  const uint8_t* d = packet.data();
+  size_t len = packet.length();
+  if (len < 10 || (d[0] & 0xC0) != LIVE_DDP_VER1) { live.bad++; return; }
+  uint8_t flags = d[0];
+  if (flags & (LIVE_DDP_QUERY | LIVE_DDP_REPLY)) return;   // discovery/status: not pixels
+  if (d[3] != 0 && d[3] != 1) return;                       // only the default display
+  if (((d[2] >> 3) & 7) == 3) { live.bad++; return; }       // RGBW
+
+  size_t hdr = (flags & LIVE_DDP_TIMECODE) ? 14 : 10;
+  uint32_t offset = liveBe32(d + 4);
+  uint16_t dlen = liveBe16(d + 8);
+  if (hdr + dlen > len || offset % 3) { live.bad++; return; }
+
+  liveNotePacket(len);
+  uint8_t seq = d[1] & 0x0F;
+  if (seq && live.ddpSeq) {
+    uint8_t expect = live.ddpSeq % 15 + 1;
+    live.lost += (uint8_t)((seq - expect + 15) % 15);
+  }
+  if (seq) live.ddpSeq = seq;
+
+  liveDeliver((int)(offset / 3), d + hdr, dlen / 3, flags & LIVE_DDP_PUSH);
+}
+
+static void liveOnE131(AsyncUDPPacket& packet) {
+  const uint8_t* d = packet.data();
+  size_t len = packet.length();
+  if (len < LIVE_E131_HDR || memcmp(d + 4, "ASC-E1.17\0\0\0", 12) != 0) { live.bad++; return; }
+  if (liveBe32(d + 18) != 0x00000004) return;               // extended (sync/discovery)
+  if (liveBe32(d + 40) != 0x00000002 || d[117] != 0x02 || d[118] != 0xA1) { live.bad++; return; }
+  uint8_t options = d[112];
+  if (options & 0x80) return;                               // preview data
+  if (options & 0x40) {                                    // stream terminated
+    live.lastPacketMs = 0;
+    if (live.wake) live.wake();
+    return;
+  }
+  if (d[125] != 0) return;                                  // not DMX level data
+
+  int k = (int)liveBe16(d + 113) - (int)live.universe;
+  if (k < 0 || k >= LIVE_MAX_UNIVERSES) return;
+  int slots = (int)liveBe16(d + 123) - 1;
+  if (slots < 0 || LIVE_E131_HDR + slots > len) { live.bad++; return; }
+
+  liveNotePacket(len);
+  uint8_t seq = d[111];
+  if (live.e131SeqValid[k]) {
+    int8_t diff = (int8_t)(seq - live.e131Seq[k]);
+    if (diff <= 0 && diff > -20) return;                    // late or duplicate (E1.31 6.7.2)
+    if (diff > 1) live.lost += diff - 1;
+  }
+  live.e131Seq[k] = seq;
+  live.e131SeqValid[k] = true;
+
+  int lastUniverse = live.pixels > 0 ? (live.pixels - 1) / LIVE_E131_PIXELS : 0;
+  liveDeliver(k * LIVE_E131_PIXELS, d + LIVE_E131_HDR, min(slots, LIVE_E131_PIXELS * 3) / 3, k >= lastUniverse);
+}
+
+// Boot and after a settings change.
+static void liveBegin(bool enabled, int universe, uint32_t timeoutMs, LivePixelSink sink, void (*wake)()) {
+  liveDdpUdp.close();
+  liveE131Udp.close();
+  live.enabled = enabled;
+  live.universe = (uint16_t)constrain(universe, 1, 63999);
+  live.timeoutMs = constrain(timeoutMs, 500UL, 60000UL);
+  live.sink = sink;
+  live.wake = wake;
+  live.lastPacketMs = 0;
+  if (!enabled) return;
+
+  bool ok = liveDdpUdp.listen(LIVE_DDP_PORT);
+  if (ok) liveDdpUdp.onPacket(liveOnDdp);
+  bool ok2 = liveE131Udp.listen(LIVE_E131_PORT);
+  if (ok2) liveE131Udp.onPacket(liveOnE131);
+  Serial.printf("[LIVE] DDP udp/%u %s, E1.31 udp/%u universe %u %s\n",
+                LIVE_DDP_PORT, ok ? "listening" : "FAILED",
+                LIVE_E131_PORT, live.universe, ok2 ? "listening" : "FAILED");
+}
+
+static void liveSetPixelCount(int n) { live.pixels = n; }
+
+// Render side: a frame is complete (pushed) or has waited long enough.
+static bool liveShowDue() {
+  uint32_t since = live.pendingSinceMs;
+  return since && (live.pushed || millis() - since >= LIVE_PUSH_WAIT_MS);
+}
+
+static void liveFrameShown() {
+  live.pushed = false;
+  live.pendingSinceMs = 0;
+  live.frames++;
+}
+
+// Render side: true once when a stream has just ended (repaint the weather).
+static bool liveTakeEnded() {
+  bool active = liveActive();
+  bool ended = live.wasActive && !active;
+  live.wasActive = active;
+  if (ended) Serial.println("[LIVE] stream ended, back to weather");
+  return ended;
+}
+
+// From loop(): packet/frame rate and loss over the last second.
+static void liveRateTick() {
+  uint32_t now = millis();
+  if (now - live.rateMs < 1000) return;
+  float secs = (now - live.rateMs) / 1000.0f;
+  uint32_t p = live.packets, f = live.frames, l = live.lost;
+  if (live.rateMs) {
+    uint32_t dp = p - live.ratePackets0, dl = l - live.rateLost0;
+    live.pps = dp / secs;
+    live.fps = (f - live.rateFrames0) / secs;
+    live.lossPct = (dp + dl) ? 100.0f * dl / (dp + dl) : 0;
+  }
+  live.rateMs = now;
+  live.ratePackets0 = p;
+  live.rateFrames0 = f;
+  live.rateLost0 = l;
+}
+
+static String liveStatusLine() {
+  if (!live.enabled) return "Live input: <b>off</b>";
+  String line = String("Live input: <b>") + (liveActive() ? "streaming" : "listening") + "</b>";
+  if (liveActive()) {
+    line += " &nbsp;|&nbsp; " + String(live.pps, 0) + " packets/s, " + String(live.fps, 1) + " fps, " +
+            String(live.lossPct, 1) + "% lost";
+  }
+  line += " &nbsp;|&nbsp; " + String(live.packets) + " packets, " + String(live.lost) + " lost, " +
+          String(live.bad) + " bad since boot";
+  return line;
+}
+
+// appended to /metrics by the map
+static void liveMetricsOut(String& out) {
+  metricGaugeOut(out, "metarlw_live_active", "1 while a DDP/E1.31 stream drives the LEDs", liveActive() ? 1 : 0);
+  metricGaugeOut(out, "metarlw_live_packets_per_second", "Live packets received, last second", live.pps);
+  metricGaugeOut(out, "metarlw_live_frames_per_second", "Live frames shown, last second", live.fps);
+  metricGaugeOut(out, "metarlw_live_loss_percent", "Live packets lost (sequence gaps), last second", live.lossPct);
+  metricHeader(out, "metarlw_live_packets_total", "Live pixel packets received", "counter");
+  metricLine(out, "metarlw_live_packets_total", "", live.packets);
+  metricHeader(out, "metarlw_live_bytes_total", "Live pixel packet bytes received", "counter");
+  metricLine(out, "metarlw_live_bytes_total", "", live.bytes);
+  metricHeader(out, "metarlw_live_lost_total", "Live packets missing from the sequence", "counter");
+  metricLine(out, "metarlw_live_lost_total", "", live.lost);
+  metricHeader(out, "metarlw_live_bad_total", "Malformed or unsupported live packets", "counter");
+  metricLine(out, "metarlw_live_bad_total", "", live.bad);
+  metricHeader(out, "metarlw_live_frames_total", "Live frames shown", "counter");
+  metricLine(out, "metarlw_live_frames_total", "", live.frames);
+  metricHeader(out, "metarlw_live_sessions_total", "Live streams started", "counter");
+  metricLine(out, "metarlw_live_sessions_total", "", live.sessions);
+}
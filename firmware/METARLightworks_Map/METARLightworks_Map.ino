@@ -4,13 +4,20 @@
 // - Reads LittleFS /config.json (written by FACTORY firmware)
 // - SoftAP is ALWAYS ON so web UI is always reachable
 // - Also attempts STA Wi-Fi using config.wifi creds (AP+STA)
-// - mDNS: metarmap.local (fixed)
+// - mDNS: metarmap.local (fixed), status in the _http._tcp TXT record
 // - Simple Map UI: comma list of ICAO + SKIP + legend tokens
-// - 1 LED per token, max 250
+// - 1 LED per token, max 250 (1000 on boards with PSRAM)
 // - Data source: aviationweather.gov (AWC Data API) METAR JSON + stationinfo JSON
 // - Refresh interval: 20 minutes
 // - Fallback: nearest airport within 75nm among configured airports; else dim white
 // - OTA in app: Check Now + Install Update + Auto-update (days) like your Lamp app
+// - Dual-core: fetch/parse on a core-0 task, rendering on a core-1 task;
+//   single-core C3 runs both cooperatively from loop()
+// - LAN hub: can serve its observations to lamps/maps nearby, or take them
+//   from another hub (found over mDNS) with AWC as the fallback
+// - Forecast view: /taf?hours=N or ?animate=1 shows TAF categories N hours
+//   ahead (TAFs decoded once per refresh, see Taf.h)
+// - Day/night terminator: stations past sunset dim and/or take a dusk tint
 // ============================================================
 
 #include <WiFi.h>
@@ -24,16 +31,43 @@
 #include <Update.h>
 #include <ESP.h>
 #include <math.h>
+#include <algorithm>
+#include <new>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include "AppTypes.h"
+#include "State.h"
+#include "Metrics.h"
+#include "Memory.h"
+#include "EventLog.h"
+#include "Stall.h"
+#include "TimeSync.h"
+#include "FleetClock.h"
+#include "Fetch.h"
+#include "Hub.h"
+#include "MdnsStatus.h"
+#include "Mqtt.h"
+#include "Live.h"
+#include "Advisory.h"
+#include "Taf.h"
+#include "Terminator.h"
+#include "Staleness.h"
 #include "AdminUI.h"
+#include "Bench.h"
 #include "version.h"
 
 // ================= WEB =================
 WebServer server(80);
 
-// ================= Config =================
-AppConfig cfg;
+// ================= Config / shared state =================
+// Read with config.read(), change with config.update() (see State.h).
+SharedState<AppConfig> config;
+SharedState<MapStatus> mapStatus;
+SharedState<OtaStatus> otaState;
+SharedState<ScheduleState> schedState;   // published by the render side
 
 // ================= FS =================
 static const char* CONFIG_PATH = "/config.json";
@@ -47,13 +81,22 @@ static const char* AWC_STATION_ENDPOINT = "https://aviationweather.gov/api/data/
 
 // ================= Map limits/timing =================
 static const int MAX_TOKENS = 250;
+static const int MAX_TOKENS_PSRAM = 1000;
 static const unsigned long METAR_INTERVAL_MS = 20UL * 60UL * 1000UL;
+static const uint32_t METAR_DUE_AGE_S = 50UL * 60UL;   // routine METARs are hourly
 static const float FALLBACK_RADIUS_NM = 75.0f;
 static const size_t MAX_URL_LEN = 1700;
+static const int TAF_CHUNK_IDS = 16;            // TAF JSON runs a few KB a station
+static const int TAF_CHUNK_IDS_PSRAM = 48;
+static const size_t JSON_ARENA_BYTES = 96 * 1024;         // largest document (METAR chunk)
+static const size_t JSON_ARENA_BYTES_PSRAM = 192 * 1024;
 
 // ================= Runtime =================
 bool connected = false;
-unsigned long lastMetarFetch = 0;
+
+static TaskHandle_t netTask = nullptr;       // dual-core only (mapTasksBegin)
+static TaskHandle_t renderTask = nullptr;
+static volatile bool stripRebuildPending = false;
 
 // ================= OTA constants (MAP assets) =================
 static const char* OTA_OWNER = "METARlightworks";
@@ -64,14 +107,6 @@ static const char* OTA_ASSET_ESP32      = "METARLightworks_Map_ESP32.bin";
 static const char* OTA_ASSET_ESP32C3    = "METARLightworks_Map_ESP32C3.bin";
 static const char* OTA_ASSET_ESP32S3M   = "METARLightworks_Map_ESP32S3_MATRIX.bin";
 
-// ================= OTA runtime status =================
-String otaLatestTag = "";
-String otaLatestUrl = "";
-int    otaLatestSize = 0;
-String otaStatusLine = "Not checked yet";
-bool   otaUpdateAvailable = false;
-unsigned long otaLastCheckMs = 0;
-
 // ================= Map token model =================
 enum TokenType : uint8_t { TOK_AIRPORT, TOK_SKIP, TOK_LEGEND, TOK_INVALID };
 
@@ -84,11 +119,39 @@ struct Token {
   float lon = 0;
 
   bool hasMetar = false;
+  bool seen = false;        // METAR in the current refresh (else kept from an earlier one)
+  bool due = false;         // in this refresh's METAR chunks (planMetarRefresh)
   String fltCat = "UNKNOWN";
+  uint32_t obsTime = 0;     // epoch of the observation, 0 = unknown (Staleness.h)
+
+  TafTimeline taf;   // baseHour 0 = none
 };
 
-static Token tokens[MAX_TOKENS];
+// station table: cold data, so PSRAM when present (see tokensBegin)
+static Token* tokens = nullptr;
+static int tokenCap = 0;
 static int tokenCount = 0;
+static uint32_t tokenListGen = 0;     // bumped when the list is re-parsed (chunk plans)
+
+int tokenCapacity() { return tokenCap; }
+
+static void tokensBegin() {
+  if (tokens) return;
+  int cap = memHasPsram() ? MAX_TOKENS_PSRAM : MAX_TOKENS;
+  void* mem = memAllocCold(sizeof(Token) * cap);
+  if (!mem && cap != MAX_TOKENS) {
+    cap = MAX_TOKENS;
+    mem = memAllocCold(sizeof(Token) * cap);
+  }
+  if (!mem) {
+    Serial.println("[MEM] station table allocation failed");
+    return;
+  }
+  tokens = (Token*)mem;
+  for (int i = 0; i < cap; i++) new (&tokens[i]) Token();
+  tokenCap = cap;
+  Serial.printf("[MEM] station table: %d tokens (%s)\n", cap, memIsPsram(tokens) ? "psram" : "internal");
+}
 
 // ------------------ Helpers ------------------
 static String toUpperTrim(String s) { s.trim(); s.toUpperCase(); return s; }
@@ -124,49 +187,128 @@ static float haversineNm(float lat1,float lon1,float lat2,float lon2){
   return (R_km*c)*0.539957f;
 }
 
-static void colorForCategory(const String& cat, uint8_t& r, uint8_t& g, uint8_t& b) {
+enum FltCat : uint8_t { CAT_UNKNOWN, CAT_VFR, CAT_MVFR, CAT_IFR, CAT_LIFR };
+
+static FltCat catFromString(const String& cat) {
   String c = cat; c.trim(); c.toUpperCase();
-  if (c=="VFR")  { r=0;   g=255; b=0;   return; }
-  if (c=="MVFR") { r=0;   g=0;   b=255; return; }
-  if (c=="IFR")  { r=255; g=0;   b=0;   return; }
-  if (c=="LIFR") { r=255; g=0;   b=255; return; }
+  if (c=="VFR")  return CAT_VFR;
+  if (c=="MVFR") return CAT_MVFR;
+  if (c=="IFR")  return CAT_IFR;
+  if (c=="LIFR") return CAT_LIFR;
+  return CAT_UNKNOWN;
+}
+
+static void colorForCat(uint8_t cat, uint8_t& r, uint8_t& g, uint8_t& b) {
+  switch (cat) {
+    case CAT_VFR:  r=0;   g=255; b=0;   return;
+    case CAT_MVFR: r=0;   g=0;   b=255; return;
+    case CAT_IFR:  r=255; g=0;   b=0;   return;
+    case CAT_LIFR: r=255; g=0;   b=255; return;
+  }
   r=12; g=12; b=12; // unknown -> dim white
 }
 
 static bool isProvisionedForMap() {
-  if (!cfg.provisioned) return false;
-  String a = cfg.app_role; a.trim(); a.toLowerCase();
+  auto cfg = config.read();
+  if (!cfg->provisioned) return false;
+  String a = cfg->app_role; a.trim(); a.toLowerCase();
   return (a == "map");
 }
 
+// ------------------ Locks ------------------
+// mapLock: token table and the refresh job's view of it (net task vs
+// bench). Config and status don't need it; see State.h. stripLock: the strip object and
+// show() (render vs LED test/setup). Never hold mapLock across a fetch.
+static SemaphoreHandle_t mapMutex = nullptr;
+static SemaphoreHandle_t stripMutex = nullptr;
+
+static void locksBegin() {
+  if (!mapMutex) mapMutex = xSemaphoreCreateMutex();
+  if (!stripMutex) stripMutex = xSemaphoreCreateMutex();
+}
+
+void mapLock()   { if (mapMutex) xSemaphoreTake(mapMutex, portMAX_DELAY); }
+void mapUnlock() { if (mapMutex) xSemaphoreGive(mapMutex); }
+static void stripLock()   { if (stripMutex) xSemaphoreTake(stripMutex, portMAX_DELAY); }
+static void stripUnlock() { if (stripMutex) xSemaphoreGive(stripMutex); }
+
 // ------------------ LED ------------------
 void clearLED() {
-  if (!strip) return;
-  strip->clear();
-  strip->show();
+  stripLock();
+  if (strip) {
+    strip->clear();
+    strip->show();
+  }
+  stripUnlock();
 }
 void setLEDColor(uint8_t r,uint8_t g,uint8_t b) {
-  if (!strip) return;
-  for (int i=0;i<strip->numPixels();i++) strip->setPixelColor(i, strip->Color(r,g,b));
-  strip->setBrightness((uint8_t)clampInt(cfg.brightness, 1, 255));
-  strip->show();
+  stripLock();
+  if (strip) {
+    for (int i=0;i<strip->numPixels();i++) strip->setPixelColor(i, strip->Color(r,g,b));
+    strip->setBrightness((uint8_t)clampInt(config.read()->brightness, 1, 255));
+    strip->show();
+  }
+  stripUnlock();
 }
 
-void rebuildStripFromConfig() {
-  // derive LED count from tokens
-  cfg.led_count = clampInt(tokenCount, 1, MAX_TOKENS);
+// Live input (Live.h) writes into the strip's pixel buffer directly, so it
+// needs the byte position of R, G and B for the configured order. show()
+// sends the buffer as is; brightness is applied while copying.
+static uint8_t liveOffsetR = 1, liveOffsetG = 0, liveOffsetB = 2;   // GRB
+
+static void liveWritePixels(int first, const uint8_t* rgb, int count) {
+  uint16_t scale = (uint16_t)clampInt(config.read()->brightness, 1, 255) + 1;
+  stripLock();
+  // live.pixels can lag a rebuild; the strip being written is what counts
+  int n = strip ? (int)strip->numPixels() : 0;
+  if (first < 0 || first >= n) count = 0;
+  else if (first + count > n) count = n - first;
+  if (count > 0) {
+    uint8_t* px = strip->getPixels() + first * 3;
+    for (int i = 0; i < count; i++, px += 3, rgb += 3) {
+      px[liveOffsetR] = (uint8_t)((rgb[0] * scale) >> 8);
+      px[liveOffsetG] = (uint8_t)((rgb[1] * scale) >> 8);
+      px[liveOffsetB] = (uint8_t)((rgb[2] * scale) >> 8);
+    }
+  }
+  stripUnlock();
+}
+
+static void stripRebuild() {
+  int ledCount = mapStatus.read()->ledCount;
+  auto snap = config.read();
+  const AppConfig& cfg = *snap;
+
+  // same fallback as neoOrderFlagFromString(): anything unknown is GRB
+  String order3 = toUpperTrim(cfg.led_order);
+  if (neoOrderFlagFromString(order3) == NEO_GRB) order3 = "GRB";
 
+  stripLock();
   if (strip) { delete strip; strip=nullptr; }
   uint16_t order = neoOrderFlagFromString(cfg.led_order);
-  strip = new Adafruit_NeoPixel(cfg.led_count, cfg.led_pin, order + NEO_KHZ800);
+  strip = new Adafruit_NeoPixel(ledCount, cfg.led_pin, order + NEO_KHZ800);
   strip->begin();
   strip->setBrightness((uint8_t)clampInt(cfg.brightness,1,255));
   strip->clear();
   strip->show();
+  liveOffsetR = (uint8_t)order3.indexOf('R');
+  liveOffsetG = (uint8_t)order3.indexOf('G');
+  liveOffsetB = (uint8_t)order3.indexOf('B');
+  liveSetPixelCount(ledCount);
+  stripUnlock();
+}
+
+// The strip is (re)built on the render side so the RMT channel stays on the
+// render core; callers anywhere just flag it.
+void rebuildStripFromConfig() {
+  stripRebuildPending = true;
+  if (renderTask) xTaskNotifyGive(renderTask);
 }
 
 // ------------------ Wi-Fi + mDNS (like Lamp) ------------------
 static void setupWiFi() {
+  auto snap = config.read();
+  const AppConfig& cfg = *snap;
   WiFi.mode(WIFI_AP_STA);
   WiFi.softAP(cfg.device_ssid.length()?cfg.device_ssid.c_str():"METARMap", "metarmap123"); // always on
 
@@ -176,9 +318,13 @@ static void setupWiFi() {
 }
 
 void restartMDNSFixed() {
+  hubCancelSearch();   // a pending query dies with the responder
+  mdnsStatusEnd();
   MDNS.end();
   if (MDNS.begin("metarmap")) {
     MDNS.addService("http", "tcp", 80);
+    mdnsStatusBegin("map", FW_VERSION);
+    if (config.read()->hubServe) hubAdvertise(80);
   }
 }
 
@@ -190,11 +336,12 @@ static bool loadConfig() {
   File f = LittleFS.open(CONFIG_PATH, "r");
   if (!f) return false;
 
-  DynamicJsonDocument doc(24 * 1024);
+  ArenaJsonDocument doc(24 * 1024);
   DeserializationError err = deserializeJson(doc, f);
   f.close();
   if (err) return false;
 
+  AppConfig cfg;
   cfg.device_ssid = doc["device_ssid"] | "METARMap";
 
   // wifi
@@ -210,6 +357,37 @@ static bool loadConfig() {
   if (lb > 0) cfg.brightness = lb;
   cfg.brightness = clampInt(cfg.brightness, 1, 255);
 
+  // schedule
+  scheduleFromJson(doc["schedule"], cfg.sched);
+  cfg.timezonePref = String((const char*)(doc["schedule"]["tz"] | "UTC0"));
+  cfg.ntpServers = String((const char*)(doc["time"]["servers"] | "pool.ntp.org"));
+  cfg.fleetSync = (bool)(doc["time"]["fleet"] | true);
+
+  // LAN hub
+  cfg.hubServe = (bool)(doc["hub"]["serve"] | false);
+  cfg.hubUse = String((const char*)(doc["hub"]["use"] | "auto"));
+  mqttFromJson(doc["mqtt"], cfg.mqtt);
+
+  // day/night terminator
+  cfg.termMode = String((const char*)(doc["overlay"]["terminator"] | "off"));
+  if (!termModeFromString(cfg.termMode)) cfg.termMode = "off";
+  cfg.termNightPct = clampInt((int)(doc["overlay"]["night_pct"] | 20), 0, 100);
+
+  // METAR age
+  staleFromJson(doc["stale"], cfg.stale);
+
+  // forecast view
+  cfg.tafEnabled = (bool)(doc["taf"]["enabled"] | false);
+
+  // advisory overlay
+  cfg.advOverlay = String((const char*)(doc["overlay"]["advisories"] | "off"));
+  if (!advKindsForMode(cfg.advOverlay)) cfg.advOverlay = "off";
+
+  // live input
+  cfg.liveEnabled = (bool)(doc["live"]["enabled"] | false);
+  cfg.liveUniverse = clampInt((int)(doc["live"]["universe"] | 1), 1, 63999);
+  cfg.liveTimeoutMs = clampInt((int)(doc["live"]["timeout_ms"] | 2500), 500, 60000);
+
   // led settings
   cfg.led_pin = (int)(doc["led"]["pin"] | 5);
   cfg.led_order = doc["led"]["order"] | "GRB";
@@ -228,13 +406,25 @@ static bool loadConfig() {
   }
   cfg.otaIntervalDays = clampInt(cfg.otaIntervalDays, 1, 60);
 
+  // fetch layer
+  JsonObject fetch = doc["fetch"].as<JsonObject>();
+  if (!fetch.isNull()) {
+    cfg.fetchMode   = String((const char*)(fetch["mode"] | "live"));
+    cfg.replaySpeed = (int)(fetch["speed"] | 60);
+    cfg.fetchParallel = (int)(fetch["parallel"] | 2);
+  }
+  cfg.replaySpeed = clampInt(cfg.replaySpeed, 1, 600);
+  cfg.fetchParallel = clampInt(cfg.fetchParallel, 1, 3);
+
+  config.update([&](AppConfig& c) { c = cfg; });
   return true;
 }
 
 bool saveConfig() {
   if (!LittleFS.begin(true)) return false;
+  AppConfig cfg = config.copy();   // not pinned across the flash write
 
-  DynamicJsonDocument doc(24 * 1024);
+  ArenaJsonDocument doc(24 * 1024);
 
   if (LittleFS.exists(CONFIG_PATH)) {
     File in = LittleFS.open(CONFIG_PATH, "r");
@@ -258,6 +448,23 @@ bool saveConfig() {
   doc["led"]["order"] = cfg.led_order;
   doc["led"]["brightness"] = cfg.brightness;
 
+  JsonObject sched = doc["schedule"].to<JsonObject>();
+  scheduleToJson(sched, cfg.sched);
+  sched["tz"] = cfg.timezonePref;
+  doc["time"]["servers"] = cfg.ntpServers;
+  doc["time"]["fleet"] = cfg.fleetSync;
+  doc["hub"]["serve"] = cfg.hubServe;
+  doc["hub"]["use"] = cfg.hubUse;
+  mqttToJson(doc["mqtt"].to<JsonObject>(), cfg.mqtt);
+  doc["taf"]["enabled"] = cfg.tafEnabled;
+  doc["overlay"]["advisories"] = cfg.advOverlay;
+  doc["overlay"]["terminator"] = cfg.termMode;
+  doc["overlay"]["night_pct"] = cfg.termNightPct;
+  staleToJson(doc["stale"].to<JsonObject>(), cfg.stale);
+  doc["live"]["enabled"] = cfg.liveEnabled;
+  doc["live"]["universe"] = cfg.liveUniverse;
+  doc["live"]["timeout_ms"] = cfg.liveTimeoutMs;
+
   // Leave provision stamp as-is (Factory owns it)
   // doc["device"]["provisioned"] / ["app"] untouched
 
@@ -266,10 +473,16 @@ bool saveConfig() {
   ota["auto_update"]   = cfg.otaAutoUpdate;
   ota["interval_days"] = cfg.otaIntervalDays;
 
+  JsonObject fetch = doc["fetch"].to<JsonObject>();
+  fetch["mode"]  = cfg.fetchMode;
+  fetch["speed"] = cfg.replaySpeed;
+  fetch["parallel"] = cfg.fetchParallel;
+
   File out = LittleFS.open(CONFIG_PATH, "w");
   if (!out) return false;
   serializeJson(doc, out);
   out.close();
+  metrics.flashWrites.inc();
   return true;
 }
 
@@ -290,7 +503,7 @@ static void parseTokenList(const String& list) {
   w.replace(";", ",");
 
   int start = 0;
-  while (start < (int)w.length() && tokenCount < MAX_TOKENS) {
+  while (start < (int)w.length() && tokenCount < tokenCap) {
     int comma = w.indexOf(',', start);
     if (comma < 0) comma = w.length();
 
@@ -304,57 +517,179 @@ static void parseTokenList(const String& list) {
     }
     start = comma + 1;
   }
-
-  cfg.led_count = clampInt(tokenCount, 1, MAX_TOKENS);
+  tokenListGen++;
 }
 
-// ------------------ HTTPS GET ------------------
+// ------------------ HTTPS GET (AWC via fetch layer) ------------------
 static bool httpsGET(const String& url, String& outBody, int& outCode) {
-  WiFiClientSecure client;
-  client.setInsecure();
+  FetchRequest req;
+  req.provider = PROV_AWC;
+  req.url = url;
+  req.userAgent = "METARLightworks-Map/1.0 ESP32";
+  return fetchGET(req, outBody, outCode);
+}
 
-  HTTPClient http;
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  http.setUserAgent("METARLightworks-Map/1.0 ESP32");
+// ------------------ Request chunk plans ------------------
+// Station ids go out as comma lists packed up to MAX_URL_LEN. Where the
+// lists break is worked out in one pass over the token table, into
+// buffers allocated once at tokenCap:
+//
+//   planIds    each airport once (its first token), in list order; redone
+//              only when the token list changes
+//   ChunkPlan  where each request's run of planIds ends, for one endpoint,
+//              id cap and selection (no geo yet, METAR due, all)
+//
+// A plan is kept until its key changes, so the TAF pass and an unchanged
+// due set reuse the last refresh's boundaries. Each chunk is written into
+// one reserved String. A selection only shrinks while its plan is walked
+// (geo fixes land, nothing becomes due mid-phase), so re-checking it as a
+// chunk is written can make the chunk shorter, never longer than the limit.
+// All of it runs under mapLock.
+enum PlanSel : uint8_t { PLAN_ALL, PLAN_NO_GEO, PLAN_DUE };
+
+struct ChunkPlan {
+  PlanSel sel;
+  uint16_t* ends = nullptr;   // exclusive end in planIds, per chunk
+  int chunks = 0;
+  bool valid = false;
+  uint32_t listGen = 0, selGen = 0;
+  size_t budget = 0;
+  int maxIds = 0;
+  uint32_t builds = 0;
+};
 
-  if (!http.begin(client, url)) { outCode = -1; outBody = ""; return false; }
-  outCode = http.GET();
-  outBody = (outCode > 0) ? http.getString() : "";
-  http.end();
-  return (outCode == 200);
+static const size_t IDS_QUERY_LEN = sizeof("?format=json&ids=") - 1;
+
+static uint16_t* planIds = nullptr;
+static uint32_t* planKeys = nullptr;     // sorted, for dedupe while planIds is built
+static int planIdCount = 0;
+static int planDupes = 0;
+static uint32_t planIdsGen = 0;
+static bool planIdsValid = false;
+static uint32_t geoGen = 0;              // bumped per geo fix (PLAN_NO_GEO)
+static uint32_t dueGen = 0;              // bumped when the due set changes (PLAN_DUE)
+
+static ChunkPlan geoPlan{ PLAN_NO_GEO };
+static ChunkPlan metarPlan{ PLAN_DUE };
+static ChunkPlan tafPlan{ PLAN_ALL };
+
+static bool chunkPlansBegin() {
+  if (planIds) return true;
+  if (tokenCap <= 0) return false;
+  size_t n = (size_t)tokenCap;
+  uint8_t* mem = (uint8_t*)memAllocCold(n * (sizeof(uint32_t) + 4 * sizeof(uint16_t)));
+  if (!mem) {
+    Serial.println("[MAP] chunk plan allocation failed");
+    return false;
+  }
+  planKeys = (uint32_t*)mem;
+  planIds = (uint16_t*)(mem + n * sizeof(uint32_t));
+  geoPlan.ends = planIds + n;
+  metarPlan.ends = planIds + 2 * n;
+  tafPlan.ends = planIds + 3 * n;
+  return true;
 }
 
-// ------------------ Station Geo (batch) ------------------
-static bool buildNextIdsChunk(int& cursor, String& outIdsCsv) {
-  outIdsCsv = "";
+static void planIdsBuild() {
+  planIdCount = 0;
+  planDupes = 0;
+  int keys = 0;
+  for (int i = 0; i < tokenCount; i++) {
+    if (tokens[i].type != TOK_AIRPORT) continue;
+    uint32_t key = hubKey(tokens[i].icao.c_str());
+    uint32_t* at = std::lower_bound(planKeys, planKeys + keys, key);
+    if (at < planKeys + keys && *at == key) { planDupes++; continue; }
+    memmove(at + 1, at, (planKeys + keys - at) * sizeof(uint32_t));
+    *at = key;
+    keys++;
+    planIds[planIdCount++] = (uint16_t)i;
+  }
+  planIdsGen = tokenListGen;
+  planIdsValid = true;
+}
 
-  while (cursor < tokenCount && tokens[cursor].type != TOK_AIRPORT) cursor++;
-  if (cursor >= tokenCount) return false;
+static bool planWants(PlanSel sel, const Token& t) {
+  if (sel == PLAN_NO_GEO) return !t.hasGeo;
+  if (sel == PLAN_DUE) return t.due;
+  return true;
+}
 
-  String base = String(AWC_STATION_ENDPOINT) + "?format=json&ids=";
-  String ids = "";
+static uint32_t planSelGen(PlanSel sel) {
+  if (sel == PLAN_NO_GEO) return geoGen;
+  if (sel == PLAN_DUE) return dueGen;
+  return 0;
+}
 
-  for (int i = cursor; i < tokenCount; i++) {
-    if (tokens[i].type != TOK_AIRPORT) continue;
-    if (tokens[i].hasGeo) continue;
+static void chunkPlanBuild(ChunkPlan& p, size_t budget, int maxIds) {
+  p.chunks = 0;
+  size_t len = 0;
+  int count = 0;
+  for (int k = 0; k < planIdCount; k++) {
+    const Token& t = tokens[planIds[k]];
+    if (!planWants(p.sel, t)) continue;
+    size_t add = t.icao.length() + (count ? 1 : 0);
+    if (count && (len + add > budget || (maxIds > 0 && count >= maxIds))) {
+      p.ends[p.chunks++] = (uint16_t)k;
+      len = 0;
+      count = 0;
+      add = t.icao.length();
+    }
+    len += add;
+    count++;
+  }
+  if (count) p.ends[p.chunks++] = (uint16_t)planIdCount;
+  p.valid = true;
+  p.listGen = tokenListGen;
+  p.selGen = planSelGen(p.sel);
+  p.budget = budget;
+  p.maxIds = maxIds;
+  p.builds++;
+}
 
-    String next = tokens[i].icao;
-    String cand = ids;
-    if (cand.length()) cand += ",";
-    cand += next;
+// Next run of ids for endpoint (cursor counts chunks, 0 = start; the plan
+// is checked then). maxIds > 0 caps a chunk below the URL limit.
+static bool buildNextChunk(ChunkPlan& p, const char* endpoint, int maxIds, int& cursor, String& outIdsCsv) {
+  outIdsCsv = "";
+  if (!chunkPlansBegin()) return false;
 
-    if ((base + cand).length() >= MAX_URL_LEN) break;
-    ids = cand;
-    cursor = i + 1;
+  if (cursor == 0) {
+    if (!planIdsValid || planIdsGen != tokenListGen) planIdsBuild();
+    size_t budget = MAX_URL_LEN - 1 - strlen(endpoint) - IDS_QUERY_LEN;
+    if (!p.valid || p.listGen != tokenListGen || p.selGen != planSelGen(p.sel) || p.budget != budget || p.maxIds != maxIds) {
+      chunkPlanBuild(p, budget, maxIds);
+    }
   }
 
-  outIdsCsv = ids;
-  return ids.length() > 0;
+  while (cursor < p.chunks) {
+    int from = cursor ? p.ends[cursor - 1] : 0;
+    int to = p.ends[cursor++];
+    outIdsCsv.reserve((to - from) * 5);
+    for (int k = from; k < to; k++) {
+      const Token& t = tokens[planIds[k]];
+      if (!planWants(p.sel, t)) continue;
+      if (outIdsCsv.length()) outIdsCsv += ',';
+      outIdsCsv += t.icao;
+    }
+    if (outIdsCsv.length()) return true;
+  }
+  return false;
+}
+
+// ------------------ Station Geo (batch) ------------------
+static bool buildNextIdsChunk(int& cursor, String& outIdsCsv) {
+  return buildNextChunk(geoPlan, AWC_STATION_ENDPOINT, 0, cursor, outIdsCsv);
 }
 
-static void applyStationInfoGeo(const String& json) {
-  DynamicJsonDocument doc(64 * 1024);
-  if (deserializeJson(doc, json)) return;
+static const size_t GEO_DOC_BYTES = 64 * 1024;
+
+// only what applyStationInfoGeo() reads
+static void stationInfoFilter(JsonDocument& filter) {
+  JsonObject f = filter.createNestedObject();
+  for (const char* k : { "icaoId", "station", "latitude", "longitude", "lat", "lon" }) f[k] = true;
+}
+
+static void applyStationInfoGeo(JsonDocument& doc) {
+  MetricTimer parseTimer(metrics.parseTime[PROV_AWC]);
   if (!doc.is<JsonArray>()) return;
 
   for (JsonVariant v : doc.as<JsonArray>()) {
@@ -383,71 +718,261 @@ static void applyStationInfoGeo(const String& json) {
     for (int i=0;i<tokenCount;i++) {
       if (tokens[i].type==TOK_AIRPORT && tokens[i].icao==id) {
         tokens[i].hasGeo=true; tokens[i].lat=lat; tokens[i].lon=lon;
+        geoGen++;
         break;
       }
     }
   }
 }
 
-static void ensureGeoForAirports() {
-  // any missing?
-  bool missing=false;
-  for (int i=0;i<tokenCount;i++){
-    if (tokens[i].type==TOK_AIRPORT && !tokens[i].hasGeo) { missing=true; break; }
+// One stationinfo chunk: the body streams into doc (fetchGETJson), which
+// is applied under mapLock.
+static void fetchStationInfoGeo(const String& idsCsv) {
+  FetchRequest req;
+  req.provider = PROV_AWC;
+  req.url = String(AWC_STATION_ENDPOINT) + "?format=json&ids=" + idsCsv;
+  req.userAgent = "METARLightworks-Map/1.0 ESP32";
+  StaticJsonDocument<256> filter;
+  stationInfoFilter(filter);
+  ArenaJsonDocument doc(GEO_DOC_BYTES);
+  int code = 0;
+  if (!fetchGETJson(req, doc, code, &filter)) return;
+  mapLock();
+  applyStationInfoGeo(doc);
+  mapUnlock();
+}
+
+// ------------------ LAN hub (serving) ------------------
+// With hub serving (or MQTT) on, every METAR the refresh job parses is also
+// kept as a compact record (Hub.h) for /hub/obs and the MQTT obs topics. Stations a client asks for that are
+// not on this map become extras: fetched after the map's own chunks until
+// nobody has asked for them in HUB_EXTRA_TTL_MS. The store is under mapLock.
+static const int HUB_EXTRA_CAP = 64;
+static const uint32_t HUB_EXTRA_TTL_MS = 60UL * 60UL * 1000UL;
+static const uint32_t HUB_ONDEMAND_GAP_MS = 60UL * 1000UL;   // extras-only refreshes
+
+struct HubEntry {
+  uint32_t key = 0;
+  bool have = false;        // obs filled in
+  bool extra = false;       // asked for by a client, not on the map
+  uint32_t lastWantMs = 0;
+  HubObs obs;
+};
+
+static HubEntry* hubStore = nullptr;
+static int hubStoreCap = 0;
+static int hubStoreCount = 0;
+static int hubExtraCount = 0;
+static uint32_t hubRequests = 0;
+static uint32_t hubRecordsOut = 0;
+
+// Allocated the first time serving or MQTT is turned on; kept after that.
+static void hubStoreBegin() {
+  if (hubStore || tokenCap <= 0) return;
+  int cap = tokenCap + HUB_EXTRA_CAP;
+  void* mem = memAllocCold(sizeof(HubEntry) * cap);
+  if (!mem) {
+    Serial.println("[HUB] store allocation failed");
+    return;
   }
-  if (!missing) return;
+  hubStore = (HubEntry*)mem;
+  for (int i = 0; i < cap; i++) new (&hubStore[i]) HubEntry();
+  hubStoreCap = cap;
+}
 
-  int cursor=0;
-  while (cursor < tokenCount) {
-    String idsCsv;
-    if (!buildNextIdsChunk(cursor, idsCsv)) break;
+static HubEntry* hubStoreFind(uint32_t key) {
+  for (int i = 0; i < hubStoreCount; i++) {
+    if (hubStore[i].key == key) return &hubStore[i];
+  }
+  return nullptr;
+}
 
-    String url = String(AWC_STATION_ENDPOINT) + "?format=json&ids=" + idsCsv;
-    String body; int code=0;
-    if (httpsGET(url, body, code) && body.length()) applyStationInfoGeo(body);
+static HubEntry* hubStoreAdd(uint32_t key, bool extra) {
+  if (hubStoreCount >= hubStoreCap) return nullptr;
+  if (extra && hubExtraCount >= HUB_EXTRA_CAP) return nullptr;
+  HubEntry& e = hubStore[hubStoreCount++];
+  e = HubEntry();
+  e.key = key;
+  e.extra = extra;
+  if (extra) hubExtraCount++;
+  return &e;
+}
 
-    delay(120);
-    yield();
+static void hubStoreRemove(int i) {
+  if (hubStore[i].extra) hubExtraCount--;
+  hubStore[i] = hubStore[--hubStoreCount];
+}
+
+// Start of a refresh: drop map stations no longer listed (listChanged) and
+// extras nobody asked for lately.
+static void hubStorePrune(bool listChanged) {
+  uint32_t now = millis();
+  for (int i = hubStoreCount - 1; i >= 0; i--) {
+    const HubEntry& e = hubStore[i];
+    bool drop = e.extra ? (now - e.lastWantMs > HUB_EXTRA_TTL_MS) : listChanged;
+    if (drop) hubStoreRemove(i);
   }
 }
 
-// ------------------ METAR fetch (batch) ------------------
-static bool buildNextMetarChunk(int& cursor, String& outIdsCsv) {
-  outIdsCsv = "";
+static int16_t hubJsonInt(JsonVariant v, float scale) {
+  if (v.isNull()) return HUB_NA;
+  if (v.is<const char*>()) {
+    const char* t = v.as<const char*>();
+    if (!strcmp(t, "VRB")) return HUB_VRB;
+    if (!*t) return HUB_NA;
+    return (int16_t)lroundf(strtof(t, nullptr) * scale);   // "10+" -> 10
+  }
+  return (int16_t)lroundf(v.as<float>() * scale);
+}
 
-  while (cursor < tokenCount && tokens[cursor].type != TOK_AIRPORT) cursor++;
-  if (cursor >= tokenCount) return false;
+// AWC METAR JSON -> hub record
+static void hubObsFromAwc(JsonObject o, const String& id, const String& cat, HubObs& h) {
+  h = HubObs();
+  memcpy(h.icao, id.c_str(), 4);
+  if (cat != "UNKNOWN" && cat.length() < sizeof(h.cat)) strcpy(h.cat, cat.c_str());
+  h.obsTime = o["obsTime"].as<uint32_t>();
+  h.temp  = hubJsonInt(o["temp"], 1);
+  h.dewp  = hubJsonInt(o["dewp"], 1);
+  h.wdir  = hubJsonInt(o["wdir"], 1);
+  h.wspd  = hubJsonInt(o["wspd"], 1);
+  h.wgst  = hubJsonInt(o["wgst"], 1);
+  h.visib = hubJsonInt(o["visib"], 10);
+  h.altim = hubJsonInt(o["altim"], 2.953f);   // hPa -> inHg * 100
+  if (o.containsKey("lat") && o.containsKey("lon")) {
+    h.lat = o["lat"].as<float>();
+    h.lon = o["lon"].as<float>();
+  }
+}
 
-  String base = String(AWC_METAR_ENDPOINT) + "?format=json&ids=";
-  String ids = "";
+static void hubStorePut(const HubObs& obs) {
+  uint32_t key = hubKey(obs.icao);
+  HubEntry* e = hubStoreFind(key);
+  if (!e) e = hubStoreAdd(key, false);
+  if (!e) return;
+  e->obs = obs;
+  e->have = true;
+}
 
-  for (int i = cursor; i < tokenCount; i++) {
-    if (tokens[i].type != TOK_AIRPORT) continue;
+static bool buildNextExtrasChunk(int& cursor, String& outIdsCsv) {
+  outIdsCsv = "";
+  size_t budget = MAX_URL_LEN - 1 - strlen(AWC_METAR_ENDPOINT) - IDS_QUERY_LEN;
+  for (; cursor < hubStoreCount; cursor++) {
+    if (!hubStore[cursor].extra) continue;
+    const char* id = hubStore[cursor].obs.icao;
+    size_t add = strlen(id) + (outIdsCsv.length() ? 1 : 0);
+    if (outIdsCsv.length() + add > budget) break;
+    if (outIdsCsv.length()) outIdsCsv += ',';
+    outIdsCsv += id;
+  }
+  return outIdsCsv.length() > 0;
+}
 
-    String next = tokens[i].icao;
-    String cand = ids;
-    if (cand.length()) cand += ",";
-    cand += next;
+// ------------------ LAN hub (client) ------------------
+// Applies a hub reply to the token table. -1 if it isn't one.
+static int applyHubRecords(const String& body) {
+  MetricTimer parseTimer(metrics.parseTime[PROV_HUB]);
+  int applied = 0;
+  bool ok = hubParseBody(body, [&](const HubObs& o) {
+    for (int i = 0; i < tokenCount; i++) {
+      Token& t = tokens[i];
+      if (t.type != TOK_AIRPORT || t.icao != o.icao) continue;
+      t.hasMetar = true;
+      t.seen = true;
+      t.fltCat = o.cat[0] ? String(o.cat) : String("UNKNOWN");
+      t.obsTime = o.obsTime;
+      if (!t.hasGeo && !isnan(o.lat) && !isnan(o.lon)) {
+        t.hasGeo = true; t.lat = o.lat; t.lon = o.lon;
+        geoGen++;
+      }
+      if (hubStore) hubStorePut(o);
+      applied++;
+      break;
+    }
+  });
+  return ok ? applied : -1;
+}
 
-    if ((base + cand).length() >= MAX_URL_LEN) break;
-    ids = cand;
-    cursor = i + 1;
+// ids from a chunk that still have no METAR (hub didn't have them yet)
+static String missingMetarIds(const String& idsCsv) {
+  String out;
+  int start = 0;
+  while (start < (int)idsCsv.length()) {
+    int comma = idsCsv.indexOf(',', start);
+    if (comma < 0) comma = idsCsv.length();
+    String id = idsCsv.substring(start, comma);
+    for (int i = 0; i < tokenCount; i++) {
+      if (tokens[i].type == TOK_AIRPORT && tokens[i].icao == id) {
+        if (!tokens[i].seen) {
+          if (out.length()) out += ",";
+          out += id;
+        }
+        break;
+      }
+    }
+    start = comma + 1;
   }
+  return out;
+}
+
+// ------------------ METAR / TAF fetch (batch) ------------------
+static int metarChunkIds = 0;     // ids per chunk, 0 = URL limit (metarFetchParallel)
 
-  outIdsCsv = ids;
-  return ids.length() > 0;
+// stations planMetarRefresh() marked due
+static bool buildNextMetarChunk(int& cursor, String& outIdsCsv) {
+  return buildNextChunk(metarPlan, AWC_METAR_ENDPOINT, metarChunkIds, cursor, outIdsCsv);
 }
 
-static void clearMetarState() {
+// Start of a refresh: which stations to fetch. Results merge into the
+// table, so the others keep their reading. A station is due without a
+// METAR, without a clock to age it by, or once its observation is
+// METAR_DUE_AGE_S old, i.e. before its next routine METAR can be out; a
+// younger one can only have gained a SPECI. Readings past the stale
+// policy's missing step are dropped. full: every station is due.
+static int planMetarRefresh(bool full) {
+  uint32_t now = staleClock();
+  StaleCutoffs cut = staleCutoffs(config.read()->stale, now);
+  int due = 0;
+  bool changed = false;
   for (int i=0;i<tokenCount;i++){
-    tokens[i].hasMetar=false;
-    tokens[i].fltCat="UNKNOWN";
+    Token& t = tokens[i];
+    bool wasDue = t.due;
+    t.seen = false;
+    t.due = false;
+    if (t.type != TOK_AIRPORT) continue;
+    bool keep = now && t.obsTime && staleLevel(t.obsTime, cut) != STALE_MISSING;
+    if (!keep) {
+      t.hasMetar=false;
+      t.fltCat="UNKNOWN";
+      t.obsTime=0;
+    }
+    t.due = full || !keep || now - t.obsTime >= METAR_DUE_AGE_S;
+    if (t.due) due++;
+    if (t.due != wasDue) changed = true;
   }
+  if (changed) dueGen++;
+  return due;
 }
 
-static void applyMetarResults(const String& json) {
-  DynamicJsonDocument doc(96 * 1024);
-  if (deserializeJson(doc, json)) return;
+// A METAR chunk as parsed (fields per station, after metarFilter): the
+// largest is a full URL of ids, ~330 stations.
+static const size_t METAR_DOC_BYTES = 96 * 1024;
+static const size_t METAR_DOC_BYTES_PER_ID = 320;
+
+static size_t metarDocBytes(const String& idsCsv) {
+  size_t ids = (idsCsv.length() + 1) / 5;
+  return min(METAR_DOC_BYTES, ids * METAR_DOC_BYTES_PER_ID + 1024);
+}
+
+// only what applyMetarDoc() reads (and the hub record when one is kept)
+static void metarFilter(JsonDocument& filter) {
+  JsonObject f = filter.createNestedObject();
+  for (const char* k : { "icaoId", "station", "fltCat", "flight_category", "obsTime" }) f[k] = true;
+  if (!hubStore) return;
+  for (const char* k : { "temp", "dewp", "wdir", "wspd", "wgst", "visib", "altim", "lat", "lon" }) f[k] = true;
+}
+
+static void applyMetarDoc(JsonDocument& doc) {
+  MetricTimer parseTimer(metrics.parseTime[PROV_AWC]);
   if (!doc.is<JsonArray>()) return;
 
   for (JsonVariant v : doc.as<JsonArray>()) {
@@ -468,21 +993,88 @@ static void applyMetarResults(const String& json) {
     for (int i=0;i<tokenCount;i++){
       if (tokens[i].type==TOK_AIRPORT && tokens[i].icao==id) {
         tokens[i].hasMetar=true;
+        tokens[i].seen=true;
         tokens[i].fltCat=cat;
+        tokens[i].obsTime=o["obsTime"].as<uint32_t>();
         break;
       }
     }
+
+    if (hubStore) {
+      HubObs obs;
+      hubObsFromAwc(o, id, cat, obs);
+      hubStorePut(obs);
+    }
   }
 }
 
-// ------------------ Fallback + Render ------------------
+// a body already in hand (bench, recorded responses)
+static void applyMetarResults(const String& json) {
+  StaticJsonDocument<384> filter;
+  metarFilter(filter);
+  ArenaJsonDocument doc(METAR_DOC_BYTES);
+  if (deserializeJson(doc, json, DeserializationOption::Filter(filter))) return;
+  applyMetarDoc(doc);
+}
+
+// AWC METARs for idsCsv: the body streams into doc (fetchGETJson); only
+// applying it takes mapLock. Safe on several tasks at once: a doc off the
+// net task comes from the heap (the JSON arena has one owner).
+static void fetchMetarIds(const String& idsCsv) {
+  FetchRequest req;
+  req.provider = PROV_AWC;
+  req.url = String(AWC_METAR_ENDPOINT) + "?format=json&ids=" + idsCsv;
+  req.userAgent = "METARLightworks-Map/1.0 ESP32";
+  StaticJsonDocument<384> filter;
+  metarFilter(filter);
+  ArenaJsonDocument doc(metarDocBytes(idsCsv));
+  int code = 0;
+  if (!fetchGETJson(req, doc, code, &filter)) return;
+  mapLock();
+  applyMetarDoc(doc);
+  mapUnlock();
+}
+
+// ------------------ TAF (forecast view) ------------------
+// A station keeps its timeline until a newer TAF replaces it; one that
+// drops out of AWC runs out at the end of its validity on its own.
+static void applyTafResults(const String& json) {
+  tafParseAwc(json, [&](const char* icao, const TafTimeline& tl) {
+    for (int i=0;i<tokenCount;i++){
+      if (tokens[i].type==TOK_AIRPORT && tokens[i].icao==icao) {
+        tokens[i].taf = tl;
+        break;
+      }
+    }
+  });
+}
+
+static int countTafStations() {
+  int n = 0;
+  for (int i=0;i<tokenCount;i++) if (tokens[i].type==TOK_AIRPORT && tokens[i].taf.baseHour) n++;
+  return n;
+}
+
+static void clearTafState() {
+  for (int i=0;i<tokenCount;i++) tokens[i].taf = TafTimeline();
+}
+
+// ------------------ Fallback ------------------
 static bool hasValidCat(const Token& t) {
   if (!t.hasMetar) return false;
-  String c=t.fltCat; c.trim(); c.toUpperCase();
-  return (c=="VFR"||c=="MVFR"||c=="IFR"||c=="LIFR");
+  return catFromString(t.fltCat) != CAT_UNKNOWN;
+}
+
+// valid and not past the missing step: what a station or a fallback may show
+static bool hasCurrentCat(const Token& t, const StaleCutoffs& cut) {
+  return hasValidCat(t) && staleLevel(t.obsTime, cut) != STALE_MISSING;
 }
 
-static int findNearestFallbackIndex(int src) {
+static bool hasTaf(const Token& t) { return t.taf.baseHour != 0; }
+
+// nearest configured airport within FALLBACK_RADIUS_NM that has(...)
+template <typename Pred>
+static int findNearestIndex(int src, Pred has) {
   const Token& s = tokens[src];
   if (!s.hasGeo) return -1;
 
@@ -494,7 +1086,7 @@ static int findNearestFallbackIndex(int src) {
     const Token& c = tokens[i];
     if (c.type!=TOK_AIRPORT) continue;
     if (!c.hasGeo) continue;
-    if (!hasValidCat(c)) continue;
+    if (!has(c)) continue;
 
     float d = haversineNm(s.lat,s.lon,c.lat,c.lon);
     if (d<=FALLBACK_RADIUS_NM && d<best) { best=d; bestIdx=i; }
@@ -502,75 +1094,1117 @@ static int findNearestFallbackIndex(int src) {
   return bestIdx;
 }
 
-static void renderMap() {
-  if (!strip) return;
+static int findNearestFallbackIndex(int src, const StaleCutoffs& cut) {
+  return findNearestIndex(src, [&](const Token& c) { return hasCurrentCat(c, cut); });
+}
+
+// ------------------ Station snapshot (net -> render) ------------------
+// The refresh job resolves every LED to a category (fallback included) and
+// publishes the result as a compact snapshot. Render only reads snapshots,
+// never the token table, so a refresh in progress can't tear a frame and
+// a slow fetch never holds up a frame.
+//
+// Two buffers, each with a sequence counter that is odd while the buffer is
+// being written. The writer fills the back buffer, then flips snapFront; a
+// reader copies the front buffer and retries if its sequence moved while it
+// was copying. No locks on either side. One writer at a time: publishers
+// hold mapLock().
+enum SnapKind : uint8_t { SNAP_OFF, SNAP_LEGEND, SNAP_STATION, SNAP_FALLBACK, SNAP_NODATA };
+
+struct StationSnap {
+  uint8_t kind;
+  uint8_t cat;
+  uint8_t adv;     // ADV_* bits of the advisories over the station (Advisory.h)
+  uint8_t taf[TAF_HOURS / 2];   // forecast nibbles from MapSnapshot::tafBase (Taf.h)
+  int16_t geo[3];               // Q14 unit vector of the station, 0 = unknown (Terminator.h)
+  uint32_t obs;                 // observation time behind cat (station or fallback), 0 = unknown
+  uint32_t ownObs;              // the station's own observation, for the stale counts
+};
+
+struct MapSnapshot {
+  StationSnap* led = nullptr;
+  int count = 0;
+  uint32_t gen = 0;
+  uint32_t tafBase = 0;         // epoch hour of taf[] cell 0 (0 = no clock)
+};
+
+static MapSnapshot snapBuf[2];
+static std::atomic<uint32_t> snapSeq[2];
+static std::atomic<uint8_t> snapFront(0);
+static std::atomic<uint32_t> snapGen(0);
+static StationSnap* renderLeds = nullptr;    // render's private copy
+static uint32_t renderTafBase = 0;
+static uint32_t snapRetries = 0;
+static volatile uint32_t staleRepublishAt = 0;   // epoch a shown METAR goes missing (0 = none)
+
+static void renderWake();
+
+static void snapshotsBegin() {
+  if (renderLeds || tokenCap <= 0) return;
+  size_t bytes = sizeof(StationSnap) * tokenCap;
+  snapBuf[0].led = (StationSnap*)memAllocCold(bytes);
+  snapBuf[1].led = (StationSnap*)memAllocCold(bytes);
+  renderLeds = (StationSnap*)memAllocCold(bytes);
+  if (!snapBuf[0].led || !snapBuf[1].led || !renderLeds) {
+    Serial.println("[MEM] snapshot allocation failed");
+    return;
+  }
+  memset(snapBuf[0].led, 0, bytes);
+  memset(snapBuf[1].led, 0, bytes);
+}
+
+// Station counts and the derived LED count for the web UI / metrics.
+static void publishStationStatus() {
+  int airports = 0, withMetar = 0, withGeo = 0;
+  int cats[5] = { 0 };
+  float sumLat = 0, sumLon = 0;
+  for (int i = 0; i < tokenCount; i++) {
+    if (tokens[i].type != TOK_AIRPORT) continue;
+    airports++;
+    if (tokens[i].hasMetar) {
+      withMetar++;
+      cats[catFromString(tokens[i].fltCat)]++;
+    }
+    if (tokens[i].hasGeo) {
+      withGeo++;
+      sumLat += tokens[i].lat;
+      sumLon += tokens[i].lon;
+    }
+  }
+  int leds = clampInt(tokenCount, 1, max(tokenCap, 1));
+  mapStatus.update([&](MapStatus& m) {
+    m.ledCount = leds;
+    m.stations = airports;
+    m.stationsWithMetar = withMetar;
+    m.stationsWithGeo = withGeo;
+    memcpy(m.catCount, cats, sizeof(cats));
+    m.hasCenter = withGeo > 0;
+    m.centerLat = withGeo ? sumLat / withGeo : 0;
+    m.centerLon = withGeo ? sumLon / withGeo : 0;
+  });
+}
+
+static void publishSnapshot() {
+  uint8_t back = snapFront.load(std::memory_order_relaxed) ^ 1;
+  MapSnapshot& s = snapBuf[back];
+  if (!s.led) return;
+
+  snapSeq[back].fetch_add(1, std::memory_order_relaxed);     // odd: writing
+  std::atomic_thread_fence(std::memory_order_release);
+
+  int n = min(tokenCount, tokenCap);
+  bool advOn = adv.cols > 0;
+  uint32_t now = timeEpochOrZero();
+  uint32_t advUs = 0;
+  uint32_t tafBase = now / 3600;
+  uint32_t staleNow = staleClock();
+  StalePolicy stale = config.read()->stale;
+  StaleCutoffs staleCut = staleCutoffs(stale, staleNow);
+  uint32_t republishAt = 0;
+  bool tafOn = tafBase && tafStats.stations > 0;
+  int advAffected = 0;
+  for (int i = 0; i < n; i++) {
+    const Token& t = tokens[i];
+    StationSnap& o = s.led[i];
+    o.cat = CAT_UNKNOWN;
+    o.adv = ADV_NONE;
+    o.obs = 0;
+    o.ownObs = 0;
+    memset(o.taf, 0, sizeof(o.taf));
+    memset(o.geo, 0, sizeof(o.geo));
+    if (t.type == TOK_LEGEND) {
+      o.kind = SNAP_LEGEND;
+      o.cat = catFromString(t.raw);
+    } else if (t.type == TOK_AIRPORT) {
+      if (hasCurrentCat(t, staleCut)) {
+        o.kind = SNAP_STATION;
+        o.cat = catFromString(t.fltCat);
+        o.obs = t.obsTime;
+      } else {
+        int fb = findNearestFallbackIndex(i, staleCut);
+        o.kind = (fb >= 0) ? SNAP_FALLBACK : SNAP_NODATA;
+        if (fb >= 0) {
+          o.cat = catFromString(tokens[fb].fltCat);
+          o.obs = tokens[fb].obsTime;
+        }
+      }
+      if (t.hasMetar) {
+        o.ownObs = t.obsTime;
+        uint32_t at = staleMissingAt(t.obsTime, stale);
+        if (at > staleNow && (!republishAt || at < republishAt)) republishAt = at;
+      }
+      if (t.hasGeo) termStationVec(t.lat, t.lon, o.geo);
+      if (advOn && t.hasGeo) {
+        uint32_t t0 = micros();
+        o.adv = advAt(t.lat, t.lon, now);
+        advUs += micros() - t0;
+        if (o.adv) advAffected++;
+      }
+      if (tafOn) {
+        // stations without a TAF borrow the nearest one, like the METAR fallback
+        int src = hasTaf(t) ? i : findNearestIndex(i, hasTaf);
+        if (src >= 0) tafRebase(tokens[src].taf, tafBase, o.taf);
+      }
+    } else {
+      o.kind = SNAP_OFF;   // SKIP and invalid tokens
+    }
+  }
+  s.count = n;
+  s.gen = snapGen.load(std::memory_order_relaxed) + 1;
+  s.tafBase = tafOn ? tafBase : 0;
+  adv.evalUs = advUs;
+  adv.affected = advAffected;
+  staleRepublishAt = republishAt;   // without a clock: as soon as there is one
+
+  snapSeq[back].fetch_add(1, std::memory_order_release);     // even: stable
+  snapFront.store(back, std::memory_order_release);
+  snapGen.store(s.gen, std::memory_order_release);
+  renderWake();
+  publishStationStatus();
+}
+
+// Copies the current snapshot into renderLeds. False only if the writer
+// lapped us repeatedly; the next frame tick tries again.
+static bool readSnapshot(int& count, uint32_t& gen) {
+  if (!renderLeds) return false;
+  for (int tries = 0; tries < 4; tries++) {
+    uint8_t f = snapFront.load(std::memory_order_acquire);
+    uint32_t seq = snapSeq[f].load(std::memory_order_acquire);
+    if (seq & 1) { snapRetries++; continue; }
+
+    const MapSnapshot& s = snapBuf[f];
+    int n = s.count;
+    uint32_t g = s.gen;
+    uint32_t base = s.tafBase;
+    memcpy(renderLeds, s.led, sizeof(StationSnap) * n);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapSeq[f].load(std::memory_order_relaxed) == seq) {
+      count = n;
+      gen = g;
+      renderTafBase = base;
+      return true;
+    }
+    snapRetries++;
+  }
+  return false;
+}
+
+// ------------------ Schedule ------------------
+// Evaluated on the render side, only at the next transition or when config
+// or the station set changes (ScheduleRunner caches the rest). A map spans
+// a region, so without a configured lat/lon the sun is taken at the mean
+// station position.
+static ScheduleRunner schedule;
+
+ScheduleConfig mapScheduleConfig() {
+  ScheduleConfig sc = config.read()->sched;
+  if (!sc.hasGeo) {
+    auto st = mapStatus.read();
+    if (st->hasCenter) {
+      sc.hasGeo = true;
+      sc.lat = st->centerLat;
+      sc.lon = st->centerLon;
+    }
+  }
+  return sc;
+}
+
+// true when on/off or the level changed
+static bool scheduleTick() {
+  uint32_t key = (config.version() * 65599u + mapStatus.version()) * 31u + timeSyncCount();
+  uint32_t evals = schedule.evals;
+  bool changed = schedule.tick(mapScheduleConfig(), key);
+  if (schedule.evals != evals) {
+    ScheduleState s = schedule.st;
+    schedState.update([&](ScheduleState& o) { o = s; });
+  }
+  return changed;
+}
+
+// ------------------ Render ------------------
+static uint32_t renderSeenGen = 0;
+static int renderSeenBrightness = -1;
+static volatile bool renderForce = false;
+static bool renderAnimating = false;        // advisory effects on screen
+static uint32_t renderLastFrameMs = 0;
+static uint32_t renderSeenTafHour = 0;
+static uint32_t renderSeenTermMinute = 0;   // terminator: a frame each minute
+static uint32_t renderSeenConfigVer = 0;    // overlay settings apply right away
+static uint32_t renderStaleAt = 0;          // epoch of the next stale step on screen (0 = none)
+static bool renderStaleBlinking = false;
+static bool renderSeenBlinkOn = false;
+
+// epoch hour the forecast view shows, 0 = current conditions
+static uint32_t renderTafHour() { return tafShownHours() > 0 ? tafShownHour() : 0; }
+
+static void renderFrame() {
+  int n = 0;
+  uint32_t gen = 0;
+  if (!readSnapshot(n, gen)) return;
+
+  stripLock();
+  if (!strip) { stripUnlock(); return; }
+  uint32_t t0 = micros();
   strip->clear();
 
-  for (int i=0;i<cfg.led_count;i++){
-    if (i>=tokenCount) {
+  int leds = schedule.st.on ? strip->numPixels() : 0;   // outside the weekday window: dark
+  uint64_t fleetMs = fleetNowMs();
+  bool animating = false;
+  uint32_t tafHour = renderTafHour();
+
+  uint8_t termMode, nightPct;
+  {
+    auto cfg = config.read();
+    termMode = termModeFromString(cfg->termMode);
+    nightPct = (uint8_t)clampInt(cfg->termNightPct, 0, 100);
+  }
+  if (termMode) termSunUpdate(timeEpochOrZero());
+  int dark = 0, dusk = 0;
+
+  // METAR age: cutoffs once per frame, then integer compares per station
+  uint32_t now = staleClock();
+  StalePolicy stale = config.read()->stale;
+  StaleCutoffs staleCut = staleCutoffs(stale, now);
+  bool blinkOn = staleBlinkOn(fleetMs);
+  bool blinking = false;
+  uint32_t staleAt = 0;
+  StaleCounts staleN;
+  for (int i=0;i<n;i++){
+    const StationSnap& t = renderLeds[i];
+    if (t.ownObs) {
+      uint8_t lvl = staleLevel(t.ownObs, staleCut);
+      if (lvl == STALE_FADE) staleN.fading++;
+      else if (lvl == STALE_BLINK) staleN.blinking++;
+      else if (lvl == STALE_MISSING) staleN.missing++;
+    }
+    uint32_t at = staleNextChange(t.obs, stale, now);
+    if (at && (!staleAt || at < staleAt)) staleAt = at;
+  }
+  for (int i=0;i<leds;i++){
+    if (i>=n) {
       strip->setPixelColor(i, strip->Color(12,12,12));
       continue;
     }
 
-    const Token& t=tokens[i];
+    const StationSnap& t = renderLeds[i];
+    if (t.kind==SNAP_OFF) continue;
 
-    if (t.type==TOK_SKIP) {
-      // off
-      continue;
+    uint8_t cat = t.kind==SNAP_NODATA ? CAT_UNKNOWN : t.cat;
+    if (tafHour && t.kind != SNAP_LEGEND) {
+      // forecast view: no TAF for the hour reads as no data
+      cat = (renderTafBase && tafHour >= renderTafBase)
+          ? (tafCellGet(t.taf, (int)(tafHour - renderTafBase)) & TAF_CAT_MASK) : CAT_UNKNOWN;
+    }
+    uint16_t staleScale = 256;
+    if (!tafHour && (t.kind == SNAP_STATION || t.kind == SNAP_FALLBACK)) {
+      uint8_t lvl = staleLevel(t.obs, staleCut);
+      if (lvl == STALE_MISSING) cat = CAT_UNKNOWN;   // until the republish moves a fallback in
+      else if (lvl == STALE_BLINK) { blinking = true; staleScale = blinkOn ? 256 : 0; }
+      else if (lvl == STALE_FADE) staleScale = STALE_FADE_SCALE;
     }
+    uint8_t r,g,b; colorForCat(cat, r,g,b);
+    if (staleScale != 256) {
+      r = (uint8_t)((r * staleScale) >> 8); g = (uint8_t)((g * staleScale) >> 8); b = (uint8_t)((b * staleScale) >> 8);
+    }
+    if (t.adv && !tafHour) {
+      uint16_t scale, white;
+      advEffect(t.adv, fleetMs, scale, white);
+      r = (uint8_t)((r * scale) >> 8); r += (uint8_t)(((255 - r) * white) >> 8);
+      g = (uint8_t)((g * scale) >> 8); g += (uint8_t)(((255 - g) * white) >> 8);
+      b = (uint8_t)((b * scale) >> 8); b += (uint8_t)(((255 - b) * white) >> 8);
+      animating = true;
+    }
+    if (termMode && t.kind != SNAP_LEGEND) {
+      uint16_t scale, tint;
+      termEffect(t.geo, termMode, nightPct, scale, tint);
+      termApplyTint(tint, r, g, b);
+      r = (uint8_t)((r * scale) >> 8); g = (uint8_t)((g * scale) >> 8); b = (uint8_t)((b * scale) >> 8);
+      if (termHasPos(t.geo)) {
+        int32_t s = termSinEl(t.geo);
+        if (s <= TERM_SIN_M12) dark++;
+        else if (s > -TERM_SIN_6 && s < TERM_SIN_6) dusk++;
+      }
+    }
+    strip->setPixelColor(i, strip->Color(r,g,b));
+  }
 
-    if (t.type==TOK_LEGEND) {
-      uint8_t r,g,b; colorForCategory(t.raw,r,g,b);
-      strip->setPixelColor(i, strip->Color(r,g,b));
-      continue;
+  int bright = clampInt(config.read()->brightness,1,255);
+  int level = (int)lroundf(bright * schedule.st.level);
+  strip->setBrightness((uint8_t)(level > 0 ? clampInt(level,1,255) : 0));
+  metrics.renderTime.observeUs(micros() - t0);
+
+  {
+    MetricTimer showTimer(metrics.showTime);
+    strip->show();
+  }
+  stripUnlock();
+
+  renderSeenGen = gen;
+  renderSeenBrightness = bright;
+  renderAnimating = animating;
+  renderLastFrameMs = millis();
+  renderSeenTafHour = tafHour;
+  renderSeenTermMinute = termMode ? term.minute : 0;
+  renderSeenConfigVer = config.version();
+  renderStaleAt = staleAt;
+  renderStaleBlinking = blinking;
+  renderSeenBlinkOn = blinkOn;
+  term.darkLeds = dark;
+  term.duskLeds = dusk;
+  staleCounts = staleN;
+}
+
+// One render-side tick: deferred strip rebuilds, then a frame if the
+// snapshot, brightness, schedule or strip changed since the last one.
+static void renderTick() {
+  if (stripRebuildPending) {
+    stripRebuildPending = false;
+    stripRebuild();
+    renderForce = true;
+  }
+  if (scheduleTick()) renderForce = true;
+
+  // a show controller is streaming: its frames go out as they complete
+  if (liveTakeEnded()) renderForce = true;
+  if (liveActive()) {
+    if (!liveShowDue()) return;
+    stripLock();
+    if (strip) {
+      MetricTimer showTimer(metrics.showTime);
+      strip->show();
     }
+    stripUnlock();
+    liveFrameShown();
+    return;
+  }
 
-    if (t.type==TOK_AIRPORT) {
-      if (hasValidCat(t)) {
-        uint8_t r,g,b; colorForCategory(t.fltCat,r,g,b);
-        strip->setPixelColor(i, strip->Color(r,g,b));
-      } else {
-        int fb = findNearestFallbackIndex(i);
-        if (fb>=0) {
-          uint8_t r,g,b; colorForCategory(tokens[fb].fltCat,r,g,b);
-          strip->setPixelColor(i, strip->Color(r,g,b));
-        } else {
-          strip->setPixelColor(i, strip->Color(12,12,12)); // dim white
+  bool changed = renderForce
+              || snapGen.load(std::memory_order_acquire) != renderSeenGen
+              || clampInt(config.read()->brightness,1,255) != renderSeenBrightness
+              || (renderAnimating && millis() - renderLastFrameMs >= ADV_FRAME_MS)
+              || renderTafHour() != renderSeenTafHour
+              || config.version() != renderSeenConfigVer
+              || (termModeFromString(config.read()->termMode) && timeEpochOrZero() / 60 != renderSeenTermMinute)
+              || (renderStaleAt && staleClock() >= renderStaleAt)
+              || (renderStaleBlinking && staleBlinkOn(fleetNowMs()) != renderSeenBlinkOn);
+  if (!changed) return;
+  renderForce = false;
+  renderFrame();
+}
+
+// Synchronous publish + frame (setup, bench).
+static void renderMap() {
+  publishSnapshot();
+  renderFrame();
+}
+
+// ------------------ Refresh job ------------------
+// A refresh is a sequence of short steps: parse the list, one stationinfo
+// chunk per step, one METAR chunk per step, publish. The net task runs them
+// back to back (paced like the old blocking loop); on single-core chips
+// loop() runs one step per pass so the web UI keeps answering.
+//
+// The token table is only rebuilt when map_list changed, so a periodic
+// refresh keeps station positions and skips the stationinfo round trips.
+// Its METAR chunks carry only stations that are due (planMetarRefresh);
+// "Refresh Now" fetches them all.
+//
+// METAR chunks go to the LAN hub when there is one (Hub.h); a chunk the hub
+// fails, or stations it doesn't have yet, are fetched from AWC in the same
+// step. A map serving as hub fetches its extras after its own stations, and
+// a client asking for new ones starts an extras-only job (RF_EXTRAS alone).
+// With the forecast view on, RF_TAF fetches TAFs in smaller chunks (Taf.h);
+// with the advisory overlay on, RF_ADVISORY fetches the SIGMET/AIRMET
+// polygons (Advisory.h). Both land before publish, so the snapshot carries them.
+enum RefreshPhase : uint8_t { RF_IDLE, RF_START, RF_GEO, RF_METAR, RF_EXTRAS, RF_TAF, RF_ADVISORY, RF_PUBLISH };
+
+struct RefreshJob {
+  volatile RefreshPhase phase = RF_IDLE;
+  volatile bool requested = false;
+  volatile bool extrasRequested = false;
+  volatile bool fullRequested = false;
+  bool full = false;               // this job fetches every station, not only due ones
+  bool extrasOnly = false;
+  unsigned long extrasMs = 0;
+  unsigned long metarStartMs = 0;
+  int cursor = 0;
+  unsigned long startMs = 0;       // 0 until the first job
+  unsigned long nextStepMs = 0;
+  String parsedList;       // map_list the token table was built from
+};
+
+static RefreshJob refreshJob;
+static const unsigned long REFRESH_CHUNK_GAP_MS = 120;
+
+static bool refreshBusy() { return refreshJob.phase != RF_IDLE; }
+
+static unsigned long refreshWaitMs() {
+  long left = (long)(refreshJob.nextStepMs - millis());
+  return left > 0 ? (unsigned long)left : 0;
+}
+
+// Starts a job when one was requested or the interval is up.
+static void refreshMaybeStart() {
+  if (refreshBusy()) return;
+  if (!isProvisionedForMap()) { refreshJob.requested = false; return; }
+
+  // periodic metar refresh (replay runs the clock faster)
+  bool due = refreshJob.requested || (millis() - refreshJob.startMs > METAR_INTERVAL_MS / fetchClockScale());
+  if (!due) {
+    if (refreshJob.extrasRequested && millis() - refreshJob.extrasMs > HUB_ONDEMAND_GAP_MS) {
+      refreshJob.extrasRequested = false;
+      refreshJob.extrasOnly = true;
+      refreshJob.extrasMs = millis();
+      refreshJob.nextStepMs = millis();
+      refreshJob.cursor = 0;
+      refreshJob.phase = RF_EXTRAS;
+    }
+    return;
+  }
+
+  refreshJob.extrasOnly = false;
+  refreshJob.extrasRequested = false;
+  refreshJob.extrasMs = millis();
+  refreshJob.startMs = millis();
+  refreshJob.nextStepMs = millis();
+  refreshJob.cursor = 0;
+  refreshJob.phase = RF_START;
+  refreshJob.requested = false;
+  refreshJob.full = refreshJob.fullRequested;
+  refreshJob.fullRequested = false;
+  unsigned long t0 = refreshJob.startMs;
+  mapStatus.update([&](MapStatus& m) { m.refreshing = true; m.lastRefreshMs = t0; });
+}
+
+// ------------------ METAR chunks ------------------
+// One chunk: from the LAN hub when there is one, the rest from AWC.
+// Results merge into the token table as each chunk lands.
+static void metarFetchChunk(String idsCsv) {
+  String hub = config.read()->hubServe ? String() : hubUrl(idsCsv);
+  if (hub.length()) {
+    FetchRequest req;
+    req.provider = PROV_HUB;
+    req.url = hub;
+    req.userAgent = "METARLightworks-Map/1.0 ESP32";
+    req.connectTimeoutMs = 3000;
+    req.timeoutMs = 5000;
+    String body; int code=0;
+    int applied = -1;
+    if (fetchGET(req, body, code)) {
+      mapLock();
+      applied = applyHubRecords(body);
+      if (applied >= 0) idsCsv = missingMetarIds(idsCsv);
+      mapUnlock();
+    }
+    hubReport(applied >= 0);
+    if (applied >= 0 && !idsCsv.length()) return;
+  }
+
+  fetchMetarIds(idsCsv);
+}
+
+// Dual-core: up to fetchParallel METAR requests at once (config, 1..3).
+// The due stations are split evenly over the connections (a 250-station
+// map fits one URL, so chunking by URL length alone leaves nothing to
+// overlap). The net task drains chunks alongside short-lived helper
+// tasks; each connection keeps the usual gap between its requests.
+//
+// Each connection parses its own reply as it streams in (fetchMetarIds);
+// applying it to the table is one chunk at a time under mapLock.
+static const int METAR_PARALLEL_MAX = 3;
+static const uint32_t METAR_HELPER_STACK = 12 * 1024;
+static const size_t METAR_HELPER_MIN_HEAP = 72 * 1024;   // stack + a TLS session (internal RAM)
+static std::atomic<int> metarHelpersLive(0);
+static int metarWorkersOverride = 0;                     // bench: force a count
+
+static int metarWorkers() {
+  if (!netTask || fetchState.mode != FETCH_LIVE) return 1;   // cooperative (C3); one capture file
+  int n = metarWorkersOverride ? metarWorkersOverride : config.read()->fetchParallel;
+  return clampInt(n, 1, METAR_PARALLEL_MAX);
+}
+
+static void metarDrain() {
+  for (;;) {
+    String idsCsv;
+    mapLock();
+    bool more = buildNextMetarChunk(refreshJob.cursor, idsCsv);
+    mapUnlock();
+    if (!more) return;
+    metarFetchChunk(idsCsv);
+    delay(REFRESH_CHUNK_GAP_MS);
+  }
+}
+
+static void metarHelperMain(void*) {
+  metarDrain();
+  metarHelpersLive.fetch_sub(1);
+  xTaskNotifyGive(netTask);
+  vTaskDelete(nullptr);
+}
+
+// Runs the whole METAR phase in parallel; false: do it chunk by chunk.
+static bool metarFetchParallel() {
+  int workers = metarWorkers();
+  int due = mapStatus.read()->stationsDue;
+  if (workers < 2 || due < 2) return false;
+
+  workers = min(workers, due);
+  metarChunkIds = (due + workers - 1) / workers;
+  // Task stacks and TLS sessions are internal RAM on every chip; the
+  // helper's METAR document is too unless PSRAM takes it.
+  size_t need = METAR_HELPER_MIN_HEAP + (memHasPsram() ? 0 : metarChunkIds * METAR_DOC_BYTES_PER_ID + 1024);
+  uint32_t t0 = millis();
+  int spawned = 0;
+  for (int i = 1; i < workers; i++) {
+    if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < need * i ||
+        heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < METAR_HELPER_STACK + 8 * 1024) break;
+    metarHelpersLive.fetch_add(1);
+    if (xTaskCreatePinnedToCore(metarHelperMain, "map-fetch", METAR_HELPER_STACK, nullptr, 1, nullptr, xPortGetCoreID()) != pdPASS) {
+      metarHelpersLive.fetch_sub(1);
+      break;
+    }
+    spawned++;
+  }
+
+  metarDrain();
+  while (metarHelpersLive.load() > 0) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+
+  metarChunkIds = 0;
+  refreshJob.cursor = 0;
+  uint32_t ms = millis() - t0;
+  int used = spawned + 1;
+  mapStatus.update([&](MapStatus& m) { m.metarConnections = used; m.metarPhaseMs = ms; });
+  return true;
+}
+
+static void refreshStep() {
+  RefreshJob& j = refreshJob;
+  j.nextStepMs = millis();
+
+  switch (j.phase) {
+    case RF_IDLE:
+      return;
+
+    case RF_START: {
+      String list = config.read()->map_list;
+      mapLock();
+      bool listChanged = (list != j.parsedList);
+      if (listChanged) {
+        j.parsedList = list;
+        parseTokenList(j.parsedList);
+        publishSnapshot();   // legends/skips immediately
+        rebuildStripFromConfig();
+      }
+      if (hubStore) hubStorePrune(listChanged);
+      mapUnlock();
+      j.cursor = 0;
+      j.phase = RF_GEO;
+      return;
+    }
+
+    case RF_GEO: {
+      String idsCsv;
+      mapLock();
+      bool more = buildNextIdsChunk(j.cursor, idsCsv);
+      int due = more ? 0 : planMetarRefresh(j.full);
+      mapUnlock();
+      if (!more) mapStatus.update([&](MapStatus& m) { m.stationsDue = due; });
+      if (!more) { j.cursor = 0; j.phase = RF_METAR; return; }
+
+      fetchStationInfoGeo(idsCsv);
+      j.nextStepMs = millis() + REFRESH_CHUNK_GAP_MS;
+      return;
+    }
+
+    case RF_METAR: {
+      if (j.cursor == 0) {
+        if (metarFetchParallel()) { j.phase = hubStore ? RF_EXTRAS : RF_TAF; return; }
+        j.metarStartMs = millis();
+      }
+
+      String idsCsv;
+      mapLock();
+      bool more = buildNextMetarChunk(j.cursor, idsCsv);
+      mapUnlock();
+      if (!more) {
+        uint32_t ms = millis() - j.metarStartMs;
+        mapStatus.update([&](MapStatus& m) { m.metarConnections = 1; m.metarPhaseMs = ms; });
+        j.cursor = 0;
+        j.phase = hubStore ? RF_EXTRAS : RF_TAF;
+        return;
+      }
+
+      metarFetchChunk(idsCsv);
+      j.nextStepMs = millis() + REFRESH_CHUNK_GAP_MS;
+      return;
+    }
+
+    case RF_EXTRAS: {
+      String idsCsv;
+      mapLock();
+      bool more = hubStore && buildNextExtrasChunk(j.cursor, idsCsv);
+      mapUnlock();
+      if (!more) { j.cursor = 0; j.phase = j.extrasOnly ? RF_IDLE : RF_TAF; return; }
+
+      fetchMetarIds(idsCsv);
+      j.nextStepMs = millis() + REFRESH_CHUNK_GAP_MS;
+      return;
+    }
+
+    case RF_TAF: {
+      if (!config.read()->tafEnabled) {
+        if (tafStats.stations) {
+          mapLock();
+          clearTafState();
+          mapUnlock();
+          tafStats.stations = 0;
         }
+        j.cursor = 0;
+        j.phase = RF_ADVISORY;
+        return;
+      }
+
+      if (j.cursor == 0) tafStats.decodeUs = 0;
+      String idsCsv;
+      mapLock();
+      bool more = buildNextChunk(tafPlan, TAF_ENDPOINT, memHasPsram() ? TAF_CHUNK_IDS_PSRAM : TAF_CHUNK_IDS, j.cursor, idsCsv);
+      int stations = more ? 0 : countTafStations();
+      mapUnlock();
+      if (!more) {
+        tafStats.stations = stations;
+        tafStats.fetchedMs = millis();
+        j.cursor = 0;
+        j.phase = RF_ADVISORY;
+        return;
       }
+
+      String url = String(TAF_ENDPOINT) + "?format=json&ids=" + idsCsv;
+      String body; int code=0;
+      if (httpsGET(url, body, code) && code == 200 && body.length()) {
+        mapLock();
+        applyTafResults(body);
+        mapUnlock();
+      } else {
+        tafStats.fetchFailures++;
+      }
+      j.nextStepMs = millis() + REFRESH_CHUNK_GAP_MS;
+      return;
+    }
+
+    // SIGMET/AIRMET polygons: airsigmet, then gairmet when AIRMETs are on.
+    // A failed first fetch keeps the previous set (still expired by time).
+    case RF_ADVISORY: {
+      uint8_t kinds = advKindsForMode(config.read()->advOverlay);
+      if (!kinds || !advBegin()) {
+        if (advReady()) advClear();
+        j.phase = RF_PUBLISH;
+        return;
+      }
+
+      bool gairmet = (j.cursor == 1);
+      String body; int code = 0;
+      bool ok = httpsGET(gairmet ? ADV_GAIRMET_URL : ADV_AIRSIGMET_URL, body, code) && code == 200;
+      if (!ok && !gairmet) {
+        adv.fetchFailures++;
+        j.phase = RF_PUBLISH;
+        return;
+      }
+      if (!gairmet) advClear();
+      if (!ok || !advParse(body, gairmet ? ADV_SRC_GAIRMET : ADV_SRC_AIRSIGMET, kinds)) adv.fetchFailures++;
+      body = String();
+
+      if (!gairmet && (kinds & ADV_AIRMET)) {
+        j.cursor = 1;
+        j.nextStepMs = millis() + REFRESH_CHUNK_GAP_MS;
+        return;
+      }
+      advIndexBuild();
+      adv.fetchedMs = millis();
+      Serial.printf("[ADV] %d polygons, grid %dx%d\n", adv.polyCount, adv.cols, adv.rows);
+      j.phase = RF_PUBLISH;
+      return;
+    }
+
+    case RF_PUBLISH: {
+      mapLock();
+      publishSnapshot();
+      mapUnlock();
+      unsigned long dur = millis() - j.startMs;
+      unsigned long done = millis();
+      mapStatus.update([&](MapStatus& m) { m.refreshing = false; m.lastRefreshDurationMs = dur; m.lastRefreshDoneMs = done; });
+      j.phase = RF_IDLE;
+      return;
     }
   }
+}
 
-  strip->setBrightness((uint8_t)clampInt(cfg.brightness,1,255));
-  strip->show();
+// A shown METAR past the missing step hands its LEDs to their fallbacks,
+// and fallbacks are only resolved on publish: so publish, no fetch needed.
+static void staleMaybeRepublish() {
+  uint32_t at = staleRepublishAt;
+  uint32_t now = staleClock();
+  if (!at || !now || now < at || refreshBusy()) return;
+  mapLock();
+  publishSnapshot();
+  mapUnlock();
+}
+
+void staleApplyConfig() {
+  staleRepublishAt = 1;
+  if (netTask) xTaskNotifyGive(netTask);
+}
+
+void requestRefresh() {
+  refreshJob.requested = true;
+  if (netTask) xTaskNotifyGive(netTask);
+}
+
+// "Refresh Now": every station, including ones with a recent METAR.
+void requestFullRefresh() {
+  refreshJob.fullRequested = true;
+  requestRefresh();
 }
 
-// ------------------ Refresh ------------------
+// Blocking refresh for setup-time and bench callers.
 void refreshNow() {
   if (!isProvisionedForMap()) return;
+  StallScope stall("refreshNow");
+  requestRefresh();
 
-  parseTokenList(cfg.map_list);
-  rebuildStripFromConfig();
-  renderMap(); // legends/skips immediately
+  if (netTask) {
+    unsigned long t0 = millis();
+    while ((refreshJob.requested || refreshBusy()) && millis() - t0 < 120000UL) delay(20);
+    return;
+  }
 
-  ensureGeoForAirports();
+  refreshMaybeStart();
+  while (refreshBusy()) {
+    unsigned long wait = refreshWaitMs();
+    if (wait) { delay(wait); continue; }
+    refreshStep();
+    yield();
+  }
+  renderTick();
+}
 
-  clearMetarState();
+// ------------------ Forecast view (endpoint) ------------------
+// /taf                   -> JSON: view, stations per category at the shown hour
+// /taf?hours=N           -> show TAF categories N hours ahead (0 = current METARs)
+// /taf?animate=1         -> step through the next TAF_ANIM_HOURS hours
+// /taf?station=KSEA      -> adds that station's timeline
+// /taf?enabled=on|off    -> TAF fetch with each refresh (a forecast view turns it on)
+// The view only reads timelines already decoded; it never starts a fetch
+// unless it turns the TAF fetch on.
+void handleTaf() {
+  bool wantsView = server.hasArg("hours") || server.hasArg("animate");
+  if (wantsView) {
+    bool animate = server.arg("animate") == "1" || server.arg("animate") == "on";
+    tafSetView(server.arg("hours").toInt(), animate);
+  }
+  bool enabled = config.read()->tafEnabled;
+  bool enable = server.hasArg("enabled") ? server.arg("enabled") == "on" : enabled;
+  if (wantsView && (tafViewHours > 0 || tafAnimate)) enable = true;
+  if (enable != enabled) {
+    config.update([&](AppConfig& c) { c.tafEnabled = enable; });
+    if (!saveConfig()) { server.send(500, "text/plain", "Save failed"); return; }
+    requestRefresh();   // fetches (or drops) the timelines
+  }
+  renderWake();
 
-  int cursor=0;
-  while (cursor < tokenCount) {
-    String idsCsv;
-    if (!buildNextMetarChunk(cursor, idsCsv)) break;
+  String station = toUpperTrim(server.arg("station"));
+  uint32_t hour = tafShownHour();
+  int cats[5] = { 0 };
+  String timeline;
+  mapLock();
+  for (int i=0;i<tokenCount;i++){
+    const Token& t = tokens[i];
+    if (t.type!=TOK_AIRPORT) continue;
+    cats[hasTaf(t) && hour ? (tafCatAt(t.taf, hour) & TAF_CAT_MASK) : CAT_UNKNOWN]++;
+    if (station.length() && t.icao==station && !timeline.length()) timeline = tafTimelineJson(t.taf);
+  }
+  mapUnlock();
+
+  String out = String("{\"enabled\":") + (enable ? "true" : "false") +
+               ",\"hours\":" + tafViewHours + ",\"animate\":" + (tafAnimate ? "true" : "false") +
+               ",\"shown_hours\":" + tafShownHours() + ",\"stations\":" + tafStats.stations;
+  if (tafStats.fetchedMs) out += ",\"fetched_age_s\":" + String((millis() - tafStats.fetchedMs) / 1000);
+  out += ",\"shown\":{\"VFR\":" + String(cats[CAT_VFR]) + ",\"MVFR\":" + cats[CAT_MVFR] + ",\"IFR\":" + cats[CAT_IFR] +
+         ",\"LIFR\":" + cats[CAT_LIFR] + ",\"none\":" + cats[CAT_UNKNOWN] + "}";
+  if (station.length()) out += ",\"station\":\"" + station + "\",\"timeline\":" + (timeline.length() ? timeline : String("[]"));
+  out += "}";
+  server.send(200, "application/json", out);
+}
 
-    String url = String(AWC_METAR_ENDPOINT) + "?format=json&ids=" + idsCsv;
-    String body; int code=0;
-    if (httpsGET(url, body, code) && body.length()) applyMetarResults(body);
+// ------------------ LAN hub (endpoint) ------------------
+// GET /hub/obs?ids=A,B (all stations when ids is empty). No auth: read-only,
+// LAN clients. Unknown stations are added as extras and fetched shortly.
+void handleHubObs() {
+  if (!config.read()->hubServe || !hubStore) {
+    server.send(404, "text/plain", "Hub serving is off.");
+    return;
+  }
+  hubRequests++;
+  String ids = toUpperTrim(server.arg("ids"));
+  String out;
+  out.reserve(32 + 64 * max(1, (int)(ids.length() / 5)));
+  hubAppendHeader(out);
+
+  bool added = false;
+  uint32_t now = millis();
+  mapLock();
+  if (!ids.length()) {
+    for (int i = 0; i < hubStoreCount; i++) {
+      if (hubStore[i].have) { hubAppendRecord(out, hubStore[i].obs); hubRecordsOut++; }
+    }
+  } else {
+    int start = 0;
+    while (start < (int)ids.length()) {
+      int comma = ids.indexOf(',', start);
+      if (comma < 0) comma = ids.length();
+      String id = ids.substring(start, comma);
+      start = comma + 1;
+      if (!isValidICAO(id)) continue;
+
+      uint32_t key = hubKey(id.c_str());
+      HubEntry* e = hubStoreFind(key);
+      if (!e) {
+        bool onMap = false;
+        for (int i = 0; i < tokenCount && !onMap; i++) onMap = (tokens[i].type == TOK_AIRPORT && tokens[i].icao == id);
+        e = hubStoreAdd(key, !onMap);
+        if (!e) continue;
+        memcpy(e->obs.icao, id.c_str(), 4);
+        added = added || !onMap;
+      }
+      e->lastWantMs = now;
+      if (e->have) { hubAppendRecord(out, e->obs); hubRecordsOut++; }
+    }
+  }
+  mapUnlock();
 
-    delay(120);
-    yield();
+  if (added) {
+    refreshJob.extrasRequested = true;
+    if (netTask) xTaskNotifyGive(netTask);
   }
+  server.send(200, "text/plain", out);
+}
 
-  renderMap();
+// Applies hub settings (boot and admin save).
+void hubApplyConfig() {
+  auto cfg = config.read();
+  if (cfg->hubServe) {
+    mapLock();
+    hubStoreBegin();
+    mapUnlock();
+  }
+  // a serving map fetches for itself; it never subscribes to another hub
+  hubBegin(cfg->hubServe ? String("off") : cfg->hubUse);
+}
+
+// ------------------ MQTT ------------------
+// Per-station topics go out incrementally: a cursor walks the station table
+// a few tokens per loop pass, only while the outbound queue has room, and
+// each slot remembers what was last published for it. A changed list shows
+// up as a different key in the slot, so nothing has to hook the re-parse.
+static const int MQTT_STATIONS_PER_PASS = 4;
+static const int MQTT_QUEUE_RESERVE = 4;   // slots left for state/health/ota
+
+struct MqttSent {
+  uint32_t key = 0;
+  uint32_t obsTime = 0;
+  uint8_t cat = 0xFF;        // FltCat last published, 0xFF = none
+};
+
+static MqttSent* mqttSent = nullptr;
+static int mqttCursor = 0;
+
+// Applies live input settings (boot and admin save).
+void liveApplyConfig() {
+  auto cfg = config.read();
+  liveBegin(cfg->liveEnabled, cfg->liveUniverse, cfg->liveTimeoutMs, liveWritePixels, renderWake);
+}
+
+// Applies MQTT settings (boot and admin save).
+void mqttApplyConfig() {
+  auto cfg = config.read();
+  if (cfg->mqtt.enabled) {
+    mapLock();
+    hubStoreBegin();
+    mapUnlock();
+    if (!mqttSent && tokenCap > 0) {
+      void* mem = memAllocCold(sizeof(MqttSent) * tokenCap);
+      if (mem) {
+        mqttSent = (MqttSent*)mem;
+        for (int i = 0; i < tokenCap; i++) new (&mqttSent[i]) MqttSent();
+      }
+    }
+  }
+  mqttConfigure(cfg->mqtt, "map");
+}
+
+static void mqttHandleCommands() {
+  MqttCommand c;
+  while (mqttPollCommand(c)) {
+    String name = c.name, value = c.value;
+    value.trim();
+    Serial.printf("[MQTT] cmd %s=%s\n", c.name, c.value);
+    if (name == "brightness") {
+      int b = clampInt(value.toInt(), 1, 255);
+      config.update([&](AppConfig& cfg) { cfg.brightness = b; });
+      saveConfig();      // the render side picks the new level up on its next frame
+    } else if (name == "refresh") {
+      requestRefresh();
+    } else {
+      Serial.println("[MQTT] not supported on the map");
+    }
+  }
+}
+
+static void mqttTickMap() {
+  mqttHandleCommands();
+  if (!mqttConnected()) return;
+
+  static const char* catNames[] = { "UNKNOWN", "VFR", "MVFR", "IFR", "LIFR" };
+  static uint32_t gen = 0;
+  static String sentState, sentOta;
+  static uint32_t healthMs = 0;
+  if (mqttConnectGen() != gen) {
+    gen = mqttConnectGen();
+    sentState = sentOta = "";
+    healthMs = 0;
+    mqttCursor = 0;
+    if (mqttSent) {
+      for (int i = 0; i < tokenCap; i++) mqttSent[i] = MqttSent();
+    }
+  }
+
+  {
+    auto st = mapStatus.read();
+    String state = "{\"brightness\":" + String(config.read()->brightness) +
+                   ",\"on\":" + (schedState.read()->on ? "true" : "false") +
+                   ",\"stations\":" + st->stations + ",\"with_metar\":" + st->stationsWithMetar + ",\"cat\":{";
+    for (int c = CAT_VFR; c <= CAT_LIFR; c++) {
+      if (c != CAT_VFR) state += ",";
+      state += String("\"") + catNames[c] + "\":" + st->catCount[c];
+    }
+    state += "}}";
+    if (state != sentState && mqttPublish("state", state, true)) sentState = state;
+  }
+  {
+    auto o = otaState.read();
+    String ota = mqttOtaJson(FW_VERSION, o->latestTag, o->updateAvailable, o->statusLine);
+    if (ota != sentOta && mqttPublish("ota", ota, true)) sentOta = ota;
+  }
+  if (!healthMs || millis() - healthMs >= MQTT_HEALTH_MS) {
+    if (mqttPublish("health", mqttHealthJson("map", FW_VERSION), true)) healthMs = millis();
+  }
+
+  if (!mqttSent) return;
+  for (int n = 0; n < MQTT_STATIONS_PER_PASS && mqttSpace() > MQTT_QUEUE_RESERVE; n++) {
+    // copy what this slot needs under the lock, publish outside it
+    String icao, obsJson;
+    uint32_t key = 0, obsTime = 0;
+    uint8_t cat = CAT_UNKNOWN;
+    int i;
+    mapLock();
+    if (mqttCursor >= tokenCount) mqttCursor = 0;
+    i = mqttCursor++;
+    bool airport = i < tokenCount && tokens[i].type == TOK_AIRPORT;
+    if (airport) {
+      const Token& t = tokens[i];
+      icao = t.icao;
+      key = hubKey(t.icao.c_str());
+      cat = t.hasMetar ? catFromString(t.fltCat) : CAT_UNKNOWN;
+      HubEntry* e = hubStore ? hubStoreFind(key) : nullptr;
+      if (e && e->have && (mqttSent[i].key != key || e->obs.obsTime != mqttSent[i].obsTime)) {
+        obsTime = e->obs.obsTime;
+        obsJson = mqttObsJson(e->obs);
+      }
+    }
+    mapUnlock();
+    if (!airport) continue;
+
+    MqttSent& sent = mqttSent[i];
+    if (sent.key != key) sent = MqttSent();
+    sent.key = key;
+    String topic = "station/" + icao + "/";
+    if (cat != sent.cat && mqttPublish((topic + "category").c_str(), catNames[cat], true)) sent.cat = cat;
+    if (obsJson.length() && mqttPublish((topic + "obs").c_str(), obsJson, true)) sent.obsTime = obsTime;
+  }
+}
+
+// ------------------ Tasks (net core / render core) ------------------
+// Dual-core chips: fetch + parse run on the net task (core 0, next to the
+// Wi-Fi stack), frames on the render task (core 1, with loop()). loop()
+// keeps the web server, OTA and housekeeping. The net task owns the JSON
+// arena. Single-core chips (C3) run the same steps cooperatively from
+// loop(); see mapCooperativeTick().
+static const uint32_t NET_TASK_STACK = 12 * 1024;
+static const uint32_t RENDER_TASK_STACK = 4 * 1024;
+static const BaseType_t NET_CORE = 0;
+static const BaseType_t RENDER_CORE = 1;
+static const uint32_t RENDER_FRAME_MS = 40;
+
+static void renderWake() {
+  if (renderTask) xTaskNotifyGive(renderTask);
+}
+
+static void netTaskMain(void*) {
+  arenaSetOwner(xTaskGetCurrentTaskHandle());
+  for (;;) {
+    refreshMaybeStart();
+    if (refreshBusy() && refreshWaitMs() == 0) {
+      refreshStep();
+      arenaReset();
+    }
+    staleMaybeRepublish();
+    uint32_t waitMs = refreshBusy() ? max(refreshWaitMs(), 1UL) : 1000;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+  }
+}
+
+// The bench draws frames from the web task; the render task parks between
+// frames meanwhile so the two never share the strip or the snapshot.
+static std::atomic<bool> renderHoldReq(false);
+static std::atomic<bool> renderParked(false);
+
+static void renderTaskMain(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RENDER_FRAME_MS));
+    if (renderHoldReq.load()) { renderParked.store(true); continue; }
+    renderParked.store(false);
+    renderTick();
+  }
+}
+
+// true: wait until the render task is parked; false: let it run (and
+// redraw). No-op without a render task (cooperative loop).
+static void renderHold(bool on) {
+  if (!renderTask) return;
+  renderHoldReq.store(on);
+  if (!on) renderForce = true;
+  xTaskNotifyGive(renderTask);
+  unsigned long t0 = millis();
+  while (on && !renderParked.load() && millis() - t0 < 1000) delay(1);
+}
+
+static void mapTasksBegin() {
+  if (ESP.getChipCores() < 2) {
+    Serial.println("[TASK] single core: refresh/render run cooperatively in loop()");
+    return;
+  }
+  xTaskCreatePinnedToCore(renderTaskMain, "map-render", RENDER_TASK_STACK, nullptr, 2, &renderTask, RENDER_CORE);
+  xTaskCreatePinnedToCore(netTaskMain, "map-net", NET_TASK_STACK, nullptr, 1, &netTask, NET_CORE);
+  if (netTask) arenaSetOwner(netTask);
+  Serial.printf("[TASK] net on core %d, render on core %d\n", (int)NET_CORE, (int)RENDER_CORE);
+}
+
+// Single-core: at most one network step per loop() pass.
+static void mapCooperativeTick() {
+  refreshMaybeStart();
+  if (refreshBusy() && refreshWaitMs() == 0) refreshStep();
+  staleMaybeRepublish();
+  renderTick();
 }
 
 // ------------------ OTA (copied workflow from Lamp, Map assets) ------------------
@@ -587,28 +2221,21 @@ const char* otaAssetNameForThisChip() {
 static bool otaGetLatest(String &outTag, String &outUrl, int &outSize) {
   outTag=""; outUrl=""; outSize=0;
 
-  if (WiFi.status() != WL_CONNECTED) return false;
-
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient http;
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  http.addHeader("User-Agent", "METARLightworks-Map");
-  http.addHeader("Accept", "application/vnd.github+json");
+  if (WiFi.status() != WL_CONNECTED && !fetchReplaying()) return false;
 
   // NOTE: We DO NOT use /releases/latest because Lamp owns "latest".
   // We list releases and pick newest tag starting with "map-v".
-  String api = String("https://api.github.com/repos/") + OTA_OWNER + "/" + OTA_REPO + "/releases?per_page=20";
-  if (!http.begin(client, api)) return false;
+  FetchRequest req;
+  req.provider = PROV_GITHUB;
+  req.url = String("https://api.github.com/repos/") + OTA_OWNER + "/" + OTA_REPO + "/releases?per_page=20";
+  req.userAgent = "METARLightworks-Map";
+  req.accept = "application/vnd.github+json";
 
-  int code = http.GET();
-  if (code != 200) { http.end(); return false; }
+  String body; int code = 0;
+  if (!fetchGET(req, body, code)) return false;
 
-  String body = http.getString();
-  http.end();
-
-  DynamicJsonDocument doc(64 * 1024);
+  MetricTimer parseTimer(metrics.parseTime[PROV_GITHUB]);
+  ArenaJsonDocument doc(64 * 1024);
   if (deserializeJson(doc, body)) return false;
   if (!doc.is<JsonArray>()) return false;
 
@@ -639,46 +2266,65 @@ static bool otaGetLatest(String &outTag, String &outUrl, int &outSize) {
   return false;
 }
 
-bool otaCheckNow() {
-  otaLatestTag = "";
-  otaLatestUrl = "";
-  otaLatestSize = 0;
-  otaUpdateAvailable = false;
+static void otaSetStatus(const String& line) {
+  otaState.update([&](OtaStatus& o) { o.statusLine = line; });
+}
 
-  if (WiFi.status() != WL_CONNECTED) {
-    otaStatusLine = "No Wi-Fi";
+bool otaCheckNow() {
+  StallScope stall("otaCheckNow");
+  metrics.otaChecks.inc();
+  otaState.update([](OtaStatus& o) {
+    o.latestTag = "";
+    o.latestUrl = "";
+    o.latestSize = 0;
+    o.updateAvailable = false;
+  });
+
+  if (WiFi.status() != WL_CONNECTED && !fetchReplaying()) {
+    otaSetStatus("No Wi-Fi");
     return false;
   }
 
   String tag, url;
   int size = 0;
   if (!otaGetLatest(tag, url, size)) {
-    otaStatusLine = "Check failed";
+    otaSetStatus("Check failed");
+    elogEvent(EV_OTA_CHECK, 0, 0, "Check failed");
     return false;
   }
 
-  otaLatestTag  = tag;     // expected like "map-v0.1.0"
-  otaLatestUrl  = url;
-  otaLatestSize = size;
-
   // Current version string must match the tag format
   String cur = String(OTA_TAG_PREFIX) + String(FW_VERSION);  // "map-v" + "0.1.0" => "map-v0.1.0"
-
-  if (otaLatestTag.length() && otaLatestTag != cur) {
-    otaUpdateAvailable = true;
-    otaStatusLine = "Update available: " + otaLatestTag + " (current " + cur + ")";
-  } else {
-    otaUpdateAvailable = false;
-    otaStatusLine = "Up to date (" + cur + ")";
-  }
-
-  otaLastCheckMs = millis();
+  bool available = tag.length() && tag != cur;
+
+  otaState.update([&](OtaStatus& o) {
+    o.latestTag  = tag;     // expected like "map-v0.1.0"
+    o.latestUrl  = url;
+    o.latestSize = size;
+    o.updateAvailable = available;
+    o.statusLine = available ? "Update available: " + tag + " (current " + cur + ")"
+                             : "Up to date (" + cur + ")";
+    o.lastCheckMs = millis();
+  });
+
+  elogEvent(EV_OTA_CHECK, 1, available ? 1 : 0, tag.c_str());
   return true;
 }
 
 void otaInstallNow() {
-  if (!otaUpdateAvailable || otaLatestUrl.length()==0) { otaStatusLine="No update available"; return; }
-  if (WiFi.status()!=WL_CONNECTED) { otaStatusLine="No Wi-Fi"; return; }
+  OtaStatus ota = otaState.copy();
+  if (!ota.updateAvailable || ota.latestUrl.length()==0) { otaSetStatus("No update available"); return; }
+  if (fetchReplaying()) { otaSetStatus("Replay mode: install disabled"); return; }
+  if (WiFi.status()!=WL_CONNECTED) { otaSetStatus("No Wi-Fi"); return; }
+
+  StallScope stall("otaInstallNow");
+
+  // every return below is a failed install (success reboots)
+  metrics.otaAttempts.inc();
+  struct OtaFailCount {
+    ~OtaFailCount() { metrics.otaFailures.inc(); elogEvent(EV_OTA_FAIL, 0, 0, otaState.read()->statusLine.c_str()); }
+  } otaFail;
+  elogEvent(EV_OTA_START, 0, 0, ota.latestTag.c_str());
 
   WiFiClientSecure client;
   client.setInsecure();
@@ -686,42 +2332,309 @@ void otaInstallNow() {
   HTTPClient http;
   http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
 
-  otaStatusLine="Downloading...";
-  if (!http.begin(client, otaLatestUrl)) { otaStatusLine="HTTP begin failed"; return; }
+  otaSetStatus("Downloading...");
+  if (!http.begin(client, ota.latestUrl)) { otaSetStatus("HTTP begin failed"); return; }
 
   int code=http.GET();
-  if (code!=200) { otaStatusLine="BIN HTTP " + String(code); http.end(); return; }
+  if (code!=200) { otaSetStatus("BIN HTTP " + String(code)); http.end(); return; }
 
   int len=http.getSize();
-  if (len<=0) len=otaLatestSize;
+  if (len<=0) len=ota.latestSize;
 
   WiFiClient* stream=http.getStreamPtr();
 
-  if (!Update.begin((len>0)?(size_t)len:UPDATE_SIZE_UNKNOWN)) { otaStatusLine="Update.begin failed"; http.end(); return; }
+  if (!Update.begin((len>0)?(size_t)len:UPDATE_SIZE_UNKNOWN)) { otaSetStatus("Update.begin failed"); http.end(); return; }
 
   size_t written=Update.writeStream(*stream);
-  if (written==0) { otaStatusLine="Write failed"; Update.abort(); http.end(); return; }
+  if (written==0) { otaSetStatus("Write failed"); Update.abort(); http.end(); return; }
 
-  if (!Update.end()) { otaStatusLine="Update.end failed"; http.end(); return; }
-  if (!Update.isFinished()) { otaStatusLine="Update not finished"; http.end(); return; }
+  if (!Update.end()) { otaSetStatus("Update.end failed"); http.end(); return; }
+  if (!Update.isFinished()) { otaSetStatus("Update not finished"); http.end(); return; }
 
   http.end();
-  otaStatusLine="Update success, rebooting...";
+  otaSetStatus("Update success, rebooting...");
+  elogEvent(EV_OTA_OK, (int32_t)written, 0, ota.latestTag.c_str());
+  elogFlush();
   delay(400);
   ESP.restart();
 }
 
 void otaMaybeAutoCheck() {
-  if (!cfg.otaAutoUpdate) return;
+  auto snap = config.read();
+  if (!snap->otaAutoUpdate) return;
+  if (fetchReplaying()) return;
   if (WiFi.status()!=WL_CONNECTED) return;
 
-  unsigned long interval = (unsigned long)cfg.otaIntervalDays * 24UL * 60UL * 60UL * 1000UL;
+  unsigned long interval = (unsigned long)snap->otaIntervalDays * 24UL * 60UL * 60UL * 1000UL;
   if (interval < 12UL * 60UL * 60UL * 1000UL) interval = 12UL * 60UL * 60UL * 1000UL; // guard
 
-  if (otaLastCheckMs == 0 || (millis() - otaLastCheckMs) > interval) {
+  unsigned long lastCheckMs = otaState.read()->lastCheckMs;
+  if (lastCheckMs == 0 || (millis() - lastCheckMs) > interval) {
     bool ok = otaCheckNow();
-    if (ok && otaUpdateAvailable) otaInstallNow();
+    if (ok && otaState.read()->updateAvailable) otaInstallNow();
+  }
+}
+
+// ------------------ Bench (/admin/bench) ------------------
+// Synthetic inputs: N stations named KAAA, KAAB, ... on a 0.3° grid so the
+// 75nm fallback search has neighbours; every 5th station has no METAR so
+// renderMap() exercises the fallback path. A recorded AWC response can be
+// dropped at /bench/metar.json (LittleFS) to time real payloads as well.
+static const char* BENCH_RECORDED_PATH = "/bench/metar.json";
+
+static String benchIcao(int i) {
+  char id[5] = { 'K', (char)('A' + (i / 676) % 26), (char)('A' + (i / 26) % 26), (char)('A' + i % 26), 0 };
+  return String(id);
+}
+
+static String benchTokenList(int n) {
+  String s = "VFR,MVFR,IFR,LIFR,SKIP";
+  s.reserve(24 + n * 5);
+  for (int i = 0; i < n; i++) { s += ","; s += benchIcao(i); }
+  return s;
+}
+
+static String benchMetarJson(int n) {
+  static const char* cats[] = { "VFR", "MVFR", "IFR", "LIFR" };
+  String s;
+  if (!s.reserve(n * 200 + 2)) return s;
+  s += "[";
+  bool first = true;
+  for (int i = 0; i < n; i++) {
+    if (i % 5 == 4) continue;
+    String id = benchIcao(i);
+    char row[256];
+    snprintf(row, sizeof(row),
+             "%s{\"icaoId\":\"%s\",\"obsTime\":1760000000,\"temp\":12,\"dewp\":4,\"wdir\":270,\"wspd\":9,"
+             "\"visib\":\"10+\",\"altim\":1016.3,\"fltCat\":\"%s\",\"rawOb\":\"%s 121853Z 27009KT 10SM FEW050 12/04 A3001\"}",
+             first ? "" : ",", id.c_str(), cats[i % 4], id.c_str());
+    s += row;
+    first = false;
   }
+  s += "]";
+  return s;
+}
+
+static void benchGiveGeo() {
+  for (int i = 0; i < tokenCount; i++) {
+    if (tokens[i].type != TOK_AIRPORT) continue;
+    tokens[i].hasGeo = true;
+    tokens[i].lat = 28.0f + (float)(i / 16) * 0.3f;
+    tokens[i].lon = -82.0f + (float)(i % 16) * 0.3f;
+  }
+}
+
+static String benchReadFile(const char* path) {
+  String body;
+  if (!LittleFS.begin(true) || !LittleFS.exists(path)) return body;
+  File f = LittleFS.open(path, "r");
+  if (!f) return body;
+  body.reserve(f.size() + 1);
+  while (f.available()) body += (char)f.read();
+  f.close();
+  return body;
+}
+
+static bool benchWants(const String& only, const char* op) {
+  return (only.length() == 0) || only.equalsIgnoreCase(op);
+}
+
+String runBenchSuite(const String& only, bool live) {
+  // wait out a refresh in progress, then keep the net task off the table
+  for (;;) {
+    mapLock();
+    if (!refreshBusy()) break;
+    mapUnlock();
+    delay(50);
+  }
+  renderHold(true);
+
+  // snapshot live state so the bench never leaves synthetic stations behind
+  int savedCount = tokenCount;
+  Token* saved = new Token[max(tokenCap, 1)];
+  for (int i = 0; i < savedCount; i++) saved[i] = tokens[i];
+
+  // its own plan: the live ones stay keyed to the real list
+  ChunkPlan benchPlan{ PLAN_ALL };
+  benchPlan.ends = new uint16_t[max(tokenCap, 1)];
+
+  String res = "[";
+  static const int sizes[] = { 50, 250, 1000 };
+  static const char* const sizedOps[] = { "parseTokenList", "buildChunks", "applyMetarResults", "renderMap" };
+
+  for (int n : sizes) {
+    char input[24];
+    snprintf(input, sizeof(input), "synthetic-%d", n);
+
+    // the table holds tokenCap tokens (MAX_TOKENS without PSRAM)
+    if (n > tokenCap) {
+      for (const char* op : sizedOps) {
+        if (benchWants(only, op)) benchAppendSkip(res, op, input, "capacity");
+      }
+      continue;
+    }
+
+    // labelled with the airports that actually fit (the list leads with legends)
+    String list = benchTokenList(n);
+    parseTokenList(list);
+    int airports = 0;
+    for (int i = 0; i < tokenCount; i++) if (tokens[i].type == TOK_AIRPORT) airports++;
+    snprintf(input, sizeof(input), "synthetic-%d", airports);
+
+    if (benchWants(only, "parseTokenList")) {
+      benchRun(res, "parseTokenList", input, 5, [&]() { parseTokenList(list); });
+    }
+    benchGiveGeo();
+
+    if (benchWants(only, "buildChunks")) {
+      benchRun(res, "buildChunks", input, 5, [&]() {
+        planIdsValid = false;   // plan from scratch, as after a list change
+        benchPlan.valid = false;
+        int cursor = 0;
+        String ids;
+        while (buildNextChunk(benchPlan, AWC_METAR_ENDPOINT, 0, cursor, ids)) {}
+      });
+    }
+
+    String json = benchMetarJson(n);
+    bool arenaFits = arenaUsableHere() && jsonArena.cap >= 96 * 1024;
+    if (json.length() == 0 || (!arenaFits && heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < 96 * 1024)) {
+      if (benchWants(only, "applyMetarResults")) benchAppendSkip(res, "applyMetarResults", input, "heap");
+    } else if (benchWants(only, "applyMetarResults")) {
+      benchRun(res, "applyMetarResults", input, 3, [&]() { planMetarRefresh(true); applyMetarResults(json); });
+    } else {
+      applyMetarResults(json);
+    }
+    json = String();
+
+    if (benchWants(only, "renderMap")) {
+      benchRun(res, "renderMap", input, 5, [&]() { renderMap(); });
+    }
+  }
+
+  // recorded AWC response (optional)
+  String recorded = benchReadFile(BENCH_RECORDED_PATH);
+  if (recorded.length()) {
+    parseTokenList(config.read()->map_list);
+    if (benchWants(only, "applyMetarResults")) {
+      benchRun(res, "applyMetarResults", "recorded", 3, [&]() { planMetarRefresh(true); applyMetarResults(recorded); });
+    }
+    if (benchWants(only, "renderMap")) {
+      benchRun(res, "renderMap", "recorded", 5, [&]() { renderMap(); });
+    }
+  }
+  recorded = String();
+
+  // restore before anything that reads live config
+  for (int i = 0; i < savedCount; i++) tokens[i] = saved[i];
+  tokenCount = savedCount;
+  tokenListGen++;
+  delete[] saved;
+  delete[] benchPlan.ends;
+  renderMap();
+  mapUnlock();
+  renderHold(false);
+
+  if (benchWants(only, "handleRoot")) {
+    benchRun(res, "handleRoot", "live-config", 5, [&]() { String page = buildRootPage(); });
+  }
+
+  if (live && benchWants(only, "refreshNow")) {
+    if (isProvisionedForMap() && WiFi.status() == WL_CONNECTED) {
+      benchRun(res, "refreshNow", "live", 1, [&]() { refreshNow(); });
+    } else {
+      benchAppendSkip(res, "refreshNow", "live", "offline");
+    }
+  }
+
+  // full refresh, one connection vs fetchParallel; input carries the station count
+  if (live && benchWants(only, "metarParallel")) {
+    if (isProvisionedForMap() && WiFi.status() == WL_CONNECTED && netTask) {
+      String serial = String(mapStatus.read()->stations) + "st-x1";
+      String parallel = String(mapStatus.read()->stations) + "st-x" + String(config.read()->fetchParallel);
+      metarWorkersOverride = 1;
+      benchRun(res, "metarParallel", serial.c_str(), 1, [&]() { refreshJob.fullRequested = true; refreshNow(); });
+      metarWorkersOverride = 0;
+      benchRun(res, "metarParallel", parallel.c_str(), 1, [&]() { refreshJob.fullRequested = true; refreshNow(); });
+    } else {
+      benchAppendSkip(res, "metarParallel", "live", netTask ? "offline" : "single-core");
+    }
+  }
+
+  res += "]";
+
+  return "{" + benchHeaderJson("map", FW_VERSION) + ",\"results\":" + res + "}";
+}
+
+// ------------------ Metrics (/metrics) ------------------
+const String& metricsText() {
+  String& out = responseBuffer(8192);
+  metricsRender(out, "map", FW_VERSION);
+
+  MapStatus st = mapStatus.copy();
+  metricGaugeOut(out, "metarlw_map_stations", "Airport tokens configured", st.stations);
+  metricGaugeOut(out, "metarlw_map_stations_with_metar", "Airports with a METAR this cycle", st.stationsWithMetar);
+  metricGaugeOut(out, "metarlw_map_stations_due", "Airports fetched by the last refresh (the rest kept a recent METAR)", st.stationsDue);
+  metricGaugeOut(out, "metarlw_map_metar_connections", "METAR requests in flight at once during the last refresh", st.metarConnections);
+  metricGaugeOut(out, "metarlw_map_metar_phase_seconds", "Wall time of the last METAR fetch phase", st.metarPhaseMs / 1000.0);
+  metricGaugeOut(out, "metarlw_map_duplicate_stations", "Airports listed more than once (fetched once)", planDupes);
+  metricHeader(out, "metarlw_map_chunk_plans_total", "Request chunk plans built (list, selection or endpoint changed)", "counter");
+  metricLine(out, "metarlw_map_chunk_plans_total", "", geoPlan.builds + metarPlan.builds + tafPlan.builds);
+  metricGaugeOut(out, "metarlw_map_stations_with_geo", "Airports with lat/lon", st.stationsWithGeo);
+  metricGaugeOut(out, "metarlw_map_leds", "Derived LED count", st.ledCount);
+  metricGaugeOut(out, "metarlw_map_last_refresh_duration_seconds", "Wall time of the last refresh job", st.lastRefreshDurationMs / 1000.0);
+  metricGaugeOut(out, "metarlw_map_last_refresh_age_seconds", "Seconds since the last refresh started", (millis() - st.lastRefreshMs) / 1000.0);
+  metricGaugeOut(out, "metarlw_map_refresh_in_progress", "1 while a refresh job is running", st.refreshing ? 1 : 0);
+  ScheduleRunner sr;
+  sr.st = schedState.copy();
+  sr.evals = schedule.evals;
+  scheduleMetricsOut(out, sr);
+  timeMetricsOut(out);
+  fleetMetricsOut(out);
+  hubMetricsOut(out);
+  mdnsStatusMetricsOut(out);
+  mqttMetricsOut(out);
+  liveMetricsOut(out);
+  advMetricsOut(out);
+  tafMetricsOut(out);
+  staleMetricsOut(out);
+  termMetricsOut(out, termModeFromString(config.read()->termMode));
+  if (hubStore) {
+    metricGaugeOut(out, "metarlw_hub_serve_stations", "Stations in the hub store", hubStoreCount);
+    metricGaugeOut(out, "metarlw_hub_serve_extras", "Stations kept for clients, not on this map", hubExtraCount);
+    metricHeader(out, "metarlw_hub_serve_requests_total", "Requests to /hub/obs", "counter");
+    metricLine(out, "metarlw_hub_serve_requests_total", "", hubRequests);
+    metricHeader(out, "metarlw_hub_serve_records_total", "Records served from /hub/obs", "counter");
+    metricLine(out, "metarlw_hub_serve_records_total", "", hubRecordsOut);
+  }
+  metricGaugeOut(out, "metarlw_config_version", "Config snapshots published since boot", config.version());
+  metricHeader(out, "metarlw_state_writer_waits_total", "Snapshot updates that waited for a pinned slot", "counter");
+  metricLine(out, "metarlw_state_writer_waits_total", "", config.writerWaits + mapStatus.writerWaits + otaState.writerWaits + schedState.writerWaits);
+  metricGaugeOut(out, "metarlw_map_snapshot_generation", "Station snapshots published since boot", snapGen.load(std::memory_order_relaxed));
+  metricHeader(out, "metarlw_map_snapshot_retries_total", "Render reads that raced a publish", "counter");
+  metricLine(out, "metarlw_map_snapshot_retries_total", "", snapRetries);
+  if (netTask) {
+    metricHeader(out, "metarlw_task_stack_free_bytes", "Lowest free stack seen per task", "gauge");
+    metricLine(out, "metarlw_task_stack_free_bytes", "task=\"net\"", uxTaskGetStackHighWaterMark(netTask));
+    metricLine(out, "metarlw_task_stack_free_bytes", "task=\"render\"", uxTaskGetStackHighWaterMark(renderTask));
+  }
+  stallMetricsOut(out);
+  memoryMetricsOut(out);
+  return out;
+}
+
+// ------------------ mDNS status TXT ------------------
+// stn = airports on the map, ok = with a METAR, cat = VFR/MVFR/IFR/LIFR counts
+static void mdnsStatusTickMap() {
+  static uint32_t lastMs = 0;
+  if (!mdnsStatus.up || millis() - lastMs < 1000) return;
+  lastMs = millis();
+  auto st = mapStatus.read();
+  mdnsStatusSet("stn", String(st->stations));
+  mdnsStatusSet("ok", String(st->stationsWithMetar));
+  mdnsStatusSet("cat", String(st->catCount[CAT_VFR]) + "/" + st->catCount[CAT_MVFR] + "/" +
+                       st->catCount[CAT_IFR] + "/" + st->catCount[CAT_LIFR]);
+  mdnsStatusTick(st->lastRefreshDoneMs);
 }
 
 // ------------------ Web server ------------------
@@ -735,57 +2648,90 @@ void setup() {
   Serial.begin(115200);
   delay(250);
 
+  // reserve the JSON arena and station table while the heap is still one piece
+  arenaBegin(JSON_ARENA_BYTES, JSON_ARENA_BYTES_PSRAM);
+  tokensBegin();
+  snapshotsBegin();
+  heapHistoryBegin();
+  locksBegin();
+
   // load config
   if (!loadConfig()) {
     // still boot AP+UI
-    cfg.device_ssid = "METARMap";
-    cfg.map_list = "VFR,MVFR,IFR,LIFR,SKIP";
-    cfg.brightness = 120;
-    cfg.led_pin = 5;
-    cfg.led_order = "GRB";
-    cfg.provisioned = false;
-    cfg.app_role = "";
+    config.update([](AppConfig& c) {
+      c.device_ssid = "METARMap";
+      c.map_list = "VFR,MVFR,IFR,LIFR,SKIP";
+      c.brightness = 120;
+      c.led_pin = 5;
+      c.led_order = "GRB";
+      c.provisioned = false;
+      c.app_role = "";
+    });
   }
+  AppConfig cfg = config.copy();
+
+  elogBegin("map", FW_VERSION);
+  fetchSetMode(fetchModeFromString(cfg.fetchMode), cfg.replaySpeed);
 
   // parse tokens now so LED count is correct even before metar
-  parseTokenList(cfg.map_list);
+  refreshJob.parsedList = cfg.map_list;
+  parseTokenList(refreshJob.parsedList);
 
+  metricsAttachWiFiEvents();
+  elogAttachWiFiEvents();
   setupWiFi();
   restartMDNSFixed();
+
+  // wall clock for the schedule; SNTP syncs in the background (the schedule
+  // reads "on, full level" until it does)
+  timeSyncBegin(cfg.ntpServers);
+  setenv("TZ", cfg.timezonePref.c_str(), 1);
+  tzset();
+
+  // always-on, so usually the best fleet time source for lamps nearby
+  fleetBegin(cfg.fleetSync);
+  hubApplyConfig();
+  mqttApplyConfig();
+  liveApplyConfig();
   setupWebServer();
 
   rebuildStripFromConfig();
-  renderMap(); // show legends/skips immediately
+  publishSnapshot();
+  renderTick(); // show legends/skips immediately
 
   connected = (WiFi.status() == WL_CONNECTED);
 
-  // Boot refresh if provisioned
-  if (isProvisionedForMap()) {
-    refreshNow();
-    lastMetarFetch = millis();
-  } else {
-    lastMetarFetch = millis();
-  }
+  // Boot refresh if provisioned (runs on the net task / from loop())
+  if (isProvisionedForMap()) requestRefresh();
 
   // OTA check on boot (same workflow)
   if (cfg.otaCheckOnBoot && (WiFi.status() == WL_CONNECTED)) {
     otaCheckNow();
   }
+
+  mapTasksBegin();
 }
 
 void loop() {
-  server.handleClient();
+  uint32_t loopStart = micros();
+  stallLoopBegin();
+  stallHandleClient(server);
 
   connected = (WiFi.status() == WL_CONNECTED);
 
-  if (isProvisionedForMap()) {
-    // periodic metar refresh
-    if (millis() - lastMetarFetch > METAR_INTERVAL_MS) {
-      lastMetarFetch = millis();
-      refreshNow();
-    }
-  }
+  if (!netTask) mapCooperativeTick();
+
+  fleetTick();
+  hubTick(connected);
+  mdnsStatusTickMap();
+  mqttTickMap();
+  liveRateTick();
 
   otaMaybeAutoCheck();
+  elogFlush();
+  heapHistoryTick();
+  arenaReset();
+  metrics.loopTime.observeUs(micros() - loopStart);
+  stallLoopEnd();
   delay(2);
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// ---------- Shared state (RCU-style versioned snapshots) ----------
+// Anything more than one task looks at (config, runtime status, OTA status)
+// lives in a SharedState<T>. Readers pin the current version and see it
+// whole; writers copy it, change the copy and publish it as the next
+// version. Readers never take a lock and never see a half-applied change.
+//
+//   auto snap = config.read();             // pinned until snap goes away
+//   const AppConfig& cfg = *snap;
+//   config.update([&](AppConfig& c) { c.brightness = b; });
+//
+// update() is the only way to change the state; writers are serialized by
+// a mutex. A slot is reused only when no reader has it pinned, so keep read
+// guards short (never across a fetch or a delay) and copy() anything that
+// has to live longer.
+
+template <typename T, int SLOTS = 3>
+class SharedState {
+public:
+  class Ref {
+  public:
+    Ref(SharedState* s, int i) : st(s), idx(i) {}
+    Ref(Ref&& o) : st(o.st), idx(o.idx) { o.st = nullptr; }
+    Ref(const Ref&) = delete;
+    Ref& operator=(const Ref&) = delete;
+    ~Ref() { if (st) st->readers[idx].fetch_sub(1, std::memory_order_release); }
+
+    const T& operator*() const { return st->slot[idx]; }
+    const T* operator->() const { return &st->slot[idx]; }
+    uint32_t version() const { return st->ver[idx]; }
+
+  private:
+    SharedState* st;
+    int idx;
+  };
+
+  SharedState() {
+    for (int i = 0; i < SLOTS; i++) { readers[i].store(0); ver[i] = 0; }
+  }
+
+  Ref read() {
+    for (;;) {
+      int i = cur.load(std::memory_order_acquire);
+      readers[i].fetch_add(1, std::memory_order_acq_rel);
+      // the writer may have moved on (and be refilling slot i) in between
+      if (cur.load(std::memory_order_acquire) == i) return Ref(this, i);
+      readers[i].fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  T copy() { Ref r = read(); return *r; }
+
+  uint32_t version() const { return ver[cur.load(std::memory_order_acquire)]; }
+
+  template <typename Fn>
+  uint32_t update(Fn fn) {
+    lock();
+    int from = cur.load(std::memory_order_relaxed);
+    int to = freeSlot(from);
+    slot[to] = slot[from];
+    fn(slot[to]);
+    ver[to] = ver[from] + 1;
+    cur.store(to, std::memory_order_release);
+    updates++;
+    uint32_t v = ver[to];
+    unlock();
+    return v;
+  }
+
+  uint32_t updates = 0;
+  uint32_t writerWaits = 0;     // update() found every spare slot pinned
+
+private:
+  T slot[SLOTS];
+  uint32_t ver[SLOTS];
+  std::atomic<int> readers[SLOTS];
+  std::atomic<int> cur{ 0 };
+  SemaphoreHandle_t mtx = nullptr;
+
+  // created on first update (setup's loadConfig), before any other writer exists
+  void lock() {
+    if (!mtx) mtx = xSemaphoreCreateMutex();
+    if (mtx) xSemaphoreTake(mtx, portMAX_DELAY);
+  }
+  void unlock() { if (mtx) xSemaphoreGive(mtx); }
+
+  int freeSlot(int from) {
+    for (;;) {
+      for (int i = 0; i < SLOTS; i++) {
+        if (i != from && readers[i].load(std::memory_order_acquire) == 0) return i;
+      }
+      writerWaits++;
+      delay(1);
+    }
+  }
+};
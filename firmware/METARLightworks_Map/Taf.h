@@ -0,0 +1,355 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <time.h>
+#include "Memory.h"
+#include "Metrics.h"
+#include "Solar.h"
+#include "TimeSync.h"
+#include "FleetClock.h"
+
+// ---------- TAF forecast timeline ----------
+// TAFs from the AWC Data API are decoded once, when they arrive, into an
+// hourly timeline of forecast flight categories per station. Showing
+// "now + N hours" or animating through the forecast only reads timelines,
+// so scrubbing never costs a fetch or a parse.
+//
+//   GET https://aviationweather.gov/api/data/taf?ids=KSEA,KPDX&format=json
+//
+//   tafParseAwc(body, [&](const char* icao, const TafTimeline& tl) { ... });
+//   uint8_t c = tafCatAt(tl, epochHour + tafShownHours());   // TafCat | TAF_TEMPO
+//
+// The decoder reads the raw text (rawTAF), not AWC's decoded groups: the
+// base group, FM (from), BECMG (taken from the start of the change) and
+// TEMPO / PROB windows. Each hour is sampled at its middle for the
+// prevailing conditions; a TEMPO or PROB window touching the hour makes it
+// the worse of the two and sets TAF_TEMPO. Only visibility and ceiling
+// count, with the usual category limits (ceiling BKN/OVC/VV).
+//
+// One hour is a nibble, so a 30-hour timeline is 15 bytes plus its base
+// hour.
+
+static const char* TAF_ENDPOINT = "https://aviationweather.gov/api/data/taf";
+static const int TAF_HOURS = 30;                    // longest TAF validity
+static const int TAF_ANIM_HOURS = 24;               // animation runs now..+24 h
+static const uint32_t TAF_ANIM_STEP_MS = 1500;      // per hour, on the fleet clock
+
+enum TafCat : uint8_t { TAF_NONE = 0, TAF_VFR, TAF_MVFR, TAF_IFR, TAF_LIFR };   // FltCat order
+static const uint8_t TAF_CAT_MASK = 0x7;
+static const uint8_t TAF_TEMPO = 0x8;               // worse at times (TEMPO / PROB)
+
+struct TafTimeline {
+  uint32_t baseHour = 0;                            // epoch / 3600 of cell 0
+  uint8_t cell[TAF_HOURS / 2] = { 0 };
+};
+
+static uint8_t tafCellGet(const uint8_t* cell, int i) {
+  if (i < 0 || i >= TAF_HOURS) return TAF_NONE;
+  return (i & 1) ? (cell[i >> 1] >> 4) : (cell[i >> 1] & 0xF);
+}
+
+static void tafCellSet(uint8_t* cell, int i, uint8_t v) {
+  if (i < 0 || i >= TAF_HOURS) return;
+  uint8_t& b = cell[i >> 1];
+  b = (i & 1) ? (uint8_t)((b & 0x0F) | (v << 4)) : (uint8_t)((b & 0xF0) | (v & 0xF));
+}
+
+// forecast at an epoch hour, TAF_NONE outside the timeline
+static uint8_t tafCatAt(const TafTimeline& tl, uint32_t hour) {
+  if (!tl.baseHour || hour < tl.baseHour) return TAF_NONE;
+  return tafCellGet(tl.cell, (int)(hour - tl.baseHour));
+}
+
+// Same timeline re-based to baseHour (hours before it are dropped), for
+// copies that share one base hour, e.g. the map's snapshot (the Lamp has
+// no use for it, hence inline).
+static inline void tafRebase(const TafTimeline& in, uint32_t baseHour, uint8_t* out) {
+  memset(out, 0, TAF_HOURS / 2);
+  for (int i = 0; i < TAF_HOURS; i++) tafCellSet(out, i, tafCatAt(in, baseHour + i));
+}
+
+static const char* tafCatName(uint8_t c) {
+  switch (c & TAF_CAT_MASK) {
+    case TAF_VFR:  return "VFR";
+    case TAF_MVFR: return "MVFR";
+    case TAF_IFR:  return "IFR";
+    case TAF_LIFR: return "LIFR";
+    default:       return "";
+  }
+}
+
+// [{"t":1760731200,"cat":"VFR","tempo":false},...], one per forecast hour
+static String tafTimelineJson(const TafTimeline& tl) {
+  String out = "[";
+  bool first = true;
+  for (int i = 0; i < TAF_HOURS && tl.baseHour; i++) {
+    uint8_t c = tafCellGet(tl.cell, i);
+    if (!(c & TAF_CAT_MASK)) continue;
+    if (!first) out += ",";
+    first = false;
+    out += "{\"t\":" + String((tl.baseHour + i) * 3600UL) + ",\"cat\":\"" + tafCatName(c) +
+           "\",\"tempo\":" + ((c & TAF_TEMPO) ? "true" : "false") + "}";
+  }
+  return out + "]";
+}
+
+// ---------- decoder ----------
+static const int16_t TAF_UNSET = -1;
+static const int16_t TAF_NO_CEIL = 999;             // hundreds of ft: no BKN/OVC/VV layer
+static const int TAF_MAX_GROUPS = 24;
+
+enum TafGroupKind : uint8_t { TAFG_BASE, TAFG_FM, TAFG_BECMG, TAFG_TEMPO };
+
+struct TafGroup {
+  uint32_t from = 0, to = 0;                        // epoch; to only for TEMPO
+  int16_t vis10 = TAF_UNSET;                        // statute miles * 10 (70 = P6SM)
+  int16_t ceil = TAF_UNSET;                         // hundreds of ft
+  uint8_t kind = TAFG_BASE;
+};
+
+static uint8_t tafCategory(int16_t vis10, int16_t ceil) {
+  if (vis10 == TAF_UNSET && ceil == TAF_UNSET) return TAF_NONE;
+  bool c = ceil != TAF_UNSET, v = vis10 != TAF_UNSET;
+  if ((c && ceil < 5) || (v && vis10 < 10)) return TAF_LIFR;
+  if ((c && ceil < 10) || (v && vis10 < 30)) return TAF_IFR;
+  if ((c && ceil <= 30) || (v && vis10 <= 50)) return TAF_MVFR;
+  return TAF_VFR;
+}
+
+// day/hour/minute of a TAF group -> epoch, in the month of ref or the one
+// next to it (TAFs cross month ends); hour 24 is fine
+static uint32_t tafResolve(uint32_t ref, int dd, int hh, int mm) {
+  time_t r = (time_t)ref;
+  struct tm tmv;
+  gmtime_r(&r, &tmv);
+  int y = tmv.tm_year + 1900, mo = tmv.tm_mon + 1;
+  if (dd < tmv.tm_mday - 15) { if (++mo > 12) { mo = 1; y++; } }
+  else if (dd > tmv.tm_mday + 15) { if (--mo < 1) { mo = 12; y--; } }
+  return (uint32_t)schedDaysFromCivil(y, mo, dd) * 86400UL + hh * 3600UL + mm * 60UL;
+}
+
+static bool tafAllDigits(const char* s, int n) {
+  for (int i = 0; i < n; i++) if (!isdigit((unsigned char)s[i])) return false;
+  return s[n] == 0;
+}
+
+// "1718/1824" -> from, to
+static bool tafPeriod(const char* s, uint32_t ref, uint32_t& from, uint32_t& to) {
+  int d1, h1, d2, h2;
+  if (strlen(s) != 9 || s[4] != '/' || sscanf(s, "%2d%2d/%2d%2d", &d1, &h1, &d2, &h2) != 4) return false;
+  from = tafResolve(ref, d1, h1, 0);
+  to = tafResolve(ref, d2, h2, 0);
+  return to > from;
+}
+
+// "P6SM", "6SM", "1/2SM", "M1/4SM" -> sm*10; whole: the "1" of "1 1/2SM"
+static bool tafVisSm(const char* s, int whole, int16_t& vis10) {
+  int n = strlen(s);
+  if (n < 3 || strcmp(s + n - 2, "SM")) return false;
+  if (*s == 'P') { vis10 = 70; return true; }
+  if (*s == 'M') s++;
+  int a, b;
+  if (sscanf(s, "%d/%dSM", &a, &b) == 2 && b > 0) { vis10 = (int16_t)(whole * 10 + a * 10 / b); return true; }
+  if (sscanf(s, "%dSM", &a) == 1) { vis10 = (int16_t)(min(a, 10) * 10); return true; }
+  return false;
+}
+
+// Raw TAF text -> timeline. validFrom/validTo (epoch) come from the JSON
+// record; they also anchor the day-of-month groups.
+static bool tafDecode(const char* raw, uint32_t validFrom, uint32_t validTo, TafTimeline& out) {
+  out = TafTimeline();
+  if (!raw || !validFrom || validTo <= validFrom) return false;
+
+  TafGroup groups[TAF_MAX_GROUPS];
+  int ng = 1;
+  groups[0].from = validFrom;
+
+  char tok[24];
+  const char* p = raw;
+  bool cloudSeen = false;
+  int pendingWhole = 0;
+  bool expectPeriod = false;                        // after BECMG / TEMPO / PROBnn
+  uint8_t nextKind = TAFG_TEMPO;
+
+  while (*p) {
+    while (*p && isspace((unsigned char)*p)) p++;
+    int n = 0;
+    while (*p && !isspace((unsigned char)*p)) { if (n < (int)sizeof(tok) - 1) tok[n++] = *p; p++; }
+    tok[n] = 0;
+    if (!n) break;
+    if (!strcmp(tok, "RMK")) break;
+
+    TafGroup& g = groups[ng - 1];
+    auto addGroup = [&](uint8_t kind, uint32_t from, uint32_t to) {
+      if (ng >= TAF_MAX_GROUPS) return;
+      TafGroup& a = groups[ng++];
+      a = TafGroup();
+      a.kind = kind;
+      a.from = from;
+      a.to = to;
+      cloudSeen = false;
+    };
+    uint32_t from, to;
+    int whole = pendingWhole;
+    pendingWhole = 0;
+
+    if (expectPeriod) {
+      if (!strcmp(tok, "TEMPO")) continue;          // PROB30 TEMPO
+      expectPeriod = false;
+      if (tafPeriod(tok, validFrom, from, to)) addGroup(nextKind, from, to);
+      continue;
+    }
+
+    if (!strncmp(tok, "FM", 2) && tafAllDigits(tok + 2, 6)) {
+      int d, h, m;
+      sscanf(tok + 2, "%2d%2d%2d", &d, &h, &m);
+      addGroup(TAFG_FM, tafResolve(validFrom, d, h, m), 0);
+      continue;
+    }
+    if (!strcmp(tok, "BECMG")) { expectPeriod = true; nextKind = TAFG_BECMG; continue; }
+    if (!strcmp(tok, "TEMPO") || !strncmp(tok, "PROB", 4)) { expectPeriod = true; nextKind = TAFG_TEMPO; continue; }
+
+    if (!strcmp(tok, "CAVOK")) { g.vis10 = 70; g.ceil = TAF_NO_CEIL; cloudSeen = true; continue; }
+    if (!strcmp(tok, "SKC") || !strcmp(tok, "NSC") || !strcmp(tok, "CLR") || !strcmp(tok, "NCD")) {
+      g.ceil = TAF_NO_CEIL; cloudSeen = true; continue;
+    }
+    if (n >= 5 && (!strncmp(tok, "FEW", 3) || !strncmp(tok, "SCT", 3) || !strncmp(tok, "BKN", 3) ||
+                   !strncmp(tok, "OVC", 3) || !strncmp(tok, "VV", 2))) {
+      int off = tok[0] == 'V' ? 2 : 3;
+      if (!isdigit((unsigned char)tok[off])) continue;
+      if (!cloudSeen) { g.ceil = TAF_NO_CEIL; cloudSeen = true; }
+      if (tok[0] == 'B' || tok[0] == 'O' || tok[0] == 'V') {
+        int base = atoi(tok + off);
+        if (base < g.ceil) g.ceil = (int16_t)base;
+      }
+      continue;
+    }
+
+    int16_t vis;
+    if (tafVisSm(tok, whole, vis)) { g.vis10 = vis; continue; }
+    if (n == 1 && isdigit((unsigned char)tok[0])) { pendingWhole = tok[0] - '0'; continue; }
+    if (tafAllDigits(tok, 4)) {           // metres (ICAO format); 9999 = 10 km+
+      int m = atoi(tok);
+      g.vis10 = (int16_t)(m >= 9999 ? 70 : m * 10 / 1609);
+      continue;
+    }
+  }
+
+  // hour by hour: prevailing at the middle of the hour, TEMPO windows that touch it
+  uint32_t firstHour = validFrom / 3600;
+  out.baseHour = firstHour;
+  int hours = min((int)((validTo + 3599) / 3600 - firstHour), TAF_HOURS);
+  for (int h = 0; h < hours; h++) {
+    uint32_t start = (firstHour + h) * 3600UL, mid = start + 1800, end = start + 3600;
+    int16_t vis = TAF_UNSET, ceil = TAF_UNSET;
+    for (int i = 0; i < ng; i++) {
+      const TafGroup& g = groups[i];
+      if (g.kind == TAFG_TEMPO || g.from > mid) continue;
+      if (g.vis10 != TAF_UNSET) vis = g.vis10;
+      if (g.ceil != TAF_UNSET) ceil = g.ceil;
+    }
+    uint8_t cat = tafCategory(vis, ceil);
+    for (int i = 0; i < ng; i++) {
+      const TafGroup& g = groups[i];
+      if (g.kind != TAFG_TEMPO || g.from >= end || g.to <= start) continue;
+      uint8_t t = tafCategory(g.vis10 != TAF_UNSET ? g.vis10 : vis, g.ceil != TAF_UNSET ? g.ceil : ceil);
+      if (t > (cat & TAF_CAT_MASK)) cat = t | TAF_TEMPO;
+    }
+    tafCellSet(out.cell, h, cat);
+  }
+  return hours > 0;
+}
+
+// ---------- AWC response ----------
+struct TafStats {
+  uint32_t fetchedMs = 0;        // millis() of the last complete fetch (0 = never)
+  int stations = 0;              // timelines from the last fetch
+  uint32_t decodeUs = 0;         // decode time of the last fetch
+  uint32_t decoded = 0;          // totals
+  uint32_t rejected = 0;
+  uint32_t fetchFailures = 0;
+};
+
+static TafStats tafStats;
+
+// One AWC taf?format=json body; fn(icao, timeline) per decoded TAF. Adds
+// to tafStats.decodeUs; callers zero it when a fetch starts. False if the
+// body didn't parse.
+template <typename Fn>
+static bool tafParseAwc(const String& body, Fn fn) {
+  StaticJsonDocument<128> filter;
+  JsonObject f = filter.createNestedObject();
+  f["icaoId"] = true;
+  f["rawTAF"] = true;
+  f["validTimeFrom"] = true;
+  f["validTimeTo"] = true;
+
+  // the filter keeps a fraction of the body (AWC's decoded fcsts go)
+  ArenaJsonDocument doc(min((size_t)body.length() + 1024, (size_t)48 * 1024));
+  DeserializationError err = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+  if (err || !doc.is<JsonArray>()) {
+    Serial.printf("[TAF] parse failed: %s\n", err.c_str());
+    return false;
+  }
+
+  uint32_t t0 = micros();
+  for (JsonObject o : doc.as<JsonArray>()) {
+    TafTimeline tl;
+    if (!tafDecode(o["rawTAF"] | "", o["validTimeFrom"] | 0u, o["validTimeTo"] | 0u, tl)) {
+      tafStats.rejected++;
+      continue;
+    }
+    tafStats.decoded++;
+    fn(o["icaoId"] | "", tl);
+  }
+  tafStats.decodeUs += micros() - t0;
+  return true;
+}
+
+// ---------- view ----------
+// 0 = current conditions (METAR), 1..TAF_HOURS = forecast that many hours
+// ahead. Animation steps 0..TAF_ANIM_HOURS on the fleet clock, so every
+// device on the LAN shows the same hour. Runtime only, not saved.
+static volatile int tafViewHours = 0;
+static volatile bool tafAnimate = false;
+
+static int tafShownHours() {
+  if (tafAnimate) return (int)((fleetNowMs() / TAF_ANIM_STEP_MS) % (TAF_ANIM_HOURS + 1));
+  return tafViewHours;
+}
+
+static void tafSetView(int hours, bool animate) {
+  tafViewHours = constrain(hours, 0, TAF_HOURS);
+  tafAnimate = animate;
+}
+
+// epoch hour the view points at (0 without a clock)
+static uint32_t tafShownHour() {
+  uint32_t now = timeEpochOrZero();
+  return now ? now / 3600 + tafShownHours() : 0;
+}
+
+static String tafStatusLine() {
+  String line = "TAF: ";
+  if (!tafStats.fetchedMs) return line + "<b>not fetched yet</b>";
+  line += "<b>" + String(tafStats.stations) + " station" + (tafStats.stations == 1 ? "" : "s") + "</b>, fetched " +
+          String((millis() - tafStats.fetchedMs) / 60000) + " min ago, decode " + String(tafStats.decodeUs) + " us";
+  line += " &nbsp;|&nbsp; showing ";
+  if (tafAnimate) line += "animation (now +" + String(tafShownHours()) + " h)";
+  else if (tafViewHours) line += "now +" + String(tafViewHours) + " h";
+  else line += "current METAR";
+  return line;
+}
+
+static void tafMetricsOut(String& out) {
+  metricGaugeOut(out, "metarlw_taf_stations", "Stations with a decoded TAF timeline", tafStats.stations);
+  metricGaugeOut(out, "metarlw_taf_view_hours", "Forecast hours ahead being shown (0 = METAR)", tafShownHours());
+  metricGaugeOut(out, "metarlw_taf_decode_seconds", "Decode time of the last TAF fetch", tafStats.decodeUs / 1e6);
+  metricHeader(out, "metarlw_taf_decoded_total", "TAFs decoded into timelines", "counter");
+  metricLine(out, "metarlw_taf_decoded_total", "", tafStats.decoded);
+  metricHeader(out, "metarlw_taf_rejected_total", "TAF records that didn't decode", "counter");
+  metricLine(out, "metarlw_taf_rejected_total", "", tafStats.rejected);
+  metricHeader(out, "metarlw_taf_fetch_failures_total", "TAF fetches that failed", "counter");
+  metricLine(out, "metarlw_taf_fetch_failures_total", "", tafStats.fetchFailures);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "Metrics.h"
+
+// ---------- Day/night terminator ----------
+// Per-station sun elevation without per-station trig. A station is a unit
+// vector on the globe (precomputed once per snapshot, int16 Q14) and so is
+// the sun's direction (recomputed once a minute). sin(elevation) is their
+// dot product: three multiplies per LED.
+//
+//   termStationVec(lat, lon, v);              // publish side, per station
+//   termSunUpdate(epoch);                     // render side, once a minute
+//   termEffect(v, mode, nightPct, scale, tint);
+//
+// Dimming ramps from full at sunset to nightPct at nautical dusk (-12
+// degrees). The dusk tint peaks at the horizon and fades out 6 degrees
+// either side. Both compose before the strip brightness and the schedule
+// level, so they stack with solar dimming.
+
+static const int16_t TERM_ONE = 16384;                // Q14
+static const int16_t TERM_SIN_M12 = -3406;            // sin(-12 deg)
+static const int16_t TERM_SIN_6 = 1713;               // sin(6 deg)
+
+enum TermMode : uint8_t { TERM_OFF = 0, TERM_DIM = 1, TERM_TINT = 2, TERM_BOTH = 3 };
+
+struct TermState {
+  int16_t sun[3] = { 0, 0, 0 };   // Q14 unit vector toward the sun
+  uint32_t minute = 0;            // epoch minute of sun[] (0 = not yet)
+  uint32_t sunUs = 0;             // last sun update
+  int darkLeds = 0;               // below -12 deg at the last update frame
+  int duskLeds = 0;               // within 6 deg of the horizon
+  uint32_t updates = 0;
+};
+
+static TermState term;
+
+static uint8_t termModeFromString(const String& s) {
+  if (s == "dim") return TERM_DIM;
+  if (s == "tint") return TERM_TINT;
+  if (s == "both") return TERM_BOTH;
+  return TERM_OFF;
+}
+
+// lat/lon (deg) -> Q14 unit vector, x toward 0/0, z toward the north pole
+static void termStationVec(float lat, float lon, int16_t v[3]) {
+  const float D2R = (float)M_PI / 180.0f;
+  float cl = cosf(lat * D2R);
+  v[0] = (int16_t)lroundf(cl * cosf(lon * D2R) * TERM_ONE);
+  v[1] = (int16_t)lroundf(cl * sinf(lon * D2R) * TERM_ONE);
+  v[2] = (int16_t)lroundf(sinf(lat * D2R) * TERM_ONE);
+}
+
+// Sun direction for an epoch (low-precision almanac, ~0.01 deg, plenty for
+// LEDs). Doubles: days since J2000 times 361 deg/day loses a float.
+// Returns true when the minute moved.
+static bool termSunUpdate(uint32_t epoch) {
+  uint32_t minute = epoch / 60;
+  if (!epoch || minute == term.minute) return false;
+  uint32_t t0 = micros();
+  const double D2R = M_PI / 180.0;
+  double d = epoch / 86400.0 - 10957.5;                       // days since 2000-01-01 12:00 UT
+  double g = fmod(357.529 + 0.98560028 * d, 360.0) * D2R;
+  double q = fmod(280.459 + 0.98564736 * d, 360.0);
+  double L = (q + 1.915 * sin(g) + 0.020 * sin(2 * g)) * D2R;
+  double e = (23.439 - 0.00000036 * d) * D2R;
+  double ra = atan2(cos(e) * sin(L), cos(L));
+  double dec = asin(sin(e) * sin(L));
+  double gmst = fmod(280.46061837 + 360.98564736629 * d, 360.0) * D2R;
+  double subLon = ra - gmst;                                    // where the sun is overhead
+  term.sun[0] = (int16_t)lround(cos(dec) * cos(subLon) * TERM_ONE);
+  term.sun[1] = (int16_t)lround(cos(dec) * sin(subLon) * TERM_ONE);
+  term.sun[2] = (int16_t)lround(sin(dec) * TERM_ONE);
+  term.minute = minute;
+  term.sunUs = micros() - t0;
+  term.updates++;
+  return true;
+}
+
+// sin(elevation) in Q14 for a station vector; v all zero = no position
+static int32_t termSinEl(const int16_t v[3]) {
+  return ((int32_t)v[0] * term.sun[0] + (int32_t)v[1] * term.sun[1] + (int32_t)v[2] * term.sun[2]) >> 14;
+}
+
+static bool termHasPos(const int16_t v[3]) { return v[0] | v[1] | v[2]; }
+
+// scale (0..256) and dusk tint weight (0..256) for one station
+static void termEffect(const int16_t v[3], uint8_t mode, uint8_t nightPct, uint16_t& scale, uint16_t& tint) {
+  scale = 256;
+  tint = 0;
+  if (!mode || !term.minute || !termHasPos(v)) return;
+  int32_t s = termSinEl(v);
+  if ((mode & TERM_DIM) && s < 0) {
+    uint32_t night = nightPct * 256 / 100;
+    if (s <= TERM_SIN_M12) scale = night;
+    else scale = (uint16_t)(256 - (256 - night) * (uint32_t)(-s) / (uint32_t)(-TERM_SIN_M12));
+  }
+  if ((mode & TERM_TINT) && s > -TERM_SIN_6 && s < TERM_SIN_6) {
+    tint = (uint16_t)(256 * (uint32_t)(TERM_SIN_6 - abs(s)) / TERM_SIN_6);
+  }
+}
+
+// dusk amber the tint blends toward, at most 40 %
+static void termApplyTint(uint16_t tint, uint8_t& r, uint8_t& g, uint8_t& b) {
+  if (!tint) return;
+  uint16_t w = tint * 102 >> 8;
+  r += (uint8_t)(((int)255 - r) * w >> 8);
+  g = (uint8_t)(g + (((int)96 - g) * (int)w >> 8));
+  b = (uint8_t)(b - (b * w >> 8));
+}
+
+static String termStatusLine(uint8_t mode) {
+  if (!mode) return "Day/night: <b>off</b>";
+  if (!term.minute) return "Day/night: <b>waiting for the clock</b>";
+  return "Day/night: <b>" + String(term.darkLeds) + " stations dark, " + String(term.duskLeds) +
+         " at dusk/dawn</b> &nbsp;|&nbsp; sun update " + String(term.sunUs) + " us, once a minute";
+}
+
+static void termMetricsOut(String& out, uint8_t mode) {
+  if (!mode) return;
+  metricGaugeOut(out, "metarlw_term_dark_stations", "Stations past nautical dusk", term.darkLeds);
+  metricGaugeOut(out, "metarlw_term_dusk_stations", "Stations within 6 degrees of the horizon", term.duskLeds);
+  metricGaugeOut(out, "metarlw_term_sun_update_seconds", "Time of the last sun position update", term.sunUs / 1e6);
+  metricHeader(out, "metarlw_term_sun_updates_total", "Sun position updates (one a minute)", "counter");
+  metricLine(out, "metarlw_term_sun_updates_total", "", term.updates);
+}
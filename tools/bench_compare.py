@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Run /admin/bench on a device (or read saved runs) and compare against a baseline.
+
+Usage:
+  bench_compare.py run  <host> [--out run.json] [--live] [--user admin --password north]
+  bench_compare.py diff <baseline.json> <run.json> [--threshold 10]
+
+`diff` exits 1 when any op/input got slower (us_avg) or allocated more than
+the threshold percent, so it can gate a release.
+"""
+
+import argparse
+import base64
+import json
+import sys
+import urllib.request
+
+
+def fetch_run(host, user, password, live, only):
+    url = "http://%s/admin/bench" % host
+    params = []
+    if live:
+        params.append("live=1")
+    if only:
+        params.append("only=" + only)
+    if params:
+        url += "?" + "&".join(params)
+    req = urllib.request.Request(url)
+    token = base64.b64encode(("%s:%s" % (user, password)).encode()).decode()
+    req.add_header("Authorization", "Basic " + token)
+    with urllib.request.urlopen(req, timeout=120) as resp:
+        return json.loads(resp.read().decode("utf-8"))
+
+
+def index_results(run):
+    out = {}
+    for r in run.get("results", []):
+        if "skipped" in r:
+            continue
+        out[(r["op"], r["input"])] = r
+    return out
+
+
+def pct(new, old):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) * 100.0 / abs(old)
+
+
+def cmd_run(args):
+    run = fetch_run(args.host, args.user, args.password, args.live, args.only)
+    text = json.dumps(run, indent=2)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text + "\n")
+    print(text)
+    return 0
+
+
+def cmd_diff(args):
+    with open(args.baseline) as f:
+        base = json.load(f)
+    with open(args.run) as f:
+        run = json.load(f)
+
+    if base.get("chip") != run.get("chip"):
+        print("warning: comparing %s baseline against %s run" % (base.get("chip"), run.get("chip")))
+
+    b, r = index_results(base), index_results(run)
+    regressions = 0
+    print("%-24s %-16s %12s %12s %8s %8s %8s" % ("op", "input", "us_base", "us_now", "d_us%", "allocs", "peak"))
+    for key in sorted(set(b) | set(r)):
+        if key not in r:
+            print("%-24s %-16s %s" % (key[0], key[1], "missing in run"))
+            continue
+        if key not in b:
+            print("%-24s %-16s %s" % (key[0], key[1], "new"))
+            continue
+        ob, nr = b[key], r[key]
+        d_us = pct(nr["us_avg"], ob["us_avg"])
+        flag = ""
+        if d_us > args.threshold:
+            flag += " SLOWER"
+        if nr["allocs"] > ob["allocs"] or pct(nr["heap_peak"], ob["heap_peak"]) > args.threshold:
+            flag += " HEAP"
+        if flag:
+            regressions += 1
+        print("%-24s %-16s %12d %12d %7.1f%% %8d %8d%s" % (
+            key[0], key[1], ob["us_avg"], nr["us_avg"], d_us, nr["allocs"], nr["heap_peak"], flag))
+
+    print("%d regression(s) above %.1f%%" % (regressions, args.threshold))
+    return 1 if regressions else 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("run")
+    p.add_argument("host")
+    p.add_argument("--out")
+    p.add_argument("--live", action="store_true")
+    p.add_argument("--only", default="")
+    p.add_argument("--user", default="admin")
+    p.add_argument("--password", default="north")
+
+    p = sub.add_parser("diff")
+    p.add_argument("baseline")
+    p.add_argument("run")
+    p.add_argument("--threshold", type=float, default=10.0)
+
+    args = ap.parse_args()
+    return cmd_run(args) if args.cmd == "run" else cmd_diff(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
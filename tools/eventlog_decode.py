@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Decode the firmware's binary event log (/log/events.bin, EventLog.h).
+
+Usage:
+  eventlog_decode.py events.1.bin events.bin [--json]
+  eventlog_decode.py --host <ip> [--save DIR] [--coredump core.elf] [--user admin --password north]
+
+--host downloads both log files from /admin/log/file (oldest first) and,
+with --coredump, the stored core dump from /admin/coredump. Inspect the
+core dump with the matching ELF:
+  esp-coredump info_corefile -t elf -c core.elf <firmware>.elf
+"""
+
+import argparse
+import base64
+import datetime
+import json
+import os
+import struct
+import sys
+import urllib.error
+import urllib.request
+
+MAGIC = b"MLEV"
+RECORD = struct.Struct("<BBHIIii")   # type, text_len, boot, uptime_ms, epoch, a, b
+
+EVENT_NAMES = {
+    1: "boot",
+    2: "crash-reset",
+    3: "coredump",
+    4: "wifi-up",
+    5: "wifi-down",
+    6: "fetch-fail",
+    7: "fetch-recover",
+    8: "ota-check",
+    9: "ota-start",
+    10: "ota-fail",
+    11: "ota-ok",
+    12: "dropped",
+    13: "stall",
+}
+
+RESET_REASONS = {
+    0: "unknown", 1: "power-on", 2: "external", 3: "software", 4: "panic",
+    5: "interrupt watchdog", 6: "task watchdog", 7: "watchdog", 8: "deep sleep",
+    9: "brownout", 10: "sdio",
+}
+
+PROVIDERS = ("awc", "avwx", "adsb", "github", "hub")
+
+
+def describe(ev):
+    t, a, b, text = ev["type"], ev["a"], ev["b"], ev["text"]
+    if t == "boot":
+        return "boot #%d, reset: %s, %s" % (b, RESET_REASONS.get(a, a), text)
+    if t == "crash-reset":
+        return "previous run ended in %s" % RESET_REASONS.get(a, a)
+    if t == "coredump":
+        return "core dump stored (%d bytes)" % a
+    if t == "wifi-up":
+        return "STA got IP, rssi %d dBm" % a
+    if t == "wifi-down":
+        return "STA disconnected, reason %d" % a
+    if t == "fetch-fail":
+        prov = PROVIDERS[a] if 0 <= a < len(PROVIDERS) else a
+        return "%s fetch failing (code %d)" % (prov, b)
+    if t == "fetch-recover":
+        prov = PROVIDERS[a] if 0 <= a < len(PROVIDERS) else a
+        return "%s fetch recovered after %d failure(s)" % (prov, b)
+    if t == "ota-check":
+        return ("check ok, latest %s%s" % (text, " (update available)" if b else "")) if a else "check failed: %s" % text
+    if t == "ota-start":
+        return "installing %s" % text
+    if t == "ota-fail":
+        return "install failed: %s" % text
+    if t == "ota-ok":
+        return "installed %s (%d bytes), rebooting" % (text, a)
+    if t == "dropped":
+        return "%d event(s) lost (queue full)" % a
+    if t == "stall":
+        return "loop blocked %d ms in %s" % (a, text)
+    return "a=%d b=%d %s" % (a, b, text)
+
+
+def decode(data, source=""):
+    if len(data) < 8 or data[:4] != MAGIC:
+        raise ValueError("%s: not an event log (bad magic)" % source)
+    version, hdr_len = data[4], data[5]
+    if version != 1:
+        raise ValueError("%s: unsupported version %d" % (source, version))
+    pos = hdr_len
+    events = []
+    while pos + RECORD.size <= len(data):
+        typ, text_len, boot, uptime_ms, epoch, a, b = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        if pos + text_len > len(data):
+            break   # truncated tail (power loss mid-write)
+        text = data[pos:pos + text_len].decode("utf-8", "replace")
+        pos += text_len
+        events.append({
+            "boot": boot,
+            "uptime_ms": uptime_ms,
+            "epoch": epoch,
+            "type": EVENT_NAMES.get(typ, "type%d" % typ),
+            "a": a,
+            "b": b,
+            "text": text,
+        })
+    return events
+
+
+def when(ev):
+    if ev["epoch"]:
+        return datetime.datetime.fromtimestamp(ev["epoch"], datetime.timezone.utc).strftime("%Y-%m-%d %H:%M:%SZ")
+    return "+%.1fs" % (ev["uptime_ms"] / 1000.0)
+
+
+def http_get(host, path, user, password):
+    req = urllib.request.Request("http://%s%s" % (host, path))
+    token = base64.b64encode(("%s:%s" % (user, password)).encode()).decode()
+    req.add_header("Authorization", "Basic " + token)
+    try:
+        with urllib.request.urlopen(req, timeout=30) as resp:
+            return resp.read()
+    except urllib.error.HTTPError as e:
+        if e.code == 404:
+            return None
+        raise
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("files", nargs="*", help="log files, oldest first")
+    ap.add_argument("--host")
+    ap.add_argument("--save", help="directory to keep downloaded files in")
+    ap.add_argument("--coredump", help="with --host: write the core dump here")
+    ap.add_argument("--user", default="admin")
+    ap.add_argument("--password", default="north")
+    ap.add_argument("--json", action="store_true")
+    args = ap.parse_args()
+
+    blobs = []
+    if args.host:
+        for n, name in ((1, "events.1.bin"), (0, "events.bin")):
+            data = http_get(args.host, "/admin/log/file?n=%d" % n, args.user, args.password)
+            if data:
+                blobs.append((name, data))
+                if args.save:
+                    os.makedirs(args.save, exist_ok=True)
+                    with open(os.path.join(args.save, name), "wb") as f:
+                        f.write(data)
+        if args.coredump:
+            core = http_get(args.host, "/admin/coredump", args.user, args.password)
+            if core:
+                with open(args.coredump, "wb") as f:
+                    f.write(core)
+                print("core dump: %d bytes -> %s" % (len(core), args.coredump), file=sys.stderr)
+            else:
+                print("no core dump stored", file=sys.stderr)
+    for path in args.files:
+        with open(path, "rb") as f:
+            blobs.append((path, f.read()))
+
+    if not blobs:
+        ap.error("no input (give files or --host)")
+
+    events = []
+    for name, data in blobs:
+        events.extend(decode(data, name))
+
+    if args.json:
+        print(json.dumps(events, indent=2))
+        return 0
+
+    for ev in events:
+        print("#%-5d %-22s %-14s %s" % (ev["boot"], when(ev), ev["type"], describe(ev)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+"""Fleet check: find every lamp and map on the LAN and scrape them at once.
+
+  fleet.py                          browse mDNS (_http._tcp, needs zeroconf)
+  fleet.py --hosts 10.0.0.21,10.0.0.22
+  fleet.py --hosts-file units.txt
+  fleet.py --subnet 192.168.1.0/24  probe every address (no zeroconf needed)
+  fleet.py --watch 30               repeat every 30 s
+  fleet.py --json                   one JSON object per unit
+
+Units are listed from their mDNS TXT status first (MdnsStatus.h: fw, chip,
+app, stn, cat, boot/fetch epochs), then /metrics is fetched from all of them
+concurrently (no auth needed), so a site with 100 units takes a few seconds.
+Rows that need a look are flagged:
+
+  DOWN     /metrics did not answer
+  STALE    last good fetch older than --stale-min
+  HEAP     lowest free heap under --heap-min-kb
+  RSSI     signal under --rssi-min dBm
+  CLOCK    time not synced
+  STALLS   stalls since boot (Stall.h)
+"""
+
+import argparse
+import ipaddress
+import json
+import re
+import socket
+import sys
+import time
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+LINE = re.compile(r'^([a-zA-Z_:][a-zA-Z0-9_:]*)(\{([^}]*)\})?\s+(\S+)')
+LABEL = re.compile(r'(\w+)="([^"]*)"')
+
+
+def parse_metrics(text):
+    """Prometheus text -> {name: [(labels, value), ...]}"""
+    out = {}
+    for line in text.splitlines():
+        if not line or line.startswith("#"):
+            continue
+        m = LINE.match(line)
+        if not m:
+            continue
+        labels = dict(LABEL.findall(m.group(3) or ""))
+        try:
+            value = float(m.group(4))
+        except ValueError:
+            continue
+        out.setdefault(m.group(1), []).append((labels, value))
+    return out
+
+
+def one(metrics, name, default=None):
+    v = metrics.get(name)
+    return v[0][1] if v else default
+
+
+def browse(seconds):
+    try:
+        from zeroconf import ServiceBrowser, Zeroconf
+    except ImportError:
+        print("zeroconf not installed: use --hosts or --subnet (pip install zeroconf)", file=sys.stderr)
+        return {}
+
+    found = {}
+
+    class Listener:
+        def add_service(self, zc, type_, name):
+            info = zc.get_service_info(type_, name, timeout=2000)
+            if not info:
+                return
+            txt = {k.decode(): (v.decode() if v else "") for k, v in info.properties.items()}
+            if txt.get("app") not in ("lamp", "map"):
+                return
+            addrs = info.parsed_addresses()
+            if addrs:
+                found[addrs[0]] = {"name": (info.server or name).rstrip("."), "port": info.port, "txt": txt}
+
+        def update_service(self, zc, type_, name):
+            self.add_service(zc, type_, name)
+
+        def remove_service(self, zc, type_, name):
+            pass
+
+    zc = Zeroconf()
+    try:
+        ServiceBrowser(zc, "_http._tcp.local.", Listener())
+        time.sleep(seconds)
+    finally:
+        zc.close()
+    return found
+
+
+def scrape(host, port, timeout):
+    url = "http://%s:%d/metrics" % (host, port)
+    t0 = time.monotonic()
+    try:
+        with urllib.request.urlopen(url, timeout=timeout) as r:
+            text = r.read().decode("utf-8", "replace")
+    except (OSError, ValueError):
+        return None, None
+    return parse_metrics(text), (time.monotonic() - t0) * 1000
+
+
+def summarize(host, unit, metrics, ms, args):
+    txt = unit.get("txt", {})
+    row = {"host": host, "name": unit.get("name", ""), "txt": txt, "up": metrics is not None}
+    flags = []
+    now = time.time()
+
+    if metrics is None:
+        flags.append("DOWN")
+        row.update(app=txt.get("app", "?"), fw=txt.get("fw", "?"), station=txt.get("stn", ""), cat=txt.get("cat", ""))
+    else:
+        info = (metrics.get("metarlw_build_info") or [({}, 0)])[0][0]
+        row.update(app=info.get("app", txt.get("app", "?")), fw=info.get("fw", "?"), chip=info.get("chip", ""))
+        row["scrape_ms"] = round(ms)
+        row["uptime_s"] = one(metrics, "metarlw_uptime_seconds")
+        row["heap_min"] = one(metrics, "metarlw_heap_min_free_bytes")
+        row["rssi"] = one(metrics, "metarlw_wifi_rssi_dbm")
+        row["time_quality"] = one(metrics, "metarlw_time_quality")
+        row["stalls"] = one(metrics, "metarlw_stalls_total", 0)
+        row["hub"] = one(metrics, "metarlw_hub_connected")
+        if row["app"] == "lamp":
+            active = [l for l, v in metrics.get("metarlw_lamp_flight_category", []) if v == 1]
+            row["station"] = active[0].get("station", "") if active else txt.get("stn", "")
+            row["cat"] = active[0].get("category", "") if active else "-"
+        else:
+            row["station"] = "%d/%d" % (one(metrics, "metarlw_map_stations_with_metar", 0), one(metrics, "metarlw_map_stations", 0))
+            row["cat"] = txt.get("cat", "")
+
+        if row["heap_min"] is not None and row["heap_min"] < args.heap_min_kb * 1024:
+            flags.append("HEAP")
+        if row["rssi"] is not None and row["rssi"] < args.rssi_min:
+            flags.append("RSSI")
+        if row["time_quality"] != 1:
+            flags.append("CLOCK")
+        if row["stalls"]:
+            flags.append("STALLS")
+
+    # fetch age: TXT epoch when the clock is valid, else the lamp gauge
+    age = None
+    if txt.get("fetch"):
+        age = now - int(txt["fetch"])
+    elif metrics is not None and one(metrics, "metarlw_lamp_last_fetch_age_seconds") is not None:
+        age = one(metrics, "metarlw_lamp_last_fetch_age_seconds")
+    elif metrics is not None and one(metrics, "metarlw_map_last_refresh_age_seconds") is not None:
+        age = one(metrics, "metarlw_map_last_refresh_age_seconds")
+    row["fetch_age_s"] = age
+    if age is not None and age > args.stale_min * 60:
+        flags.append("STALE")
+
+    row["flags"] = flags
+    return row
+
+
+def fmt_age(s):
+    if s is None:
+        return "-"
+    s = int(s)
+    if s < 3600:
+        return "%dm" % (s // 60)
+    if s < 86400:
+        return "%dh" % (s // 3600)
+    return "%dd" % (s // 86400)
+
+
+def print_table(rows):
+    cols = ("host", "app", "fw", "station", "cat", "fetch", "uptime", "heap_min", "rssi", "flags")
+    lines = []
+    for r in rows:
+        lines.append((
+            r["host"], r.get("app", ""), r.get("fw", ""), r.get("station", ""), r.get("cat", ""),
+            fmt_age(r.get("fetch_age_s")), fmt_age(r.get("uptime_s")),
+            "%dk" % (r["heap_min"] // 1024) if r.get("heap_min") is not None else "-",
+            "%d" % r["rssi"] if r.get("rssi") is not None else "-",
+            " ".join(r["flags"]),
+        ))
+    widths = [max([len(c)] + [len(str(l[i])) for l in lines]) for i, c in enumerate(cols)]
+    print("  ".join(c.ljust(w) for c, w in zip(cols, widths)))
+    for l in lines:
+        print("  ".join(str(v).ljust(w) for v, w in zip(l, widths)))
+    bad = sum(1 for r in rows if r["flags"])
+    print("%d units, %d flagged" % (len(rows), bad))
+
+
+def targets(args):
+    units = {}
+    hosts = []
+    if args.hosts:
+        hosts += [h.strip() for h in args.hosts.split(",") if h.strip()]
+    if args.hosts_file:
+        with open(args.hosts_file) as f:
+            hosts += [l.split("#")[0].strip() for l in f if l.split("#")[0].strip()]
+    if args.subnet:
+        hosts += [str(ip) for ip in ipaddress.ip_network(args.subnet, strict=False).hosts()]
+    for h in hosts:
+        host, _, port = h.partition(":")
+        units[host] = {"port": int(port) if port else 80}
+    if not hosts:
+        units = browse(args.browse)
+    return units
+
+
+def run_once(args):
+    units = targets(args)
+    timeout = args.timeout if not args.subnet else min(args.timeout, 1.5)
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futs = {h: pool.submit(scrape, h, u.get("port", 80), timeout) for h, u in units.items()}
+        results = {h: f.result() for h, f in futs.items()}
+
+    rows = []
+    for h, u in units.items():
+        metrics, ms = results[h]
+        if args.subnet and metrics is None:
+            continue                       # probing: silence is just an empty address
+        if args.subnet and one(metrics, "metarlw_uptime_seconds") is None:
+            continue                       # answered, but not one of ours
+        rows.append(summarize(h, u, metrics, ms, args))
+
+    def key(r):
+        try:
+            return (0, socket.inet_aton(r["host"]))
+        except OSError:
+            return (1, r["host"].encode())
+    rows.sort(key=key)
+
+    if args.json:
+        for r in rows:
+            print(json.dumps(r, sort_keys=True))
+    else:
+        print_table(rows)
+    return 1 if any(r["flags"] for r in rows) else 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--hosts", help="comma list of host[:port]")
+    ap.add_argument("--hosts-file", help="one host[:port] per line")
+    ap.add_argument("--subnet", help="probe every address, e.g. 192.168.1.0/24")
+    ap.add_argument("--browse", type=float, default=3.0, help="mDNS browse seconds")
+    ap.add_argument("--jobs", type=int, default=64, help="concurrent scrapes")
+    ap.add_argument("--timeout", type=float, default=4.0)
+    ap.add_argument("--stale-min", type=float, default=45, help="flag fetches older than this")
+    ap.add_argument("--heap-min-kb", type=int, default=20)
+    ap.add_argument("--rssi-min", type=int, default=-80)
+    ap.add_argument("--watch", type=float, default=0, help="repeat every N seconds")
+    ap.add_argument("--json", action="store_true")
+    args = ap.parse_args()
+
+    if not args.watch:
+        return run_once(args)
+    try:
+        while True:
+            if not args.json:
+                print("\033[2J\033[H" + time.strftime("%H:%M:%S"))
+            run_once(args)
+            time.sleep(args.watch)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
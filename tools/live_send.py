@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Test pattern sender for the map's live LED input (Live.h).
+
+  live_send.py 192.168.1.40 --leds 120                 DDP rainbow at 40 fps
+  live_send.py 192.168.1.40 --leds 400 --e131 --universe 1
+  live_send.py 192.168.1.40 --leds 120 --fps 30 --seconds 20 --drop 0.05
+
+--drop skips that fraction of packets on purpose (sequence numbers still
+advance), so the loss figure on /admin/live and /metrics can be checked.
+After --seconds the stream stops; the map goes back to the weather one
+timeout later (E1.31 sends stream-terminated right away).
+"""
+
+import argparse
+import colorsys
+import random
+import socket
+import struct
+import sys
+import time
+import uuid
+
+DDP_PORT = 4048
+E131_PORT = 5568
+E131_PIXELS = 170
+DDP_MAX_PIXELS = 480            # 1440 data bytes per DDP packet
+
+
+def rainbow(leds, t):
+    out = bytearray()
+    for i in range(leds):
+        r, g, b = colorsys.hsv_to_rgb((i / max(leds, 1) + t * 0.25) % 1.0, 1.0, 1.0)
+        out += bytes((int(r * 255), int(g * 255), int(b * 255)))
+    return out
+
+
+def ddp_packets(frame, seq):
+    """seq: last DDP sequence number (1..15, per packet) -> (packets, seq)"""
+    n = len(frame) // 3
+    chunks = range(0, n, DDP_MAX_PIXELS)
+    out = []
+    for k, first in enumerate(chunks):
+        seq = seq % 15 + 1
+        data = frame[first * 3:(first + DDP_MAX_PIXELS) * 3]
+        flags = 0x40 | (0x01 if k == len(chunks) - 1 else 0)
+        out.append(struct.pack(">BBBBIH", flags, seq, 0x0B, 1, first * 3, len(data)) + data)
+    return out, seq
+
+
+def e131_packet(cid, universe, seq, data, terminate=False):
+    data = bytes(data)
+    slots = len(data) + 1
+    dmp = struct.pack(">HBBHHH", 0x7000 | (10 + slots), 0x02, 0xA1, 0, 1, slots) + b"\x00" + data
+    name = b"live_send.py".ljust(64, b"\x00")
+    framing_len = 77 + len(dmp)
+    framing = struct.pack(">HI", 0x7000 | framing_len, 0x00000002) + name + \
+        struct.pack(">BHBBH", 100, 0, seq, 0x40 if terminate else 0, universe) + dmp
+    root_len = 22 + len(framing)
+    root = struct.pack(">HH", 0x0010, 0) + b"ASC-E1.17\x00\x00\x00" + \
+        struct.pack(">HI", 0x7000 | root_len, 0x00000004) + cid
+    return root + framing
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("host")
+    ap.add_argument("--leds", type=int, required=True)
+    ap.add_argument("--fps", type=float, default=40)
+    ap.add_argument("--seconds", type=float, default=10)
+    ap.add_argument("--e131", action="store_true", help="E1.31 instead of DDP")
+    ap.add_argument("--universe", type=int, default=1, help="E1.31 start universe")
+    ap.add_argument("--drop", type=float, default=0.0, help="fraction of packets to skip")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    cid = uuid.uuid4().bytes
+    universes = (args.leds + E131_PIXELS - 1) // E131_PIXELS
+    useq = [0] * universes
+    dseq = 0
+    sent = dropped = frames = 0
+    t0 = time.monotonic()
+    period = 1.0 / args.fps
+
+    while time.monotonic() - t0 < args.seconds:
+        t = time.monotonic() - t0
+        frame = rainbow(args.leds, t)
+        if args.e131:
+            packets = []
+            for k in range(universes):
+                useq[k] = (useq[k] + 1) % 256
+                chunk = frame[k * E131_PIXELS * 3:(k + 1) * E131_PIXELS * 3]
+                packets.append((e131_packet(cid, args.universe + k, useq[k], chunk), E131_PORT))
+        else:
+            ddp, dseq = ddp_packets(frame, dseq)
+            packets = [(p, DDP_PORT) for p in ddp]
+        for p, port in packets:
+            if args.drop and random.random() < args.drop:
+                dropped += 1
+                continue
+            sock.sendto(p, (args.host, port))
+            sent += 1
+        frames += 1
+        time.sleep(max(0.0, t0 + frames * period - time.monotonic()))
+
+    if args.e131:
+        for k in range(universes):
+            sock.sendto(e131_packet(cid, args.universe + k, (useq[k] + 1) % 256, b"", terminate=True), (args.host, E131_PORT))
+    secs = time.monotonic() - t0
+    print("%d frames, %d packets sent, %d dropped on purpose, %.1f fps" % (frames, sent, dropped, frames / secs))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
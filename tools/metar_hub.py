@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""LAN METAR hub stand-in (Hub.h): one fetcher for every lamp and map nearby.
+
+Serves the same compact records a map with hub serving on does:
+
+  metar_hub.py [--port 8080] [--ids KSEA,KPDX] [--interval 600]
+
+  GET /hub/obs?ids=KSEA,KPDX     -> "#metarhub 1" + one record per station
+
+Stations are fetched from aviationweather.gov in one batch per refresh: the
+--ids seed list plus every station a client has asked for in the last hour.
+A station nobody has asked for before is fetched as soon as a client asks,
+so the client's next poll finds it.
+
+With the python-zeroconf package installed the hub is advertised as
+_metarhub._tcp (TXT v=1) and devices on "auto" find it by themselves;
+without it, point them at host:port in their admin Hub page.
+"""
+
+import argparse
+import json
+import socket
+import sys
+import threading
+import time
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+HUB_VERSION = 1
+AWC_METAR = "https://aviationweather.gov/api/data/metar?format=json&ids="
+USER_AGENT = "METARLightworks-Hub/1.0"
+MAX_URL_LEN = 1700            # same chunking limit as the map
+EXTRA_TTL_S = 3600
+ON_DEMAND_GAP_S = 60
+
+
+def num(v, scale=1.0):
+    """AWC value -> int field, '' when missing. '10+' -> 10, 'VRB' kept."""
+    if v is None or v == "":
+        return ""
+    if isinstance(v, str):
+        if v == "VRB":
+            return "VRB"
+        v = v.rstrip("+")
+        try:
+            v = float(v)
+        except ValueError:
+            return ""
+    return str(int(round(float(v) * scale)))
+
+
+def record(o):
+    cat = o.get("fltCat") or ""
+    lat, lon = o.get("lat"), o.get("lon")
+    fields = [
+        o.get("icaoId", ""),
+        str(o["obsTime"]) if o.get("obsTime") else "",
+        cat if cat in ("VFR", "MVFR", "IFR", "LIFR") else "",
+        num(o.get("temp")),
+        num(o.get("dewp")),
+        num(o.get("wdir")),
+        num(o.get("wspd")),
+        num(o.get("wgst")),
+        num(o.get("visib"), 10),
+        num(o.get("altim"), 2.953),     # hPa -> inHg * 100
+        "%.3f" % lat if lat is not None else "",
+        "%.3f" % lon if lon is not None else "",
+    ]
+    return ",".join(fields)
+
+
+def valid_icao(s):
+    return len(s) == 4 and s.isalnum()
+
+
+class Hub:
+    def __init__(self, seed, interval, verbose):
+        self.seed = set(seed)
+        self.interval = interval
+        self.verbose = verbose
+        self.records = {}            # icao -> record line
+        self.wanted = {}             # icao -> last time a client asked
+        self.lock = threading.Lock()
+        self.wake = threading.Event()
+        self.last_on_demand = 0.0
+
+    def want(self, ids):
+        now = time.time()
+        new = False
+        with self.lock:
+            for i in ids:
+                if i not in self.wanted and i not in self.seed and i not in self.records:
+                    new = True
+                self.wanted[i] = now
+            lines = [self.records[i] for i in ids if i in self.records]
+        if new and now - self.last_on_demand > ON_DEMAND_GAP_S:
+            self.last_on_demand = now
+            self.wake.set()
+        return lines
+
+    def all_records(self):
+        with self.lock:
+            return list(self.records.values())
+
+    def stations(self):
+        now = time.time()
+        with self.lock:
+            for i, t in list(self.wanted.items()):
+                if now - t > EXTRA_TTL_S:
+                    del self.wanted[i]
+                    if i not in self.seed:
+                        self.records.pop(i, None)
+            return sorted(self.seed | set(self.wanted))
+
+    def fetch(self):
+        ids = self.stations()
+        chunks, cur = [], []
+        for i in ids:
+            if cur and len(AWC_METAR) + len(",".join(cur + [i])) >= MAX_URL_LEN:
+                chunks.append(cur)
+                cur = []
+            cur.append(i)
+        if cur:
+            chunks.append(cur)
+
+        got = 0
+        for chunk in chunks:
+            req = urllib.request.Request(AWC_METAR + ",".join(chunk), headers={"User-Agent": USER_AGENT})
+            try:
+                with urllib.request.urlopen(req, timeout=15) as r:
+                    data = json.loads(r.read().decode("utf-8") or "[]")
+            except Exception as e:
+                print("[hub] fetch failed: %s" % e, file=sys.stderr)
+                continue
+            with self.lock:
+                for o in data:
+                    i = (o.get("icaoId") or "").upper()
+                    if valid_icao(i):
+                        self.records[i] = record(o)
+                        got += 1
+        if self.verbose:
+            print("[hub] %d stations, %d records" % (len(ids), got), file=sys.stderr)
+
+    def run(self):
+        while True:
+            self.fetch()
+            self.wake.wait(self.interval)
+            self.wake.clear()
+
+
+def make_handler(hub, verbose):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            parts = urlsplit(self.path)
+            if parts.path != "/hub/obs":
+                self.send_error(404)
+                return
+            ids = parse_qs(parts.query).get("ids", [""])[0].upper()
+            ids = [i.strip() for i in ids.split(",") if valid_icao(i.strip())]
+            lines = hub.want(ids) if ids else hub.all_records()
+            body = ("#metarhub %d\n" % HUB_VERSION + "".join(l + "\n" for l in lines)).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, fmt, *args):
+            if verbose:
+                sys.stderr.write("[hub] " + (fmt % args) + "\n")
+
+    return Handler
+
+
+def advertise(port):
+    try:
+        from zeroconf import ServiceInfo, Zeroconf
+    except ImportError:
+        print("zeroconf not installed: not advertised, configure clients with host:port")
+        return None
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(("10.255.255.255", 1))
+        ip = s.getsockname()[0]
+    finally:
+        s.close()
+    name = "metar-hub-%s" % socket.gethostname()
+    info = ServiceInfo("_metarhub._tcp.local.", "%s._metarhub._tcp.local." % name,
+                       addresses=[socket.inet_aton(ip)], port=port,
+                       properties={"v": str(HUB_VERSION)}, server="%s.local." % name)
+    zc = Zeroconf()
+    zc.register_service(info)
+    print("advertised _metarhub._tcp on %s:%d" % (ip, port))
+    return zc
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--bind", default="0.0.0.0")
+    ap.add_argument("--ids", default="", help="stations to always keep (comma list)")
+    ap.add_argument("--interval", type=int, default=600, help="refresh seconds")
+    ap.add_argument("--no-advertise", action="store_true")
+    ap.add_argument("-v", "--verbose", action="store_true")
+    args = ap.parse_args()
+
+    seed = [i.strip().upper() for i in args.ids.split(",") if valid_icao(i.strip().upper())]
+    hub = Hub(seed, args.interval, args.verbose)
+    threading.Thread(target=hub.run, daemon=True).start()
+
+    zc = None if args.no_advertise else advertise(args.port)
+    srv = ThreadingHTTPServer((args.bind, args.port), make_handler(hub, args.verbose))
+    print("METAR hub on http://%s:%d/hub/obs" % (args.bind, args.port))
+    try:
+        srv.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if zc:
+            zc.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
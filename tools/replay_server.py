@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Local HTTP stand-in that replays firmware capture files (/cap/<provider>.cap).
+
+Download captures from a device at /admin/replay/file?p=awc|avwx|adsb|github|hub,
+drop them in a directory, then:
+
+  replay_server.py <capture_dir> [--port 8080] [--speed 60]
+  replay_server.py <capture_dir> --list
+
+Requests are routed to a provider by path, the same way the firmware sorts
+them, and served with the same record-selection rule as Fetch.h: newest
+record at or before the accelerated clock, exact path+query match preferred,
+looping past the end of the capture.
+
+  /api/data/...   -> awc      (aviationweather.gov)
+  /api/metar/...  -> avwx
+  /v2/...         -> adsb     (api.adsb.lol)
+  /repos/...      -> github
+  /hub/...        -> hub      (LAN METAR hub, Hub.h)
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit
+
+PROVIDERS = ("awc", "avwx", "adsb", "github", "hub")
+
+
+class Record:
+    __slots__ = ("t_ms", "epoch", "code", "url", "path", "body")
+
+    def __init__(self, t_ms, epoch, code, url, body):
+        self.t_ms = t_ms
+        self.epoch = epoch
+        self.code = code
+        self.url = url
+        parts = urlsplit(url)
+        self.path = parts.path + (("?" + parts.query) if parts.query else "")
+        self.body = body
+
+
+def read_capture(path):
+    """Parse '#CAP <t_ms> <epoch> <code> <len> <url>\\n<body>\\n' records."""
+    records = []
+    with open(path, "rb") as f:
+        data = f.read()
+    pos = 0
+    while pos < len(data):
+        nl = data.find(b"\n", pos)
+        if nl < 0:
+            break
+        header = data[pos:nl].decode("utf-8", "replace")
+        if not header.startswith("#CAP "):
+            raise ValueError("%s: bad record header at byte %d" % (path, pos))
+        fields = header.split(" ", 5)
+        t_ms, epoch, code, length = int(fields[1]), int(fields[2]), int(fields[3]), int(fields[4])
+        url = fields[5] if len(fields) > 5 else ""
+        body = data[nl + 1:nl + 1 + length]
+        records.append(Record(t_ms, epoch, code, url, body))
+        pos = nl + 1 + length + 1
+    return records
+
+
+def provider_for_path(path):
+    if path.startswith("/api/data/"):
+        return "awc"
+    if path.startswith("/api/metar/") or path.startswith("/api/station/"):
+        return "avwx"
+    if path.startswith("/v2/"):
+        return "adsb"
+    if path.startswith("/repos/"):
+        return "github"
+    if path.startswith("/hub/"):
+        return "hub"
+    return None
+
+
+class Replayer:
+    def __init__(self, captures, speed):
+        self.captures = captures
+        self.speed = speed
+        self.start = time.monotonic()
+        self.lock = threading.Lock()
+
+    def clock_ms(self):
+        return int((time.monotonic() - self.start) * 1000 * self.speed)
+
+    def pick(self, provider, path):
+        recs = self.captures.get(provider) or []
+        if not recs:
+            return None
+        last_t = max(r.t_ms for r in recs)
+        now = self.clock_ms() % (last_t + 1)
+        exact = any_rec = None
+        for r in recs:
+            if r.t_ms > now:
+                continue
+            if r.path == path:
+                exact = r
+            any_rec = r
+        return exact or any_rec or recs[0]
+
+
+def make_handler(replayer, verbose):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            provider = provider_for_path(self.path)
+            rec = replayer.pick(provider, self.path) if provider else None
+            if rec is None:
+                body = b"no capture for this path\n"
+                self.send_response(404)
+                self.send_header("Content-Type", "text/plain")
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+                return
+            self.send_response(rec.code)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(rec.body)))
+            self.send_header("X-Replay-Provider", provider)
+            self.send_header("X-Replay-T-Ms", str(rec.t_ms))
+            self.end_headers()
+            self.wfile.write(rec.body)
+
+        def log_message(self, fmt, *args):
+            if verbose:
+                sys.stderr.write("[replay] " + (fmt % args) + "\n")
+
+    return Handler
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("capture_dir")
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--bind", default="127.0.0.1")
+    ap.add_argument("--speed", type=float, default=60.0)
+    ap.add_argument("--list", action="store_true", help="print records and exit")
+    ap.add_argument("-v", "--verbose", action="store_true")
+    args = ap.parse_args()
+
+    captures = {}
+    for p in PROVIDERS:
+        path = os.path.join(args.capture_dir, p + ".cap")
+        if os.path.exists(path):
+            captures[p] = read_capture(path)
+
+    if not captures:
+        print("no *.cap files in %s" % args.capture_dir, file=sys.stderr)
+        return 1
+
+    if args.list:
+        for p, recs in captures.items():
+            for r in recs:
+                print("%-7s t=%8dms epoch=%d code=%d len=%d %s" % (p, r.t_ms, r.epoch, r.code, len(r.body), r.url))
+        return 0
+
+    replayer = Replayer(captures, args.speed)
+    srv = ThreadingHTTPServer((args.bind, args.port), make_handler(replayer, args.verbose))
+    print("replaying %s at %.0fx on http://%s:%d/" % (
+        ", ".join("%s(%d)" % (p, len(r)) for p, r in captures.items()), args.speed, args.bind, args.port))
+    try:
+        srv.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())